@@ -0,0 +1,284 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Checks that the block renderer of the OPL3 emulator produces
+//     exactly the same output as generating one sample at a time, both
+//     with and without skipping silent slots, and compares the speed of
+//     the three.  Speed is given as CPU time per second of audio at
+//     the native OPL3 rate.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "opl3.h"
+
+#define BLOCK_LEN 128
+
+// Native sample rate of the OPL3.
+
+#define OPL_RATE 49716
+
+static unsigned int rand_state = 1;
+
+static unsigned int Random(void)
+{
+    rand_state = rand_state * 1103515245 + 12345;
+    return (rand_state >> 16) & 0x7fff;
+}
+
+static const int slot_regs[] =
+{
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15,
+};
+
+static void WriteBoth(opl_chip *a, opl_chip *b, unsigned int reg,
+                      unsigned int val)
+{
+    chip_write(a, reg, val);
+
+    if (b != NULL)
+    {
+        chip_write(b, reg, val);
+    }
+}
+
+// Program a random instrument on a channel and key it on or off.
+
+static void RandomChannel(opl_chip *a, opl_chip *b, int bank, int channel)
+{
+    int op;
+    int i;
+
+    for (i = 0; i < 2; ++i)
+    {
+        op = slot_regs[(channel / 3) * 6 + (channel % 3) + i * 3];
+
+        WriteBoth(a, b, bank | (0x20 + op), Random() & 0xff);
+        WriteBoth(a, b, bank | (0x40 + op), Random() & 0xff);
+        WriteBoth(a, b, bank | (0x60 + op), Random() & 0xff);
+        WriteBoth(a, b, bank | (0x80 + op), Random() & 0xff);
+        WriteBoth(a, b, bank | (0xe0 + op), Random() & 0x07);
+    }
+
+    WriteBoth(a, b, bank | (0xc0 + channel), Random() & 0xff);
+    WriteBoth(a, b, bank | (0xa0 + channel), Random() & 0xff);
+    WriteBoth(a, b, bank | (0xb0 + channel), Random() & 0x3f);
+}
+
+// Make a random change to the chip, as music playback would.
+
+static void RandomWrite(opl_chip *a, opl_chip *b)
+{
+    int bank = (Random() & 1) ? 0x100 : 0;
+    int channel = Random() % 9;
+
+    switch (Random() % 16)
+    {
+        case 0:
+            // Rhythm mode, vibrato and tremolo depth.
+            WriteBoth(a, b, 0xbd, Random() & 0xff);
+            break;
+
+        case 1:
+            // 4-operator mode and OPL3 mode.
+            WriteBoth(a, b, 0x104, Random() & 0x3f);
+            WriteBoth(a, b, 0x105, Random() & 0x01);
+            break;
+
+        case 2:
+        case 3:
+        case 4:
+            RandomChannel(a, b, bank, channel);
+            break;
+
+        default:
+            // Key on or off, with a new frequency.
+            WriteBoth(a, b, bank | (0xa0 + channel), Random() & 0xff);
+            WriteBoth(a, b, bank | (0xb0 + channel), Random() & 0x3f);
+            break;
+    }
+}
+
+// Compare the two generators, with random register writes between
+// blocks of random length.
+
+static int CheckExact(int nblocks, int skip_silent)
+{
+    opl_chip *a, *b;
+    Bit16s buf_a[BLOCK_LEN * 2], buf_b[BLOCK_LEN * 2];
+    int block, len, i;
+
+    a = malloc(sizeof(opl_chip));
+    b = malloc(sizeof(opl_chip));
+    chip_reset(a, OPL_RATE);
+    chip_reset(b, OPL_RATE);
+    b->skip_silent = skip_silent;
+    rand_state = 1;
+
+    WriteBoth(a, b, 0x01, 0x20);
+
+    for (block = 0; block < nblocks; ++block)
+    {
+        for (i = Random() % 4; i > 0; --i)
+        {
+            RandomWrite(a, b);
+        }
+
+        len = 1 + Random() % BLOCK_LEN;
+
+        for (i = 0; i < len; ++i)
+        {
+            chip_generate(a, buf_a + i * 2);
+        }
+
+        chip_generate_block(b, buf_b, len);
+
+        if (memcmp(buf_a, buf_b, len * 2 * sizeof(Bit16s)) != 0)
+        {
+            for (i = 0; i < len * 2; ++i)
+            {
+                if (buf_a[i] != buf_b[i])
+                {
+                    break;
+                }
+            }
+
+            printf("opl3bench: MISMATCH (skip_silent=%i) in block %i, "
+                   "sample %i: %i != %i\n", skip_silent, block, i / 2,
+                   buf_a[i], buf_b[i]);
+            return 0;
+        }
+    }
+
+    chip_remove(a);
+    chip_remove(b);
+    free(a);
+    free(b);
+
+    printf("opl3bench: %i blocks identical (skip_silent=%i)\n",
+           nblocks, skip_silent);
+
+    return 1;
+}
+
+// Generators compared by the benchmark.
+
+typedef enum
+{
+    GEN_PER_SAMPLE,
+    GEN_BLOCK,
+    GEN_BLOCK_SKIP,
+} generator_t;
+
+// Time generating the specified number of seconds of output, with
+// a new note every 50ms, and return the CPU time in milliseconds per
+// second of audio.
+
+static double Benchmark(generator_t gen, int seconds, int voices)
+{
+    opl_chip *chip;
+    Bit16s buf[BLOCK_LEN * 2];
+    clock_t start;
+    int block, nblocks;
+    int i;
+
+    chip = malloc(sizeof(opl_chip));
+    chip_reset(chip, OPL_RATE);
+    chip->skip_silent = gen == GEN_BLOCK_SKIP;
+    rand_state = 1;
+
+    chip_write(chip, 0x01, 0x20);
+
+    for (i = 0; i < voices; ++i)
+    {
+        RandomChannel(chip, NULL, (i / 9) * 0x100, i % 9);
+        chip_write(chip, (i / 9) * 0x100 + 0xb0 + i % 9, 0x20 | (Random() & 0x1f));
+    }
+
+    nblocks = (seconds * OPL_RATE) / BLOCK_LEN;
+    start = clock();
+
+    for (block = 0; block < nblocks; ++block)
+    {
+        if ((block % ((OPL_RATE / 20) / BLOCK_LEN)) == 0)
+        {
+            i = Random() % voices;
+            chip_write(chip, (i / 9) * 0x100 + 0xa0 + i % 9, Random() & 0xff);
+            chip_write(chip, (i / 9) * 0x100 + 0xb0 + i % 9,
+                       0x20 | (Random() & 0x1f));
+        }
+
+        if (gen != GEN_PER_SAMPLE)
+        {
+            chip_generate_block(chip, buf, BLOCK_LEN);
+        }
+        else
+        {
+            for (i = 0; i < BLOCK_LEN; ++i)
+            {
+                chip_generate(chip, buf + i * 2);
+            }
+        }
+    }
+
+    chip_remove(chip);
+    free(chip);
+
+    return (1000.0 * (clock() - start) / CLOCKS_PER_SEC)
+         / ((double) nblocks * BLOCK_LEN / OPL_RATE);
+}
+
+int main(int argc, char *argv[])
+{
+    double ms_sample, ms_block, ms_skip;
+    int seconds = 60;
+    int voices = 9;
+
+    if (argc > 1)
+    {
+        seconds = atoi(argv[1]);
+    }
+
+    if (argc > 2)
+    {
+        voices = atoi(argv[2]);
+    }
+
+    if (voices < 1 || voices > 18)
+    {
+        printf("Usage: %s [seconds] [voices (1-18)]\n", argv[0]);
+        exit(-1);
+    }
+
+    if (!CheckExact(200000, 0) || !CheckExact(200000, 1))
+    {
+        exit(1);
+    }
+
+    ms_sample = Benchmark(GEN_PER_SAMPLE, seconds, voices);
+    ms_block = Benchmark(GEN_BLOCK, seconds, voices);
+    ms_skip = Benchmark(GEN_BLOCK_SKIP, seconds, voices);
+
+    printf("opl3bench: voices=%i cpu_ms_per_audio_sec: per_sample=%.2f "
+           "block=%.2f block_skip=%.2f\n",
+           voices, ms_sample, ms_block, ms_skip);
+
+    return 0;
+}
+
@@ -0,0 +1,179 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Stress test for OPL callback scheduling with software emulation.
+//     Callbacks that write registers and reschedule themselves run on
+//     the audio thread, while the main thread hammers the library as
+//     the music code does: locking, clearing and restarting callbacks,
+//     and writing registers with and without the lock held.
+//
+//     Fails if a callback runs while the main thread holds the lock,
+//     or if a callback runs after the callbacks have been cleared.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SDL.h"
+
+#include "opl.h"
+
+#define NUM_CALLBACKS 16
+
+typedef struct
+{
+    int index;
+    unsigned int generation;
+} stress_callback_t;
+
+// Callbacks are restarted with a new generation each time they are
+// cleared.  Data for the current and previous generations is kept.
+
+static stress_callback_t callback_data[2][NUM_CALLBACKS];
+static volatile unsigned int generation;
+
+// Set by the main thread while it holds the lock.
+
+static volatile int locked;
+
+static volatile unsigned int callbacks_run;
+static volatile unsigned int violations;
+static volatile unsigned int stale;
+
+static void StressCallback(void *data)
+{
+    stress_callback_t *cb = data;
+    unsigned int n;
+
+    if (locked)
+    {
+        ++violations;
+    }
+
+    if (cb->generation != generation)
+    {
+        ++stale;
+    }
+
+    n = ++callbacks_run;
+
+    OPL_WriteRegister(OPL_REGS_FREQ_1 + cb->index % 9, n & 0xff);
+    OPL_WriteRegister(OPL_REGS_FREQ_2 + cb->index % 9, 0x20 | (n & 0x1f));
+
+    // Reschedule after a short, varying delay.
+
+    OPL_SetCallback((cb->index + 1) * 250 + (n % 7) * 100,
+                    StressCallback, cb);
+}
+
+static void StartCallbacks(void)
+{
+    stress_callback_t *cb;
+    int i;
+
+    for (i = 0; i < NUM_CALLBACKS; ++i)
+    {
+        cb = &callback_data[generation % 2][i];
+        cb->index = i;
+        cb->generation = generation;
+        OPL_SetCallback(i * 100, StressCallback, cb);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    opl_stats_t stats;
+    unsigned int iterations;
+    unsigned int end_time;
+    int seconds = 10;
+    int i;
+
+    if (argc > 1)
+    {
+        seconds = atoi(argv[1]);
+    }
+
+    // Only the software emulation driver is being tested.
+
+    putenv("OPL_DRIVER=SDL");
+
+    if (SDL_Init(SDL_INIT_TIMER) < 0)
+    {
+        fprintf(stderr, "Unable to initialise SDL timer\n");
+        exit(-1);
+    }
+
+    if (!OPL_Init(0x388))
+    {
+        fprintf(stderr, "Unable to initialise OPL layer\n");
+        exit(-1);
+    }
+
+    StartCallbacks();
+
+    iterations = 0;
+    end_time = SDL_GetTicks() + seconds * 1000;
+
+    while (SDL_GetTicks() < end_time)
+    {
+        // Change song: stop everything and start again.
+
+        OPL_Lock();
+        locked = 1;
+
+        for (i = 0; i < 18; ++i)
+        {
+            OPL_WriteRegister(OPL_REGS_LEVEL + i, iterations & 0x3f);
+        }
+
+        if ((iterations % 8) == 0)
+        {
+            OPL_ClearCallbacks();
+            ++generation;
+            StartCallbacks();
+        }
+
+        locked = 0;
+        OPL_Unlock();
+
+        // Volume changes and tempo changes are made without the lock.
+
+        for (i = 0; i < 9; ++i)
+        {
+            OPL_WriteRegister(OPL_REGS_FEEDBACK + i, 0x30 | (i & 0x0f));
+        }
+
+        OPL_AdjustCallbacks((iterations % 2) ? 1.25f : 0.8f);
+
+        ++iterations;
+
+        SDL_Delay(iterations % 3);
+    }
+
+    OPL_Lock();
+    OPL_ClearCallbacks();
+    OPL_Unlock();
+
+    OPL_GetStats(&stats);
+
+    printf("oplstress: iterations=%u callbacks=%u violations=%u stale=%u "
+           "underruns=%u deferred=%u ring_waits=%u\n",
+           iterations, callbacks_run, violations, stale,
+           stats.underruns, stats.deferred, stats.ring_waits);
+
+    OPL_Shutdown();
+
+    return (violations == 0 && stale == 0) ? 0 : 1;
+}
+
@@ -57,6 +57,8 @@ static opl_driver_t *driver = NULL;
 static int init_stage_reg_writes = 1;
 
 unsigned int opl_sample_rate = 22050;
+int opl_offline = 0;
+opl_stats_t opl_stats;
 
 //
 // Init/shutdown code.
@@ -70,6 +72,13 @@ static opl_init_result_t InitDriver(opl_driver_t *_driver,
 {
     opl_init_result_t result1, result2;
 
+    // When rendering offline, only software emulation can be used.
+
+    if (opl_offline && _driver->render_func == NULL)
+    {
+        return OPL_INIT_NONE;
+    }
+
     // Initialize the driver.
 
     if (!_driver->init_func(port_base))
@@ -184,6 +193,21 @@ void OPL_SetSampleRate(unsigned int rate)
     opl_sample_rate = rate;
 }
 
+// Enable or disable offline rendering.
+
+void OPL_SetOffline(int offline)
+{
+    opl_offline = offline;
+}
+
+void OPL_Render(int16_t *buffer, unsigned int nsamples)
+{
+    if (driver != NULL && driver->render_func != NULL)
+    {
+        driver->render_func(buffer, nsamples);
+    }
+}
+
 void OPL_WritePort(opl_port_t port, unsigned int value)
 {
     if (driver != NULL)
@@ -473,6 +497,7 @@ static void DelayCallback(void *_delay_data)
 void OPL_Delay(uint64_t us)
 {
     delay_data_t delay_data;
+    int16_t discard[256 * 2];
 
     if (driver == NULL)
     {
@@ -488,16 +513,28 @@ void OPL_Delay(uint64_t us)
 
     OPL_SetCallback(us, DelayCallback, &delay_data);
 
-    // Wait until the callback is invoked.
-
-    SDL_LockMutex(delay_data.mutex);
+    // Wait until the callback is invoked.  When rendering offline,
+    // nothing else advances the time, so generate output (which is
+    // thrown away) until it is.
 
-    while (!delay_data.finished)
+    if (opl_offline)
     {
-        SDL_CondWait(delay_data.cond, delay_data.mutex);
+        while (!delay_data.finished)
+        {
+            OPL_Render(discard, 256);
+        }
     }
+    else
+    {
+        SDL_LockMutex(delay_data.mutex);
 
-    SDL_UnlockMutex(delay_data.mutex);
+        while (!delay_data.finished)
+        {
+            SDL_CondWait(delay_data.cond, delay_data.mutex);
+        }
+
+        SDL_UnlockMutex(delay_data.mutex);
+    }
 
     // Clean up.
 
@@ -521,3 +558,8 @@ void OPL_AdjustCallbacks(float value)
     }
 }
 
+void OPL_GetStats(opl_stats_t *stats)
+{
+    *stats = opl_stats;
+}
+
@@ -149,5 +149,44 @@ void OPL_Delay(uint64_t us);
 
 void OPL_SetPaused(int paused);
 
+// Statistics gathered by the software emulation driver about the
+// audio thread.
+
+typedef struct
+{
+    // Number of audio buffers that took longer to fill than the time
+    // they take to play.
+
+    unsigned int underruns;
+
+    // Number of times callbacks were due, but were put off because
+    // OPL_Lock was held by another thread.
+
+    unsigned int deferred;
+
+    // Number of times a thread had to wait for space to queue a
+    // command for the audio thread.
+
+    unsigned int ring_waits;
+} opl_stats_t;
+
+void OPL_GetStats(opl_stats_t *stats);
+
+//
+// Offline rendering.
+//
+
+// If enabled before OPL_Init is called, only software emulation is
+// used, no audio device is opened and time does not advance by
+// itself: output must be generated by calling OPL_Render.
+
+void OPL_SetOffline(int offline);
+
+// Generate the specified number of stereo samples of emulator output,
+// invoking callbacks as time advances.  The output is the same as the
+// stream that the emulator would feed to SDL_mixer.
+
+void OPL_Render(int16_t *buffer, unsigned int nsamples);
+
 #endif
 
@@ -1021,6 +1021,540 @@ void chip_generate_opl3l(opl_chip *chip, Bit16s *buffer) {
     chip->samplecnt += 64;
 }
 
+//
+// Block generation
+//
+// chip_generate_block produces the same output as calling chip_generate
+// once per sample, but works one stage at a time over the whole block:
+// chip-wide timers first, then the phase and envelope of each slot,
+// then the output of each slot, then the mix.  Per-slot state is kept
+// in arrays indexed by sample (structure of arrays), the waveform and
+// modulation source are decoded once per block rather than through
+// pointers every sample, and the phase, envelope and mix stages have
+// simple loops that the compiler can vectorise.
+//
+// Registers must not be written during a block; chip_update only
+// writes between its blocks, so this holds.
+//
+
+#define BLOCK_MAX 128
+
+// Source of a slot's modulation or a channel's output, decoded from
+// the pointers set up by chan_setupalg.
+
+enum {
+    src_zero = -1,
+    src_fb = -2,
+    src_invalid = -3
+};
+
+static Bits block_srcindex(opl_chip *chip, Bit16s *ptr) {
+    Bits offset;
+    if (ptr == &chip->zeromod) {
+        return src_zero;
+    }
+    offset = (Bit8s*)ptr - (Bit8s*)&chip->slot[0].out;
+    if (offset < 0 || (Bitu)offset % sizeof(opl_slot) != 0
+     || (Bitu)offset / sizeof(opl_slot) >= 36) {
+        return src_invalid;
+    }
+    return (Bitu)offset / sizeof(opl_slot);
+}
+
+static Bit16s block_sin(Bit8u wf, Bit16u phase, Bit16u envelope) {
+    switch (wf) {
+    case 0:
+        return envelope_calcsin0(phase, envelope);
+    case 1:
+        return envelope_calcsin1(phase, envelope);
+    case 2:
+        return envelope_calcsin2(phase, envelope);
+    case 3:
+        return envelope_calcsin3(phase, envelope);
+    case 4:
+        return envelope_calcsin4(phase, envelope);
+    case 5:
+        return envelope_calcsin5(phase, envelope);
+    case 6:
+        return envelope_calcsin6(phase, envelope);
+    default:
+        return envelope_calcsin7(phase, envelope);
+    }
+}
+
+static Bit32u block_phaseinc(opl_slot *slot) {
+    Bit32u basefreq;
+    basefreq = (slot->channel->f_num << slot->channel->block) >> 1;
+    return (basefreq * mt[slot->reg_mult]) >> 1;
+}
+
+static void block_phase(opl_slot *slot, const Bit8u *vibpos, Bit32u *phase,
+                        Bit32u n) {
+    Bit32u basefreq, inc, p;
+    Bit32u t;
+
+    p = slot->pg_phase;
+    phase[0] = p;
+
+    if (!slot->reg_vib) {
+        inc = block_phaseinc(slot);
+        for (t = 0; t < n; t++) {
+            phase[t + 1] = p + inc * (t + 1);
+        }
+    }
+    else {
+        for (t = 0; t < n; t++) {
+            Bit16u f_num;
+            Bit8s range;
+
+            f_num = slot->channel->f_num;
+            range = (f_num >> 7) & 7;
+            if (!(vibpos[t] & 3)) {
+                range = 0;
+            }
+            else if (vibpos[t] & 1) {
+                range >>= 1;
+            }
+            range >>= slot->chip->vibshift;
+            if (vibpos[t] & 4) {
+                range = -range;
+            }
+            f_num += range;
+            basefreq = (f_num << slot->channel->block) >> 1;
+            p += (basefreq * mt[slot->reg_mult]) >> 1;
+            phase[t + 1] = p;
+        }
+    }
+
+    slot->pg_phase = phase[n];
+}
+
+static Bit8u block_eginc(opl_slot *slot, Bit16u timer) {
+    Bit8u rate_h, rate_l;
+    rate_h = slot->eg_rate >> 2;
+    rate_l = slot->eg_rate & 3;
+    if (eg_incsh[rate_h] > 0) {
+        if ((timer & ((1 << eg_incsh[rate_h]) - 1)) == 0) {
+            return eg_incstep[eg_incdesc[rate_h]][rate_l][(timer >> eg_incsh[rate_h]) & 0x07];
+        }
+        return 0;
+    }
+    return eg_incstep[eg_incdesc[rate_h]][rate_l][timer & 0x07] << (-eg_incsh[rate_h]);
+}
+
+static void block_envelope(opl_slot *slot, const Bit16u *timer,
+                           const Bit8u *trem, Bit16u *eg_out, Bit32u n) {
+    Bit16u base;
+    Bit32u t;
+
+    base = (slot->reg_tl << 2) + (slot->eg_ksl >> kslshift[slot->reg_ksl]);
+
+    // Envelope is off, or holding at the sustain level: the level
+    // does not change, so only tremolo varies.
+
+    if ((slot->eg_gen == envelope_gen_num_off && slot->eg_rout == 0x1ff)
+     || (slot->eg_gen == envelope_gen_num_sustain && slot->reg_type)) {
+        base += slot->eg_rout;
+        if (eg_out != NULL) {
+            for (t = 0; t < n; t++) {
+                eg_out[t] = base + trem[t];
+            }
+        }
+        slot->eg_inc = block_eginc(slot, timer[n - 1]);
+        slot->eg_out = base + trem[n - 1];
+        return;
+    }
+
+    for (t = 0; t < n; t++) {
+        slot->eg_inc = block_eginc(slot, timer[t]);
+        eg_out[t] = slot->eg_rout + base + trem[t];
+        switch (slot->eg_gen) {
+        case envelope_gen_num_off:
+            envelope_gen_off(slot);
+            break;
+        case envelope_gen_num_attack:
+            envelope_gen_attack(slot);
+            break;
+        case envelope_gen_num_decay:
+            envelope_gen_decay(slot);
+            break;
+        case envelope_gen_num_sustain:
+            envelope_gen_sustain(slot);
+            break;
+        case envelope_gen_num_release:
+            envelope_gen_release(slot);
+            break;
+        }
+    }
+
+    slot->eg_out = eg_out[n - 1];
+}
+
+// Output of a slot whose envelope is off.  The attenuation is at least
+// 0x1ff, so envelope_calcexp always returns zero, and the output is
+// just the sign that the waveform gives the phase: zero or -1.
+
+static Bit16s block_offsign(Bit8u wf, Bit16u phase) {
+    phase &= 0x3ff;
+    switch (wf) {
+    case 0:
+    case 6:
+    case 7:
+        return (phase & 0x200) ? ~0 : 0;
+    case 4:
+        return ((phase & 0x300) == 0x100) ? ~0 : 0;
+    default:
+        return 0;
+    }
+}
+
+// Waveforms 1, 2, 3 and 5 have no negative half, so a slot that is off
+// and uses one of them outputs zero whatever its phase.
+
+static Bit8u block_silent(opl_slot *slot) {
+    return slot->reg_wf == 1 || slot->reg_wf == 2
+        || slot->reg_wf == 3 || slot->reg_wf == 5;
+}
+
+// Output of a silent slot: only the feedback state needs updating,
+// and it settles at zero after a couple of samples.
+
+static void block_output_zero(opl_slot *slot, Bit16s *out, Bit32u n) {
+    Bit8u fb;
+    Bit32u t;
+
+    fb = slot->channel->fb;
+
+    for (t = 0; t < n; t++) {
+        if (fb != 0x00) {
+            slot->fbmod = (slot->prout + slot->out) >> (0x09 - fb);
+        }
+        else {
+            slot->fbmod = 0;
+        }
+        slot->prout = slot->out;
+        slot->out = 0;
+        out[t + 1] = 0;
+        if (slot->prout == 0 && slot->fbmod == 0) {
+            memset(out + t + 2, 0, (n - t - 1) * sizeof(Bit16s));
+            break;
+        }
+    }
+}
+
+// Generate the output of a slot.  out[0] holds the output before the
+// block; out[t + 1] receives the output for sample t.  modout is the
+// output of the modulating slot, in the same layout, or NULL.
+
+static void block_output(opl_slot *slot, const Bit32u *phase,
+                         const Bit16u *eg_out, Bits modsrc,
+                         const Bit16s *modout, Bit8u off, Bit16s *out,
+                         Bit32u n) {
+    Bit8u wf, fb;
+    Bit16s mod;
+    Bit32u t;
+
+    wf = slot->reg_wf;
+    fb = slot->channel->fb;
+
+    for (t = 0; t < n; t++) {
+        if (fb != 0x00) {
+            slot->fbmod = (slot->prout + slot->out) >> (0x09 - fb);
+        }
+        else {
+            slot->fbmod = 0;
+        }
+        slot->prout = slot->out;
+
+        if (modsrc == src_fb) {
+            mod = slot->fbmod;
+        }
+        else if (modsrc == src_zero) {
+            mod = 0;
+        }
+        else {
+            mod = modout[t + 1];
+        }
+
+        if (off) {
+            slot->out = block_offsign(wf, (Bit16u)(phase[t + 1] >> 9) + mod);
+        }
+        else {
+            slot->out = block_sin(wf, (Bit16u)(phase[t + 1] >> 9) + mod,
+                                  eg_out[t]);
+        }
+        out[t + 1] = slot->out;
+    }
+}
+
+// Output of a rhythm slot with a fixed phase, computed by the caller.
+
+static void block_output_phase(opl_slot *slot, const Bit16u *phasein,
+                               const Bit16u *eg_out, Bit8u off, Bit16s *out,
+                               Bit32u n) {
+    Bit8u wf, fb;
+    Bit32u t;
+
+    wf = slot->reg_wf;
+    fb = slot->channel->fb;
+
+    for (t = 0; t < n; t++) {
+        if (fb != 0x00) {
+            slot->fbmod = (slot->prout + slot->out) >> (0x09 - fb);
+        }
+        else {
+            slot->fbmod = 0;
+        }
+        slot->prout = slot->out;
+        if (off) {
+            slot->out = block_offsign(wf, phasein[t]);
+        }
+        else {
+            slot->out = block_sin(wf, phasein[t], eg_out[t]);
+        }
+        out[t + 1] = slot->out;
+    }
+}
+
+static Bit16u block_rhythmbit(Bit32u p14, Bit32u p17) {
+    Bit16u phase14 = (p14 >> 9) & 0x3ff;
+    Bit16u phase17 = (p17 >> 9) & 0x3ff;
+    return ((phase14 & 0x08) | (((phase14 >> 5) ^ phase14) & 0x04) | (((phase17 >> 2) ^ phase17) & 0x08)) ? 0x01 : 0x00;
+}
+
+static void block_mix(opl_chip *chip, Bit16s out[36][BLOCK_MAX + 1],
+                      Bits outsrc[18][4], const Bit8u *zero, Bit32s *mix,
+                      Bits late, Bit16u mask_b, Bit32u n) {
+    static const Bit16s zeroout[BLOCK_MAX + 1];
+    const Bit16s *src[4];
+    Bit16u mask;
+    Bit32u t;
+    Bit8u ii, jj;
+
+    for (t = 0; t < n; t++) {
+        mix[t] = 0;
+    }
+
+    for (ii = 0; ii < 18; ii++) {
+        Bit8u active = 0;
+        mask = mask_b ? chip->channel[ii].chb : chip->channel[ii].cha;
+        if (!mask) {
+            continue;
+        }
+        for (jj = 0; jj < 4; jj++) {
+            Bits s = outsrc[ii][jj];
+            if (s < 0 || zero[s]) {
+                src[jj] = zeroout;
+            }
+            else if (s < late) {
+                src[jj] = out[s] + 1;
+            }
+            else {
+                src[jj] = out[s];
+            }
+            if (src[jj] != zeroout) {
+                active = 1;
+            }
+        }
+        if (!active) {
+            continue;
+        }
+        for (t = 0; t < n; t++) {
+            Bit16s accm = (Bit16s)(src[0][t] + src[1][t] + src[2][t] + src[3][t]);
+            mix[t] += accm;
+        }
+    }
+}
+
+void chip_generate_block(opl_chip *chip, Bit16s *buff, Bit32u numsamples) {
+    Bit16u timer[BLOCK_MAX];
+    Bit8u tremolo[BLOCK_MAX];
+    Bit8u vibpos[BLOCK_MAX];
+    Bit32u noise[BLOCK_MAX];
+    static const Bit8u notrem[BLOCK_MAX];
+    Bit32u phase[36][BLOCK_MAX + 1];
+    Bit16u eg_out[36][BLOCK_MAX];
+    Bit16s out[36][BLOCK_MAX + 1];
+    Bit16u phasein[BLOCK_MAX];
+    Bits modsrc[36];
+    Bits outsrc[18][4];
+    Bit32s mix0[BLOCK_MAX], mix1[BLOCK_MAX];
+    Bit8u off[36], silent[36], zero[36];
+    Bit8u rhythm;
+    Bit32u n, t;
+    Bit8u ii, jj;
+
+    while (numsamples > BLOCK_MAX) {
+        chip_generate_block(chip, buff, BLOCK_MAX);
+        buff += BLOCK_MAX * 2;
+        numsamples -= BLOCK_MAX;
+    }
+
+    n = numsamples;
+    if (n == 0) {
+        return;
+    }
+
+    rhythm = (chip->rhy & 0x20) != 0;
+
+    // Decode modulation and output routing.  Every slot must only be
+    // modulated by a slot that is generated before it; if not, fall
+    // back to generating one sample at a time.
+
+    for (ii = 0; ii < 36; ii++) {
+        if (chip->slot[ii].mod == &chip->slot[ii].fbmod) {
+            modsrc[ii] = src_fb;
+        }
+        else {
+            modsrc[ii] = block_srcindex(chip, chip->slot[ii].mod);
+            if (modsrc[ii] == src_invalid || modsrc[ii] >= ii) {
+                goto fallback;
+            }
+        }
+    }
+
+    for (ii = 0; ii < 18; ii++) {
+        for (jj = 0; jj < 4; jj++) {
+            outsrc[ii][jj] = block_srcindex(chip, chip->channel[ii].out[jj]);
+            if (outsrc[ii][jj] == src_invalid) {
+                goto fallback;
+            }
+        }
+    }
+
+    // Chip-wide state at the start of each sample.
+
+    for (t = 0; t < n; t++) {
+        timer[t] = chip->timer;
+        tremolo[t] = chip->tremolo;
+        vibpos[t] = chip->vibpos;
+        noise[t] = chip->noise;
+
+        n_generate(chip);
+
+        if ((chip->timer & 0x3f) == 0x3f) {
+            chip->tremolopos = (chip->tremolopos + 1) % 210;
+            if (chip->tremolopos < 105) {
+                chip->tremolo = chip->tremolopos >> (2 + chip->tremoloshift);
+            }
+            else {
+                chip->tremolo = (210 - chip->tremolopos) >> (2 + chip->tremoloshift);
+            }
+        }
+
+        if ((chip->timer & 0x3ff) == 0x3ff) {
+            chip->vibpos = (chip->vibpos + 1) & 7;
+        }
+
+        chip->timer++;
+    }
+
+    // Slots whose envelope is off stay off until the next register
+    // write, so for the whole block their output is only a sign, and
+    // for some waveforms always zero.  Only the state that remains
+    // observable is updated for them.
+
+    for (ii = 0; ii < 36; ii++) {
+        opl_slot *slot = &chip->slot[ii];
+        off[ii] = chip->skip_silent
+               && slot->eg_gen == envelope_gen_num_off
+               && slot->eg_rout == 0x1ff;
+        silent[ii] = off[ii] && block_silent(slot);
+    }
+
+    // Phase and envelope of every slot.  The rhythm section reads the
+    // phase of slots 13 and 17 directly.
+
+    for (ii = 0; ii < 36; ii++) {
+        opl_slot *slot = &chip->slot[ii];
+        if (silent[ii] && !slot->reg_vib
+         && !(rhythm && (ii == 13 || ii == 17))) {
+            slot->pg_phase += block_phaseinc(slot) * n;
+        }
+        else {
+            block_phase(slot, vibpos, phase[ii], n);
+        }
+        block_envelope(slot, timer,
+                       slot->trem == &chip->tremolo ? tremolo : notrem,
+                       off[ii] ? NULL : eg_out[ii], n);
+    }
+
+    // Output of every slot, in the order that chip_generate uses.
+
+    for (ii = 0; ii < 36; ii++) {
+        opl_slot *slot = &chip->slot[ii];
+        out[ii][0] = slot->out;
+
+        if (silent[ii]) {
+            block_output_zero(slot, out[ii], n);
+        }
+        else if (rhythm && ii == 13) {
+            // Hi-hat
+            for (t = 0; t < n; t++) {
+                Bit16u phasebit = block_rhythmbit(phase[13][t + 1], phase[17][t]);
+                phasein[t] = (phasebit << 9) | (0x34 << ((phasebit ^ (noise[t] & 0x01) << 1)));
+            }
+            block_output_phase(slot, phasein, eg_out[ii], off[ii],
+                               out[ii], n);
+        }
+        else if (rhythm && ii == 14) {
+            // Tom-tom
+            for (t = 0; t < n; t++) {
+                phasein[t] = 0;
+            }
+            block_output_phase(slot, phasein, eg_out[ii], off[ii],
+                               out[ii], n);
+        }
+        else if (rhythm && ii == 16) {
+            // Snare drum
+            for (t = 0; t < n; t++) {
+                Bit16u phase14 = (phase[13][t + 1] >> 9) & 0x3ff;
+                phasein[t] = (0x100 << ((phase14 >> 8) & 0x01)) ^ ((noise[t] & 0x01) << 8);
+            }
+            block_output_phase(slot, phasein, eg_out[ii], off[ii],
+                               out[ii], n);
+        }
+        else if (rhythm && ii == 17) {
+            // Top cymbal
+            for (t = 0; t < n; t++) {
+                Bit16u phasebit = block_rhythmbit(phase[13][t + 1], phase[17][t + 1]);
+                phasein[t] = 0x100 | (phasebit << 9);
+            }
+            block_output_phase(slot, phasein, eg_out[ii], off[ii],
+                               out[ii], n);
+        }
+        else {
+            block_output(slot, phase[ii], eg_out[ii], modsrc[ii],
+                         modsrc[ii] >= 0 ? out[modsrc[ii]] : NULL,
+                         off[ii], out[ii], n);
+        }
+        zero[ii] = silent[ii] && out[ii][0] == 0;
+    }
+
+    // The left channel is mixed after slot 14 is generated and the
+    // right after slot 32; the right output lags by one sample.
+
+    block_mix(chip, out, outsrc, zero, mix0, 15, 0, n);
+    block_mix(chip, out, outsrc, zero, mix1, 33, 1, n);
+
+    buff[1] = limshort(chip->mixbuff[1]);
+    for (t = 0; t < n; t++) {
+        buff[t * 2] = limshort(mix0[t]);
+        if (t > 0) {
+            buff[t * 2 + 1] = limshort(mix1[t - 1]);
+        }
+    }
+
+    chip->mixbuff[0] = mix0[n - 1];
+    chip->mixbuff[1] = mix1[n - 1];
+    return;
+
+fallback:
+    for (t = 0; t < n; t++) {
+        chip_generate(chip, buff + t * 2);
+    }
+}
+
 void chip_reset(opl_chip *chip, Bit32u samplerate) {
     Bit8u slotnum;
     Bit8u channum;
@@ -1035,6 +1569,7 @@ void chip_reset(opl_chip *chip, Bit32u samplerate) {
         chip->slot[slotnum].eg_gen = envelope_gen_num_off;
         chip->slot[slotnum].trem = (Bit8u*)&chip->zeromod;
     }
+    chip->skip_silent = 1;
     for (channum = 0; channum < 18; channum++) {
         chip->channel[channum].slots[0] = &chip->slot[ch_slot[channum]];
         chip->channel[channum].slots[1] = &chip->slot[ch_slot[channum] + 3];
@@ -1147,7 +1682,7 @@ void chip_write(opl_chip *chip, Bit16u reg, Bit8u v) {
 
 
 void chip_update(opl_chip *chip, Bit16s* sndptr, Bit32u numsamples) {
-    Bit16s out[2];
+    Bit16s block[128][2];
     float outb[128][2];
     SRC_DATA rsm_data;
     Bit32u generated = 0;
@@ -1158,10 +1693,10 @@ void chip_update(opl_chip *chip, Bit16s* sndptr, Bit32u numsamples) {
     {
         if (chip->rsm_status == 0)
         {
+            chip_generate_block(chip, block[0], 128);
             for (i = 0; i < 128; i++) {
-                chip_generate(chip, out);
-                chip->rsm_buff[i][0] = (float)(out[0] / 32768.0);
-                chip->rsm_buff[i][1] = (float)(out[1] / 32768.0);
+                chip->rsm_buff[i][0] = (float)(block[i][0] / 32768.0);
+                chip->rsm_buff[i][1] = (float)(block[i][1] / 32768.0);
             }
             chip->rsm_status = 1;
             chip->rsm_counter = 0;
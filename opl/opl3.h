@@ -101,6 +101,7 @@ struct _opl_chip {
     Bit32u noise;
     Bit16s zeromod;
     Bit32s mixbuff[2];
+    Bit8u skip_silent;
     float rsm_buff[128][2];
     Bit16u rsm_counter;
     Bit32u rsm_status;
@@ -115,5 +116,7 @@ struct _opl_chip {
 
 void chip_reset(opl_chip *chip, Bit32u samplerate);
 void chip_write(opl_chip *chip, Bit16u reg, Bit8u v);
+void chip_generate(opl_chip *chip, Bit16s *buff);
+void chip_generate_block(opl_chip *chip, Bit16s *buff, Bit32u numsamples);
 void chip_update(opl_chip *chip, Bit16s* sndptr, Bit32u numsamples);
 void chip_remove(opl_chip *chip);
\ No newline at end of file
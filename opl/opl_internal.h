@@ -33,6 +33,7 @@ typedef void (*opl_lock_func)(void);
 typedef void (*opl_unlock_func)(void);
 typedef void (*opl_set_paused_func)(int paused);
 typedef void (*opl_adjust_callbacks_func)(float value);
+typedef void (*opl_render_func)(int16_t *buffer, unsigned int nsamples);
 
 typedef struct
 {
@@ -48,11 +49,24 @@ typedef struct
     opl_unlock_func unlock_func;
     opl_set_paused_func set_paused_func;
     opl_adjust_callbacks_func adjust_callbacks_func;
+
+    // Only for software emulation drivers; NULL otherwise.
+
+    opl_render_func render_func;
 } opl_driver_t;
 
 // Sample rate to use when doing software emulation.
 
 extern unsigned int opl_sample_rate;
 
+// If non-zero, software emulation output is rendered on demand by
+// OPL_Render, rather than being played.
+
+extern int opl_offline;
+
+// Statistics returned by OPL_GetStats.
+
+extern opl_stats_t opl_stats;
+
 #endif /* #ifndef OPL_INTERNAL_H */
 
@@ -112,6 +112,7 @@ opl_driver_t opl_openbsd_driver =
     OPL_Timer_Unlock,
     OPL_Timer_SetPaused,
     OPL_Timer_AdjustCallbacks,
+    NULL,  // Render
 };
 
 #endif /* #ifndef NO_OBSD_DRIVER */
@@ -0,0 +1,97 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Lock-free single producer, single consumer ring of OPL commands.
+//
+//     The producer only writes the head index and the consumer only
+//     writes the tail index.  Both indexes count up continuously and
+//     are masked to find a position in the ring, so that a full ring
+//     can be told apart from an empty one.
+//
+
+#include <stdlib.h>
+
+#include "opl_ring.h"
+
+struct opl_cmd_ring_s
+{
+    opl_cmd_t *cmds;
+    unsigned int mask;
+
+    volatile unsigned int head;
+    volatile unsigned int tail;
+};
+
+opl_cmd_ring_t *OPL_Ring_Create(unsigned int size)
+{
+    opl_cmd_ring_t *ring;
+
+    ring = malloc(sizeof(opl_cmd_ring_t));
+    ring->cmds = malloc(size * sizeof(opl_cmd_t));
+    ring->mask = size - 1;
+    ring->head = 0;
+    ring->tail = 0;
+
+    return ring;
+}
+
+void OPL_Ring_Destroy(opl_cmd_ring_t *ring)
+{
+    free(ring->cmds);
+    free(ring);
+}
+
+int OPL_Ring_Push(opl_cmd_ring_t *ring, const opl_cmd_t *cmd)
+{
+    unsigned int head;
+
+    head = ring->head;
+
+    if (head - ring->tail > ring->mask)
+    {
+        return 0;
+    }
+
+    ring->cmds[head & ring->mask] = *cmd;
+
+    // The command must be visible before the new head is.
+
+    OPL_MemoryBarrier();
+    ring->head = head + 1;
+
+    return 1;
+}
+
+int OPL_Ring_Pop(opl_cmd_ring_t *ring, opl_cmd_t *cmd)
+{
+    unsigned int tail;
+
+    tail = ring->tail;
+
+    if (tail == ring->head)
+    {
+        return 0;
+    }
+
+    // Read the command only after seeing the head that covers it, and
+    // finish reading it before the slot is handed back.
+
+    OPL_MemoryBarrier();
+    *cmd = ring->cmds[tail & ring->mask];
+    OPL_MemoryBarrier();
+    ring->tail = tail + 1;
+
+    return 1;
+}
+
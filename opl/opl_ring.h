@@ -0,0 +1,87 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Lock-free single producer, single consumer ring of OPL commands.
+//
+
+#ifndef OPL_RING_H
+#define OPL_RING_H
+
+#include "opl.h"
+
+// Full memory barrier, and atomic compare-and-swap of an int, which
+// evaluates to non-zero if *ptr held oldval and was set to newval.
+
+#if defined(_MSC_VER)
+
+#include <windows.h>
+
+#define OPL_MemoryBarrier() MemoryBarrier()
+#define OPL_CompareAndSwap(ptr, oldval, newval)                          \
+    (InterlockedCompareExchange((volatile LONG *) (ptr),                 \
+                                (newval), (oldval)) == (oldval))
+
+#else
+
+#define OPL_MemoryBarrier() __sync_synchronize()
+#define OPL_CompareAndSwap(ptr, oldval, newval)                          \
+    __sync_bool_compare_and_swap((ptr), (oldval), (newval))
+
+#endif
+
+typedef enum
+{
+    OPL_CMD_WRITE_REGISTER,
+    OPL_CMD_SET_CALLBACK,
+    OPL_CMD_CLEAR_CALLBACKS,
+    OPL_CMD_ADJUST_CALLBACKS,
+    OPL_CMD_SET_PAUSED,
+} opl_cmd_type_t;
+
+typedef struct
+{
+    opl_cmd_type_t type;
+
+    // OPL_CMD_WRITE_REGISTER: register and value.
+    // OPL_CMD_SET_PAUSED: value is the new paused state.
+
+    unsigned int reg;
+    unsigned int value;
+
+    // OPL_CMD_SET_CALLBACK
+
+    uint64_t us;
+    opl_callback_t callback;
+    void *data;
+
+    // OPL_CMD_ADJUST_CALLBACKS
+
+    float factor;
+} opl_cmd_t;
+
+typedef struct opl_cmd_ring_s opl_cmd_ring_t;
+
+// The size of the ring must be a power of two.
+
+opl_cmd_ring_t *OPL_Ring_Create(unsigned int size);
+void OPL_Ring_Destroy(opl_cmd_ring_t *ring);
+
+// Only one thread may push, and only one thread may pop.  Push returns
+// zero if the ring is full; Pop returns zero if it is empty.
+
+int OPL_Ring_Push(opl_cmd_ring_t *ring, const opl_cmd_t *cmd);
+int OPL_Ring_Pop(opl_cmd_ring_t *ring, opl_cmd_t *cmd);
+
+#endif /* #ifndef OPL_RING_H */
+
@@ -18,6 +18,7 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
@@ -31,9 +32,20 @@
 #include "opl_internal.h"
 
 #include "opl_queue.h"
+#include "opl_ring.h"
 
 #define MAX_SOUND_SLICE_TIME 100 /* ms */
 
+// Number of commands that other threads can queue for the audio
+// thread.  Must be a power of two.
+
+#define CMD_RING_SIZE 4096
+
+// When callbacks are due but another thread holds OPL_Lock, output is
+// generated in chunks of this many samples until it is released.
+
+#define LOCK_RETRY_SAMPLES 128
+
 typedef struct
 {
     unsigned int rate;        // Number of times the timer is advanced per sec.
@@ -42,18 +54,33 @@ typedef struct
     uint64_t expire_time;     // Calculated time that timer will expire.
 } opl_timer_t;
 
-// When the callback mutex is locked using OPL_Lock, callback functions
-// are not invoked.
+// The emulator, the timers and the callback queue belong to the audio
+// thread, which runs the mixing callback and the OPL callbacks.  Other
+// threads queue register writes and callback changes as commands in
+// cmd_ring, which the audio thread runs before generating output and
+// before invoking each callback.  The audio thread therefore never
+// waits for another thread.
 
-static SDL_mutex *callback_mutex = NULL;
+static opl_cmd_ring_t *cmd_ring = NULL;
 
-// Queue of callbacks waiting to be invoked.
+// Identity of the audio thread, once the mixing callback has run.
 
-static opl_callback_queue_t *callback_queue;
+static volatile int audio_thread_known;
+static volatile Uint32 audio_thread_id;
 
-// Mutex used to control access to the callback queue.
+// Non-zero while the audio thread is invoking a callback, or while
+// another thread holds OPL_Lock.  The audio thread only ever tries to
+// take it: if it is held, callbacks are put off until it is released.
 
-static SDL_mutex *callback_queue_mutex = NULL;
+static volatile int callback_lock;
+
+// Number of nested OPL_Lock calls by the thread holding the lock.
+
+static int lock_depth;
+
+// Queue of callbacks waiting to be invoked.
+
+static opl_callback_queue_t *callback_queue;
 
 // Current time, in us since startup:
 
@@ -77,9 +104,11 @@ static int opl_opl3mode;
 
 static int32_t *mix_buffer = NULL;
 
-// Register number that was written.
+// Register number that was written by the audio thread, and by
+// other threads.
 
 static int register_num = 0;
+static int queued_register_num = 0;
 
 // Timers; DBOPL does not do timer stuff itself.
 
@@ -92,6 +121,12 @@ static int sdl_was_initialized = 0;
 static int mixing_freq, mixing_channels;
 static Uint16 mixing_format;
 
+// When rendering offline, the most recent buffer filled by the mixing
+// callback, its length and the number of samples already returned.
+
+static int16_t *render_buffer = NULL;
+static unsigned int render_len, render_pos;
+
 static int SDLIsInitialized(void)
 {
     int freq, channels;
@@ -100,57 +135,141 @@ static int SDLIsInitialized(void)
     return Mix_QuerySpec(&freq, &format, &channels);
 }
 
-// Advance time by the specified number of samples, invoking any
-// callback functions as appropriate.
+// When rendering offline, everything runs on the thread calling
+// OPL_Render.
 
-static void AdvanceTime(unsigned int nsamples)
+static int IsAudioThread(void)
 {
-    opl_callback_t callback;
-    void *callback_data;
-    uint64_t us;
+    return opl_offline
+        || (audio_thread_known && SDL_ThreadID() == audio_thread_id);
+}
 
-    SDL_LockMutex(callback_queue_mutex);
+static void WriteRegister(unsigned int reg_num, unsigned int value);
 
-    // Advance time.
+// Run a command on the audio thread.
 
-    us = ((uint64_t) nsamples * OPL_SECOND) / mixing_freq;
-    current_time += us;
+static void RunCommand(opl_cmd_t *cmd)
+{
+    switch (cmd->type)
+    {
+        case OPL_CMD_WRITE_REGISTER:
+            WriteRegister(cmd->reg, cmd->value);
+            break;
 
-    if (opl_sdl_paused)
+        case OPL_CMD_SET_CALLBACK:
+            OPL_Queue_Push(callback_queue, cmd->callback, cmd->data,
+                           current_time - pause_offset + cmd->us);
+            break;
+
+        case OPL_CMD_CLEAR_CALLBACKS:
+            OPL_Queue_Clear(callback_queue);
+            break;
+
+        case OPL_CMD_ADJUST_CALLBACKS:
+            OPL_Queue_AdjustCallbacks(callback_queue, current_time,
+                                      cmd->factor);
+            break;
+
+        case OPL_CMD_SET_PAUSED:
+            opl_sdl_paused = cmd->value;
+            break;
+    }
+}
+
+static void RunQueuedCommands(void)
+{
+    opl_cmd_t cmd;
+
+    while (OPL_Ring_Pop(cmd_ring, &cmd))
     {
-        pause_offset += us;
+        RunCommand(&cmd);
     }
+}
 
-    // Are there callbacks to invoke now?  Keep invoking them
-    // until there are no more left.
+// Run a command now if called from the audio thread, or queue it for
+// the audio thread otherwise.  If the ring is full, this waits for the
+// audio thread to catch up.
 
-    while (!OPL_Queue_IsEmpty(callback_queue)
-        && current_time >= OPL_Queue_Peek(callback_queue) + pause_offset)
+static void RunOrQueueCommand(opl_cmd_t *cmd)
+{
+    if (IsAudioThread())
     {
-        // Pop the callback from the queue to invoke it.
+        RunCommand(cmd);
+        return;
+    }
 
-        if (!OPL_Queue_Pop(callback_queue, &callback, &callback_data))
+    if (!OPL_Ring_Push(cmd_ring, cmd))
+    {
+        ++opl_stats.ring_waits;
+
+        do
         {
-            break;
+            SDL_Delay(1);
+        } while (!OPL_Ring_Push(cmd_ring, cmd));
+    }
+}
+
+static int CallbackDue(void)
+{
+    return !OPL_Queue_IsEmpty(callback_queue)
+        && current_time >= OPL_Queue_Peek(callback_queue) + pause_offset;
+}
+
+// Run queued commands, then invoke any callbacks that are due.
+// Returns zero if callbacks are due but could not be invoked because
+// another thread holds OPL_Lock.
+
+static int RunCallbacks(void)
+{
+    opl_callback_t callback;
+    void *callback_data;
+
+    RunQueuedCommands();
+
+    while (CallbackDue())
+    {
+        if (!OPL_CompareAndSwap(&callback_lock, 0, 1))
+        {
+            ++opl_stats.deferred;
+            return 0;
         }
 
-        // The mutex stuff here is a bit complicated.  We must
-        // hold callback_mutex when we invoke the callback (so that
-        // the control thread can use OPL_Lock() to prevent callbacks
-        // from being invoked), but we must not be holding
-        // callback_queue_mutex, as the callback must be able to
-        // call OPL_SetCallback to schedule new callbacks.
+        // Commands queued by the thread that held the lock until now
+        // must take effect before the callback runs; they may have
+        // cleared the queue.
 
-        SDL_UnlockMutex(callback_queue_mutex);
+        RunQueuedCommands();
 
-        SDL_LockMutex(callback_mutex);
-        callback(callback_data);
-        SDL_UnlockMutex(callback_mutex);
+        if (CallbackDue()
+         && OPL_Queue_Pop(callback_queue, &callback, &callback_data))
+        {
+            callback(callback_data);
+        }
 
-        SDL_LockMutex(callback_queue_mutex);
+        OPL_MemoryBarrier();
+        callback_lock = 0;
     }
 
-    SDL_UnlockMutex(callback_queue_mutex);
+    return 1;
+}
+
+// Advance time by the specified number of samples, invoking any
+// callback functions as appropriate.  Returns zero if callbacks were
+// put off, as for RunCallbacks.
+
+static int AdvanceTime(unsigned int nsamples)
+{
+    uint64_t us;
+
+    us = ((uint64_t) nsamples * OPL_SECOND) / mixing_freq;
+    current_time += us;
+
+    if (opl_sdl_paused)
+    {
+        pause_offset += us;
+    }
+
+    return RunCallbacks();
 }
 
 // Call the OPL emulator code to fill the specified buffer.
@@ -177,12 +296,28 @@ static void OPL_Mix_Callback(void *udata,
     int16_t *buffer;
     unsigned int buffer_len;
     unsigned int filled = 0;
+    unsigned int start_time;
+    int deferred;
+
+    start_time = SDL_GetTicks();
+
+    if (!audio_thread_known)
+    {
+        audio_thread_id = SDL_ThreadID();
+        OPL_MemoryBarrier();
+        audio_thread_known = 1;
+    }
 
     // Buffer length in samples (quadrupled, because of 16-bit and stereo)
 
     buffer = (int16_t *) byte_buffer;
     buffer_len = buffer_bytes / 4;
 
+    // Pick up commands queued since the last buffer, and callbacks that
+    // were put off.
+
+    deferred = !RunCallbacks();
+
     // Repeatedly call the OPL emulator update function until the buffer is
     // full.
 
@@ -191,8 +326,6 @@ static void OPL_Mix_Callback(void *udata,
         uint64_t next_callback_time;
         uint64_t nsamples;
 
-        SDL_LockMutex(callback_queue_mutex);
-
         // Work out the time until the next callback waiting in
         // the callback queue must be invoked.  We can then fill the
         // buffer with this many samples.
@@ -201,20 +334,22 @@ static void OPL_Mix_Callback(void *udata,
         {
             nsamples = buffer_len - filled;
         }
+        else if (deferred)
+        {
+            nsamples = LOCK_RETRY_SAMPLES;
+        }
         else
         {
             next_callback_time = OPL_Queue_Peek(callback_queue) + pause_offset;
 
             nsamples = (next_callback_time - current_time) * mixing_freq;
             nsamples = (nsamples + OPL_SECOND - 1) / OPL_SECOND;
-
-            if (nsamples > buffer_len - filled)
-            {
-                nsamples = buffer_len - filled;
-            }
         }
 
-        SDL_UnlockMutex(callback_queue_mutex);
+        if (nsamples > buffer_len - filled)
+        {
+            nsamples = buffer_len - filled;
+        }
 
         // Add emulator output to buffer.
 
@@ -223,23 +358,75 @@ static void OPL_Mix_Callback(void *udata,
 
         // Invoke callbacks for this point in time.
 
-        AdvanceTime(nsamples);
+        deferred = !AdvanceTime(nsamples);
+    }
+
+    // Count buffers that took longer to generate than to play.
+
+    if (!opl_offline
+     && (uint64_t) (SDL_GetTicks() - start_time) * mixing_freq
+          > (uint64_t) buffer_len * 1000)
+    {
+        ++opl_stats.underruns;
+    }
+}
+
+// Generate output when rendering offline.  The mixing callback is
+// invoked with whole buffers, exactly as SDL_mixer would invoke it, so
+// that the output is the same however many samples are requested.
+
+static void OPL_SDL_Render(int16_t *buffer, unsigned int nsamples)
+{
+    unsigned int n;
+
+    while (nsamples > 0)
+    {
+        if (render_pos >= render_len)
+        {
+            OPL_Mix_Callback(NULL, (Uint8 *) render_buffer, render_len * 4);
+            render_pos = 0;
+        }
+
+        n = render_len - render_pos;
+
+        if (n > nsamples)
+        {
+            n = nsamples;
+        }
+
+        memcpy(buffer, render_buffer + render_pos * 2, n * 4);
+        buffer += n * 2;
+        render_pos += n;
+        nsamples -= n;
     }
 }
 
 static void OPL_SDL_Shutdown(void)
 {
-    Mix_HookMusic(NULL, NULL);
+    if (opl_offline)
+    {
+        OPL_Queue_Destroy(callback_queue);
+        free(render_buffer);
+        render_buffer = NULL;
+    }
+    else
+    {
+        Mix_HookMusic(NULL, NULL);
+    }
 
     if (sdl_was_initialized)
     {
         Mix_CloseAudio();
         SDL_QuitSubSystem(SDL_INIT_AUDIO);
         OPL_Queue_Destroy(callback_queue);
-        free(mix_buffer);
         sdl_was_initialized = 0;
     }
 
+    // Allocated by OPL_SDL_Init in both modes.
+
+    free(mix_buffer);
+    mix_buffer = NULL;
+
 /*
     if (opl_chip != NULL)
     {
@@ -248,16 +435,10 @@ static void OPL_SDL_Shutdown(void)
     }
     */
 
-    if (callback_mutex != NULL)
+    if (cmd_ring != NULL)
     {
-        SDL_DestroyMutex(callback_mutex);
-        callback_mutex = NULL;
-    }
-
-    if (callback_queue_mutex != NULL)
-    {
-        SDL_DestroyMutex(callback_queue_mutex);
-        callback_queue_mutex = NULL;
+        OPL_Ring_Destroy(cmd_ring);
+        cmd_ring = NULL;
     }
 }
 
@@ -287,35 +468,51 @@ static unsigned int GetSliceSize(void)
 
 static int OPL_SDL_Init(unsigned int port_base)
 {
-    // Check if SDL_mixer has been opened already
-    // If not, we must initialize it now
+    if (opl_offline)
+    {
+        // No audio device is opened: the mixing callback is invoked
+        // by OPL_SDL_Render instead, with the same buffer size that
+        // would be requested from SDL_mixer below.
 
-    if (!SDLIsInitialized())
+        sdl_was_initialized = 0;
+        render_len = GetSliceSize();
+        render_pos = render_len;
+        render_buffer = malloc(render_len * sizeof(int16_t) * 2);
+    }
+    else
     {
-        if (SDL_Init(SDL_INIT_AUDIO) < 0)
-        {
-            fprintf(stderr, "Unable to set up sound.\n");
-            return 0;
-        }
+        // Check if SDL_mixer has been opened already
+        // If not, we must initialize it now
 
-        if (Mix_OpenAudio(opl_sample_rate, AUDIO_S16SYS, 2, GetSliceSize()) < 0)
+        if (!SDLIsInitialized())
         {
-            fprintf(stderr, "Error initialising SDL_mixer: %s\n", Mix_GetError());
+            if (SDL_Init(SDL_INIT_AUDIO) < 0)
+            {
+                fprintf(stderr, "Unable to set up sound.\n");
+                return 0;
+            }
 
-            SDL_QuitSubSystem(SDL_INIT_AUDIO);
-            return 0;
-        }
+            if (Mix_OpenAudio(opl_sample_rate, AUDIO_S16SYS, 2,
+                              GetSliceSize()) < 0)
+            {
+                fprintf(stderr, "Error initialising SDL_mixer: %s\n",
+                        Mix_GetError());
 
-        SDL_PauseAudio(0);
+                SDL_QuitSubSystem(SDL_INIT_AUDIO);
+                return 0;
+            }
 
-        // When this module shuts down, it has the responsibility to 
-        // shut down SDL.
+            SDL_PauseAudio(0);
 
-        sdl_was_initialized = 1;
-    }
-    else
-    {
-        sdl_was_initialized = 0;
+            // When this module shuts down, it has the responsibility to 
+            // shut down SDL.
+
+            sdl_was_initialized = 1;
+        }
+        else
+        {
+            sdl_was_initialized = 0;
+        }
     }
 
     opl_sdl_paused = 0;
@@ -328,7 +525,16 @@ static int OPL_SDL_Init(unsigned int port_base)
 
     // Get the mixer frequency, format and number of channels.
 
-    Mix_QuerySpec(&mixing_freq, &mixing_format, &mixing_channels);
+    if (opl_offline)
+    {
+        mixing_freq = opl_sample_rate;
+        mixing_format = AUDIO_S16SYS;
+        mixing_channels = 2;
+    }
+    else
+    {
+        Mix_QuerySpec(&mixing_freq, &mixing_format, &mixing_channels);
+    }
 
     // Only supports AUDIO_S16SYS
 
@@ -351,11 +557,27 @@ static int OPL_SDL_Init(unsigned int port_base)
     chip_reset(&opl_emu, mixing_freq);
     opl_opl3mode = 0;
 
-    callback_mutex = SDL_CreateMutex();
-    callback_queue_mutex = SDL_CreateMutex();
+    // The emulator skips work for slots that are silent; this can be
+    // turned off to compare the speed.
+
+    if (getenv("OPL_NOSKIP") != NULL)
+    {
+        opl_emu.skip_silent = 0;
+    }
+
+    // Commands from other threads, which are run by the audio thread.
+
+    cmd_ring = OPL_Ring_Create(CMD_RING_SIZE);
+    audio_thread_known = 0;
+    callback_lock = 0;
+    lock_depth = 0;
+    memset(&opl_stats, 0, sizeof(opl_stats));
 
     // TODO: This should be music callback? or-?
-    Mix_HookMusic(OPL_Mix_Callback, NULL);
+    if (!opl_offline)
+    {
+        Mix_HookMusic(OPL_Mix_Callback, NULL);
+    }
 
     return 1;
 }
@@ -447,56 +669,118 @@ static void WriteRegister(unsigned int reg_num, unsigned int value)
 
 static void OPL_SDL_PortWrite(opl_port_t port, unsigned int value)
 {
+    opl_cmd_t cmd;
+    int *reg;
+
+    // The audio thread and other threads each select their own
+    // register, so that they do not interfere with each other.
+
+    reg = IsAudioThread() ? &register_num : &queued_register_num;
+
     if (port == OPL_REGISTER_PORT)
     {
-        register_num = value;
+        *reg = value;
     }
     else if (port == OPL_REGISTER_PORT_OPL3)
     {
-        register_num = value | 0x100;
+        *reg = value | 0x100;
+    }
+    else if (port == OPL_DATA_PORT
+          && (*reg == OPL_REG_TIMER1 || *reg == OPL_REG_TIMER2
+           || *reg == OPL_REG_TIMER_CTRL))
+    {
+        // The timers do not affect the emulator output; they are set
+        // immediately, so that the status port reflects them as soon
+        // as the write returns.
+
+        WriteRegister(*reg, value);
     }
     else if (port == OPL_DATA_PORT)
     {
-        WriteRegister(register_num, value);
+        cmd.type = OPL_CMD_WRITE_REGISTER;
+        cmd.reg = *reg;
+        cmd.value = value;
+        RunOrQueueCommand(&cmd);
     }
 }
 
 static void OPL_SDL_SetCallback(uint64_t us, opl_callback_t callback,
                                 void *data)
 {
-    SDL_LockMutex(callback_queue_mutex);
-    OPL_Queue_Push(callback_queue, callback, data,
-                   current_time - pause_offset + us);
-    SDL_UnlockMutex(callback_queue_mutex);
+    opl_cmd_t cmd;
+
+    cmd.type = OPL_CMD_SET_CALLBACK;
+    cmd.us = us;
+    cmd.callback = callback;
+    cmd.data = data;
+    RunOrQueueCommand(&cmd);
 }
 
 static void OPL_SDL_ClearCallbacks(void)
 {
-    SDL_LockMutex(callback_queue_mutex);
-    OPL_Queue_Clear(callback_queue);
-    SDL_UnlockMutex(callback_queue_mutex);
+    opl_cmd_t cmd;
+
+    cmd.type = OPL_CMD_CLEAR_CALLBACKS;
+    RunOrQueueCommand(&cmd);
 }
 
+// Callbacks are only invoked by the audio thread, so it has nothing to
+// lock out.  Other threads wait for the callback that is running, if
+// any, to finish.
+
 static void OPL_SDL_Lock(void)
 {
-    SDL_LockMutex(callback_mutex);
+    if (IsAudioThread())
+    {
+        return;
+    }
+
+    if (lock_depth == 0)
+    {
+        while (!OPL_CompareAndSwap(&callback_lock, 0, 1))
+        {
+            SDL_Delay(1);
+        }
+    }
+
+    ++lock_depth;
 }
 
 static void OPL_SDL_Unlock(void)
 {
-    SDL_UnlockMutex(callback_mutex);
+    if (IsAudioThread())
+    {
+        return;
+    }
+
+    --lock_depth;
+
+    if (lock_depth == 0)
+    {
+        // Commands queued while the lock was held must be visible to
+        // the audio thread when it takes the lock.
+
+        OPL_MemoryBarrier();
+        callback_lock = 0;
+    }
 }
 
 static void OPL_SDL_SetPaused(int paused)
 {
-    opl_sdl_paused = paused;
+    opl_cmd_t cmd;
+
+    cmd.type = OPL_CMD_SET_PAUSED;
+    cmd.value = paused;
+    RunOrQueueCommand(&cmd);
 }
 
 static void OPL_SDL_AdjustCallbacks(float factor)
 {
-    SDL_LockMutex(callback_queue_mutex);
-    OPL_Queue_AdjustCallbacks(callback_queue, current_time, factor);
-    SDL_UnlockMutex(callback_queue_mutex);
+    opl_cmd_t cmd;
+
+    cmd.type = OPL_CMD_ADJUST_CALLBACKS;
+    cmd.factor = factor;
+    RunOrQueueCommand(&cmd);
 }
 
 opl_driver_t opl_sdl_driver =
@@ -512,5 +796,6 @@ opl_driver_t opl_sdl_driver =
     OPL_SDL_Unlock,
     OPL_SDL_SetPaused,
     OPL_SDL_AdjustCallbacks,
+    OPL_SDL_Render,
 };
 
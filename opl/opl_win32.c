@@ -186,6 +186,7 @@ opl_driver_t opl_win32_driver =
     OPL_Timer_Unlock,
     OPL_Timer_SetPaused,
     OPL_Timer_AdjustCallbacks,
+    NULL,  // Render
 };
 
 #endif /* #ifdef _WIN32 */
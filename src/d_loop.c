@@ -34,6 +34,7 @@
 
 #include "net_client.h"
 #include "net_gui.h"
+#include "net_impair.h"
 #include "net_io.h"
 #include "net_query.h"
 #include "net_server.h"
@@ -119,6 +120,40 @@ static boolean local_playeringame[NET_MAXPLAYERS];
 
 static int player_class;
 
+// If non-zero, quit after this many tics have been run (-netbench).
+
+static int netbench_tics = 0;
+
+// Statistics on time spent waiting for tics from the network,
+// printed on exit with -netstats.
+
+static unsigned int stats_stalls;
+static unsigned int stats_stall_time;
+static unsigned int stats_stall_bailouts;
+
+// Frame timing statistics, printed every few seconds with -framestats.
+// A frame is counted from one call of TryRunTics to the next, which
+// is when the frame drawn after the last tics has been presented.
+
+static boolean frame_stats = false;
+
+// Time at which the ticcmd for each tic was built.
+
+static uint64_t tic_built_time[BACKUPTICS];
+
+// Build time of the ticcmd for the last tic run.
+
+static uint64_t last_run_built_time;
+
+static uint64_t frame_start_time;
+static uint64_t frame_stats_start_time;
+static unsigned int frame_stats_frames;
+static uint64_t frame_time_total, frame_time_max;
+static uint64_t latency_total, latency_max;
+static unsigned int tic_stats_tics;
+static uint64_t lateness_total, lateness_max;
+static unsigned int missed_tics;
+
 
 // 35 fps clock adjusted by offsetms milliseconds
 
@@ -142,6 +177,7 @@ static int GetAdjustedTime(void)
 static boolean BuildNewTic(void)
 {
     int	gameticdiv;
+    int maxlead;
     ticcmd_t cmd;
 
     gameticdiv = gametic/ticdup;
@@ -168,9 +204,17 @@ static boolean BuildNewTic(void)
        if (!net_client_connected && maketic - gameticdiv > 2)
            return false;
 
-       // Never go more than ~200ms ahead
+       // Never go more than ~200ms ahead, unless the network code
+       // has measured that we need to (-netadapt).
+
+       maxlead = 8;
 
-       if (maketic - gameticdiv > 8)
+#ifdef FEATURE_MULTIPLAYER
+       if (net_client_connected)
+           maxlead = NET_CL_MaxLead(maxlead);
+#endif
+
+       if (maketic - gameticdiv > maxlead)
            return false;
     }
     else
@@ -194,6 +238,11 @@ static boolean BuildNewTic(void)
     ticdata[maketic % BACKUPTICS].cmds[localplayer] = cmd;
     ticdata[maketic % BACKUPTICS].ingame[localplayer] = true;
 
+    if (frame_stats)
+    {
+        tic_built_time[maketic % BACKUPTICS] = I_GetTimeNS();
+    }
+
     ++maketic;
 
     return true;
@@ -255,6 +304,20 @@ void NetUpdate (void)
     }
 }
 
+// Sleep until GetAdjustedTime reaches the tic after lasttime, when
+// NetUpdate will next build a ticcmd.
+
+static void SleepUntilNextTic(void)
+{
+    uint64_t deadline;
+    int offset;
+
+    deadline = I_GetTicTimeNS((lasttime + 1) * ticdup);
+    offset = new_sync ? offsetms / FRACUNIT : 0;
+
+    I_SleepUntilNS(deadline - (int64_t) offset * 1000000);
+}
+
 static void D_Disconnected(void)
 {
     // In drone mode, the game cannot continue once disconnected.
@@ -302,6 +365,15 @@ void D_ReceiveTic(ticcmd_t *ticcmds, boolean *players_mask)
     ++recvtic;
 }
 
+//
+// Returns true if there is no space to store another tic received from
+// the server until more tics have been run.
+//
+boolean D_TicBufferFull(void)
+{
+    return recvtic - gametic / ticdup >= BACKUPTICS - 1;
+}
+
 //
 // Start game loop
 //
@@ -310,9 +382,114 @@ void D_ReceiveTic(ticcmd_t *ticcmds, boolean *players_mask)
 
 void D_StartGameLoop(void)
 {
+    //!
+    // @category video
+    //
+    // Every few seconds, print the time between frames, the time from
+    // reading input to presenting the frame it affected, how late
+    // tics are run and how many tics ran without a frame being drawn.
+    //
+
+    frame_stats = M_CheckParm("-framestats") > 0;
+
     lasttime = GetAdjustedTime() / ticdup;
 }
 
+// Called at the start of TryRunTics, when the last frame has been
+// presented.
+
+static void UpdateFrameStats(void)
+{
+    uint64_t now;
+    uint64_t elapsed;
+    uint64_t frame_time;
+    uint64_t latency;
+
+    now = I_GetTimeNS();
+
+    if (frame_start_time != 0)
+    {
+        frame_time = now - frame_start_time;
+        frame_time_total += frame_time;
+
+        if (frame_time > frame_time_max)
+        {
+            frame_time_max = frame_time;
+        }
+
+        ++frame_stats_frames;
+    }
+
+    if (last_run_built_time != 0)
+    {
+        latency = now - last_run_built_time;
+        latency_total += latency;
+
+        if (latency > latency_max)
+        {
+            latency_max = latency;
+        }
+    }
+
+    frame_start_time = now;
+
+    if (frame_stats_start_time == 0)
+    {
+        frame_stats_start_time = now;
+    }
+
+    elapsed = now - frame_stats_start_time;
+
+    if (elapsed < 5000000000ULL || frame_stats_frames == 0)
+    {
+        return;
+    }
+
+    printf("framestats: %u frames, frame %.2f/%.2f ms, "
+           "input to present %.2f/%.2f ms, "
+           "tic lateness %.2f/%.2f ms, %u missed tics (average/max)\n",
+           frame_stats_frames,
+           frame_time_total / 1e6 / frame_stats_frames,
+           frame_time_max / 1e6,
+           latency_total / 1e6 / frame_stats_frames,
+           latency_max / 1e6,
+           tic_stats_tics ? lateness_total / 1e6 / tic_stats_tics : 0.0,
+           lateness_max / 1e6,
+           missed_tics);
+
+    frame_stats_start_time = now;
+    frame_stats_frames = 0;
+    frame_time_total = frame_time_max = 0;
+    latency_total = latency_max = 0;
+    tic_stats_tics = 0;
+    lateness_total = lateness_max = 0;
+    missed_tics = 0;
+}
+
+// Called as each tic is run, to record how long its ticcmd waited.
+
+static void UpdateTicStats(int tic)
+{
+    uint64_t lateness;
+
+    last_run_built_time = tic_built_time[tic % BACKUPTICS];
+
+    if (last_run_built_time == 0)
+    {
+        return;
+    }
+
+    lateness = I_GetTimeNS() - last_run_built_time;
+    lateness_total += lateness;
+
+    if (lateness > lateness_max)
+    {
+        lateness_max = lateness;
+    }
+
+    ++tic_stats_tics;
+}
+
 //
 // Block until the game start message is received from the server.
 //
@@ -440,6 +617,19 @@ void D_StartNetGame(net_gamesettings_t *settings,
     //}
 }
 
+static void D_PrintNetStats(void)
+{
+    printf("netstats: game tics=%i stalls=%u stall_ms=%u bailouts=%u\n",
+           gametic, stats_stalls, stats_stall_time, stats_stall_bailouts);
+
+#ifdef FEATURE_MULTIPLAYER
+    NET_CL_PrintStats();
+    NET_Impair_PrintStats();
+#endif
+
+    fflush(stdout);
+}
+
 boolean D_InitNetGame(net_connect_data_t *connect_data)
 {
     boolean result = false;
@@ -452,6 +642,26 @@ boolean D_InitNetGame(net_connect_data_t *connect_data)
 
     player_class = connect_data->player_class;
 
+    //!
+    // @category net
+    // @arg <n>
+    //
+    // Network benchmark mode: quit after n game tics have been run,
+    // printing statistics as with -netstats.
+    //
+
+    i = M_CheckParmWithArgs("-netbench", 1);
+
+    if (i > 0)
+    {
+        netbench_tics = atoi(myargv[i + 1]);
+    }
+
+    if (netbench_tics > 0 || M_CheckParm("-netstats") > 0)
+    {
+        I_AtExit(D_PrintNetStats, false);
+    }
+
 #ifdef FEATURE_MULTIPLAYER
 
     //!
@@ -701,6 +911,12 @@ void TryRunTics (void)
     int realtics;
     int	availabletics;
     int	counts;
+    int stall_start;
+
+    if (frame_stats)
+    {
+        UpdateFrameStats();
+    }
 
     // get real tics
     entertic = I_GetTime() / ticdup;
@@ -742,6 +958,12 @@ void TryRunTics (void)
         if (counts < 1)
             counts = 1;
 
+        // A drone that has joined a game in progress has a backlog of
+        // tics to get through; run them all at once.
+
+        if (drone && availabletics > TICRATE)
+            counts = availabletics;
+
         if (net_client_connected)
         {
             OldNetSync();
@@ -751,6 +973,8 @@ void TryRunTics (void)
     if (counts < 1)
 	counts = 1;
 
+    stall_start = -1;
+
     // wait for new tics if needed
     while (!PlayersInGame() || lowtic < gametic/ticdup + counts)
     {
@@ -764,18 +988,57 @@ void TryRunTics (void)
         // Still no tics to run? Sleep until some are available.
         if (lowtic < gametic/ticdup + counts)
         {
+            // Waiting on data from the network, rather than for our
+            // own next tic to be built?
+
+            if (stall_start < 0 && net_client_connected && recvtic < maketic)
+            {
+                stall_start = I_GetTimeMS();
+                ++stats_stalls;
+            }
+
             // If we're in a netgame, we might spin forever waiting for
             // new network data to be received. So don't stay in here
             // forever - give the menu a chance to work.
             if (I_GetTime() / ticdup - entertic >= MAX_NETGAME_STALL_TICS)
             {
+                if (stall_start >= 0)
+                {
+                    stats_stall_time += I_GetTimeMS() - stall_start;
+                    ++stats_stall_bailouts;
+                }
+
                 return;
             }
 
-            I_Sleep(1);
+            // In a netgame, keep checking for packets.  Otherwise
+            // nothing can happen until the next tic is due, so sleep
+            // until then.
+
+            if (net_client_connected)
+            {
+                I_Sleep(1);
+            }
+            else
+            {
+                SleepUntilNextTic();
+            }
         }
     }
 
+    // Tics beyond the first are run without a frame being drawn
+    // for them.
+
+    if (frame_stats && counts > 1)
+    {
+        missed_tics += counts - 1;
+    }
+
+    if (stall_start >= 0)
+    {
+        stats_stall_time += I_GetTimeMS() - stall_start;
+    }
+
     // run the count * ticdup dics
     while (counts--)
     {
@@ -793,6 +1056,11 @@ void TryRunTics (void)
             SinglePlayerClear(set);
         }
 
+        if (frame_stats)
+        {
+            UpdateTicStats(gametic / ticdup);
+        }
+
 	for (i=0 ; i<ticdup ; i++)
 	{
             if (gametic/ticdup > lowtic)
@@ -810,6 +1078,11 @@ void TryRunTics (void)
 
 	NetUpdate ();	// check for new console commands
     }
+
+    if (netbench_tics > 0 && gametic >= netbench_tics)
+    {
+        I_Quit();
+    }
 }
 
 void D_RegisterLoopCallbacks(loop_interface_t *i)
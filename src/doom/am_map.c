@@ -18,6 +18,7 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "deh_main.h"
 
@@ -28,10 +29,12 @@
 #include "p_local.h"
 #include "w_wad.h"
 
+#include "m_bbox.h"
 #include "m_cheat.h"
 #include "m_controls.h"
 #include "m_misc.h"
 #include "i_system.h"
+#include "i_timer.h"
 
 // Needs access to LFB.
 #include "v_video.h"
@@ -108,6 +111,9 @@
 // the following is crap
 #define LINE_NEVERSEE ML_DONTDRAW
 
+// size of the blocks in the automap's line index (512 map units)
+#define AM_BLOCKSHIFT	(FRACBITS+9)
+
 typedef struct
 {
     int x, y;
@@ -267,6 +273,25 @@ cheatseq_t cheat_amap = CHEAT("iddt", 0);
 
 static boolean stopped = true;
 
+// Index of the lines touching each block of the map, so that
+// AM_drawWalls only has to look at the lines near the window.
+// Built by AM_LevelInit.
+static int	am_blockorgx;
+static int	am_blockorgy;
+static int	am_blockwidth;
+static int	am_blockheight;
+static int*	am_blockstart;	// first entry of each block in am_blocklines
+static int*	am_blocklines;	// line numbers, block after block
+static int*	am_linecheck;	// am_checkcount when each line was last found
+static int*	am_visiblelines;
+static int	am_checkcount;
+
+// Draw time for -renderstats, printed when the automap is closed.
+static unsigned int	statframes;
+static unsigned int	statlines;
+static uint64_t		stattime;
+static uint64_t		stattimemax;
+
 // Calculates the slope and slope according to the x-axis of a line
 // segment in map coordinates (with the upright y-axis n' all) so
 // that it can be used with the brain-dead drawing stuff.
@@ -511,6 +536,121 @@ void AM_clearMarks(void)
     markpointnum = 0;
 }
 
+//
+// Finds the range of index blocks covered by a box in map
+// coordinates, clipped to the edges of the index.
+//
+static void
+AM_blockRange
+( fixed_t	x1,
+  fixed_t	y1,
+  fixed_t	x2,
+  fixed_t	y2,
+  int*		range )
+{
+    range[0] = (x1 >> AM_BLOCKSHIFT) - am_blockorgx;
+    range[1] = (y1 >> AM_BLOCKSHIFT) - am_blockorgy;
+    range[2] = (x2 >> AM_BLOCKSHIFT) - am_blockorgx;
+    range[3] = (y2 >> AM_BLOCKSHIFT) - am_blockorgy;
+
+    if (range[0] < 0)
+	range[0] = 0;
+    if (range[1] < 0)
+	range[1] = 0;
+    if (range[2] > am_blockwidth - 1)
+	range[2] = am_blockwidth - 1;
+    if (range[3] > am_blockheight - 1)
+	range[3] = am_blockheight - 1;
+}
+
+//
+// Finds the range of index blocks a line's bounding box covers.
+//
+static void AM_lineBlockRange(line_t* line, int* range)
+{
+    AM_blockRange(line->bbox[BOXLEFT], line->bbox[BOXBOTTOM],
+		  line->bbox[BOXRIGHT], line->bbox[BOXTOP], range);
+}
+
+//
+// Builds the index of lines by block for AM_drawWalls.  Each line
+// is listed in every block its bounding box covers, in line order.
+//
+static void AM_buildLineIndex(void)
+{
+    int		i;
+    int		x;
+    int		y;
+    int		b;
+    int		total;
+    int		numblocks;
+    int		range[4];
+    int*	fill;
+
+    if (am_blockstart)
+    {
+	Z_Free(am_blockstart);
+	Z_Free(am_blocklines);
+	Z_Free(am_linecheck);
+	Z_Free(am_visiblelines);
+    }
+
+    am_blockorgx = min_x >> AM_BLOCKSHIFT;
+    am_blockorgy = min_y >> AM_BLOCKSHIFT;
+    am_blockwidth = (max_x >> AM_BLOCKSHIFT) - am_blockorgx + 1;
+    am_blockheight = (max_y >> AM_BLOCKSHIFT) - am_blockorgy + 1;
+
+    if (am_blockwidth < 1)
+	am_blockwidth = 1;
+    if (am_blockheight < 1)
+	am_blockheight = 1;
+    numblocks = am_blockwidth * am_blockheight;
+
+    am_blockstart = Z_Malloc((numblocks + 1) * sizeof(*am_blockstart),
+			     PU_STATIC, 0);
+    fill = Z_Malloc(numblocks * sizeof(*fill), PU_STATIC, 0);
+    memset(fill, 0, numblocks * sizeof(*fill));
+
+    // count the lines in each block
+    for (i=0;i<numlines;i++)
+    {
+	AM_lineBlockRange(&lines[i], range);
+
+	for (y=range[1];y<=range[3];y++)
+	    for (x=range[0];x<=range[2];x++)
+		fill[y*am_blockwidth+x]++;
+    }
+
+    total = 0;
+    for (b=0;b<numblocks;b++)
+    {
+	am_blockstart[b] = total;
+	total += fill[b];
+	fill[b] = am_blockstart[b];
+    }
+    am_blockstart[numblocks] = total;
+
+    am_blocklines = Z_Malloc(total * sizeof(*am_blocklines), PU_STATIC, 0);
+
+    for (i=0;i<numlines;i++)
+    {
+	AM_lineBlockRange(&lines[i], range);
+
+	for (y=range[1];y<=range[3];y++)
+	    for (x=range[0];x<=range[2];x++)
+		am_blocklines[fill[y*am_blockwidth+x]++] = i;
+    }
+
+    Z_Free(fill);
+
+    am_linecheck = Z_Malloc(numlines * sizeof(*am_linecheck), PU_STATIC, 0);
+    memset(am_linecheck, 0, numlines * sizeof(*am_linecheck));
+    am_checkcount = 0;
+
+    am_visiblelines = Z_Malloc(numlines * sizeof(*am_visiblelines),
+			       PU_STATIC, 0);
+}
+
 //
 // should be called at the start of every level
 // right now, i figure it out myself
@@ -530,11 +670,35 @@ void AM_LevelInit(void)
     if (scale_mtof > max_scale_mtof)
 	scale_mtof = min_scale_mtof;
     scale_ftom = FixedDiv(FRACUNIT, scale_mtof);
+
+    AM_buildLineIndex();
 }
 
 
 
 
+//
+// Prints the -renderstats totals for the time the automap was up.
+//
+static void AM_printStats(void)
+{
+    if (!renderstats || statframes == 0)
+	return;
+
+    printf("AM_Drawer: %u frames, %.1f of %d lines looked at/frame, "
+	   "%.3f us/frame (max %.3f)\n",
+	   statframes,
+	   (double) statlines / statframes,
+	   numlines,
+	   (double) stattime / statframes,
+	   (double) stattimemax);
+
+    statframes = 0;
+    statlines = 0;
+    stattime = 0;
+    stattimemax = 0;
+}
+
 //
 //
 //
@@ -542,6 +706,7 @@ void AM_Stop (void)
 {
     static event_t st_notify = { 0, ev_keyup, AM_MSGEXITED, 0 };
 
+    AM_printStats();
     AM_unloadPics();
     automapactive = false;
     ST_Responder(&st_notify);
@@ -980,6 +1145,12 @@ AM_clipMline
 //
 // Classic Bresenham w/ whatever optimizations needed for speed
 //
+// Lines close to the axes, which most walls are, are drawn a run
+// of pixels at a time: the error term is stepped to the end of the
+// run and the run then filled, with memset along rows.  Steeper
+// diagonals are stepped a pixel at a time as before.  Either way
+// the same pixels are set.
+//
 void
 AM_drawFline
 ( fline_t*	fl,
@@ -994,7 +1165,10 @@ AM_drawFline
     register int ax;
     register int ay;
     register int d;
-    
+    int		left;
+    int		run;
+    byte*	dest;
+
     static int fuck = 0;
 
     // For debugging only
@@ -1020,7 +1194,28 @@ AM_drawFline
     x = fl->a.x;
     y = fl->a.y;
 
-    if (ax > ay)
+    if (ax > ay && ax >= 4*ay)
+    {
+	// a row at a time
+	d = ay - ax/2;
+	left = ax/2 + 1;
+	while (left > 0)
+	{
+	    // the run ends at the first pixel where d >= 0
+	    run = left;
+	    if (ay)
+		for (run=1; d<0 && run<left; run++)
+		    d += ay;
+
+	    memset(fb + y*f_w + (sx > 0 ? x : x-run+1), color, run);
+
+	    left -= run;
+	    x += run*sx;
+	    y += sy;
+	    d += ay - ax;
+	}
+    }
+    else if (ax > ay)
     {
 	d = ay - ax/2;
 	while (1)
@@ -1036,6 +1231,31 @@ AM_drawFline
 	    d += ay;
 	}
     }
+    else if (ay >= 4*ax)
+    {
+	// a column at a time
+	d = ax - ay/2;
+	left = ay/2 + 1;
+	while (left > 0)
+	{
+	    run = left;
+	    if (ax)
+		for (run=1; d<0 && run<left; run++)
+		    d += ax;
+
+	    dest = fb + (sy > 0 ? y : y-run+1)*f_w + x;
+	    left -= run;
+	    y += run*sy;
+	    x += sx;
+	    d += ax - ay;
+
+	    while (run--)
+	    {
+		*dest = color;
+		dest += f_w;
+	    }
+	}
+    }
     else
     {
 	d = ax - ay/2;
@@ -1117,57 +1337,115 @@ void AM_drawGrid(int color)
 }
 
 //
-// Determines visible lines, draws them.
-// This is LineDef based, not LineSeg based.
+// Draws one line in the color for its kind, if it should be seen.
 //
-void AM_drawWalls(void)
+static void AM_drawWall(line_t* line)
 {
-    int i;
     static mline_t l;
 
-    for (i=0;i<numlines;i++)
+    l.a.x = line->v1->x;
+    l.a.y = line->v1->y;
+    l.b.x = line->v2->x;
+    l.b.y = line->v2->y;
+    if (cheating || (line->flags & ML_MAPPED))
     {
-	l.a.x = lines[i].v1->x;
-	l.a.y = lines[i].v1->y;
-	l.b.x = lines[i].v2->x;
-	l.b.y = lines[i].v2->y;
-	if (cheating || (lines[i].flags & ML_MAPPED))
+	if ((line->flags & LINE_NEVERSEE) && !cheating)
+	    return;
+	if (!line->backsector)
 	{
-	    if ((lines[i].flags & LINE_NEVERSEE) && !cheating)
-		continue;
-	    if (!lines[i].backsector)
+	    AM_drawMline(&l, WALLCOLORS+lightlev);
+	}
+	else
+	{
+	    if (line->special == 39)
+	    { // teleporters
+		AM_drawMline(&l, WALLCOLORS+WALLRANGE/2);
+	    }
+	    else if (line->flags & ML_SECRET) // secret door
 	    {
-		AM_drawMline(&l, WALLCOLORS+lightlev);
+		if (cheating) AM_drawMline(&l, SECRETWALLCOLORS + lightlev);
+		else AM_drawMline(&l, WALLCOLORS+lightlev);
 	    }
-	    else
+	    else if (line->backsector->floorheight
+		       != line->frontsector->floorheight) {
+		AM_drawMline(&l, FDWALLCOLORS + lightlev); // floor level change
+	    }
+	    else if (line->backsector->ceilingheight
+		       != line->frontsector->ceilingheight) {
+		AM_drawMline(&l, CDWALLCOLORS+lightlev); // ceiling level change
+	    }
+	    else if (cheating) {
+		AM_drawMline(&l, TSWALLCOLORS+lightlev);
+	    }
+	}
+    }
+    else if (plr->powers[pw_allmap])
+    {
+	if (!(line->flags & LINE_NEVERSEE)) AM_drawMline(&l, GRAYS+3);
+    }
+}
+
+static int AM_compareLines(const void* a, const void* b)
+{
+    return *(const int*) a - *(const int*) b;
+}
+
+//
+// Determines visible lines, draws them.
+// This is LineDef based, not LineSeg based.
+//
+// Only the lines listed in the index blocks under the window are
+// looked at.  They are drawn in line order all the same, so that
+// where lines cross, the same one ends up on top.
+//
+void AM_drawWalls(void)
+{
+    int		i;
+    int		x;
+    int		y;
+    int		b;
+    int		count;
+    int		range[4];
+
+    AM_blockRange(m_x, m_y, m_x2, m_y2, range);
+
+    // the whole map is in view
+    if (range[0] == 0 && range[1] == 0
+	&& range[2] == am_blockwidth - 1 && range[3] == am_blockheight - 1)
+    {
+	for (i=0;i<numlines;i++)
+	    AM_drawWall(&lines[i]);
+
+	statlines += numlines;
+	return;
+    }
+
+    am_checkcount++;
+    count = 0;
+
+    for (y=range[1];y<=range[3];y++)
+    {
+	for (x=range[0];x<=range[2];x++)
+	{
+	    b = y*am_blockwidth+x;
+
+	    for (i=am_blockstart[b];i<am_blockstart[b+1];i++)
 	    {
-		if (lines[i].special == 39)
-		{ // teleporters
-		    AM_drawMline(&l, WALLCOLORS+WALLRANGE/2);
-		}
-		else if (lines[i].flags & ML_SECRET) // secret door
+		if (am_linecheck[am_blocklines[i]] != am_checkcount)
 		{
-		    if (cheating) AM_drawMline(&l, SECRETWALLCOLORS + lightlev);
-		    else AM_drawMline(&l, WALLCOLORS+lightlev);
-		}
-		else if (lines[i].backsector->floorheight
-			   != lines[i].frontsector->floorheight) {
-		    AM_drawMline(&l, FDWALLCOLORS + lightlev); // floor level change
-		}
-		else if (lines[i].backsector->ceilingheight
-			   != lines[i].frontsector->ceilingheight) {
-		    AM_drawMline(&l, CDWALLCOLORS+lightlev); // ceiling level change
-		}
-		else if (cheating) {
-		    AM_drawMline(&l, TSWALLCOLORS+lightlev);
+		    am_linecheck[am_blocklines[i]] = am_checkcount;
+		    am_visiblelines[count++] = am_blocklines[i];
 		}
 	    }
 	}
-	else if (plr->powers[pw_allmap])
-	{
-	    if (!(lines[i].flags & LINE_NEVERSEE)) AM_drawMline(&l, GRAYS+3);
-	}
     }
+
+    qsort(am_visiblelines, count, sizeof(*am_visiblelines), AM_compareLines);
+
+    for (i=0;i<count;i++)
+	AM_drawWall(&lines[am_visiblelines[i]]);
+
+    statlines += count;
 }
 
 
@@ -1337,8 +1615,12 @@ void AM_drawCrosshair(int color)
 
 void AM_Drawer (void)
 {
+    uint64_t	starttime;
+
     if (!automapactive) return;
 
+    starttime = renderstats ? I_GetTimeUS() : 0;
+
     AM_clearFB(BACKGROUND);
     if (grid)
 	AM_drawGrid(GRIDCOLORS);
@@ -1352,4 +1634,13 @@ void AM_Drawer (void)
 
     V_MarkRect(f_x, f_y, f_w, f_h);
 
+    if (renderstats)
+    {
+	starttime = I_GetTimeUS() - starttime;
+	stattime += starttime;
+	if (starttime > stattimemax)
+	    stattimemax = starttime;
+	statframes++;
+    }
+
 }
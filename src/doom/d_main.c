@@ -67,6 +67,7 @@
 #include "am_map.h"
 #include "net_client.h"
 #include "net_dedicated.h"
+#include "net_fake.h"
 #include "net_query.h"
 
 #include "p_setup.h"
@@ -168,6 +169,12 @@ extern  boolean setsizeneeded;
 extern  int             showMessages;
 void R_ExecuteSetViewSize (void);
 
+// Time spent drawing the status bar, heads-up and intermission
+// screens, for -renderstats.
+static unsigned int	statuiframes;
+static uint64_t		statuitime;
+static uint64_t		statuitimemax;
+
 void D_Display (void)
 {
     static  boolean		viewactivestate = false;
@@ -183,6 +190,10 @@ void D_Display (void)
     boolean			done;
     boolean			wipe;
     boolean			redrawsbar;
+    uint64_t			wipetime;
+    uint64_t			sleeptime;
+    uint64_t			sleepstart;
+    uint64_t			uitime;
 
     if (nodrawers)
 	return;                    // for comparative timing / profiling
@@ -206,8 +217,18 @@ void D_Display (void)
     else
 	wipe = false;
 
+    // added up around each of the status bar, heads-up and
+    // intermission drawers
+    uitime = 0;
+
+    if (renderstats)
+	uitime -= I_GetTimeUS ();
+
     if (gamestate == GS_LEVEL && gametic)
 	HU_Erase();
+
+    if (renderstats)
+	uitime += I_GetTimeUS ();
     
     // do buffered drawing
     switch (gamestate)
@@ -221,12 +242,20 @@ void D_Display (void)
 	    redrawsbar = true;
 	if (inhelpscreensstate && !inhelpscreens)
 	    redrawsbar = true;              // just put away the help screen
+	if (renderstats)
+	    uitime -= I_GetTimeUS ();
 	ST_Drawer (viewheight == SCREENHEIGHT, redrawsbar );
+	if (renderstats)
+	    uitime += I_GetTimeUS ();
 	fullscreen = viewheight == SCREENHEIGHT;
 	break;
 
       case GS_INTERMISSION:
+	if (renderstats)
+	    uitime -= I_GetTimeUS ();
 	WI_Drawer ();
+	if (renderstats)
+	    uitime += I_GetTimeUS ();
 	break;
 
       case GS_FINALE:
@@ -243,10 +272,25 @@ void D_Display (void)
     
     // draw the view directly
     if (gamestate == GS_LEVEL && !automapactive && gametic)
-	R_RenderPlayerView (&players[displayplayer]);
+	R_RenderPlayerView (&defaultcontext, &players[displayplayer]);
 
     if (gamestate == GS_LEVEL && gametic)
+    {
+	if (renderstats)
+	    uitime -= I_GetTimeUS ();
 	HU_Drawer ();
+	if (renderstats)
+	    uitime += I_GetTimeUS ();
+    }
+
+    if (renderstats
+     && (gamestate == GS_LEVEL || gamestate == GS_INTERMISSION))
+    {
+	statuitime += uitime;
+	if (uitime > statuitimemax)
+	    statuitimemax = uitime;
+	statuiframes++;
+    }
     
     // clean up border stuff
     if (gamestate != oldgamestate && gamestate != GS_LEVEL)
@@ -312,15 +356,18 @@ void D_Display (void)
     wipe_EndScreen(0, 0, SCREENWIDTH, SCREENHEIGHT);
 
     wipestart = I_GetTime () - 1;
+    wipetime = I_GetTimeUS ();
+    sleeptime = 0;
 
     do
     {
-	do
-	{
-	    nowtime = I_GetTime ();
-	    tics = nowtime - wipestart;
-            I_Sleep(1);
-	} while (tics <= 0);
+	// sleep until at least one tic has passed
+	sleepstart = I_GetTimeUS ();
+	I_SleepUntilTic (wipestart + 1);
+	sleeptime += I_GetTimeUS () - sleepstart;
+
+	nowtime = I_GetTime ();
+	tics = nowtime - wipestart;
         
 	wipestart = nowtime;
 	done = wipe_ScreenWipe(wipe_Melt
@@ -329,6 +376,31 @@ void D_Display (void)
 	M_Drawer ();                            // menu is drawn even on top of wipes
 	I_FinishUpdate ();                      // page flip or blit buffer
     } while (!done);
+
+    if (renderstats)
+    {
+	wipetime = I_GetTimeUS () - wipetime;
+	printf ("D_Display: wipe took %.1f ms, %.1f%% of it busy\n",
+		wipetime / 1000.0,
+		wipetime ? 100.0 * (wipetime - sleeptime) / wipetime : 0.0);
+    }
+}
+
+//
+// D_PrintUIStats
+// Prints the -renderstats totals for the status bar, heads-up and
+// intermission screens.
+//
+void D_PrintUIStats (void)
+{
+    if (!renderstats || statuiframes == 0)
+	return;
+
+    printf ("D_PrintUIStats: %u frames, %.3f us/frame drawing the "
+	    "status bar, heads-up and intermission (max %.3f)\n",
+	    statuiframes,
+	    (double) statuitime / statuiframes,
+	    (double) statuitimemax);
 }
 
 //
@@ -430,6 +502,7 @@ void D_DoomLoop (void)
     I_SetWindowTitle(gamedescription);
     I_GraphicsCheckCommandLine();
     I_SetGrabMouseCallback(D_GrabMouseCallback);
+    I_UseDirtyBox();
     I_InitGraphics();
     V_EnableLoadingDisk(SCREENWIDTH - LOADING_DISK_W, SCREENHEIGHT - LOADING_DISK_H);
 
@@ -1245,6 +1318,24 @@ void D_DoomMain (void)
         exit(0);
     }
 
+    //!
+    // @arg <n>
+    // @category net
+    //
+    // Benchmark searching for servers: query a simulated master server
+    // listing n simulated servers, and print the time taken to receive
+    // the first response and to complete the search.
+    //
+
+    p = M_CheckParmWithArgs("-searchbench", 1);
+
+    if (p)
+    {
+        NET_Fake_Init(atoi(myargv[p+1]));
+        NET_SearchBenchmark(&net_fake_module, NET_FAKE_MASTER_ADDRESS);
+        exit(0);
+    }
+
     //!
     // @arg <address>
     // @category net
@@ -38,6 +38,10 @@ void D_PageDrawer (void);
 void D_AdvanceDemo (void);
 void D_DoAdvanceDemo (void);
 void D_StartTitle (void);
+
+// Print the -renderstats totals for the status bar, heads-up and
+// intermission screens.
+void D_PrintUIStats (void);
  
 //
 // GLOBAL VARIABLES
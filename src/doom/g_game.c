@@ -2241,6 +2241,11 @@ boolean G_CheckDemoStatus (void)
         timingdemo = false;
         demoplayback = false;
 
+        R_PrintFrameHash ();
+        R_PrintPlaneStats ();
+        R_PrintSpriteStats ();
+        D_PrintUIStats ();
+
 	I_Error ("timed %i gametics in %i realtics (%f fps)",
                  gametic, realtics, fps);
     } 
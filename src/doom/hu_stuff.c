@@ -31,6 +31,7 @@
 #include "hu_lib.h"
 #include "m_controls.h"
 #include "m_misc.h"
+#include "v_video.h"
 #include "w_wad.h"
 
 #include "s_sound.h"
@@ -350,6 +351,7 @@ void HU_Init(void)
     {
 	DEH_snprintf(buffer, 9, "STCFN%.3d", j++);
 	hu_font[i] = (patch_t *) W_CacheLumpName(buffer, PU_STATIC);
+	V_CachePatch(hu_font[i]);
     }
 
 }
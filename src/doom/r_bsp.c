@@ -37,19 +37,10 @@
 
 
 
-seg_t*		curline;
-side_t*		sidedef;
-line_t*		linedef;
-sector_t*	frontsector;
-sector_t*	backsector;
-
-drawseg_t	drawsegs[MAXDRAWSEGS];
-drawseg_t*	ds_p;
-
-
 void
 R_StoreWallRange
-( int	start,
+( rcontext_t*	rc,
+  int	start,
   int	stop );
 
 
@@ -58,9 +49,9 @@ R_StoreWallRange
 //
 // R_ClearDrawSegs
 //
-void R_ClearDrawSegs (void)
+void R_ClearDrawSegs (rcontext_t* rc)
 {
-    ds_p = drawsegs;
+    rc->ds_p = rc->drawsegs;
 }
 
 
@@ -69,21 +60,8 @@ void R_ClearDrawSegs (void)
 // ClipWallSegment
 // Clips the given range of columns
 // and includes it in the new clip list.
+// The clip list is rc->solidsegs, up to rc->newend.
 //
-typedef	struct
-{
-    int	first;
-    int last;
-    
-} cliprange_t;
-
-
-#define MAXSEGS		32
-
-// newend is one past the last valid seg
-cliprange_t*	newend;
-cliprange_t	solidsegs[MAXSEGS];
-
 
 
 
@@ -95,7 +73,8 @@ cliprange_t	solidsegs[MAXSEGS];
 // 
 void
 R_ClipSolidWallSegment
-( int			first,
+( rcontext_t*		rc,
+  int			first,
   int			last )
 {
     cliprange_t*	next;
@@ -103,7 +82,7 @@ R_ClipSolidWallSegment
 
     // Find the first range that touches the range
     //  (adjacent pixels are touching).
-    start = solidsegs;
+    start = rc->solidsegs;
     while (start->last < first-1)
 	start++;
 
@@ -113,9 +92,9 @@ R_ClipSolidWallSegment
 	{
 	    // Post is entirely visible (above start),
 	    //  so insert a new clippost.
-	    R_StoreWallRange (first, last);
-	    next = newend;
-	    newend++;
+	    R_StoreWallRange (rc, first, last);
+	    next = rc->newend;
+	    rc->newend++;
 	    
 	    while (next != start)
 	    {
@@ -128,7 +107,7 @@ R_ClipSolidWallSegment
 	}
 		
 	// There is a fragment above *start.
-	R_StoreWallRange (first, start->first - 1);
+	R_StoreWallRange (rc, first, start->first - 1);
 	// Now adjust the clip size.
 	start->first = first;	
     }
@@ -141,7 +120,7 @@ R_ClipSolidWallSegment
     while (last >= (next+1)->first-1)
     {
 	// There is a fragment between two posts.
-	R_StoreWallRange (next->last + 1, (next+1)->first - 1);
+	R_StoreWallRange (rc, next->last + 1, (next+1)->first - 1);
 	next++;
 	
 	if (last <= next->last)
@@ -154,7 +133,7 @@ R_ClipSolidWallSegment
     }
 	
     // There is a fragment after *next.
-    R_StoreWallRange (next->last + 1, last);
+    R_StoreWallRange (rc, next->last + 1, last);
     // Adjust the clip size.
     start->last = last;
 	
@@ -168,13 +147,13 @@ R_ClipSolidWallSegment
     }
     
 
-    while (next++ != newend)
+    while (next++ != rc->newend)
     {
 	// Remove a post.
 	*++start = *next;
     }
 
-    newend = start+1;
+    rc->newend = start+1;
 }
 
 
@@ -188,14 +167,15 @@ R_ClipSolidWallSegment
 //
 void
 R_ClipPassWallSegment
-( int	first,
+( rcontext_t*	rc,
+  int	first,
   int	last )
 {
     cliprange_t*	start;
 
     // Find the first range that touches the range
     //  (adjacent pixels are touching).
-    start = solidsegs;
+    start = rc->solidsegs;
     while (start->last < first-1)
 	start++;
 
@@ -204,12 +184,12 @@ R_ClipPassWallSegment
 	if (last < start->first-1)
 	{
 	    // Post is entirely visible (above start).
-	    R_StoreWallRange (first, last);
+	    R_StoreWallRange (rc, first, last);
 	    return;
 	}
 		
 	// There is a fragment above *start.
-	R_StoreWallRange (first, start->first - 1);
+	R_StoreWallRange (rc, first, start->first - 1);
     }
 
     // Bottom contained in start?
@@ -219,7 +199,7 @@ R_ClipPassWallSegment
     while (last >= (start+1)->first-1)
     {
 	// There is a fragment between two posts.
-	R_StoreWallRange (start->last + 1, (start+1)->first - 1);
+	R_StoreWallRange (rc, start->last + 1, (start+1)->first - 1);
 	start++;
 	
 	if (last <= start->last)
@@ -227,7 +207,7 @@ R_ClipPassWallSegment
     }
 	
     // There is a fragment after *next.
-    R_StoreWallRange (start->last + 1, last);
+    R_StoreWallRange (rc, start->last + 1, last);
 }
 
 
@@ -235,13 +215,13 @@ R_ClipPassWallSegment
 //
 // R_ClearClipSegs
 //
-void R_ClearClipSegs (void)
+void R_ClearClipSegs (rcontext_t* rc)
 {
-    solidsegs[0].first = -0x7fffffff;
-    solidsegs[0].last = -1;
-    solidsegs[1].first = viewwidth;
-    solidsegs[1].last = 0x7fffffff;
-    newend = solidsegs+2;
+    rc->solidsegs[0].first = -0x7fffffff;
+    rc->solidsegs[0].last = -1;
+    rc->solidsegs[1].first = viewwidth;
+    rc->solidsegs[1].last = 0x7fffffff;
+    rc->newend = rc->solidsegs+2;
 }
 
 //
@@ -249,7 +229,7 @@ void R_ClearClipSegs (void)
 // Clips the given segment
 // and adds any visible pieces to the line list.
 //
-void R_AddLine (seg_t*	line)
+void R_AddLine (rcontext_t* rc, seg_t* line)
 {
     int			x1;
     int			x2;
@@ -258,11 +238,11 @@ void R_AddLine (seg_t*	line)
     angle_t		span;
     angle_t		tspan;
     
-    curline = line;
+    rc->curline = line;
 
     // OPTIMIZE: quickly reject orthogonal back sides.
-    angle1 = R_PointToAngle (line->v1->x, line->v1->y);
-    angle2 = R_PointToAngle (line->v2->x, line->v2->y);
+    angle1 = R_PointToAngle (rc, line->v1->x, line->v1->y);
+    angle2 = R_PointToAngle (rc, line->v2->x, line->v2->y);
     
     // Clip to view edges.
     // OPTIMIZE: make constant out of 2*clipangle (FIELDOFVIEW).
@@ -273,9 +253,9 @@ void R_AddLine (seg_t*	line)
 	return;		
 
     // Global angle needed by segcalc.
-    rw_angle1 = angle1;
-    angle1 -= viewangle;
-    angle2 -= viewangle;
+    rc->rw_angle1 = angle1;
+    angle1 -= rc->viewangle;
+    angle2 -= rc->viewangle;
 	
     tspan = angle1 + clipangle;
     if (tspan > 2*clipangle)
@@ -310,20 +290,20 @@ void R_AddLine (seg_t*	line)
     if (x1 == x2)
 	return;				
 	
-    backsector = line->backsector;
+    rc->backsector = line->backsector;
 
     // Single sided line?
-    if (!backsector)
+    if (!rc->backsector)
 	goto clipsolid;		
 
     // Closed door.
-    if (backsector->ceilingheight <= frontsector->floorheight
-	|| backsector->floorheight >= frontsector->ceilingheight)
+    if (rc->backsector->ceilingheight <= rc->frontsector->floorheight
+	|| rc->backsector->floorheight >= rc->frontsector->ceilingheight)
 	goto clipsolid;		
 
     // Window.
-    if (backsector->ceilingheight != frontsector->ceilingheight
-	|| backsector->floorheight != frontsector->floorheight)
+    if (rc->backsector->ceilingheight != rc->frontsector->ceilingheight
+	|| rc->backsector->floorheight != rc->frontsector->floorheight)
 	goto clippass;	
 		
     // Reject empty lines used for triggers
@@ -331,21 +311,21 @@ void R_AddLine (seg_t*	line)
     // Identical floor and ceiling on both sides,
     // identical light levels on both sides,
     // and no middle texture.
-    if (backsector->ceilingpic == frontsector->ceilingpic
-	&& backsector->floorpic == frontsector->floorpic
-	&& backsector->lightlevel == frontsector->lightlevel
-	&& curline->sidedef->midtexture == 0)
+    if (rc->backsector->ceilingpic == rc->frontsector->ceilingpic
+	&& rc->backsector->floorpic == rc->frontsector->floorpic
+	&& rc->backsector->lightlevel == rc->frontsector->lightlevel
+	&& rc->curline->sidedef->midtexture == 0)
     {
 	return;
     }
     
 				
   clippass:
-    R_ClipPassWallSegment (x1, x2-1);	
+    R_ClipPassWallSegment (rc, x1, x2-1);	
     return;
 		
   clipsolid:
-    R_ClipSolidWallSegment (x1, x2-1);
+    R_ClipSolidWallSegment (rc, x1, x2-1);
 }
 
 
@@ -371,7 +351,7 @@ int	checkcoord[12][4] =
 };
 
 
-boolean R_CheckBBox (fixed_t*	bspcoord)
+boolean R_CheckBBox (rcontext_t* rc, fixed_t* bspcoord)
 {
     int			boxx;
     int			boxy;
@@ -394,16 +374,16 @@ boolean R_CheckBBox (fixed_t*	bspcoord)
     
     // Find the corners of the box
     // that define the edges from current viewpoint.
-    if (viewx <= bspcoord[BOXLEFT])
+    if (rc->viewx <= bspcoord[BOXLEFT])
 	boxx = 0;
-    else if (viewx < bspcoord[BOXRIGHT])
+    else if (rc->viewx < bspcoord[BOXRIGHT])
 	boxx = 1;
     else
 	boxx = 2;
 		
-    if (viewy >= bspcoord[BOXTOP])
+    if (rc->viewy >= bspcoord[BOXTOP])
 	boxy = 0;
-    else if (viewy > bspcoord[BOXBOTTOM])
+    else if (rc->viewy > bspcoord[BOXBOTTOM])
 	boxy = 1;
     else
 	boxy = 2;
@@ -418,8 +398,8 @@ boolean R_CheckBBox (fixed_t*	bspcoord)
     y2 = bspcoord[checkcoord[boxpos][3]];
     
     // check clip list for an open space
-    angle1 = R_PointToAngle (x1, y1) - viewangle;
-    angle2 = R_PointToAngle (x2, y2) - viewangle;
+    angle1 = R_PointToAngle (rc, x1, y1) - rc->viewangle;
+    angle2 = R_PointToAngle (rc, x2, y2) - rc->viewangle;
 	
     span = angle1 - angle2;
 
@@ -465,7 +445,7 @@ boolean R_CheckBBox (fixed_t*	bspcoord)
 	return false;			
     sx2--;
 	
-    start = solidsegs;
+    start = rc->solidsegs;
     while (start->last < sx2)
 	start++;
     
@@ -487,7 +467,7 @@ boolean R_CheckBBox (fixed_t*	bspcoord)
 // Add sprites of things in sector.
 // Draw one or more line segments.
 //
-void R_Subsector (int num)
+void R_Subsector (rcontext_t* rc, int num)
 {
     int			count;
     seg_t*		line;
@@ -500,36 +480,38 @@ void R_Subsector (int num)
 		 numsubsectors);
 #endif
 
-    sscount++;
+    rc->sscount++;
     sub = &subsectors[num];
-    frontsector = sub->sector;
+    rc->frontsector = sub->sector;
     count = sub->numlines;
     line = &segs[sub->firstline];
 
-    if (frontsector->floorheight < viewz)
+    if (rc->frontsector->floorheight < rc->viewz)
     {
-	floorplane = R_FindPlane (frontsector->floorheight,
-				  frontsector->floorpic,
-				  frontsector->lightlevel);
+	rc->floorplane = R_FindPlane (rc,
+				      rc->frontsector->floorheight,
+				      rc->frontsector->floorpic,
+				      rc->frontsector->lightlevel);
     }
     else
-	floorplane = NULL;
+	rc->floorplane = NULL;
     
-    if (frontsector->ceilingheight > viewz 
-	|| frontsector->ceilingpic == skyflatnum)
+    if (rc->frontsector->ceilingheight > rc->viewz 
+	|| rc->frontsector->ceilingpic == skyflatnum)
     {
-	ceilingplane = R_FindPlane (frontsector->ceilingheight,
-				    frontsector->ceilingpic,
-				    frontsector->lightlevel);
+	rc->ceilingplane = R_FindPlane (rc,
+					rc->frontsector->ceilingheight,
+					rc->frontsector->ceilingpic,
+					rc->frontsector->lightlevel);
     }
     else
-	ceilingplane = NULL;
+	rc->ceilingplane = NULL;
 		
-    R_AddSprites (frontsector);	
+    R_AddSprites (rc, rc->frontsector);	
 
     while (count--)
     {
-	R_AddLine (line);
+	R_AddLine (rc, line);
 	line++;
     }
 }
@@ -542,7 +524,7 @@ void R_Subsector (int num)
 // Renders all subsectors below a given node,
 //  traversing subtree recursively.
 // Just call with BSP root.
-void R_RenderBSPNode (int bspnum)
+void R_RenderBSPNode (rcontext_t* rc, int bspnum)
 {
     node_t*	bsp;
     int		side;
@@ -551,23 +533,23 @@ void R_RenderBSPNode (int bspnum)
     if (bspnum & NF_SUBSECTOR)
     {
 	if (bspnum == -1)			
-	    R_Subsector (0);
+	    R_Subsector (rc, 0);
 	else
-	    R_Subsector (bspnum&(~NF_SUBSECTOR));
+	    R_Subsector (rc, bspnum&(~NF_SUBSECTOR));
 	return;
     }
 		
     bsp = &nodes[bspnum];
     
     // Decide which side the view point is on.
-    side = R_PointOnSide (viewx, viewy, bsp);
+    side = R_PointOnSide (rc->viewx, rc->viewy, bsp);
 
     // Recursively divide front space.
-    R_RenderBSPNode (bsp->children[side]); 
+    R_RenderBSPNode (rc, bsp->children[side]); 
 
     // Possibly divide back space.
-    if (R_CheckBBox (bsp->bbox[side^1]))	
-	R_RenderBSPNode (bsp->children[side^1]);
+    if (R_CheckBBox (rc, bsp->bbox[side^1]))	
+	R_RenderBSPNode (rc, bsp->children[side^1]);
 }
 
 
@@ -392,10 +392,13 @@ R_GetColumn
     ofs = texturecolumnofs[tex][col];
     
     if (lump > 0)
-	return (byte *)W_CacheLumpNum(lump,PU_CACHE)+ofs;
+	return (byte *)R_CacheLumpNum(lump,PU_CACHE)+ofs;
 
     if (!texturecomposite[tex])
+    {
+	R_FlushDrawQueue ();
 	R_GenerateComposite (tex);
+    }
 
     return texturecomposite[tex] + ofs;
 }
@@ -21,10 +21,25 @@
 
 
 
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) \
+ || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPAN_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SPAN_NEON
+#include <arm_neon.h>
+#endif
+
 #include "doomdef.h"
 #include "deh_main.h"
 
+#include "i_swap.h"
 #include "i_system.h"
+#include "i_thread.h"
+#include "m_argv.h"
 #include "z_zone.h"
 #include "w_wad.h"
 
@@ -78,20 +93,145 @@ static byte *background_buffer = NULL;
 //
 // R_DrawColumn
 // Source is the top of the column to scale.
+// The dc_* variables it draws from are in the renderer context.
 //
-lighttable_t*		dc_colormap; 
-int			dc_x; 
-int			dc_yl; 
-int			dc_yh; 
-fixed_t			dc_iscale; 
-fixed_t			dc_texturemid;
-
-// first pixel in a column (possibly virtual) 
-byte*			dc_source;		
 
 // just for profiling 
 int			dccount;
 
+//
+// Draw commands.
+// Each column or span is described by a draw command holding what
+//  was in the dc_* or ds_* variables when it was drawn.  Normally the
+//  command is drawn straight away, or soon after if it is a column
+//  that can be batched (see below).  With -renderthreads, commands are
+//  queued, and R_FlushDrawQueue splits the view into vertical strips
+//  and draws each strip's share of every command on its own thread.
+// Draws in a strip are done in the order they were made, and nothing
+//  reads the framebuffer outside its own column, so the result is the
+//  same as drawing them one by one.
+//
+
+typedef struct drawcmd_s drawcmd_t;
+
+// Draws the part of a command between view columns x1 and x2.
+
+typedef void (*drawcmdfunc_t) (const drawcmd_t *cmd, int x1, int x2);
+
+struct drawcmd_s
+{
+    drawcmdfunc_t	func;
+
+    // Columns covered, x1 == x2 for a column.
+    // A column covers rows y1 to y2, a span is on row y1.
+    int			x1;
+    int			x2;
+    int			y1;
+    int			y2;
+
+    lighttable_t*	colormap;
+    byte*		source;
+    byte*		translation;
+
+    // Columns.
+    fixed_t		iscale;
+    fixed_t		texturemid;
+    int			fuzzpos;
+
+    // Spans.
+    fixed_t		xfrac;
+    fixed_t		yfrac;
+    fixed_t		xstep;
+    fixed_t		ystep;
+};
+
+// Number of strips the view is drawn in.  With one, draws are not
+//  queued.
+static int		num_draw_strips = 1;
+
+static drawcmd_t*	draw_queue = NULL;
+static int		draw_queue_len = 0;
+static int		draw_queue_size = 0;
+
+static drawcmd_t	immediate_cmd;
+
+static drawcmd_t *NewDrawCmd (drawcmdfunc_t func)
+{
+    drawcmd_t *cmd;
+
+    if (num_draw_strips <= 1)
+    {
+        cmd = &immediate_cmd;
+    }
+    else
+    {
+        // Not zone memory: allocating from the zone could purge
+        // lumps that queued commands are still to draw from.
+
+        if (draw_queue_len >= draw_queue_size)
+        {
+            if (draw_queue_size == 0)
+                draw_queue_size = 4096;
+            else
+                draw_queue_size *= 2;
+
+            draw_queue = realloc(draw_queue,
+                                 draw_queue_size * sizeof(*draw_queue));
+
+            if (draw_queue == NULL)
+            {
+                I_Error("NewDrawCmd: Failed to grow draw queue to %i",
+                        draw_queue_size);
+            }
+        }
+
+        cmd = &draw_queue[draw_queue_len];
+        ++draw_queue_len;
+    }
+
+    cmd->func = func;
+
+    return cmd;
+}
+
+static void RunDrawCmd (drawcmd_t *cmd);
+
+static void SubmitColumn (rcontext_t* rc, drawcmdfunc_t func)
+{
+    drawcmd_t *cmd;
+
+    cmd = NewDrawCmd(func);
+    cmd->x1 = rc->dc_x;
+    cmd->x2 = rc->dc_x;
+    cmd->y1 = rc->dc_yl;
+    cmd->y2 = rc->dc_yh;
+    cmd->colormap = rc->dc_colormap;
+    cmd->source = rc->dc_source;
+    cmd->translation = rc->dc_translation;
+    cmd->iscale = rc->dc_iscale;
+    cmd->texturemid = rc->dc_texturemid;
+
+    RunDrawCmd(cmd);
+}
+
+static void SubmitSpan (rcontext_t* rc, drawcmdfunc_t func)
+{
+    drawcmd_t *cmd;
+
+    cmd = NewDrawCmd(func);
+    cmd->x1 = rc->ds_x1;
+    cmd->x2 = rc->ds_x2;
+    cmd->y1 = rc->ds_y;
+    cmd->colormap = rc->ds_colormap;
+    cmd->source = rc->ds_source;
+    cmd->xfrac = rc->ds_xfrac;
+    cmd->yfrac = rc->ds_yfrac;
+    cmd->xstep = rc->ds_xstep;
+    cmd->ystep = rc->ds_ystep;
+
+    RunDrawCmd(cmd);
+}
+
 //
 // A column is a vertical slice/span from a wall texture that,
 //  given the DOOM style restrictions on the view orientation,
@@ -99,35 +239,40 @@ int			dccount;
 // Thus a special case loop for very fast rendering can
 //  be used. It has also been used with Wolfenstein 3D.
 // 
-void R_DrawColumn (void) 
+static void DrawColumn (const drawcmd_t *cmd, int x1, int x2)
 { 
     int			count; 
     byte*		dest; 
     fixed_t		frac;
     fixed_t		fracstep;	 
+    lighttable_t*	colormap;
+    byte*		source;
  
-    count = dc_yh - dc_yl; 
+    count = cmd->y2 - cmd->y1;
 
     // Zero length, column does not exceed a pixel.
     if (count < 0) 
 	return; 
 				 
 #ifdef RANGECHECK 
-    if ((unsigned)dc_x >= SCREENWIDTH
-	|| dc_yl < 0
-	|| dc_yh >= SCREENHEIGHT) 
-	I_Error ("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x); 
+    if ((unsigned)x1 >= SCREENWIDTH
+	|| cmd->y1 < 0
+	|| cmd->y2 >= SCREENHEIGHT)
+	I_Error ("R_DrawColumn: %i to %i at %i", cmd->y1, cmd->y2, x1);
 #endif 
 
     // Framebuffer destination address.
     // Use ylookup LUT to avoid multiply with ScreenWidth.
     // Use columnofs LUT for subwindows? 
-    dest = ylookup[dc_yl] + columnofs[dc_x];  
+    dest = ylookup[cmd->y1] + columnofs[x1];
 
     // Determine scaling,
     //  which is the only mapping to be done.
-    fracstep = dc_iscale; 
-    frac = dc_texturemid + (dc_yl-centery)*fracstep; 
+    fracstep = cmd->iscale;
+    frac = cmd->texturemid + (cmd->y1-centery)*fracstep;
+
+    colormap = cmd->colormap;
+    source = cmd->source;
 
     // Inner loop that does the actual texture mapping,
     //  e.g. a DDA-lile scaling.
@@ -136,12 +281,17 @@ void R_DrawColumn (void)
     {
 	// Re-map color indices from wall texture column
 	//  using a lighting/special effects LUT.
-	*dest = dc_colormap[dc_source[(frac>>FRACBITS)&127]];
+	*dest = colormap[source[(frac>>FRACBITS)&127]];
 	
 	dest += SCREENWIDTH; 
 	frac += fracstep;
 	
     } while (count--); 
+}
+
+void R_DrawColumn (rcontext_t* rc)
+{
+    SubmitColumn(rc, DrawColumn);
 } 
 
 
@@ -205,7 +355,7 @@ void R_DrawColumn (void)
 #endif
 
 
-void R_DrawColumnLow (void) 
+static void DrawColumnLow (const drawcmd_t *cmd, int x1, int x2)
 { 
     int			count; 
     byte*		dest; 
@@ -213,36 +363,41 @@ void R_DrawColumnLow (void)
     fixed_t		frac;
     fixed_t		fracstep;	 
     int                 x;
+    lighttable_t*	colormap;
+    byte*		source;
  
-    count = dc_yh - dc_yl; 
+    count = cmd->y2 - cmd->y1;
 
     // Zero length.
     if (count < 0) 
 	return; 
 				 
 #ifdef RANGECHECK 
-    if ((unsigned)dc_x >= SCREENWIDTH
-	|| dc_yl < 0
-	|| dc_yh >= SCREENHEIGHT)
+    if ((unsigned)x1 >= SCREENWIDTH
+	|| cmd->y1 < 0
+	|| cmd->y2 >= SCREENHEIGHT)
     {
 	
-	I_Error ("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+	I_Error ("R_DrawColumn: %i to %i at %i", cmd->y1, cmd->y2, x1);
     }
     //	dccount++; 
 #endif 
     // Blocky mode, need to multiply by 2.
-    x = dc_x << 1;
+    x = x1 << 1;
     
-    dest = ylookup[dc_yl] + columnofs[x];
-    dest2 = ylookup[dc_yl] + columnofs[x+1];
+    dest = ylookup[cmd->y1] + columnofs[x];
+    dest2 = ylookup[cmd->y1] + columnofs[x+1];
     
-    fracstep = dc_iscale; 
-    frac = dc_texturemid + (dc_yl-centery)*fracstep;
+    fracstep = cmd->iscale;
+    frac = cmd->texturemid + (cmd->y1-centery)*fracstep;
+
+    colormap = cmd->colormap;
+    source = cmd->source;
     
     do 
     {
 	// Hack. Does not work corretly.
-	*dest2 = *dest = dc_colormap[dc_source[(frac>>FRACBITS)&127]];
+	*dest2 = *dest = colormap[source[(frac>>FRACBITS)&127]];
 	dest += SCREENWIDTH;
 	dest2 += SCREENWIDTH;
 	frac += fracstep; 
@@ -250,6 +405,11 @@ void R_DrawColumnLow (void)
     } while (count--);
 }
 
+void R_DrawColumnLow (rcontext_t* rc)
+{
+    SubmitColumn(rc, DrawColumnLow);
+}
+
 
 //
 // Spectre/Invisibility.
@@ -269,52 +429,80 @@ int	fuzzoffset[FUZZTABLE] =
     FUZZOFF,FUZZOFF,-FUZZOFF,FUZZOFF,FUZZOFF,-FUZZOFF,FUZZOFF 
 }; 
 
-int	fuzzpos = 0; 
-
 
 //
-// Framebuffer postprocessing.
-// Creates a fuzzy image by copying pixels
-//  from adjacent ones to left and right.
-// Used with an all black colormap, this
-//  could create the SHADOW effect,
-//  i.e. spectres and invisible players.
+// Fuzz columns carry on through the fuzz table from where the last
+//  one left off.  So that they can be drawn in any order, each column
+//  is given its starting position, and fuzzpos is moved on past it.
 //
-void R_DrawFuzzColumn (void) 
+static void SubmitFuzzColumn (rcontext_t* rc, drawcmdfunc_t func)
 { 
+    drawcmd_t*		cmd;
     int			count; 
-    byte*		dest; 
-    fixed_t		frac;
-    fixed_t		fracstep;	 
 
     // Adjust borders. Low... 
-    if (!dc_yl) 
-	dc_yl = 1;
+    if (!rc->dc_yl) 
+	rc->dc_yl = 1;
 
     // .. and high.
-    if (dc_yh == viewheight-1) 
-	dc_yh = viewheight - 2; 
+    if (rc->dc_yh == viewheight-1) 
+	rc->dc_yh = viewheight - 2; 
 		 
-    count = dc_yh - dc_yl; 
+    count = rc->dc_yh - rc->dc_yl; 
 
     // Zero length.
     if (count < 0) 
 	return; 
 
+    cmd = NewDrawCmd(func);
+    cmd->x1 = rc->dc_x;
+    cmd->x2 = rc->dc_x;
+    cmd->y1 = rc->dc_yl;
+    cmd->y2 = rc->dc_yh;
+    cmd->iscale = rc->dc_iscale;
+    cmd->texturemid = rc->dc_texturemid;
+    cmd->fuzzpos = rc->fuzzpos;
+
+    rc->fuzzpos = (rc->fuzzpos + count + 1) % FUZZTABLE;
+
+    RunDrawCmd(cmd);
+}
+
+
+//
+// Framebuffer postprocessing.
+// Creates a fuzzy image by copying pixels
+//  from adjacent ones to left and right.
+// Used with an all black colormap, this
+//  could create the SHADOW effect,
+//  i.e. spectres and invisible players.
+//
+static void DrawFuzzColumn (const drawcmd_t *cmd, int x1, int x2)
+{
+    int			count;
+    byte*		dest;
+    fixed_t		frac;
+    fixed_t		fracstep;
+    int			pos;
+
+    count = cmd->y2 - cmd->y1;
+
 #ifdef RANGECHECK 
-    if ((unsigned)dc_x >= SCREENWIDTH
-	|| dc_yl < 0 || dc_yh >= SCREENHEIGHT)
+    if ((unsigned)x1 >= SCREENWIDTH
+	|| cmd->y1 < 0 || cmd->y2 >= SCREENHEIGHT)
     {
 	I_Error ("R_DrawFuzzColumn: %i to %i at %i",
-		 dc_yl, dc_yh, dc_x);
+		 cmd->y1, cmd->y2, x1);
     }
 #endif
     
-    dest = ylookup[dc_yl] + columnofs[dc_x];
+    dest = ylookup[cmd->y1] + columnofs[x1];
 
     // Looks familiar.
-    fracstep = dc_iscale; 
-    frac = dc_texturemid + (dc_yl-centery)*fracstep; 
+    fracstep = cmd->iscale;
+    frac = cmd->texturemid + (cmd->y1-centery)*fracstep;
+
+    pos = cmd->fuzzpos;
 
     // Looks like an attempt at dithering,
     //  using the colormap #6 (of 0-31, a bit
@@ -325,11 +513,11 @@ void R_DrawFuzzColumn (void)
 	//  a pixel that is either one column
 	//  left or right of the current one.
 	// Add index from colormap to index.
-	*dest = colormaps[6*256+dest[fuzzoffset[fuzzpos]]]; 
+	*dest = colormaps[6*256+dest[fuzzoffset[pos]]];
 
 	// Clamp table lookup index.
-	if (++fuzzpos == FUZZTABLE) 
-	    fuzzpos = 0;
+	if (++pos == FUZZTABLE)
+	    pos = 0;
 	
 	dest += SCREENWIDTH;
 
@@ -337,9 +525,14 @@ void R_DrawFuzzColumn (void)
     } while (count--); 
 } 
 
+void R_DrawFuzzColumn (rcontext_t* rc)
+{
+    SubmitFuzzColumn(rc, DrawFuzzColumn);
+}
+
 // low detail mode version
  
-void R_DrawFuzzColumnLow (void) 
+static void DrawFuzzColumnLow (const drawcmd_t *cmd, int x1, int x2)
 { 
     int			count; 
     byte*		dest; 
@@ -347,40 +540,31 @@ void R_DrawFuzzColumnLow (void)
     fixed_t		frac;
     fixed_t		fracstep;	 
     int x;
+    int			pos;
 
-    // Adjust borders. Low... 
-    if (!dc_yl) 
-	dc_yl = 1;
-
-    // .. and high.
-    if (dc_yh == viewheight-1) 
-	dc_yh = viewheight - 2; 
-		 
-    count = dc_yh - dc_yl; 
-
-    // Zero length.
-    if (count < 0) 
-	return; 
+    count = cmd->y2 - cmd->y1;
 
     // low detail mode, need to multiply by 2
     
-    x = dc_x << 1;
+    x = x1 << 1;
     
 #ifdef RANGECHECK 
     if ((unsigned)x >= SCREENWIDTH
-	|| dc_yl < 0 || dc_yh >= SCREENHEIGHT)
+	|| cmd->y1 < 0 || cmd->y2 >= SCREENHEIGHT)
     {
 	I_Error ("R_DrawFuzzColumn: %i to %i at %i",
-		 dc_yl, dc_yh, dc_x);
+		 cmd->y1, cmd->y2, x1);
     }
 #endif
     
-    dest = ylookup[dc_yl] + columnofs[x];
-    dest2 = ylookup[dc_yl] + columnofs[x+1];
+    dest = ylookup[cmd->y1] + columnofs[x];
+    dest2 = ylookup[cmd->y1] + columnofs[x+1];
 
     // Looks familiar.
-    fracstep = dc_iscale; 
-    frac = dc_texturemid + (dc_yl-centery)*fracstep; 
+    fracstep = cmd->iscale;
+    frac = cmd->texturemid + (cmd->y1-centery)*fracstep;
+
+    pos = cmd->fuzzpos;
 
     // Looks like an attempt at dithering,
     //  using the colormap #6 (of 0-31, a bit
@@ -391,18 +575,23 @@ void R_DrawFuzzColumnLow (void)
 	//  a pixel that is either one column
 	//  left or right of the current one.
 	// Add index from colormap to index.
-	*dest = colormaps[6*256+dest[fuzzoffset[fuzzpos]]]; 
-	*dest2 = colormaps[6*256+dest2[fuzzoffset[fuzzpos]]]; 
+	*dest = colormaps[6*256+dest[fuzzoffset[pos]]];
+	*dest2 = colormaps[6*256+dest2[fuzzoffset[pos]]];
 
 	// Clamp table lookup index.
-	if (++fuzzpos == FUZZTABLE) 
-	    fuzzpos = 0;
+	if (++pos == FUZZTABLE)
+	    pos = 0;
 	
 	dest += SCREENWIDTH;
 	dest2 += SCREENWIDTH;
 
 	frac += fracstep; 
     } while (count--); 
+}
+
+void R_DrawFuzzColumnLow (rcontext_t* rc)
+{
+    SubmitFuzzColumn(rc, DrawFuzzColumnLow);
 } 
  
   
@@ -418,37 +607,43 @@ void R_DrawFuzzColumnLow (void)
 //  of the BaronOfHell, the HellKnight, uses
 //  identical sprites, kinda brightened up.
 //
-byte*	dc_translation;
 byte*	translationtables;
 
-void R_DrawTranslatedColumn (void) 
+static void DrawTranslatedColumn (const drawcmd_t *cmd, int x1, int x2)
 { 
     int			count; 
     byte*		dest; 
     fixed_t		frac;
     fixed_t		fracstep;	 
+    lighttable_t*	colormap;
+    byte*		translation;
+    byte*		source;
  
-    count = dc_yh - dc_yl; 
+    count = cmd->y2 - cmd->y1;
     if (count < 0) 
 	return; 
 				 
 #ifdef RANGECHECK 
-    if ((unsigned)dc_x >= SCREENWIDTH
-	|| dc_yl < 0
-	|| dc_yh >= SCREENHEIGHT)
+    if ((unsigned)x1 >= SCREENWIDTH
+	|| cmd->y1 < 0
+	|| cmd->y2 >= SCREENHEIGHT)
     {
 	I_Error ( "R_DrawColumn: %i to %i at %i",
-		  dc_yl, dc_yh, dc_x);
+		  cmd->y1, cmd->y2, x1);
     }
     
 #endif 
 
 
-    dest = ylookup[dc_yl] + columnofs[dc_x]; 
+    dest = ylookup[cmd->y1] + columnofs[x1];
 
     // Looks familiar.
-    fracstep = dc_iscale; 
-    frac = dc_texturemid + (dc_yl-centery)*fracstep; 
+    fracstep = cmd->iscale;
+    frac = cmd->texturemid + (cmd->y1-centery)*fracstep;
+
+    colormap = cmd->colormap;
+    translation = cmd->translation;
+    source = cmd->source;
 
     // Here we do an additional index re-mapping.
     do 
@@ -458,14 +653,19 @@ void R_DrawTranslatedColumn (void)
 	//  used with PLAY sprites.
 	// Thus the "green" ramp of the player 0 sprite
 	//  is mapped to gray, red, black/indigo. 
-	*dest = dc_colormap[dc_translation[dc_source[frac>>FRACBITS]]];
+	*dest = colormap[translation[source[frac>>FRACBITS]]];
 	dest += SCREENWIDTH;
 	
 	frac += fracstep; 
     } while (count--); 
 } 
 
-void R_DrawTranslatedColumnLow (void) 
+void R_DrawTranslatedColumn (rcontext_t* rc)
+{
+    SubmitColumn(rc, DrawTranslatedColumn);
+}
+
+static void DrawTranslatedColumnLow (const drawcmd_t *cmd, int x1, int x2)
 { 
     int			count; 
     byte*		dest; 
@@ -473,32 +673,39 @@ void R_DrawTranslatedColumnLow (void)
     fixed_t		frac;
     fixed_t		fracstep;	 
     int                 x;
+    lighttable_t*	colormap;
+    byte*		translation;
+    byte*		source;
  
-    count = dc_yh - dc_yl; 
+    count = cmd->y2 - cmd->y1;
     if (count < 0) 
 	return; 
 
     // low detail, need to scale by 2
-    x = dc_x << 1;
+    x = x1 << 1;
 				 
 #ifdef RANGECHECK 
     if ((unsigned)x >= SCREENWIDTH
-	|| dc_yl < 0
-	|| dc_yh >= SCREENHEIGHT)
+	|| cmd->y1 < 0
+	|| cmd->y2 >= SCREENHEIGHT)
     {
 	I_Error ( "R_DrawColumn: %i to %i at %i",
-		  dc_yl, dc_yh, x);
+		  cmd->y1, cmd->y2, x);
     }
     
 #endif 
 
 
-    dest = ylookup[dc_yl] + columnofs[x]; 
-    dest2 = ylookup[dc_yl] + columnofs[x+1]; 
+    dest = ylookup[cmd->y1] + columnofs[x];
+    dest2 = ylookup[cmd->y1] + columnofs[x+1];
 
     // Looks familiar.
-    fracstep = dc_iscale; 
-    frac = dc_texturemid + (dc_yl-centery)*fracstep; 
+    fracstep = cmd->iscale;
+    frac = cmd->texturemid + (cmd->y1-centery)*fracstep;
+
+    colormap = cmd->colormap;
+    translation = cmd->translation;
+    source = cmd->source;
 
     // Here we do an additional index re-mapping.
     do 
@@ -508,13 +715,18 @@ void R_DrawTranslatedColumnLow (void)
 	//  used with PLAY sprites.
 	// Thus the "green" ramp of the player 0 sprite
 	//  is mapped to gray, red, black/indigo. 
-	*dest = dc_colormap[dc_translation[dc_source[frac>>FRACBITS]]];
-	*dest2 = dc_colormap[dc_translation[dc_source[frac>>FRACBITS]]];
+	*dest = colormap[translation[source[frac>>FRACBITS]]];
+	*dest2 = colormap[translation[source[frac>>FRACBITS]]];
 	dest += SCREENWIDTH;
 	dest2 += SCREENWIDTH;
 	
 	frac += fracstep; 
     } while (count--); 
+}
+
+void R_DrawTranslatedColumnLow (rcontext_t* rc)
+{
+    SubmitColumn(rc, DrawTranslatedColumnLow);
 } 
 
 
@@ -566,76 +778,245 @@ void R_InitTranslationTables (void)
 //  the texture at an angle in all but a few cases.
 // In consequence, flats are not stored by column (like walls),
 //  and the inner loop has to step in texture space u and v.
+// The ds_* variables it draws from are in the renderer context.
 //
-int			ds_y; 
-int			ds_x1; 
-int			ds_x2;
 
-lighttable_t*		ds_colormap; 
+// just for profiling
+int			dscount;
 
-fixed_t			ds_xfrac; 
-fixed_t			ds_yfrac; 
-fixed_t			ds_xstep; 
-fixed_t			ds_ystep;
+// Work out span texture coordinates eight at a time with SSE2 or
+//  NEON, where available.
+boolean			simdspans = true;
 
-// start of a 64*64 tile image 
-byte*			ds_source;	
 
-// just for profiling
-int			dscount;
+//
+// Pack position and step variables into a single 32-bit integer,
+//  with x in the top 16 bits and y in the bottom 16 bits.  For
+//  each 16-bit part, the top 6 bits are the integer part and the
+//  bottom 10 bits are the fractional part of the pixel position.
+//
+#define PACKPOSITION(x, y) \
+    ((((x) << 10) & 0xffff0000) | (((y) >> 6) & 0x0000ffff))
+
+// Index into the 64*64 flat of a packed position.
+#define SPOT(position) \
+    ((((position) >> 4) & 0x0fc0) | ((position) >> 26))
+
+//
+// DrawSpanPixels
+// Draws count pixels of a span, each repeat times, stepping the
+//  packed position along.
+//
+static void DrawSpanPixels_C (byte *dest, int count, int repeat,
+			      unsigned int position, unsigned int step,
+			      lighttable_t *colormap, byte *source)
+{
+    byte	pixel;
+
+    if (repeat == 1)
+    {
+	while (count > 0)
+	{
+	    // Lookup pixel from flat texture tile,
+	    //  re-index using light/colormap.
+	    *dest++ = colormap[source[SPOT(position)]];
+	    position += step;
+	    --count;
+	}
+    }
+    else
+    {
+	while (count > 0)
+	{
+	    // Lowres/blocky mode does it twice,
+	    //  while scale is adjusted appropriately.
+	    pixel = colormap[source[SPOT(position)]];
+	    *dest++ = pixel;
+	    *dest++ = pixel;
+	    position += step;
+	    --count;
+	}
+    }
+}
+
+#if defined(SPAN_SSE2) || defined(SPAN_NEON)
+
+// The positions of the next eight pixels are kept in two vectors,
+//  and the texture indexes of all eight packed into one vector of
+//  16-bit lanes, which are then read out one at a time.
+
+#if defined(SPAN_SSE2)
+
+typedef __m128i spanvec_t;
+typedef __m128i spanspots_t;
+
+#define SPANVEC(a, b, c, d)	_mm_setr_epi32(a, b, c, d)
+#define SPANVEC1(a)		_mm_set1_epi32(a)
+#define SPANADD(a, b)		_mm_add_epi32(a, b)
+#define SPANSPOTS(p0, p1, mask) \
+    _mm_packs_epi32( \
+        _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p0, 4), mask), \
+                     _mm_srli_epi32(p0, 26)), \
+        _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p1, 4), mask), \
+                     _mm_srli_epi32(p1, 26)))
+#define SPANSPOT(spots, n)	_mm_extract_epi16(spots, n)
+#define SPANFIRST(p)		((unsigned int) _mm_cvtsi128_si32(p))
+
+#else
+
+typedef uint32x4_t spanvec_t;
+typedef uint16x8_t spanspots_t;
+
+static spanvec_t SPANVEC(unsigned int a, unsigned int b,
+			 unsigned int c, unsigned int d)
+{
+    uint32_t	v[4];
+
+    v[0] = a;
+    v[1] = b;
+    v[2] = c;
+    v[3] = d;
+
+    return vld1q_u32(v);
+}
+
+#define SPANVEC1(a)		vdupq_n_u32(a)
+#define SPANADD(a, b)		vaddq_u32(a, b)
+#define SPANSPOTS(p0, p1, mask) \
+    vcombine_u16( \
+        vmovn_u32(vorrq_u32(vandq_u32(vshrq_n_u32(p0, 4), mask), \
+                            vshrq_n_u32(p0, 26))), \
+        vmovn_u32(vorrq_u32(vandq_u32(vshrq_n_u32(p1, 4), mask), \
+                            vshrq_n_u32(p1, 26))))
+#define SPANSPOT(spots, n)	vgetq_lane_u16(spots, n)
+#define SPANFIRST(p)		vgetq_lane_u32(p, 0)
+
+#endif
+
+static void DrawSpanPixels_SIMD (byte *dest, int count, int repeat,
+				 unsigned int position, unsigned int step,
+				 lighttable_t *colormap, byte *source)
+{
+    spanvec_t	pos0;
+    spanvec_t	pos1;
+    spanvec_t	step8;
+    spanvec_t	mask;
+    spanspots_t	spots;
+    byte	pixel;
+
+    pos0 = SPANVEC(position, position + step,
+		   position + 2 * step, position + 3 * step);
+    pos1 = SPANADD(pos0, SPANVEC1(4 * step));
+    step8 = SPANVEC1(8 * step);
+    mask = SPANVEC1(0x0fc0);
+
+    if (repeat == 1)
+    {
+	for (; count >= 8; count -= 8)
+	{
+	    spots = SPANSPOTS(pos0, pos1, mask);
+
+	    dest[0] = colormap[source[SPANSPOT(spots, 0)]];
+	    dest[1] = colormap[source[SPANSPOT(spots, 1)]];
+	    dest[2] = colormap[source[SPANSPOT(spots, 2)]];
+	    dest[3] = colormap[source[SPANSPOT(spots, 3)]];
+	    dest[4] = colormap[source[SPANSPOT(spots, 4)]];
+	    dest[5] = colormap[source[SPANSPOT(spots, 5)]];
+	    dest[6] = colormap[source[SPANSPOT(spots, 6)]];
+	    dest[7] = colormap[source[SPANSPOT(spots, 7)]];
+
+	    dest += 8;
+	    pos0 = SPANADD(pos0, step8);
+	    pos1 = SPANADD(pos1, step8);
+	}
+    }
+    else
+    {
+	for (; count >= 8; count -= 8)
+	{
+	    spots = SPANSPOTS(pos0, pos1, mask);
+
+	    pixel = colormap[source[SPANSPOT(spots, 0)]];
+	    dest[0] = dest[1] = pixel;
+	    pixel = colormap[source[SPANSPOT(spots, 1)]];
+	    dest[2] = dest[3] = pixel;
+	    pixel = colormap[source[SPANSPOT(spots, 2)]];
+	    dest[4] = dest[5] = pixel;
+	    pixel = colormap[source[SPANSPOT(spots, 3)]];
+	    dest[6] = dest[7] = pixel;
+	    pixel = colormap[source[SPANSPOT(spots, 4)]];
+	    dest[8] = dest[9] = pixel;
+	    pixel = colormap[source[SPANSPOT(spots, 5)]];
+	    dest[10] = dest[11] = pixel;
+	    pixel = colormap[source[SPANSPOT(spots, 6)]];
+	    dest[12] = dest[13] = pixel;
+	    pixel = colormap[source[SPANSPOT(spots, 7)]];
+	    dest[14] = dest[15] = pixel;
+
+	    dest += 16;
+	    pos0 = SPANADD(pos0, step8);
+	    pos1 = SPANADD(pos1, step8);
+	}
+    }
+
+    // The rest one at a time.
+    DrawSpanPixels_C(dest, count, repeat, SPANFIRST(pos0), step,
+		     colormap, source);
+}
+
+#endif
+
+static void DrawSpanPixels (byte *dest, int count, int repeat,
+			    unsigned int position, unsigned int step,
+			    lighttable_t *colormap, byte *source)
+{
+#if defined(SPAN_SSE2) || defined(SPAN_NEON)
+    if (simdspans)
+    {
+	DrawSpanPixels_SIMD(dest, count, repeat, position, step,
+			    colormap, source);
+	return;
+    }
+#endif
+
+    DrawSpanPixels_C(dest, count, repeat, position, step,
+		     colormap, source);
+}
 
 
 //
 // Draws the actual span.
-void R_DrawSpan (void) 
+static void DrawSpan (const drawcmd_t *cmd, int x1, int x2)
 { 
     unsigned int position, step;
-    byte *dest;
-    int count;
-    int spot;
-    unsigned int xtemp, ytemp;
 
 #ifdef RANGECHECK
-    if (ds_x2 < ds_x1
-	|| ds_x1<0
-	|| ds_x2>=SCREENWIDTH
-	|| (unsigned)ds_y>SCREENHEIGHT)
+    if (cmd->x2 < cmd->x1
+	|| cmd->x1<0
+	|| cmd->x2>=SCREENWIDTH
+	|| (unsigned)cmd->y1>SCREENHEIGHT)
     {
 	I_Error( "R_DrawSpan: %i to %i at %i",
-		 ds_x1,ds_x2,ds_y);
+		 cmd->x1,cmd->x2,cmd->y1);
     }
 //	dscount++;
 #endif
 
-    // Pack position and step variables into a single 32-bit integer,
-    // with x in the top 16 bits and y in the bottom 16 bits.  For
-    // each 16-bit part, the top 6 bits are the integer part and the
-    // bottom 10 bits are the fractional part of the pixel position.
-
-    position = ((ds_xfrac << 10) & 0xffff0000)
-             | ((ds_yfrac >> 6)  & 0x0000ffff);
-    step = ((ds_xstep << 10) & 0xffff0000)
-         | ((ds_ystep >> 6)  & 0x0000ffff);
+    position = PACKPOSITION(cmd->xfrac, cmd->yfrac);
+    step = PACKPOSITION(cmd->xstep, cmd->ystep);
 
-    dest = ylookup[ds_y] + columnofs[ds_x1];
+    // Skip to the first column being drawn.  Adding the step a number
+    // of times wraps the same way as multiplying it.
 
-    // We do not check for zero spans here?
-    count = ds_x2 - ds_x1;
+    position += (unsigned int) (x1 - cmd->x1) * step;
 
-    do
-    {
-	// Calculate current texture index in u,v.
-        ytemp = (position >> 4) & 0x0fc0;
-        xtemp = (position >> 26);
-        spot = xtemp | ytemp;
-
-	// Lookup pixel from flat texture tile,
-	//  re-index using light/colormap.
-	*dest++ = ds_colormap[ds_source[spot]];
-
-        position += step;
+    DrawSpanPixels(ylookup[cmd->y1] + columnofs[x1], x2 - x1 + 1, 1,
+		   position, step, cmd->colormap, cmd->source);
+}
 
-    } while (count--);
+void R_DrawSpan (rcontext_t* rc)
+{
+    SubmitSpan(rc, DrawSpan);
 }
 
 
@@ -716,54 +1097,398 @@ void R_DrawSpan (void)
 //
 // Again..
 //
-void R_DrawSpanLow (void)
+static void DrawSpanLow (const drawcmd_t *cmd, int x1, int x2)
 {
     unsigned int position, step;
-    unsigned int xtemp, ytemp;
-    byte *dest;
-    int count;
-    int spot;
 
 #ifdef RANGECHECK
-    if (ds_x2 < ds_x1
-	|| ds_x1<0
-	|| ds_x2>=SCREENWIDTH
-	|| (unsigned)ds_y>SCREENHEIGHT)
+    if (cmd->x2 < cmd->x1
+	|| cmd->x1<0
+	|| cmd->x2>=SCREENWIDTH
+	|| (unsigned)cmd->y1>SCREENHEIGHT)
     {
 	I_Error( "R_DrawSpan: %i to %i at %i",
-		 ds_x1,ds_x2,ds_y);
+		 cmd->x1,cmd->x2,cmd->y1);
     }
 //	dscount++; 
 #endif
 
-    position = ((ds_xfrac << 10) & 0xffff0000)
-             | ((ds_yfrac >> 6)  & 0x0000ffff);
-    step = ((ds_xstep << 10) & 0xffff0000)
-         | ((ds_ystep >> 6)  & 0x0000ffff);
+    position = PACKPOSITION(cmd->xfrac, cmd->yfrac);
+    step = PACKPOSITION(cmd->xstep, cmd->ystep);
 
-    count = (ds_x2 - ds_x1);
+    position += (unsigned int) (x1 - cmd->x1) * step;
 
     // Blocky mode, need to multiply by 2.
-    ds_x1 <<= 1;
-    ds_x2 <<= 1;
+    DrawSpanPixels(ylookup[cmd->y1] + columnofs[x1 << 1], x2 - x1 + 1, 2,
+		   position, step, cmd->colormap, cmd->source);
+}
+
+void R_DrawSpanLow (rcontext_t* rc)
+{
+    SubmitSpan(rc, DrawSpanLow);
+}
 
-    dest = ylookup[ds_y] + columnofs[ds_x1];
+//
+// Column batches.
+// Drawing a column touches a new cache line for every pixel.  So
+//  plain columns are held back in a batch covering four framebuffer
+//  columns next to each other, until a draw falls outside it, and
+//  then drawn together, writing each row as one 32-bit word.
+// A wall with upper and lower textures draws two columns at each x,
+//  so each x has a few slots, and the n-th column at each x is drawn
+//  along with the n-th of the others.  Plain columns do not read the
+//  framebuffer, so only the order of draws within each column
+//  matters, and that is kept.  Any other draw first draws what is
+//  held back.
+//
+
+#define BATCHWIDTH		4
+#define BATCHDEPTH		4
+
+// Four pixels, left to right, as they are laid out in memory.
+// SYS_BIG_ENDIAN from i_swap.h is not reliable, so ask SDL directly.
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+#define QUAD(a, b, c, d) \
+    (((uint32_t) (a) << 24) | ((b) << 16) | ((c) << 8) | (d))
+#else
+#define QUAD(a, b, c, d) \
+    ((a) | ((b) << 8) | ((c) << 16) | ((uint32_t) (d) << 24))
+#endif
+
+typedef struct
+{
+    drawcmd_t		cmds[BATCHWIDTH][BATCHDEPTH];
+    int			depth[BATCHWIDTH];
+
+    // Draw function and view column of the first slot.  func is
+    //  NULL when the batch is empty.
+    drawcmdfunc_t	func;
+    int			x;
+} colbatch_t;
+
+static colbatch_t	immediate_batch;
+
+// Number of view columns in a batch drawn by func, or zero if its
+//  draws are not batched.
+static int BatchWidth (drawcmdfunc_t func)
+{
+    if (func == DrawColumn)
+	return BATCHWIDTH;
+    else if (func == DrawColumnLow)
+	return BATCHWIDTH / 2;
+    else
+	return 0;
+}
 
-    do
+//
+// DrawColumnBatch
+// Each column's rows above and below the rows they all cover are
+//  drawn one by one, then the shared rows a word at a time.  Every
+//  pixel is worked out the same way DrawColumn does it.
+//
+static void DrawColumnBatch (const drawcmd_t **cmds, int num_cmds)
+{
+    byte*		dest;
+    fixed_t		frac[BATCHWIDTH];
+    fixed_t		fracstep[BATCHWIDTH];
+    lighttable_t*	colormap[BATCHWIDTH];
+    byte*		source[BATCHWIDTH];
+    uint32_t		quad;
+    byte		pixel;
+    int			top;
+    int			bottom;
+    int			shift;
+    int			y;
+    int			i;
+
+    top = cmds[0]->y1;
+    bottom = cmds[0]->y2;
+
+    for (i=1 ; i<num_cmds ; i++)
     {
-	// Calculate current texture index in u,v.
-        ytemp = (position >> 4) & 0x0fc0;
-        xtemp = (position >> 26);
-        spot = xtemp | ytemp;
+	if (cmds[i]->y1 > top)
+	    top = cmds[i]->y1;
+	if (cmds[i]->y2 < bottom)
+	    bottom = cmds[i]->y2;
+    }
 
-	// Lowres/blocky mode does it twice,
-	//  while scale is adjusted appropriately.
-	*dest++ = ds_colormap[ds_source[spot]];
-	*dest++ = ds_colormap[ds_source[spot]];
+    // Nothing shared.
+    if (top > bottom)
+    {
+	for (i=0 ; i<num_cmds ; i++)
+	    cmds[i]->func(cmds[i], cmds[i]->x1, cmds[i]->x1);
+	return;
+    }
 
-	position += step;
+    // Blocky mode draws each column twice.
+    shift = num_cmds == BATCHWIDTH ? 0 : 1;
 
-    } while (count--);
+    for (i=0 ; i<num_cmds ; i++)
+    {
+#ifdef RANGECHECK
+	if ((unsigned)(cmds[i]->x1 << shift) >= SCREENWIDTH
+	    || cmds[i]->y1 < 0
+	    || cmds[i]->y2 >= SCREENHEIGHT)
+	{
+	    I_Error ("R_DrawColumn: %i to %i at %i",
+		     cmds[i]->y1, cmds[i]->y2, cmds[i]->x1);
+	}
+#endif
+
+	fracstep[i] = cmds[i]->iscale;
+	frac[i] = cmds[i]->texturemid + (cmds[i]->y1-centery)*fracstep[i];
+	colormap[i] = cmds[i]->colormap;
+	source[i] = cmds[i]->source;
+
+	dest = ylookup[cmds[i]->y1] + columnofs[cmds[i]->x1 << shift];
+
+	for (y=cmds[i]->y1 ; y<top ; y++)
+	{
+	    dest[0] = dest[shift]
+		    = colormap[i][source[i][(frac[i]>>FRACBITS)&127]];
+	    dest += SCREENWIDTH;
+	    frac[i] += fracstep[i];
+	}
+    }
+
+    dest = ylookup[top] + columnofs[cmds[0]->x1 << shift];
+
+    if (shift == 0)
+    {
+	for (y=top ; y<=bottom ; y++)
+	{
+	    quad = QUAD(colormap[0][source[0][(frac[0]>>FRACBITS)&127]],
+			colormap[1][source[1][(frac[1]>>FRACBITS)&127]],
+			colormap[2][source[2][(frac[2]>>FRACBITS)&127]],
+			colormap[3][source[3][(frac[3]>>FRACBITS)&127]]);
+	    memcpy(dest, &quad, sizeof(quad));
+
+	    dest += SCREENWIDTH;
+	    frac[0] += fracstep[0];
+	    frac[1] += fracstep[1];
+	    frac[2] += fracstep[2];
+	    frac[3] += fracstep[3];
+	}
+    }
+    else
+    {
+	for (y=top ; y<=bottom ; y++)
+	{
+	    pixel = colormap[0][source[0][(frac[0]>>FRACBITS)&127]];
+	    quad = colormap[1][source[1][(frac[1]>>FRACBITS)&127]];
+	    quad = QUAD(pixel, pixel, quad, quad);
+	    memcpy(dest, &quad, sizeof(quad));
+
+	    dest += SCREENWIDTH;
+	    frac[0] += fracstep[0];
+	    frac[1] += fracstep[1];
+	}
+    }
+
+    for (i=0 ; i<num_cmds ; i++)
+    {
+	dest = ylookup[bottom+1] + columnofs[cmds[i]->x1 << shift];
+
+	for (y=bottom+1 ; y<=cmds[i]->y2 ; y++)
+	{
+	    dest[0] = dest[shift]
+		    = colormap[i][source[i][(frac[i]>>FRACBITS)&127]];
+	    dest += SCREENWIDTH;
+	    frac[i] += fracstep[i];
+	}
+    }
+}
+
+static void FlushColumnBatch (colbatch_t *batch)
+{
+    const drawcmd_t*	cmds[BATCHWIDTH];
+    int			width;
+    int			num_cmds;
+    int			i;
+    int			j;
+
+    if (batch->func == NULL)
+	return;
+
+    width = BatchWidth(batch->func);
+
+    for (j=0 ; j<BATCHDEPTH ; j++)
+    {
+	num_cmds = 0;
+
+	for (i=0 ; i<width ; i++)
+	{
+	    if (batch->depth[i] > j)
+	    {
+		cmds[num_cmds] = &batch->cmds[i][j];
+		++num_cmds;
+	    }
+	}
+
+	if (num_cmds == 0)
+	    break;
+
+	if (num_cmds == width)
+	{
+	    DrawColumnBatch(cmds, num_cmds);
+	}
+	else
+	{
+	    for (i=0 ; i<num_cmds ; i++)
+		cmds[i]->func(cmds[i], cmds[i]->x1, cmds[i]->x1);
+	}
+    }
+
+    for (i=0 ; i<width ; i++)
+	batch->depth[i] = 0;
+
+    batch->func = NULL;
+}
+
+//
+// Draw the part of a command between columns x1 and x2, adding it to
+//  the batch if it is a plain column.
+//
+static void BatchDrawCmd (colbatch_t *batch, const drawcmd_t *cmd,
+			  int x1, int x2)
+{
+    int		width;
+    int		slot;
+
+    width = BatchWidth(cmd->func);
+
+    if (width == 0)
+    {
+	FlushColumnBatch(batch);
+	cmd->func(cmd, x1, x2);
+	return;
+    }
+
+    // Zero length columns draw nothing.
+    if (cmd->y2 < cmd->y1)
+	return;
+
+    if (batch->func != NULL)
+    {
+	slot = cmd->x1 - batch->x;
+
+	if (batch->func != cmd->func
+	 || slot < 0 || slot >= width
+	 || batch->depth[slot] == BATCHDEPTH)
+	{
+	    FlushColumnBatch(batch);
+	}
+    }
+
+    if (batch->func == NULL)
+    {
+	batch->func = cmd->func;
+	batch->x = cmd->x1;
+    }
+
+    slot = cmd->x1 - batch->x;
+    batch->cmds[slot][batch->depth[slot]] = *cmd;
+    ++batch->depth[slot];
+}
+
+// Draw a command now, unless it is queued.
+
+static void RunDrawCmd (drawcmd_t *cmd)
+{
+    if (cmd == &immediate_cmd)
+    {
+        BatchDrawCmd(&immediate_batch, cmd, cmd->x1, cmd->x2);
+    }
+}
+
+//
+// R_FlushDrawQueue
+// Each strip runs through the whole queue, drawing the part of each
+//  command that falls within it.
+//
+static void DrawStrip (int index, void *data)
+{
+    colbatch_t	batch;
+    drawcmd_t*	cmd;
+    drawcmd_t*	end;
+    int		x1;
+    int		x2;
+
+    x1 = (viewwidth * index) / num_draw_strips;
+    x2 = (viewwidth * (index + 1)) / num_draw_strips - 1;
+
+    end = draw_queue + draw_queue_len;
+    memset(&batch.depth, 0, sizeof(batch.depth));
+    batch.func = NULL;
+
+    for (cmd = draw_queue; cmd < end; ++cmd)
+    {
+	if (cmd->x2 < x1 || cmd->x1 > x2)
+	    continue;
+
+	BatchDrawCmd(&batch, cmd,
+		     cmd->x1 > x1 ? cmd->x1 : x1,
+		     cmd->x2 < x2 ? cmd->x2 : x2);
+    }
+
+    FlushColumnBatch(&batch);
+}
+
+void R_FlushDrawQueue (void)
+{
+    FlushColumnBatch(&immediate_batch);
+
+    if (draw_queue_len == 0)
+	return;
+
+    I_RunParallel(num_draw_strips, DrawStrip, NULL);
+
+    draw_queue_len = 0;
+}
+
+//
+// R_CacheLumpNum
+// Loading a lump can purge other lumps from the zone, so anything
+//  still queued or held back in a batch is drawn first.
+//
+void *R_CacheLumpNum (int lump, int tag)
+{
+    if ((draw_queue_len > 0 || immediate_batch.func != NULL)
+     && lumpinfo[lump]->wad_file->mapped == NULL
+     && lumpinfo[lump]->cache == NULL)
+    {
+	R_FlushDrawQueue ();
+    }
+
+    return W_CacheLumpNum (lump, tag);
+}
+
+//
+// R_InitDrawThreads
+//
+void R_InitDrawThreads (void)
+{
+    int		p;
+
+    //!
+    // @arg <n>
+    // @category video
+    //
+    // Draw the 3D view with n threads, each drawing a vertical strip
+    // of the screen.  The picture drawn is the same as with one.
+    //
+
+    p = M_CheckParmWithArgs("-renderthreads", 1);
+
+    if (p > 0)
+    {
+	num_draw_strips = atoi(myargv[p + 1]);
+
+	if (num_draw_strips < 1)
+	    num_draw_strips = 1;
+	else if (num_draw_strips > MAX_PARALLEL_JOBS)
+	    num_draw_strips = MAX_PARALLEL_JOBS;
+    }
 }
 
 //
@@ -929,6 +1654,10 @@ R_VideoErase
     if (background_buffer != NULL)
     {
         memcpy(I_VideoBuffer + ofs, background_buffer + ofs, count * sizeof(*I_VideoBuffer));
+
+        // Mark the rows copied to.
+        V_MarkRect (0, ofs / SCREENWIDTH, SCREENWIDTH,
+                    (ofs + count - 1) / SCREENWIDTH - ofs / SCREENWIDTH + 1);
     }
 } 
 
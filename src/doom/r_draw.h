@@ -23,62 +23,40 @@
 
 
 
-extern lighttable_t*	dc_colormap;
-extern int		dc_x;
-extern int		dc_yl;
-extern int		dc_yh;
-extern fixed_t		dc_iscale;
-extern fixed_t		dc_texturemid;
-
-// first pixel in a column
-extern byte*		dc_source;		
-
-
 // The span blitting interface.
 // Hook in assembler or system specific BLT
 //  here.
-void 	R_DrawColumn (void);
-void 	R_DrawColumnLow (void);
+// The dc_* and ds_* variables drawn from are in the context.
+void 	R_DrawColumn (rcontext_t* rc);
+void 	R_DrawColumnLow (rcontext_t* rc);
 
 // The Spectre/Invisibility effect.
-void 	R_DrawFuzzColumn (void);
-void 	R_DrawFuzzColumnLow (void);
+void 	R_DrawFuzzColumn (rcontext_t* rc);
+void 	R_DrawFuzzColumnLow (rcontext_t* rc);
 
 // Draw with color translation tables,
 //  for player sprite rendering,
 //  Green/Red/Blue/Indigo shirts.
-void	R_DrawTranslatedColumn (void);
-void	R_DrawTranslatedColumnLow (void);
+void	R_DrawTranslatedColumn (rcontext_t* rc);
+void	R_DrawTranslatedColumnLow (rcontext_t* rc);
 
 void
 R_VideoErase
 ( unsigned	ofs,
   int		count );
 
-extern int		ds_y;
-extern int		ds_x1;
-extern int		ds_x2;
-
-extern lighttable_t*	ds_colormap;
-
-extern fixed_t		ds_xfrac;
-extern fixed_t		ds_yfrac;
-extern fixed_t		ds_xstep;
-extern fixed_t		ds_ystep;
-
-// start of a 64*64 tile image
-extern byte*		ds_source;		
+// Use the vector span drawer, where there is one.
+extern boolean		simdspans;
 
 extern byte*		translationtables;
-extern byte*		dc_translation;
 
 
 // Span blitting for rows, floor/ceiling.
 // No Sepctre effect needed.
-void 	R_DrawSpan (void);
+void 	R_DrawSpan (rcontext_t* rc);
 
 // Low resolution mode, 160x200?
-void 	R_DrawSpanLow (void);
+void 	R_DrawSpanLow (rcontext_t* rc);
 
 
 void
@@ -87,6 +65,18 @@ R_InitBuffer
   int		height );
 
 
+// Read -renderthreads.
+void	R_InitDrawThreads (void);
+
+// Draw all queued columns and spans.  Must be called before
+//  allocating zone memory while drawing the view, and once the view
+//  is finished.
+void	R_FlushDrawQueue (void);
+
+// W_CacheLumpNum for lumps that are drawn from, which first flushes
+//  the draw queue if the lump has to be loaded.
+void*	R_CacheLumpNum (int lump, int tag);
+
 // Initialize color translation tables,
 //  for player rendering etc.
 void	R_InitTranslationTables (void);
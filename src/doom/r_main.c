@@ -24,13 +24,19 @@
 
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 
 
 #include "doomdef.h"
 #include "d_loop.h"
 
+#include "i_video.h"
+#include "v_video.h"
+#include "m_argv.h"
 #include "m_bbox.h"
 #include "m_menu.h"
+#include "sha1.h"
+#include "z_zone.h"
 
 #include "r_local.h"
 #include "r_sky.h"
@@ -49,9 +55,16 @@ int			viewangleoffset;
 // increment every time a check is made
 int			validcount = 1;		
 
+// The context the player's view is drawn with.
+rcontext_t		defaultcontext;
+
+// Hash of every view drawn, for -renderhash.
+static boolean		hash_frames = false;
+static sha1_context_t	frame_hash;
+
+// Count and time parts of the renderer, for -renderstats.
+boolean			renderstats = false;
 
-lighttable_t*		fixedcolormap;
-extern lighttable_t**	walllights;
 
 int			centerx;
 int			centery;
@@ -63,21 +76,9 @@ fixed_t			projection;
 // just for profiling purposes
 int			framecount;	
 
-int			sscount;
 int			linecount;
 int			loopcount;
 
-fixed_t			viewx;
-fixed_t			viewy;
-fixed_t			viewz;
-
-angle_t			viewangle;
-
-fixed_t			viewcos;
-fixed_t			viewsin;
-
-player_t*		viewplayer;
-
 // 0 = high, 1 = low
 int			detailshift;	
 
@@ -98,19 +99,14 @@ int			viewangletox[FINEANGLES/2];
 angle_t			xtoviewangle[SCREENWIDTH+1];
 
 lighttable_t*		scalelight[LIGHTLEVELS][MAXLIGHTSCALE];
-lighttable_t*		scalelightfixed[MAXLIGHTSCALE];
 lighttable_t*		zlight[LIGHTLEVELS][MAXLIGHTZ];
 
-// bumped light from gun blasts
-int			extralight;			
 
 
-
-void (*colfunc) (void);
-void (*basecolfunc) (void);
-void (*fuzzcolfunc) (void);
-void (*transcolfunc) (void);
-void (*spanfunc) (void);
+void (*basecolfunc) (rcontext_t* rc);
+void (*fuzzcolfunc) (rcontext_t* rc);
+void (*transcolfunc) (rcontext_t* rc);
+void (*spanfunc) (rcontext_t* rc);
 
 
 
@@ -266,20 +262,15 @@ R_PointOnSegSide
 //  the y (<=x) is scaled and divided by x to get a
 //  tangent (slope) value which is looked up in the
 //  tantoangle[] table.
-
+// R_PointToAngleDelta does this for an x and y
+//  relative to the point looked from.
 //
 
-
-
-
-angle_t
-R_PointToAngle
+static angle_t
+R_PointToAngleDelta
 ( fixed_t	x,
   fixed_t	y )
 {	
-    x -= viewx;
-    y -= viewy;
-    
     if ( (!x) && (!y) )
 	return 0;
 
@@ -358,6 +349,16 @@ R_PointToAngle
 }
 
 
+angle_t
+R_PointToAngle
+( rcontext_t*	rc,
+  fixed_t	x,
+  fixed_t	y )
+{	
+    return R_PointToAngleDelta (x - rc->viewx, y - rc->viewy);
+}
+
+
 angle_t
 R_PointToAngle2
 ( fixed_t	x1,
@@ -365,16 +366,14 @@ R_PointToAngle2
   fixed_t	x2,
   fixed_t	y2 )
 {	
-    viewx = x1;
-    viewy = y1;
-    
-    return R_PointToAngle (x2, y2);
+    return R_PointToAngleDelta (x2 - x1, y2 - y1);
 }
 
 
 fixed_t
 R_PointToDist
-( fixed_t	x,
+( rcontext_t*	rc,
+  fixed_t	x,
   fixed_t	y )
 {
     int		angle;
@@ -384,8 +383,8 @@ R_PointToDist
     fixed_t	dist;
     fixed_t     frac;
 	
-    dx = abs(x - viewx);
-    dy = abs(y - viewy);
+    dx = abs(x - rc->viewx);
+    dy = abs(y - rc->viewy);
 	
     if (dy>dx)
     {
@@ -446,7 +445,7 @@ void R_InitPointToAngle (void)
 //  at the given angle.
 // rw_distance must be calculated first.
 //
-fixed_t R_ScaleFromGlobalAngle (angle_t visangle)
+fixed_t R_ScaleFromGlobalAngle (rcontext_t* rc, angle_t visangle)
 {
     fixed_t		scale;
     angle_t		anglea;
@@ -473,14 +472,14 @@ fixed_t R_ScaleFromGlobalAngle (angle_t visangle)
 }
 #endif
 
-    anglea = ANG90 + (visangle-viewangle);
-    angleb = ANG90 + (visangle-rw_normalangle);
+    anglea = ANG90 + (visangle-rc->viewangle);
+    angleb = ANG90 + (visangle-rc->rw_normalangle);
 
     // both sines are allways positive
     sinea = finesine[anglea>>ANGLETOFINESHIFT];	
     sineb = finesine[angleb>>ANGLETOFINESHIFT];
     num = FixedMul(projection,sineb)<<detailshift;
-    den = FixedMul(rw_distance,sinea);
+    den = FixedMul(rc->rw_distance,sinea);
 
     if (den > num>>FRACBITS)
     {
@@ -697,14 +696,14 @@ void R_ExecuteSetViewSize (void)
 
     if (!detailshift)
     {
-	colfunc = basecolfunc = R_DrawColumn;
+	basecolfunc = R_DrawColumn;
 	fuzzcolfunc = R_DrawFuzzColumn;
 	transcolfunc = R_DrawTranslatedColumn;
 	spanfunc = R_DrawSpan;
     }
     else
     {
-	colfunc = basecolfunc = R_DrawColumnLow;
+	basecolfunc = R_DrawColumnLow;
 	fuzzcolfunc = R_DrawFuzzColumnLow;
 	transcolfunc = R_DrawTranslatedColumnLow;
 	spanfunc = R_DrawSpanLow;
@@ -781,9 +780,77 @@ void R_Init (void)
     printf (".");
     R_InitSkyMap ();
     R_InitTranslationTables ();
+    R_InitDrawThreads ();
     printf (".");
 	
     framecount = 0;
+
+    //!
+    // @category demo
+    //
+    // Hash every frame of the 3D view, and print the hash at the end
+    // of a -timedemo, to check that the picture drawn has not changed.
+    //
+
+    if (M_CheckParm ("-renderhash") > 0)
+    {
+	hash_frames = true;
+	SHA1_Init (&frame_hash);
+    }
+
+    //!
+    // @category video
+    //
+    // Count and time the floors, ceilings and sprites drawn, and
+    // print the totals at the end of a -timedemo.  Also print how
+    // much of each screen wipe was spent working rather than waiting,
+    // how long the automap took to draw each time it is closed, and
+    // how long the status bar, heads-up and intermission took per
+    // frame.
+    //
+
+    renderstats = M_CheckParm ("-renderstats") > 0;
+
+    R_BenchmarkSpans ();
+}
+
+
+//
+// R_HashFrame
+//
+static void R_HashFrame (void)
+{
+    int		y;
+
+    for (y=0 ; y<viewheight ; y++)
+    {
+	SHA1_Update (&frame_hash,
+		     I_VideoBuffer + (y+viewwindowy)*SCREENWIDTH + viewwindowx,
+		     scaledviewwidth);
+    }
+}
+
+
+//
+// R_PrintFrameHash
+//
+void R_PrintFrameHash (void)
+{
+    sha1_digest_t	digest;
+    int			i;
+
+    if (!hash_frames)
+	return;
+
+    SHA1_Final (digest, &frame_hash);
+    hash_frames = false;
+
+    printf ("R_PrintFrameHash: %i frames, hash ", framecount);
+
+    for (i=0 ; i<sizeof(digest) ; i++)
+	printf ("%02x", digest[i]);
+
+    printf ("\n");
 }
 
 
@@ -820,39 +887,50 @@ R_PointInSubsector
 //
 // R_SetupFrame
 //
-void R_SetupFrame (player_t* player)
+void R_SetupFrame (rcontext_t* rc, player_t* player)
 {		
     int		i;
     
-    viewplayer = player;
-    viewx = player->mo->x;
-    viewy = player->mo->y;
-    viewangle = player->mo->angle + viewangleoffset;
-    extralight = player->extralight;
+    rc->colfunc = basecolfunc;
 
-    viewz = player->viewz;
+    rc->viewplayer = player;
+    rc->viewx = player->mo->x;
+    rc->viewy = player->mo->y;
+    rc->viewangle = player->mo->angle + viewangleoffset;
+    rc->extralight = player->extralight;
+
+    rc->viewz = player->viewz;
     
-    viewsin = finesine[viewangle>>ANGLETOFINESHIFT];
-    viewcos = finecosine[viewangle>>ANGLETOFINESHIFT];
+    rc->viewsin = finesine[rc->viewangle>>ANGLETOFINESHIFT];
+    rc->viewcos = finecosine[rc->viewangle>>ANGLETOFINESHIFT];
 	
-    sscount = 0;
+    rc->sscount = 0;
 	
     if (player->fixedcolormap)
     {
-	fixedcolormap =
+	rc->fixedcolormap =
 	    colormaps
 	    + player->fixedcolormap*256;
 	
-	walllights = scalelightfixed;
+	rc->walllights = rc->scalelightfixed;
 
 	for (i=0 ; i<MAXLIGHTSCALE ; i++)
-	    scalelightfixed[i] = fixedcolormap;
+	    rc->scalelightfixed[i] = rc->fixedcolormap;
     }
     else
-	fixedcolormap = 0;
+	rc->fixedcolormap = 0;
 		
+    // The sector marks are freed with the level.
+    if (rc->sectorvalid == NULL)
+    {
+	rc->sectorvalid = Z_Malloc (numsectors * sizeof(*rc->sectorvalid),
+				    PU_LEVEL, &rc->sectorvalid);
+	memset (rc->sectorvalid, 0, numsectors * sizeof(*rc->sectorvalid));
+	rc->validcount = 0;
+    }
+
     framecount++;
-    validcount++;
+    rc->validcount++;
 }
 
 
@@ -860,31 +938,43 @@ void R_SetupFrame (player_t* player)
 //
 // R_RenderView
 //
-void R_RenderPlayerView (player_t* player)
+void R_RenderPlayerView (rcontext_t* rc, player_t* player)
 {	
-    R_SetupFrame (player);
+    R_SetupFrame (rc, player);
 
     // Clear buffers.
-    R_ClearClipSegs ();
-    R_ClearDrawSegs ();
-    R_ClearPlanes ();
-    R_ClearSprites ();
+    R_ClearClipSegs (rc);
+    R_ClearDrawSegs (rc);
+    R_ClearPlanes (rc);
+    R_ClearSprites (rc);
     
     // check for new console commands.
     NetUpdate ();
 
     // The head node is the last node output.
-    R_RenderBSPNode (numnodes-1);
+    R_RenderBSPNode (rc, numnodes-1);
+
+    // Anything queued must be drawn before NetUpdate,
+    //  as it may load sounds into the zone.
+    R_FlushDrawQueue ();
     
     // Check for new console commands.
     NetUpdate ();
     
-    R_DrawPlanes ();
+    R_DrawPlanes (rc);
+    R_FlushDrawQueue ();
     
     // Check for new console commands.
     NetUpdate ();
     
-    R_DrawMasked ();
+    R_DrawMasked (rc);
+    R_FlushDrawQueue ();
+
+    // The whole view window has been drawn over.
+    V_MarkRect (viewwindowx, viewwindowy, scaledviewwidth, viewheight);
+
+    if (hash_frames)
+	R_HashFrame ();
 
     // Check for new console commands.
     NetUpdate ();				
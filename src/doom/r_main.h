@@ -29,9 +29,6 @@
 //
 // POV related.
 //
-extern fixed_t		viewcos;
-extern fixed_t		viewsin;
-
 extern int		viewwindowx;
 extern int		viewwindowy;
 
@@ -67,12 +64,8 @@ extern int		loopcount;
 #define LIGHTZSHIFT		20
 
 extern lighttable_t*	scalelight[LIGHTLEVELS][MAXLIGHTSCALE];
-extern lighttable_t*	scalelightfixed[MAXLIGHTSCALE];
 extern lighttable_t*	zlight[LIGHTLEVELS][MAXLIGHTZ];
 
-extern int		extralight;
-extern lighttable_t*	fixedcolormap;
-
 
 // Number of diminishing brightness levels.
 // There a 0-31, i.e. 32 LUT in the COLORMAP lump.
@@ -85,16 +78,226 @@ extern lighttable_t*	fixedcolormap;
 extern	int		detailshift;	
 
 
+//
+// Renderer context.
+// Everything that is worked out while one view is drawn, from the
+//  viewpoint through the clip lists, visplanes, drawsegs and
+//  vissprites to the column and span being drawn, is kept in a
+//  context passed down from R_RenderPlayerView.  The view size and
+//  the tables that follow from it are shared by all contexts.
+//
+
+// Here comes the obnoxious "visplane".
+#define MAXVISPLANES	128
+
+// ?
+#define MAXOPENINGS	SCREENWIDTH*64
+
+#define MAXSEGS		32
+
+#define MAXVISSPRITES  	128
+
+//
+// Distance and texture steps for each row, for one plane height.
+// Planes at the same height, such as neighbouring floors with other
+//  flats or light levels, share the rows worked out for the first
+//  one drawn, so a few heights are kept each frame.
+//
+#define NUMPLANEROWS	8
+
+typedef struct
+{
+    fixed_t		height;
+    boolean		valid[SCREENHEIGHT];
+    fixed_t		distance[SCREENHEIGHT];
+    fixed_t		xstep[SCREENHEIGHT];
+    fixed_t		ystep[SCREENHEIGHT];
+} planerows_t;
+
+// A range of columns in the solid seg clip list.
+typedef	struct
+{
+    int	first;
+    int last;
+    
+} cliprange_t;
+
+typedef struct rcontext_s rcontext_t;
+
+struct rcontext_s
+{
+    // View point, set by R_SetupFrame.
+    fixed_t		viewx;
+    fixed_t		viewy;
+    fixed_t		viewz;
+    angle_t		viewangle;
+    fixed_t		viewcos;
+    fixed_t		viewsin;
+    player_t*		viewplayer;
+
+    // bumped light from gun blasts
+    int			extralight;
+    lighttable_t*	fixedcolormap;
+    lighttable_t*	scalelightfixed[MAXLIGHTSCALE];
+
+    // Sectors whose sprites have been added are marked with
+    //  validcount, which goes up every view.  The marks are kept
+    //  here, apart from the playsim's sector validcount.
+    int			validcount;
+    int*		sectorvalid;
+
+    int			sscount;
+
+    // Used to select shadow mode etc.
+    void		(*colfunc) (rcontext_t* rc);
+
+    // r_bsp
+    seg_t*		curline;
+    side_t*		sidedef;
+    line_t*		linedef;
+    sector_t*		frontsector;
+    sector_t*		backsector;
+
+    drawseg_t		drawsegs[MAXDRAWSEGS];
+    drawseg_t*		ds_p;
+
+    // newend is one past the last valid seg
+    cliprange_t*	newend;
+    cliprange_t		solidsegs[MAXSEGS];
+
+    // r_segs
+    // True if any of the segs textures might be visible.
+    boolean		segtextured;
+
+    // False if the back side is the same plane.
+    boolean		markfloor;
+    boolean		markceiling;
+
+    boolean		maskedtexture;
+    int			toptexture;
+    int			bottomtexture;
+    int			midtexture;
+
+    angle_t		rw_normalangle;
+    // angle to line origin
+    int			rw_angle1;
+
+    int			rw_x;
+    int			rw_stopx;
+    angle_t		rw_centerangle;
+    fixed_t		rw_offset;
+    fixed_t		rw_distance;
+    fixed_t		rw_scale;
+    fixed_t		rw_scalestep;
+    fixed_t		rw_midtexturemid;
+    fixed_t		rw_toptexturemid;
+    fixed_t		rw_bottomtexturemid;
+
+    int			worldtop;
+    int			worldbottom;
+    int			worldhigh;
+    int			worldlow;
+
+    fixed_t		pixhigh;
+    fixed_t		pixlow;
+    fixed_t		pixhighstep;
+    fixed_t		pixlowstep;
+
+    fixed_t		topfrac;
+    fixed_t		topstep;
+
+    fixed_t		bottomfrac;
+    fixed_t		bottomstep;
+
+    lighttable_t**	walllights;
+
+    short*		maskedtexturecol;
+
+    // r_plane
+    visplane_t		visplanes[MAXVISPLANES];
+    visplane_t*		lastvisplane;
+    visplane_t*		floorplane;
+    visplane_t*		ceilingplane;
+
+    short		openings[MAXOPENINGS];
+    short*		lastopening;
+
+    // Clip values are the solid pixel bounding the range.
+    //  floorclip starts out SCREENHEIGHT
+    //  ceilingclip starts out -1
+    short		floorclip[SCREENWIDTH];
+    short		ceilingclip[SCREENWIDTH];
+
+    // spanstart holds the start of a plane span
+    int			spanstart[SCREENHEIGHT];
+
+    lighttable_t**	planezlight;
+    fixed_t		planeheight;
+
+    fixed_t		basexscale;
+    fixed_t		baseyscale;
+
+    planerows_t		planerows[NUMPLANEROWS];
+    int			numplanerows;
+    int			nextplanerows;
+
+    // Rows for planeheight.
+    planerows_t*	rows;
+
+    // r_things
+    vissprite_t		vissprites[MAXVISSPRITES];
+    vissprite_t*	vissprite_p;
+    vissprite_t		overflowsprite;
+    vissprite_t		vsprsortedhead;
+    vissprite_t*	sortbuf[2][MAXVISSPRITES];
+
+    lighttable_t**	spritelights;
+
+    // vars for R_DrawMaskedColumn
+    short*		mfloorclip;
+    short*		mceilingclip;
+    fixed_t		spryscale;
+    fixed_t		sprtopscreen;
+
+    // r_draw: the column or span to draw next.
+    lighttable_t*	dc_colormap;
+    int			dc_x;
+    int			dc_yl;
+    int			dc_yh;
+    fixed_t		dc_iscale;
+    fixed_t		dc_texturemid;
+    // first pixel in a column
+    byte*		dc_source;
+    byte*		dc_translation;
+
+    int			ds_y;
+    int			ds_x1;
+    int			ds_x2;
+    lighttable_t*	ds_colormap;
+    fixed_t		ds_xfrac;
+    fixed_t		ds_yfrac;
+    fixed_t		ds_xstep;
+    fixed_t		ds_ystep;
+    // start of a 64*64 tile image
+    byte*		ds_source;
+
+    // Fuzz columns carry on through the fuzz table from here.
+    int			fuzzpos;
+};
+
+// The context the player's view is drawn with.
+extern rcontext_t	defaultcontext;
+
+
 //
 // Function pointers to switch refresh/drawing functions.
-// Used to select shadow mode etc.
+// The column function for each view starts as basecolfunc.
 //
-extern void		(*colfunc) (void);
-extern void		(*transcolfunc) (void);
-extern void		(*basecolfunc) (void);
-extern void		(*fuzzcolfunc) (void);
+extern void		(*transcolfunc) (rcontext_t* rc);
+extern void		(*basecolfunc) (rcontext_t* rc);
+extern void		(*fuzzcolfunc) (rcontext_t* rc);
 // No shadow effects on floors.
-extern void		(*spanfunc) (void);
+extern void		(*spanfunc) (rcontext_t* rc);
 
 
 //
@@ -113,7 +316,8 @@ R_PointOnSegSide
 
 angle_t
 R_PointToAngle
-( fixed_t	x,
+( rcontext_t*	rc,
+  fixed_t	x,
   fixed_t	y );
 
 angle_t
@@ -125,11 +329,12 @@ R_PointToAngle2
 
 fixed_t
 R_PointToDist
-( fixed_t	x,
+( rcontext_t*	rc,
+  fixed_t	x,
   fixed_t	y );
 
 
-fixed_t R_ScaleFromGlobalAngle (angle_t visangle);
+fixed_t R_ScaleFromGlobalAngle (rcontext_t* rc, angle_t visangle);
 
 subsector_t*
 R_PointInSubsector
@@ -149,11 +354,17 @@ R_AddPointToBox
 //
 
 // Called by G_Drawer.
-void R_RenderPlayerView (player_t *player);
+void R_RenderPlayerView (rcontext_t* rc, player_t *player);
 
 // Called by startup code.
 void R_Init (void);
 
+// Print the hash of every view drawn, if -renderhash was given.
+void R_PrintFrameHash (void);
+
+// Set by -renderstats.
+extern boolean		renderstats;
+
 // Called by M_Responder.
 void R_SetViewSize (int blocks, int detail);
 
@@ -21,8 +21,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "deh_main.h"
 #include "i_system.h"
+#include "i_timer.h"
+#include "i_video.h"
+#include "m_argv.h"
+#include "sha1.h"
 #include "z_zone.h"
 #include "w_wad.h"
 
@@ -38,52 +44,23 @@ planefunction_t		floorfunc;
 planefunction_t		ceilingfunc;
 
 //
-// opening
+// The visplanes, openings, clip lists and row steps for the view
+//  being drawn are kept in the renderer context.
 //
-
-// Here comes the obnoxious "visplane".
-#define MAXVISPLANES	128
-visplane_t		visplanes[MAXVISPLANES];
-visplane_t*		lastvisplane;
-visplane_t*		floorplane;
-visplane_t*		ceilingplane;
-
-// ?
-#define MAXOPENINGS	SCREENWIDTH*64
-short			openings[MAXOPENINGS];
-short*			lastopening;
-
-
-//
-// Clip values are the solid pixel bounding the range.
-//  floorclip starts out SCREENHEIGHT
-//  ceilingclip starts out -1
-//
-short			floorclip[SCREENWIDTH];
-short			ceilingclip[SCREENWIDTH];
-
-//
-// spanstart holds the start of a plane span
-// initialized to 0 at start
-//
-int			spanstart[SCREENHEIGHT];
 int			spanstop[SCREENHEIGHT];
 
-//
-// texture mapping
-//
-lighttable_t**		planezlight;
-fixed_t			planeheight;
-
 fixed_t			yslope[SCREENHEIGHT];
 fixed_t			distscale[SCREENWIDTH];
-fixed_t			basexscale;
-fixed_t			baseyscale;
 
-fixed_t			cachedheight[SCREENHEIGHT];
-fixed_t			cacheddistance[SCREENHEIGHT];
-fixed_t			cachedxstep[SCREENHEIGHT];
-fixed_t			cachedystep[SCREENHEIGHT];
+//
+// Span statistics for -renderstats.
+//
+static unsigned int	statframes;
+static unsigned int	statspans;
+static uint64_t		statpixels;
+static unsigned int	statrowhits;
+static unsigned int	statrowmisses;
+static uint64_t		statplanetime;
 
 
 
@@ -97,10 +74,43 @@ void R_InitPlanes (void)
 }
 
 
+//
+// R_SetPlaneRows
+// Finds the rows for planeheight, or starts a new set.
+//
+static void R_SetPlaneRows (rcontext_t* rc)
+{
+    int		i;
+
+    for (i=0 ; i<rc->numplanerows ; i++)
+    {
+	if (rc->planerows[i].height == rc->planeheight)
+	{
+	    rc->rows = &rc->planerows[i];
+	    return;
+	}
+    }
+
+    if (rc->numplanerows < NUMPLANEROWS)
+    {
+	rc->rows = &rc->planerows[rc->numplanerows];
+	rc->numplanerows++;
+    }
+    else
+    {
+	rc->rows = &rc->planerows[rc->nextplanerows];
+	rc->nextplanerows = (rc->nextplanerows + 1) % NUMPLANEROWS;
+    }
+
+    rc->rows->height = rc->planeheight;
+    memset (rc->rows->valid, 0, sizeof(rc->rows->valid));
+}
+
+
 //
 // R_MapPlane
 //
-// Uses global vars:
+// Uses context vars:
 //  planeheight
 //  ds_source
 //  basexscale
@@ -112,7 +122,8 @@ void R_InitPlanes (void)
 //
 void
 R_MapPlane
-( int		y,
+( rcontext_t*	rc,
+  int		y,
   int		x1,
   int		x2 )
 {
@@ -131,27 +142,30 @@ R_MapPlane
     }
 #endif
 
-    if (planeheight != cachedheight[y])
+    if (!rc->rows->valid[y])
     {
-	cachedheight[y] = planeheight;
-	distance = cacheddistance[y] = FixedMul (planeheight, yslope[y]);
-	ds_xstep = cachedxstep[y] = FixedMul (distance,basexscale);
-	ds_ystep = cachedystep[y] = FixedMul (distance,baseyscale);
+	rc->rows->valid[y] = true;
+	distance = rc->rows->distance[y] =
+	    FixedMul (rc->planeheight, yslope[y]);
+	rc->ds_xstep = rc->rows->xstep[y] = FixedMul (distance,rc->basexscale);
+	rc->ds_ystep = rc->rows->ystep[y] = FixedMul (distance,rc->baseyscale);
+	statrowmisses++;
     }
     else
     {
-	distance = cacheddistance[y];
-	ds_xstep = cachedxstep[y];
-	ds_ystep = cachedystep[y];
+	distance = rc->rows->distance[y];
+	rc->ds_xstep = rc->rows->xstep[y];
+	rc->ds_ystep = rc->rows->ystep[y];
+	statrowhits++;
     }
 	
     length = FixedMul (distance,distscale[x1]);
-    angle = (viewangle + xtoviewangle[x1])>>ANGLETOFINESHIFT;
-    ds_xfrac = viewx + FixedMul(finecosine[angle], length);
-    ds_yfrac = -viewy - FixedMul(finesine[angle], length);
+    angle = (rc->viewangle + xtoviewangle[x1])>>ANGLETOFINESHIFT;
+    rc->ds_xfrac = rc->viewx + FixedMul(finecosine[angle], length);
+    rc->ds_yfrac = -rc->viewy - FixedMul(finesine[angle], length);
 
-    if (fixedcolormap)
-	ds_colormap = fixedcolormap;
+    if (rc->fixedcolormap)
+	rc->ds_colormap = rc->fixedcolormap;
     else
     {
 	index = distance >> LIGHTZSHIFT;
@@ -159,15 +173,18 @@ R_MapPlane
 	if (index >= MAXLIGHTZ )
 	    index = MAXLIGHTZ-1;
 
-	ds_colormap = planezlight[index];
+	rc->ds_colormap = rc->planezlight[index];
     }
 	
-    ds_y = y;
-    ds_x1 = x1;
-    ds_x2 = x2;
+    rc->ds_y = y;
+    rc->ds_x1 = x1;
+    rc->ds_x2 = x2;
+
+    statspans++;
+    statpixels += x2 - x1 + 1;
 
     // high or low detail
-    spanfunc ();	
+    spanfunc (rc);	
 }
 
 
@@ -175,7 +192,7 @@ R_MapPlane
 // R_ClearPlanes
 // At begining of frame.
 //
-void R_ClearPlanes (void)
+void R_ClearPlanes (rcontext_t* rc)
 {
     int		i;
     angle_t	angle;
@@ -183,22 +200,23 @@ void R_ClearPlanes (void)
     // opening / clipping determination
     for (i=0 ; i<viewwidth ; i++)
     {
-	floorclip[i] = viewheight;
-	ceilingclip[i] = -1;
+	rc->floorclip[i] = viewheight;
+	rc->ceilingclip[i] = -1;
     }
 
-    lastvisplane = visplanes;
-    lastopening = openings;
+    rc->lastvisplane = rc->visplanes;
+    rc->lastopening = rc->openings;
     
     // texture calculation
-    memset (cachedheight, 0, sizeof(cachedheight));
+    rc->numplanerows = 0;
+    rc->nextplanerows = 0;
 
     // left to right mapping
-    angle = (viewangle-ANG90)>>ANGLETOFINESHIFT;
+    angle = (rc->viewangle-ANG90)>>ANGLETOFINESHIFT;
 	
     // scale will be unit scale at SCREENWIDTH/2 distance
-    basexscale = FixedDiv (finecosine[angle],centerxfrac);
-    baseyscale = -FixedDiv (finesine[angle],centerxfrac);
+    rc->basexscale = FixedDiv (finecosine[angle],centerxfrac);
+    rc->baseyscale = -FixedDiv (finesine[angle],centerxfrac);
 }
 
 
@@ -209,7 +227,8 @@ void R_ClearPlanes (void)
 //
 visplane_t*
 R_FindPlane
-( fixed_t	height,
+( rcontext_t*	rc,
+  fixed_t	height,
   int		picnum,
   int		lightlevel )
 {
@@ -221,7 +240,7 @@ R_FindPlane
 	lightlevel = 0;
     }
 	
-    for (check=visplanes; check<lastvisplane; check++)
+    for (check=rc->visplanes; check<rc->lastvisplane; check++)
     {
 	if (height == check->height
 	    && picnum == check->picnum
@@ -232,13 +251,13 @@ R_FindPlane
     }
     
 			
-    if (check < lastvisplane)
+    if (check < rc->lastvisplane)
 	return check;
 		
-    if (lastvisplane - visplanes == MAXVISPLANES)
+    if (rc->lastvisplane - rc->visplanes == MAXVISPLANES)
 	I_Error ("R_FindPlane: no more visplanes");
 		
-    lastvisplane++;
+    rc->lastvisplane++;
 
     check->height = height;
     check->picnum = picnum;
@@ -257,7 +276,8 @@ R_FindPlane
 //
 visplane_t*
 R_CheckPlane
-( visplane_t*	pl,
+( rcontext_t*	rc,
+  visplane_t*	pl,
   int		start,
   int		stop )
 {
@@ -303,11 +323,11 @@ R_CheckPlane
     }
 	
     // make a new visplane
-    lastvisplane->height = pl->height;
-    lastvisplane->picnum = pl->picnum;
-    lastvisplane->lightlevel = pl->lightlevel;
+    rc->lastvisplane->height = pl->height;
+    rc->lastvisplane->picnum = pl->picnum;
+    rc->lastvisplane->lightlevel = pl->lightlevel;
     
-    pl = lastvisplane++;
+    pl = rc->lastvisplane++;
     pl->minx = start;
     pl->maxx = stop;
 
@@ -322,7 +342,8 @@ R_CheckPlane
 //
 void
 R_MakeSpans
-( int		x,
+( rcontext_t*	rc,
+  int		x,
   int		t1,
   int		b1,
   int		t2,
@@ -330,23 +351,23 @@ R_MakeSpans
 {
     while (t1 < t2 && t1<=b1)
     {
-	R_MapPlane (t1,spanstart[t1],x-1);
+	R_MapPlane (rc, t1,rc->spanstart[t1],x-1);
 	t1++;
     }
     while (b1 > b2 && b1>=t1)
     {
-	R_MapPlane (b1,spanstart[b1],x-1);
+	R_MapPlane (rc, b1,rc->spanstart[b1],x-1);
 	b1--;
     }
 	
     while (t2 < t1 && t2<=b2)
     {
-	spanstart[t2] = x;
+	rc->spanstart[t2] = x;
 	t2++;
     }
     while (b2 > b1 && b2>=t2)
     {
-	spanstart[b2] = x;
+	rc->spanstart[b2] = x;
 	b2--;
     }
 }
@@ -357,7 +378,7 @@ R_MakeSpans
 // R_DrawPlanes
 // At the end of each frame.
 //
-void R_DrawPlanes (void)
+void R_DrawPlanes (rcontext_t* rc)
 {
     visplane_t*		pl;
     int			light;
@@ -365,22 +386,25 @@ void R_DrawPlanes (void)
     int			stop;
     int			angle;
     int                 lumpnum;
+    uint64_t		starttime;
 				
 #ifdef RANGECHECK
-    if (ds_p - drawsegs > MAXDRAWSEGS)
+    if (rc->ds_p - rc->drawsegs > MAXDRAWSEGS)
 	I_Error ("R_DrawPlanes: drawsegs overflow (%i)",
-		 ds_p - drawsegs);
+		 rc->ds_p - rc->drawsegs);
     
-    if (lastvisplane - visplanes > MAXVISPLANES)
+    if (rc->lastvisplane - rc->visplanes > MAXVISPLANES)
 	I_Error ("R_DrawPlanes: visplane overflow (%i)",
-		 lastvisplane - visplanes);
+		 rc->lastvisplane - rc->visplanes);
     
-    if (lastopening - openings > MAXOPENINGS)
+    if (rc->lastopening - rc->openings > MAXOPENINGS)
 	I_Error ("R_DrawPlanes: opening overflow (%i)",
-		 lastopening - openings);
+		 rc->lastopening - rc->openings);
 #endif
 
-    for (pl = visplanes ; pl < lastvisplane ; pl++)
+    starttime = renderstats ? I_GetTimeUS() : 0;
+
+    for (pl = rc->visplanes ; pl < rc->lastvisplane ; pl++)
     {
 	if (pl->minx > pl->maxx)
 	    continue;
@@ -389,25 +413,25 @@ void R_DrawPlanes (void)
 	// sky flat
 	if (pl->picnum == skyflatnum)
 	{
-	    dc_iscale = pspriteiscale>>detailshift;
+	    rc->dc_iscale = pspriteiscale>>detailshift;
 	    
 	    // Sky is allways drawn full bright,
 	    //  i.e. colormaps[0] is used.
 	    // Because of this hack, sky is not affected
 	    //  by INVUL inverse mapping.
-	    dc_colormap = colormaps;
-	    dc_texturemid = skytexturemid;
+	    rc->dc_colormap = colormaps;
+	    rc->dc_texturemid = skytexturemid;
 	    for (x=pl->minx ; x <= pl->maxx ; x++)
 	    {
-		dc_yl = pl->top[x];
-		dc_yh = pl->bottom[x];
+		rc->dc_yl = pl->top[x];
+		rc->dc_yh = pl->bottom[x];
 
-		if (dc_yl <= dc_yh)
+		if (rc->dc_yl <= rc->dc_yh)
 		{
-		    angle = (viewangle + xtoviewangle[x])>>ANGLETOSKYSHIFT;
-		    dc_x = x;
-		    dc_source = R_GetColumn(skytexture, angle);
-		    colfunc ();
+		    angle = (rc->viewangle + xtoviewangle[x])>>ANGLETOSKYSHIFT;
+		    rc->dc_x = x;
+		    rc->dc_source = R_GetColumn(skytexture, angle);
+		    rc->colfunc (rc);
 		}
 	    }
 	    continue;
@@ -415,10 +439,11 @@ void R_DrawPlanes (void)
 	
 	// regular flat
         lumpnum = firstflat + flattranslation[pl->picnum];
-	ds_source = W_CacheLumpNum(lumpnum, PU_STATIC);
+	rc->ds_source = R_CacheLumpNum(lumpnum, PU_STATIC);
 	
-	planeheight = abs(pl->height-viewz);
-	light = (pl->lightlevel >> LIGHTSEGSHIFT)+extralight;
+	rc->planeheight = abs(pl->height-rc->viewz);
+	R_SetPlaneRows (rc);
+	light = (pl->lightlevel >> LIGHTSEGSHIFT)+rc->extralight;
 
 	if (light >= LIGHTLEVELS)
 	    light = LIGHTLEVELS-1;
@@ -426,7 +451,7 @@ void R_DrawPlanes (void)
 	if (light < 0)
 	    light = 0;
 
-	planezlight = zlight[light];
+	rc->planezlight = zlight[light];
 
 	pl->top[pl->maxx+1] = 0xff;
 	pl->top[pl->minx-1] = 0xff;
@@ -435,7 +460,7 @@ void R_DrawPlanes (void)
 
 	for (x=pl->minx ; x<= stop ; x++)
 	{
-	    R_MakeSpans(x,pl->top[x-1],
+	    R_MakeSpans(rc, x,pl->top[x-1],
 			pl->bottom[x-1],
 			pl->top[x],
 			pl->bottom[x]);
@@ -443,4 +468,150 @@ void R_DrawPlanes (void)
 	
         W_ReleaseLumpNum(lumpnum);
     }
+
+    if (renderstats)
+    {
+	// Include the spans still waiting in the draw queue.
+	R_FlushDrawQueue ();
+	statplanetime += I_GetTimeUS() - starttime;
+	statframes++;
+    }
+}
+
+
+//
+// R_PrintPlaneStats
+// Prints the -renderstats totals for planes.
+//
+void R_PrintPlaneStats (void)
+{
+    unsigned int	lookups;
+
+    if (!renderstats || statframes == 0)
+	return;
+
+    lookups = statrowhits + statrowmisses;
+
+    printf ("R_PrintPlaneStats: %u frames, %u spans, %.1f pixels/span, "
+	    "%.1f%% rows cached, %.3f ms/frame in R_DrawPlanes\n",
+	    statframes, statspans,
+	    statspans ? (double) statpixels / statspans : 0.0,
+	    lookups ? 100.0 * statrowhits / lookups : 0.0,
+	    statplanetime / 1000.0 / statframes);
+}
+
+
+//
+// R_BenchmarkSpans
+// Draws floors filling the view, once with the plain C span drawer
+//  and once with the vector one, and prints the times and whether
+//  the pictures match.
+//
+#define BENCHFRAMES	200
+
+void R_ExecuteSetViewSize (void);
+
+static void
+R_BenchmarkSpanFrames
+( rcontext_t*		rc,
+  uint64_t*		time,
+  sha1_digest_t		digest )
+{
+    sha1_context_t	sha1;
+    uint64_t		starttime;
+    int			frame;
+    int			plane;
+    int			x;
+    int			y;
+    int			x1;
+    int			x2;
+
+    SHA1_Init (&sha1);
+    starttime = I_GetTimeUS ();
+
+    for (frame=0 ; frame<BENCHFRAMES ; frame++)
+    {
+	rc->viewangle = frame << 24;
+	R_ClearPlanes (rc);
+
+	// Four floors at different heights, side by side.
+	for (plane=0 ; plane<4 ; plane++)
+	{
+	    rc->planeheight = (plane + 1) * 24 * FRACUNIT;
+	    R_SetPlaneRows (rc);
+
+	    x1 = plane * viewwidth / 4;
+	    x2 = (plane + 1) * viewwidth / 4 - 1;
+
+	    for (y=0 ; y<viewheight ; y++)
+	    {
+		// Rows at the horizon have no distance.
+		if (y != centery)
+		    R_MapPlane (rc, y, x1, x2);
+	    }
+	}
+
+	R_FlushDrawQueue ();
+
+	for (y=0 ; y<viewheight ; y++)
+	{
+	    x = (y+viewwindowy)*SCREENWIDTH + viewwindowx;
+	    SHA1_Update (&sha1, I_VideoBuffer + x, scaledviewwidth);
+	}
+    }
+
+    *time = I_GetTimeUS () - starttime;
+    SHA1_Final (digest, &sha1);
+}
+
+void R_BenchmarkSpans (void)
+{
+    rcontext_t*		rc = &defaultcontext;
+    sha1_digest_t	cdigest;
+    sha1_digest_t	simddigest;
+    uint64_t		ctime;
+    uint64_t		simdtime;
+    int			lumpnum;
+    int			pixels;
+
+    //!
+    // @category video
+    //
+    // Time drawing floors with and without the vector span drawer,
+    // then quit.
+    //
+
+    if (!M_CheckParm ("-spanbench"))
+	return;
+
+    I_VideoBuffer = Z_Malloc (SCREENWIDTH * SCREENHEIGHT, PU_STATIC, NULL);
+    memset (I_VideoBuffer, 0, SCREENWIDTH * SCREENHEIGHT);
+    R_ExecuteSetViewSize ();
+
+    lumpnum = firstflat + flattranslation[R_FlatNumForName(DEH_String("FLOOR4_8"))];
+    rc->ds_source = W_CacheLumpNum (lumpnum, PU_STATIC);
+    rc->planezlight = zlight[LIGHTLEVELS / 2];
+    rc->fixedcolormap = NULL;
+
+    simdspans = false;
+    R_BenchmarkSpanFrames (rc, &ctime, cdigest);
+    simdspans = true;
+    R_BenchmarkSpanFrames (rc, &simdtime, simddigest);
+
+    W_ReleaseLumpNum (lumpnum);
+
+    pixels = viewwidth * (viewheight - 1);
+
+    printf ("R_BenchmarkSpans: %ix%i view, %i frames\n",
+	    viewwidth, viewheight, BENCHFRAMES);
+    printf ("  C:      %.3f ms/frame, %.1f Mpixels/s\n",
+	    ctime / 1000.0 / BENCHFRAMES,
+	    (double) pixels * BENCHFRAMES / (ctime ? ctime : 1));
+    printf ("  vector: %.3f ms/frame, %.1f Mpixels/s, %s\n",
+	    simdtime / 1000.0 / BENCHFRAMES,
+	    (double) pixels * BENCHFRAMES / (simdtime ? simdtime : 1),
+	    memcmp (cdigest, simddigest, sizeof(cdigest)) ? "MISMATCH"
+							 : "identical");
+
+    exit (0);
 }
@@ -25,49 +25,48 @@
 
 
 
-// Visplane related.
-extern  short*		lastopening;
-
-
 typedef void (*planefunction_t) (int top, int bottom);
 
 extern planefunction_t	floorfunc;
 extern planefunction_t	ceilingfunc_t;
 
-extern short		floorclip[SCREENWIDTH];
-extern short		ceilingclip[SCREENWIDTH];
-
 extern fixed_t		yslope[SCREENHEIGHT];
 extern fixed_t		distscale[SCREENWIDTH];
 
 void R_InitPlanes (void);
-void R_ClearPlanes (void);
+void R_ClearPlanes (rcontext_t* rc);
 
 void
 R_MapPlane
-( int		y,
+( rcontext_t*	rc,
+  int		y,
   int		x1,
   int		x2 );
 
 void
 R_MakeSpans
-( int		x,
+( rcontext_t*	rc,
+  int		x,
   int		t1,
   int		b1,
   int		t2,
   int		b2 );
 
-void R_DrawPlanes (void);
+void R_DrawPlanes (rcontext_t* rc);
+void R_PrintPlaneStats (void);
+void R_BenchmarkSpans (void);
 
 visplane_t*
 R_FindPlane
-( fixed_t	height,
+( rcontext_t*	rc,
+  fixed_t	height,
   int		picnum,
   int		lightlevel );
 
 visplane_t*
 R_CheckPlane
-( visplane_t*	pl,
+( rcontext_t*	rc,
+  visplane_t*	pl,
   int		start,
   int		stop );
 
@@ -35,57 +35,8 @@
 
 // OPTIMIZE: closed two sided lines as single sided
 
-// True if any of the segs textures might be visible.
-boolean		segtextured;	
-
-// False if the back side is the same plane.
-boolean		markfloor;	
-boolean		markceiling;
-
-boolean		maskedtexture;
-int		toptexture;
-int		bottomtexture;
-int		midtexture;
-
-
-angle_t		rw_normalangle;
-// angle to line origin
-int		rw_angle1;	
-
-//
-// regular wall
-//
-int		rw_x;
-int		rw_stopx;
-angle_t		rw_centerangle;
-fixed_t		rw_offset;
-fixed_t		rw_distance;
-fixed_t		rw_scale;
-fixed_t		rw_scalestep;
-fixed_t		rw_midtexturemid;
-fixed_t		rw_toptexturemid;
-fixed_t		rw_bottomtexturemid;
-
-int		worldtop;
-int		worldbottom;
-int		worldhigh;
-int		worldlow;
-
-fixed_t		pixhigh;
-fixed_t		pixlow;
-fixed_t		pixhighstep;
-fixed_t		pixlowstep;
-
-fixed_t		topfrac;
-fixed_t		topstep;
-
-fixed_t		bottomfrac;
-fixed_t		bottomstep;
-
-
-lighttable_t**	walllights;
-
-short*		maskedtexturecol;
+// The wall being drawn, its textures and the stepping values
+//  for its edges are kept in the renderer context.
 
 
 
@@ -94,7 +45,8 @@ short*		maskedtexturecol;
 //
 void
 R_RenderMaskedSegRange
-( drawseg_t*	ds,
+( rcontext_t*	rc,
+  drawseg_t*	ds,
   int		x1,
   int		x2 )
 {
@@ -107,77 +59,79 @@ R_RenderMaskedSegRange
     // Use different light tables
     //   for horizontal / vertical / diagonal. Diagonal?
     // OPTIMIZE: get rid of LIGHTSEGSHIFT globally
-    curline = ds->curline;
-    frontsector = curline->frontsector;
-    backsector = curline->backsector;
-    texnum = texturetranslation[curline->sidedef->midtexture];
+    rc->curline = ds->curline;
+    rc->frontsector = rc->curline->frontsector;
+    rc->backsector = rc->curline->backsector;
+    texnum = texturetranslation[rc->curline->sidedef->midtexture];
 	
-    lightnum = (frontsector->lightlevel >> LIGHTSEGSHIFT)+extralight;
+    lightnum = (rc->frontsector->lightlevel >> LIGHTSEGSHIFT)+rc->extralight;
 
-    if (curline->v1->y == curline->v2->y)
+    if (rc->curline->v1->y == rc->curline->v2->y)
 	lightnum--;
-    else if (curline->v1->x == curline->v2->x)
+    else if (rc->curline->v1->x == rc->curline->v2->x)
 	lightnum++;
 
     if (lightnum < 0)		
-	walllights = scalelight[0];
+	rc->walllights = scalelight[0];
     else if (lightnum >= LIGHTLEVELS)
-	walllights = scalelight[LIGHTLEVELS-1];
+	rc->walllights = scalelight[LIGHTLEVELS-1];
     else
-	walllights = scalelight[lightnum];
+	rc->walllights = scalelight[lightnum];
 
-    maskedtexturecol = ds->maskedtexturecol;
+    rc->maskedtexturecol = ds->maskedtexturecol;
 
-    rw_scalestep = ds->scalestep;		
-    spryscale = ds->scale1 + (x1 - ds->x1)*rw_scalestep;
-    mfloorclip = ds->sprbottomclip;
-    mceilingclip = ds->sprtopclip;
+    rc->rw_scalestep = ds->scalestep;		
+    rc->spryscale = ds->scale1 + (x1 - ds->x1)*rc->rw_scalestep;
+    rc->mfloorclip = ds->sprbottomclip;
+    rc->mceilingclip = ds->sprtopclip;
     
     // find positioning
-    if (curline->linedef->flags & ML_DONTPEGBOTTOM)
+    if (rc->curline->linedef->flags & ML_DONTPEGBOTTOM)
     {
-	dc_texturemid = frontsector->floorheight > backsector->floorheight
-	    ? frontsector->floorheight : backsector->floorheight;
-	dc_texturemid = dc_texturemid + textureheight[texnum] - viewz;
+	rc->dc_texturemid = rc->frontsector->floorheight > rc->backsector->floorheight
+	    ? rc->frontsector->floorheight : rc->backsector->floorheight;
+	rc->dc_texturemid = rc->dc_texturemid + textureheight[texnum] - rc->viewz;
     }
     else
     {
-	dc_texturemid =frontsector->ceilingheight<backsector->ceilingheight
-	    ? frontsector->ceilingheight : backsector->ceilingheight;
-	dc_texturemid = dc_texturemid - viewz;
+	rc->dc_texturemid =
+	    rc->frontsector->ceilingheight<rc->backsector->ceilingheight
+	    ? rc->frontsector->ceilingheight : rc->backsector->ceilingheight;
+	rc->dc_texturemid = rc->dc_texturemid - rc->viewz;
     }
-    dc_texturemid += curline->sidedef->rowoffset;
+    rc->dc_texturemid += rc->curline->sidedef->rowoffset;
 			
-    if (fixedcolormap)
-	dc_colormap = fixedcolormap;
+    if (rc->fixedcolormap)
+	rc->dc_colormap = rc->fixedcolormap;
     
     // draw the columns
-    for (dc_x = x1 ; dc_x <= x2 ; dc_x++)
+    for (rc->dc_x = x1 ; rc->dc_x <= x2 ; rc->dc_x++)
     {
 	// calculate lighting
-	if (maskedtexturecol[dc_x] != SHRT_MAX)
+	if (rc->maskedtexturecol[rc->dc_x] != SHRT_MAX)
 	{
-	    if (!fixedcolormap)
+	    if (!rc->fixedcolormap)
 	    {
-		index = spryscale>>LIGHTSCALESHIFT;
+		index = rc->spryscale>>LIGHTSCALESHIFT;
 
 		if (index >=  MAXLIGHTSCALE )
 		    index = MAXLIGHTSCALE-1;
 
-		dc_colormap = walllights[index];
+		rc->dc_colormap = rc->walllights[index];
 	    }
 			
-	    sprtopscreen = centeryfrac - FixedMul(dc_texturemid, spryscale);
-	    dc_iscale = 0xffffffffu / (unsigned)spryscale;
+	    rc->sprtopscreen =
+		centeryfrac - FixedMul(rc->dc_texturemid, rc->spryscale);
+	    rc->dc_iscale = 0xffffffffu / (unsigned)rc->spryscale;
 	    
 	    // draw the texture
 	    col = (column_t *)( 
-		(byte *)R_GetColumn(texnum,maskedtexturecol[dc_x]) -3);
+		(byte *)R_GetColumn(texnum,rc->maskedtexturecol[rc->dc_x]) -3);
 			
-	    R_DrawMaskedColumn (col);
-	    maskedtexturecol[dc_x] = SHRT_MAX;
+	    R_DrawMaskedColumn (rc, col);
+	    rc->maskedtexturecol[rc->dc_x] = SHRT_MAX;
 	}
-	spryscale += rw_scalestep;
+	rc->spryscale += rc->rw_scalestep;
     }
 	
 }
@@ -196,7 +150,7 @@ R_RenderMaskedSegRange
 #define HEIGHTBITS		12
 #define HEIGHTUNIT		(1<<HEIGHTBITS)
 
-void R_RenderSegLoop (void)
+void R_RenderSegLoop (rcontext_t* rc)
 {
     angle_t		angle;
     unsigned		index;
@@ -207,64 +161,65 @@ void R_RenderSegLoop (void)
     int			top;
     int			bottom;
 
-    for ( ; rw_x < rw_stopx ; rw_x++)
+    for ( ; rc->rw_x < rc->rw_stopx ; rc->rw_x++)
     {
 	// mark floor / ceiling areas
-	yl = (topfrac+HEIGHTUNIT-1)>>HEIGHTBITS;
+	yl = (rc->topfrac+HEIGHTUNIT-1)>>HEIGHTBITS;
 
 	// no space above wall?
-	if (yl < ceilingclip[rw_x]+1)
-	    yl = ceilingclip[rw_x]+1;
+	if (yl < rc->ceilingclip[rc->rw_x]+1)
+	    yl = rc->ceilingclip[rc->rw_x]+1;
 	
-	if (markceiling)
+	if (rc->markceiling)
 	{
-	    top = ceilingclip[rw_x]+1;
+	    top = rc->ceilingclip[rc->rw_x]+1;
 	    bottom = yl-1;
 
-	    if (bottom >= floorclip[rw_x])
-		bottom = floorclip[rw_x]-1;
+	    if (bottom >= rc->floorclip[rc->rw_x])
+		bottom = rc->floorclip[rc->rw_x]-1;
 
 	    if (top <= bottom)
 	    {
-		ceilingplane->top[rw_x] = top;
-		ceilingplane->bottom[rw_x] = bottom;
+		rc->ceilingplane->top[rc->rw_x] = top;
+		rc->ceilingplane->bottom[rc->rw_x] = bottom;
 	    }
 	}
 		
-	yh = bottomfrac>>HEIGHTBITS;
+	yh = rc->bottomfrac>>HEIGHTBITS;
 
-	if (yh >= floorclip[rw_x])
-	    yh = floorclip[rw_x]-1;
+	if (yh >= rc->floorclip[rc->rw_x])
+	    yh = rc->floorclip[rc->rw_x]-1;
 
-	if (markfloor)
+	if (rc->markfloor)
 	{
 	    top = yh+1;
-	    bottom = floorclip[rw_x]-1;
-	    if (top <= ceilingclip[rw_x])
-		top = ceilingclip[rw_x]+1;
+	    bottom = rc->floorclip[rc->rw_x]-1;
+	    if (top <= rc->ceilingclip[rc->rw_x])
+		top = rc->ceilingclip[rc->rw_x]+1;
 	    if (top <= bottom)
 	    {
-		floorplane->top[rw_x] = top;
-		floorplane->bottom[rw_x] = bottom;
+		rc->floorplane->top[rc->rw_x] = top;
+		rc->floorplane->bottom[rc->rw_x] = bottom;
 	    }
 	}
 	
 	// texturecolumn and lighting are independent of wall tiers
-	if (segtextured)
+	if (rc->segtextured)
 	{
 	    // calculate texture offset
-	    angle = (rw_centerangle + xtoviewangle[rw_x])>>ANGLETOFINESHIFT;
-	    texturecolumn = rw_offset-FixedMul(finetangent[angle],rw_distance);
+	    angle = (rc->rw_centerangle + xtoviewangle[rc->rw_x])>>ANGLETOFINESHIFT;
+	    texturecolumn =
+		rc->rw_offset-FixedMul(finetangent[angle],rc->rw_distance);
 	    texturecolumn >>= FRACBITS;
 	    // calculate lighting
-	    index = rw_scale>>LIGHTSCALESHIFT;
+	    index = rc->rw_scale>>LIGHTSCALESHIFT;
 
 	    if (index >=  MAXLIGHTSCALE )
 		index = MAXLIGHTSCALE-1;
 
-	    dc_colormap = walllights[index];
-	    dc_x = rw_x;
-	    dc_iscale = 0xffffffffu / (unsigned)rw_scale;
+	    rc->dc_colormap = rc->walllights[index];
+	    rc->dc_x = rc->rw_x;
+	    rc->dc_iscale = 0xffffffffu / (unsigned)rc->rw_scale;
 	}
         else
         {
@@ -274,89 +229,89 @@ void R_RenderSegLoop (void)
         }
 	
 	// draw the wall tiers
-	if (midtexture)
+	if (rc->midtexture)
 	{
 	    // single sided line
-	    dc_yl = yl;
-	    dc_yh = yh;
-	    dc_texturemid = rw_midtexturemid;
-	    dc_source = R_GetColumn(midtexture,texturecolumn);
-	    colfunc ();
-	    ceilingclip[rw_x] = viewheight;
-	    floorclip[rw_x] = -1;
+	    rc->dc_yl = yl;
+	    rc->dc_yh = yh;
+	    rc->dc_texturemid = rc->rw_midtexturemid;
+	    rc->dc_source = R_GetColumn(rc->midtexture,texturecolumn);
+	    rc->colfunc (rc);
+	    rc->ceilingclip[rc->rw_x] = viewheight;
+	    rc->floorclip[rc->rw_x] = -1;
 	}
 	else
 	{
 	    // two sided line
-	    if (toptexture)
+	    if (rc->toptexture)
 	    {
 		// top wall
-		mid = pixhigh>>HEIGHTBITS;
-		pixhigh += pixhighstep;
+		mid = rc->pixhigh>>HEIGHTBITS;
+		rc->pixhigh += rc->pixhighstep;
 
-		if (mid >= floorclip[rw_x])
-		    mid = floorclip[rw_x]-1;
+		if (mid >= rc->floorclip[rc->rw_x])
+		    mid = rc->floorclip[rc->rw_x]-1;
 
 		if (mid >= yl)
 		{
-		    dc_yl = yl;
-		    dc_yh = mid;
-		    dc_texturemid = rw_toptexturemid;
-		    dc_source = R_GetColumn(toptexture,texturecolumn);
-		    colfunc ();
-		    ceilingclip[rw_x] = mid;
+		    rc->dc_yl = yl;
+		    rc->dc_yh = mid;
+		    rc->dc_texturemid = rc->rw_toptexturemid;
+		    rc->dc_source = R_GetColumn(rc->toptexture,texturecolumn);
+		    rc->colfunc (rc);
+		    rc->ceilingclip[rc->rw_x] = mid;
 		}
 		else
-		    ceilingclip[rw_x] = yl-1;
+		    rc->ceilingclip[rc->rw_x] = yl-1;
 	    }
 	    else
 	    {
 		// no top wall
-		if (markceiling)
-		    ceilingclip[rw_x] = yl-1;
+		if (rc->markceiling)
+		    rc->ceilingclip[rc->rw_x] = yl-1;
 	    }
 			
-	    if (bottomtexture)
+	    if (rc->bottomtexture)
 	    {
 		// bottom wall
-		mid = (pixlow+HEIGHTUNIT-1)>>HEIGHTBITS;
-		pixlow += pixlowstep;
+		mid = (rc->pixlow+HEIGHTUNIT-1)>>HEIGHTBITS;
+		rc->pixlow += rc->pixlowstep;
 
 		// no space above wall?
-		if (mid <= ceilingclip[rw_x])
-		    mid = ceilingclip[rw_x]+1;
+		if (mid <= rc->ceilingclip[rc->rw_x])
+		    mid = rc->ceilingclip[rc->rw_x]+1;
 		
 		if (mid <= yh)
 		{
-		    dc_yl = mid;
-		    dc_yh = yh;
-		    dc_texturemid = rw_bottomtexturemid;
-		    dc_source = R_GetColumn(bottomtexture,
+		    rc->dc_yl = mid;
+		    rc->dc_yh = yh;
+		    rc->dc_texturemid = rc->rw_bottomtexturemid;
+		    rc->dc_source = R_GetColumn(rc->bottomtexture,
 					    texturecolumn);
-		    colfunc ();
-		    floorclip[rw_x] = mid;
+		    rc->colfunc (rc);
+		    rc->floorclip[rc->rw_x] = mid;
 		}
 		else
-		    floorclip[rw_x] = yh+1;
+		    rc->floorclip[rc->rw_x] = yh+1;
 	    }
 	    else
 	    {
 		// no bottom wall
-		if (markfloor)
-		    floorclip[rw_x] = yh+1;
+		if (rc->markfloor)
+		    rc->floorclip[rc->rw_x] = yh+1;
 	    }
 			
-	    if (maskedtexture)
+	    if (rc->maskedtexture)
 	    {
 		// save texturecol
 		//  for backdrawing of masked mid texture
-		maskedtexturecol[rw_x] = texturecolumn;
+		rc->maskedtexturecol[rc->rw_x] = texturecolumn;
 	    }
 	}
 		
-	rw_scale += rw_scalestep;
-	topfrac += topstep;
-	bottomfrac += bottomstep;
+	rc->rw_scale += rc->rw_scalestep;
+	rc->topfrac += rc->topstep;
+	rc->bottomfrac += rc->bottomstep;
     }
 }
 
@@ -370,7 +325,8 @@ void R_RenderSegLoop (void)
 //
 void
 R_StoreWallRange
-( int	start,
+( rcontext_t*	rc,
+  int	start,
   int	stop )
 {
     fixed_t		hyp;
@@ -380,7 +336,7 @@ R_StoreWallRange
     int			lightnum;
 
     // don't overflow and crash
-    if (ds_p == &drawsegs[MAXDRAWSEGS])
+    if (rc->ds_p == &rc->drawsegs[MAXDRAWSEGS])
 	return;		
 		
 #ifdef RANGECHECK
@@ -388,39 +344,40 @@ R_StoreWallRange
 	I_Error ("Bad R_RenderWallRange: %i to %i", start , stop);
 #endif
     
-    sidedef = curline->sidedef;
-    linedef = curline->linedef;
+    rc->sidedef = rc->curline->sidedef;
+    rc->linedef = rc->curline->linedef;
 
     // mark the segment as visible for auto map
-    linedef->flags |= ML_MAPPED;
+    rc->linedef->flags |= ML_MAPPED;
     
     // calculate rw_distance for scale calculation
-    rw_normalangle = curline->angle + ANG90;
-    offsetangle = abs(rw_normalangle-rw_angle1);
+    rc->rw_normalangle = rc->curline->angle + ANG90;
+    offsetangle = abs(rc->rw_normalangle-rc->rw_angle1);
     
     if (offsetangle > ANG90)
 	offsetangle = ANG90;
 
     distangle = ANG90 - offsetangle;
-    hyp = R_PointToDist (curline->v1->x, curline->v1->y);
+    hyp = R_PointToDist (rc, rc->curline->v1->x, rc->curline->v1->y);
     sineval = finesine[distangle>>ANGLETOFINESHIFT];
-    rw_distance = FixedMul (hyp, sineval);
+    rc->rw_distance = FixedMul (hyp, sineval);
 		
 	
-    ds_p->x1 = rw_x = start;
-    ds_p->x2 = stop;
-    ds_p->curline = curline;
-    rw_stopx = stop+1;
+    rc->ds_p->x1 = rc->rw_x = start;
+    rc->ds_p->x2 = stop;
+    rc->ds_p->curline = rc->curline;
+    rc->rw_stopx = stop+1;
     
     // calculate scale at both ends and step
-    ds_p->scale1 = rw_scale = 
-	R_ScaleFromGlobalAngle (viewangle + xtoviewangle[start]);
+    rc->ds_p->scale1 = rc->rw_scale = 
+	R_ScaleFromGlobalAngle (rc, rc->viewangle + xtoviewangle[start]);
     
     if (stop > start )
     {
-	ds_p->scale2 = R_ScaleFromGlobalAngle (viewangle + xtoviewangle[stop]);
-	ds_p->scalestep = rw_scalestep = 
-	    (ds_p->scale2 - rw_scale) / (stop-start);
+	rc->ds_p->scale2 =
+	    R_ScaleFromGlobalAngle (rc, rc->viewangle + xtoviewangle[stop]);
+	rc->ds_p->scalestep = rc->rw_scalestep = 
+	    (rc->ds_p->scale2 - rc->rw_scale) / (stop-start);
     }
     else
     {
@@ -439,183 +396,185 @@ R_StoreWallRange
 	    ds_p->scale1 = FixedDiv(projection, gxt-gyt)<<detailshift;
 	}
 #endif
-	ds_p->scale2 = ds_p->scale1;
+	rc->ds_p->scale2 = rc->ds_p->scale1;
     }
     
     // calculate texture boundaries
     //  and decide if floor / ceiling marks are needed
-    worldtop = frontsector->ceilingheight - viewz;
-    worldbottom = frontsector->floorheight - viewz;
+    rc->worldtop = rc->frontsector->ceilingheight - rc->viewz;
+    rc->worldbottom = rc->frontsector->floorheight - rc->viewz;
 	
-    midtexture = toptexture = bottomtexture = maskedtexture = 0;
-    ds_p->maskedtexturecol = NULL;
+    rc->midtexture = rc->toptexture = rc->bottomtexture = rc->maskedtexture = 0;
+    rc->ds_p->maskedtexturecol = NULL;
 	
-    if (!backsector)
+    if (!rc->backsector)
     {
 	// single sided line
-	midtexture = texturetranslation[sidedef->midtexture];
+	rc->midtexture = texturetranslation[rc->sidedef->midtexture];
 	// a single sided line is terminal, so it must mark ends
-	markfloor = markceiling = true;
-	if (linedef->flags & ML_DONTPEGBOTTOM)
+	rc->markfloor = rc->markceiling = true;
+	if (rc->linedef->flags & ML_DONTPEGBOTTOM)
 	{
-	    vtop = frontsector->floorheight +
-		textureheight[sidedef->midtexture];
+	    vtop = rc->frontsector->floorheight +
+		textureheight[rc->sidedef->midtexture];
 	    // bottom of texture at bottom
-	    rw_midtexturemid = vtop - viewz;	
+	    rc->rw_midtexturemid = vtop - rc->viewz;	
 	}
 	else
 	{
 	    // top of texture at top
-	    rw_midtexturemid = worldtop;
+	    rc->rw_midtexturemid = rc->worldtop;
 	}
-	rw_midtexturemid += sidedef->rowoffset;
+	rc->rw_midtexturemid += rc->sidedef->rowoffset;
 
-	ds_p->silhouette = SIL_BOTH;
-	ds_p->sprtopclip = screenheightarray;
-	ds_p->sprbottomclip = negonearray;
-	ds_p->bsilheight = INT_MAX;
-	ds_p->tsilheight = INT_MIN;
+	rc->ds_p->silhouette = SIL_BOTH;
+	rc->ds_p->sprtopclip = screenheightarray;
+	rc->ds_p->sprbottomclip = negonearray;
+	rc->ds_p->bsilheight = INT_MAX;
+	rc->ds_p->tsilheight = INT_MIN;
     }
     else
     {
 	// two sided line
-	ds_p->sprtopclip = ds_p->sprbottomclip = NULL;
-	ds_p->silhouette = 0;
+	rc->ds_p->sprtopclip = rc->ds_p->sprbottomclip = NULL;
+	rc->ds_p->silhouette = 0;
 	
-	if (frontsector->floorheight > backsector->floorheight)
+	if (rc->frontsector->floorheight > rc->backsector->floorheight)
 	{
-	    ds_p->silhouette = SIL_BOTTOM;
-	    ds_p->bsilheight = frontsector->floorheight;
+	    rc->ds_p->silhouette = SIL_BOTTOM;
+	    rc->ds_p->bsilheight = rc->frontsector->floorheight;
 	}
-	else if (backsector->floorheight > viewz)
+	else if (rc->backsector->floorheight > rc->viewz)
 	{
-	    ds_p->silhouette = SIL_BOTTOM;
-	    ds_p->bsilheight = INT_MAX;
+	    rc->ds_p->silhouette = SIL_BOTTOM;
+	    rc->ds_p->bsilheight = INT_MAX;
 	    // ds_p->sprbottomclip = negonearray;
 	}
 	
-	if (frontsector->ceilingheight < backsector->ceilingheight)
+	if (rc->frontsector->ceilingheight < rc->backsector->ceilingheight)
 	{
-	    ds_p->silhouette |= SIL_TOP;
-	    ds_p->tsilheight = frontsector->ceilingheight;
+	    rc->ds_p->silhouette |= SIL_TOP;
+	    rc->ds_p->tsilheight = rc->frontsector->ceilingheight;
 	}
-	else if (backsector->ceilingheight < viewz)
+	else if (rc->backsector->ceilingheight < rc->viewz)
 	{
-	    ds_p->silhouette |= SIL_TOP;
-	    ds_p->tsilheight = INT_MIN;
+	    rc->ds_p->silhouette |= SIL_TOP;
+	    rc->ds_p->tsilheight = INT_MIN;
 	    // ds_p->sprtopclip = screenheightarray;
 	}
 		
-	if (backsector->ceilingheight <= frontsector->floorheight)
+	if (rc->backsector->ceilingheight <= rc->frontsector->floorheight)
 	{
-	    ds_p->sprbottomclip = negonearray;
-	    ds_p->bsilheight = INT_MAX;
-	    ds_p->silhouette |= SIL_BOTTOM;
+	    rc->ds_p->sprbottomclip = negonearray;
+	    rc->ds_p->bsilheight = INT_MAX;
+	    rc->ds_p->silhouette |= SIL_BOTTOM;
 	}
 	
-	if (backsector->floorheight >= frontsector->ceilingheight)
+	if (rc->backsector->floorheight >= rc->frontsector->ceilingheight)
 	{
-	    ds_p->sprtopclip = screenheightarray;
-	    ds_p->tsilheight = INT_MIN;
-	    ds_p->silhouette |= SIL_TOP;
+	    rc->ds_p->sprtopclip = screenheightarray;
+	    rc->ds_p->tsilheight = INT_MIN;
+	    rc->ds_p->silhouette |= SIL_TOP;
 	}
 	
-	worldhigh = backsector->ceilingheight - viewz;
-	worldlow = backsector->floorheight - viewz;
+	rc->worldhigh = rc->backsector->ceilingheight - rc->viewz;
+	rc->worldlow = rc->backsector->floorheight - rc->viewz;
 		
 	// hack to allow height changes in outdoor areas
-	if (frontsector->ceilingpic == skyflatnum 
-	    && backsector->ceilingpic == skyflatnum)
+	if (rc->frontsector->ceilingpic == skyflatnum 
+	    && rc->backsector->ceilingpic == skyflatnum)
 	{
-	    worldtop = worldhigh;
+	    rc->worldtop = rc->worldhigh;
 	}
 	
 			
-	if (worldlow != worldbottom 
-	    || backsector->floorpic != frontsector->floorpic
-	    || backsector->lightlevel != frontsector->lightlevel)
+	if (rc->worldlow != rc->worldbottom 
+	    || rc->backsector->floorpic != rc->frontsector->floorpic
+	    || rc->backsector->lightlevel != rc->frontsector->lightlevel)
 	{
-	    markfloor = true;
+	    rc->markfloor = true;
 	}
 	else
 	{
 	    // same plane on both sides
-	    markfloor = false;
+	    rc->markfloor = false;
 	}
 	
 			
-	if (worldhigh != worldtop 
-	    || backsector->ceilingpic != frontsector->ceilingpic
-	    || backsector->lightlevel != frontsector->lightlevel)
+	if (rc->worldhigh != rc->worldtop 
+	    || rc->backsector->ceilingpic != rc->frontsector->ceilingpic
+	    || rc->backsector->lightlevel != rc->frontsector->lightlevel)
 	{
-	    markceiling = true;
+	    rc->markceiling = true;
 	}
 	else
 	{
 	    // same plane on both sides
-	    markceiling = false;
+	    rc->markceiling = false;
 	}
 	
-	if (backsector->ceilingheight <= frontsector->floorheight
-	    || backsector->floorheight >= frontsector->ceilingheight)
+	if (rc->backsector->ceilingheight <= rc->frontsector->floorheight
+	    || rc->backsector->floorheight >= rc->frontsector->ceilingheight)
 	{
 	    // closed door
-	    markceiling = markfloor = true;
+	    rc->markceiling = rc->markfloor = true;
 	}
 	
 
-	if (worldhigh < worldtop)
+	if (rc->worldhigh < rc->worldtop)
 	{
 	    // top texture
-	    toptexture = texturetranslation[sidedef->toptexture];
-	    if (linedef->flags & ML_DONTPEGTOP)
+	    rc->toptexture = texturetranslation[rc->sidedef->toptexture];
+	    if (rc->linedef->flags & ML_DONTPEGTOP)
 	    {
 		// top of texture at top
-		rw_toptexturemid = worldtop;
+		rc->rw_toptexturemid = rc->worldtop;
 	    }
 	    else
 	    {
 		vtop =
-		    backsector->ceilingheight
-		    + textureheight[sidedef->toptexture];
+		    rc->backsector->ceilingheight
+		    + textureheight[rc->sidedef->toptexture];
 		
 		// bottom of texture
-		rw_toptexturemid = vtop - viewz;	
+		rc->rw_toptexturemid = vtop - rc->viewz;	
 	    }
 	}
-	if (worldlow > worldbottom)
+	if (rc->worldlow > rc->worldbottom)
 	{
 	    // bottom texture
-	    bottomtexture = texturetranslation[sidedef->bottomtexture];
+	    rc->bottomtexture = texturetranslation[rc->sidedef->bottomtexture];
 
-	    if (linedef->flags & ML_DONTPEGBOTTOM )
+	    if (rc->linedef->flags & ML_DONTPEGBOTTOM )
 	    {
 		// bottom of texture at bottom
 		// top of texture at top
-		rw_bottomtexturemid = worldtop;
+		rc->rw_bottomtexturemid = rc->worldtop;
 	    }
 	    else	// top of texture at top
-		rw_bottomtexturemid = worldlow;
+		rc->rw_bottomtexturemid = rc->worldlow;
 	}
-	rw_toptexturemid += sidedef->rowoffset;
-	rw_bottomtexturemid += sidedef->rowoffset;
+	rc->rw_toptexturemid += rc->sidedef->rowoffset;
+	rc->rw_bottomtexturemid += rc->sidedef->rowoffset;
 	
 	// allocate space for masked texture tables
-	if (sidedef->midtexture)
+	if (rc->sidedef->midtexture)
 	{
 	    // masked midtexture
-	    maskedtexture = true;
-	    ds_p->maskedtexturecol = maskedtexturecol = lastopening - rw_x;
-	    lastopening += rw_stopx - rw_x;
+	    rc->maskedtexture = true;
+	    rc->ds_p->maskedtexturecol = rc->maskedtexturecol =
+		rc->lastopening - rc->rw_x;
+	    rc->lastopening += rc->rw_stopx - rc->rw_x;
 	}
     }
     
     // calculate rw_offset (only needed for textured lines)
-    segtextured = midtexture | toptexture | bottomtexture | maskedtexture;
+    rc->segtextured = rc->midtexture | rc->toptexture
+		    | rc->bottomtexture | rc->maskedtexture;
 
-    if (segtextured)
+    if (rc->segtextured)
     {
-	offsetangle = rw_normalangle-rw_angle1;
+	offsetangle = rc->rw_normalangle-rc->rw_angle1;
 	
 	if (offsetangle > ANG180)
 	    offsetangle = -offsetangle;
@@ -624,33 +583,33 @@ R_StoreWallRange
 	    offsetangle = ANG90;
 
 	sineval = finesine[offsetangle >>ANGLETOFINESHIFT];
-	rw_offset = FixedMul (hyp, sineval);
+	rc->rw_offset = FixedMul (hyp, sineval);
 
-	if (rw_normalangle-rw_angle1 < ANG180)
-	    rw_offset = -rw_offset;
+	if (rc->rw_normalangle-rc->rw_angle1 < ANG180)
+	    rc->rw_offset = -rc->rw_offset;
 
-	rw_offset += sidedef->textureoffset + curline->offset;
-	rw_centerangle = ANG90 + viewangle - rw_normalangle;
+	rc->rw_offset += rc->sidedef->textureoffset + rc->curline->offset;
+	rc->rw_centerangle = ANG90 + rc->viewangle - rc->rw_normalangle;
 	
 	// calculate light table
 	//  use different light tables
 	//  for horizontal / vertical / diagonal
 	// OPTIMIZE: get rid of LIGHTSEGSHIFT globally
-	if (!fixedcolormap)
+	if (!rc->fixedcolormap)
 	{
-	    lightnum = (frontsector->lightlevel >> LIGHTSEGSHIFT)+extralight;
+	    lightnum = (rc->frontsector->lightlevel >> LIGHTSEGSHIFT)+rc->extralight;
 
-	    if (curline->v1->y == curline->v2->y)
+	    if (rc->curline->v1->y == rc->curline->v2->y)
 		lightnum--;
-	    else if (curline->v1->x == curline->v2->x)
+	    else if (rc->curline->v1->x == rc->curline->v2->x)
 		lightnum++;
 
 	    if (lightnum < 0)		
-		walllights = scalelight[0];
+		rc->walllights = scalelight[0];
 	    else if (lightnum >= LIGHTLEVELS)
-		walllights = scalelight[LIGHTLEVELS-1];
+		rc->walllights = scalelight[LIGHTLEVELS-1];
 	    else
-		walllights = scalelight[lightnum];
+		rc->walllights = scalelight[lightnum];
 	}
     }
     
@@ -659,85 +618,89 @@ R_StoreWallRange
     //  and doesn't need to be marked.
     
   
-    if (frontsector->floorheight >= viewz)
+    if (rc->frontsector->floorheight >= rc->viewz)
     {
 	// above view plane
-	markfloor = false;
+	rc->markfloor = false;
     }
     
-    if (frontsector->ceilingheight <= viewz 
-	&& frontsector->ceilingpic != skyflatnum)
+    if (rc->frontsector->ceilingheight <= rc->viewz 
+	&& rc->frontsector->ceilingpic != skyflatnum)
     {
 	// below view plane
-	markceiling = false;
+	rc->markceiling = false;
     }
 
     
     // calculate incremental stepping values for texture edges
-    worldtop >>= 4;
-    worldbottom >>= 4;
+    rc->worldtop >>= 4;
+    rc->worldbottom >>= 4;
 	
-    topstep = -FixedMul (rw_scalestep, worldtop);
-    topfrac = (centeryfrac>>4) - FixedMul (worldtop, rw_scale);
+    rc->topstep = -FixedMul (rc->rw_scalestep, rc->worldtop);
+    rc->topfrac = (centeryfrac>>4) - FixedMul (rc->worldtop, rc->rw_scale);
 
-    bottomstep = -FixedMul (rw_scalestep,worldbottom);
-    bottomfrac = (centeryfrac>>4) - FixedMul (worldbottom, rw_scale);
+    rc->bottomstep = -FixedMul (rc->rw_scalestep,rc->worldbottom);
+    rc->bottomfrac = (centeryfrac>>4) - FixedMul (rc->worldbottom, rc->rw_scale);
 	
-    if (backsector)
+    if (rc->backsector)
     {	
-	worldhigh >>= 4;
-	worldlow >>= 4;
+	rc->worldhigh >>= 4;
+	rc->worldlow >>= 4;
 
-	if (worldhigh < worldtop)
+	if (rc->worldhigh < rc->worldtop)
 	{
-	    pixhigh = (centeryfrac>>4) - FixedMul (worldhigh, rw_scale);
-	    pixhighstep = -FixedMul (rw_scalestep,worldhigh);
+	    rc->pixhigh = (centeryfrac>>4) - FixedMul (rc->worldhigh, rc->rw_scale);
+	    rc->pixhighstep = -FixedMul (rc->rw_scalestep,rc->worldhigh);
 	}
 	
-	if (worldlow > worldbottom)
+	if (rc->worldlow > rc->worldbottom)
 	{
-	    pixlow = (centeryfrac>>4) - FixedMul (worldlow, rw_scale);
-	    pixlowstep = -FixedMul (rw_scalestep,worldlow);
+	    rc->pixlow = (centeryfrac>>4) - FixedMul (rc->worldlow, rc->rw_scale);
+	    rc->pixlowstep = -FixedMul (rc->rw_scalestep,rc->worldlow);
 	}
     }
     
     // render it
-    if (markceiling)
-	ceilingplane = R_CheckPlane (ceilingplane, rw_x, rw_stopx-1);
+    if (rc->markceiling)
+	rc->ceilingplane = R_CheckPlane (rc, rc->ceilingplane,
+					 rc->rw_x, rc->rw_stopx-1);
     
-    if (markfloor)
-	floorplane = R_CheckPlane (floorplane, rw_x, rw_stopx-1);
+    if (rc->markfloor)
+	rc->floorplane = R_CheckPlane (rc, rc->floorplane,
+				       rc->rw_x, rc->rw_stopx-1);
 
-    R_RenderSegLoop ();
+    R_RenderSegLoop (rc);
 
     
     // save sprite clipping info
-    if ( ((ds_p->silhouette & SIL_TOP) || maskedtexture)
-	 && !ds_p->sprtopclip)
+    if ( ((rc->ds_p->silhouette & SIL_TOP) || rc->maskedtexture)
+	 && !rc->ds_p->sprtopclip)
     {
-	memcpy (lastopening, ceilingclip+start, sizeof(*lastopening)*(rw_stopx-start));
-	ds_p->sprtopclip = lastopening - start;
-	lastopening += rw_stopx - start;
+	memcpy (rc->lastopening, rc->ceilingclip+start,
+		sizeof(*rc->lastopening)*(rc->rw_stopx-start));
+	rc->ds_p->sprtopclip = rc->lastopening - start;
+	rc->lastopening += rc->rw_stopx - start;
     }
     
-    if ( ((ds_p->silhouette & SIL_BOTTOM) || maskedtexture)
-	 && !ds_p->sprbottomclip)
+    if ( ((rc->ds_p->silhouette & SIL_BOTTOM) || rc->maskedtexture)
+	 && !rc->ds_p->sprbottomclip)
     {
-	memcpy (lastopening, floorclip+start, sizeof(*lastopening)*(rw_stopx-start));
-	ds_p->sprbottomclip = lastopening - start;
-	lastopening += rw_stopx - start;	
+	memcpy (rc->lastopening, rc->floorclip+start,
+		sizeof(*rc->lastopening)*(rc->rw_stopx-start));
+	rc->ds_p->sprbottomclip = rc->lastopening - start;
+	rc->lastopening += rc->rw_stopx - start;	
     }
 
-    if (maskedtexture && !(ds_p->silhouette&SIL_TOP))
+    if (rc->maskedtexture && !(rc->ds_p->silhouette&SIL_TOP))
     {
-	ds_p->silhouette |= SIL_TOP;
-	ds_p->tsilheight = INT_MIN;
+	rc->ds_p->silhouette |= SIL_TOP;
+	rc->ds_p->tsilheight = INT_MIN;
     }
-    if (maskedtexture && !(ds_p->silhouette&SIL_BOTTOM))
+    if (rc->maskedtexture && !(rc->ds_p->silhouette&SIL_BOTTOM))
     {
-	ds_p->silhouette |= SIL_BOTTOM;
-	ds_p->bsilheight = INT_MAX;
+	rc->ds_p->silhouette |= SIL_BOTTOM;
+	rc->ds_p->bsilheight = INT_MAX;
     }
-    ds_p++;
+    rc->ds_p++;
 }
 
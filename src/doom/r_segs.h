@@ -25,7 +25,8 @@
 
 void
 R_RenderMaskedSegRange
-( drawseg_t*	ds,
+( rcontext_t*	rc,
+  drawseg_t*	ds,
   int		x1,
   int		x2 );
 
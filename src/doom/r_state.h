@@ -93,14 +93,8 @@ extern side_t*		sides;
 
 //
 // POV data.
+// The view point itself is kept in the renderer context.
 //
-extern fixed_t		viewx;
-extern fixed_t		viewy;
-extern fixed_t		viewz;
-
-extern angle_t		viewangle;
-extern player_t*	viewplayer;
-
 
 // ?
 extern angle_t		clipangle;
@@ -109,19 +103,5 @@ extern int		viewangletox[FINEANGLES/2];
 extern angle_t		xtoviewangle[SCREENWIDTH+1];
 //extern fixed_t		finetangent[FINEANGLES/2];
 
-extern fixed_t		rw_distance;
-extern angle_t		rw_normalangle;
-
-
-
-// angle to line origin
-extern int		rw_angle1;
-
-// Segs count?
-extern int		sscount;
-
-extern visplane_t*	floorplane;
-extern visplane_t*	ceilingplane;
-
 
 #endif
@@ -28,6 +28,7 @@
 
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_timer.h"
 #include "z_zone.h"
 #include "w_wad.h"
 
@@ -68,8 +69,6 @@ typedef struct
 fixed_t		pspritescale;
 fixed_t		pspriteiscale;
 
-lighttable_t**	spritelights;
-
 // constant arrays
 //  used for psprite clipping and initializing clipping
 short		negonearray[SCREENWIDTH];
@@ -278,8 +277,6 @@ void R_InitSpriteDefs (char** namelist)
 //
 // GAME FUNCTIONS
 //
-vissprite_t	vissprites[MAXVISSPRITES];
-vissprite_t*	vissprite_p;
 int		newvissprite;
 
 
@@ -306,24 +303,22 @@ void R_InitSprites (char** namelist)
 // R_ClearSprites
 // Called at frame start.
 //
-void R_ClearSprites (void)
+void R_ClearSprites (rcontext_t* rc)
 {
-    vissprite_p = vissprites;
+    rc->vissprite_p = rc->vissprites;
 }
 
 
 //
 // R_NewVisSprite
 //
-vissprite_t	overflowsprite;
-
-vissprite_t* R_NewVisSprite (void)
+vissprite_t* R_NewVisSprite (rcontext_t* rc)
 {
-    if (vissprite_p == &vissprites[MAXVISSPRITES])
-	return &overflowsprite;
+    if (rc->vissprite_p == &rc->vissprites[MAXVISSPRITES])
+	return &rc->overflowsprite;
     
-    vissprite_p++;
-    return vissprite_p-1;
+    rc->vissprite_p++;
+    return rc->vissprite_p-1;
 }
 
 
@@ -334,49 +329,43 @@ vissprite_t* R_NewVisSprite (void)
 // Masked means: partly transparent, i.e. stored
 //  in posts/runs of opaque pixels.
 //
-short*		mfloorclip;
-short*		mceilingclip;
-
-fixed_t		spryscale;
-fixed_t		sprtopscreen;
-
-void R_DrawMaskedColumn (column_t* column)
+void R_DrawMaskedColumn (rcontext_t* rc, column_t* column)
 {
     int		topscreen;
     int 	bottomscreen;
     fixed_t	basetexturemid;
 	
-    basetexturemid = dc_texturemid;
+    basetexturemid = rc->dc_texturemid;
 	
     for ( ; column->topdelta != 0xff ; ) 
     {
 	// calculate unclipped screen coordinates
 	//  for post
-	topscreen = sprtopscreen + spryscale*column->topdelta;
-	bottomscreen = topscreen + spryscale*column->length;
+	topscreen = rc->sprtopscreen + rc->spryscale*column->topdelta;
+	bottomscreen = topscreen + rc->spryscale*column->length;
 
-	dc_yl = (topscreen+FRACUNIT-1)>>FRACBITS;
-	dc_yh = (bottomscreen-1)>>FRACBITS;
+	rc->dc_yl = (topscreen+FRACUNIT-1)>>FRACBITS;
+	rc->dc_yh = (bottomscreen-1)>>FRACBITS;
 		
-	if (dc_yh >= mfloorclip[dc_x])
-	    dc_yh = mfloorclip[dc_x]-1;
-	if (dc_yl <= mceilingclip[dc_x])
-	    dc_yl = mceilingclip[dc_x]+1;
+	if (rc->dc_yh >= rc->mfloorclip[rc->dc_x])
+	    rc->dc_yh = rc->mfloorclip[rc->dc_x]-1;
+	if (rc->dc_yl <= rc->mceilingclip[rc->dc_x])
+	    rc->dc_yl = rc->mceilingclip[rc->dc_x]+1;
 
-	if (dc_yl <= dc_yh)
+	if (rc->dc_yl <= rc->dc_yh)
 	{
-	    dc_source = (byte *)column + 3;
-	    dc_texturemid = basetexturemid - (column->topdelta<<FRACBITS);
+	    rc->dc_source = (byte *)column + 3;
+	    rc->dc_texturemid = basetexturemid - (column->topdelta<<FRACBITS);
 	    // dc_source = (byte *)column + 3 - column->topdelta;
 
 	    // Drawn by either R_DrawColumn
 	    //  or (SHADOW) R_DrawFuzzColumn.
-	    colfunc ();	
+	    rc->colfunc (rc);	
 	}
 	column = (column_t *)(  (byte *)column + column->length + 4);
     }
 	
-    dc_texturemid = basetexturemid;
+    rc->dc_texturemid = basetexturemid;
 }
 
 
@@ -387,7 +376,8 @@ void R_DrawMaskedColumn (column_t* column)
 //
 void
 R_DrawVisSprite
-( vissprite_t*		vis,
+( rcontext_t*		rc,
+  vissprite_t*		vis,
   int			x1,
   int			x2 )
 {
@@ -397,29 +387,31 @@ R_DrawVisSprite
     patch_t*		patch;
 	
 	
-    patch = W_CacheLumpNum (vis->patch+firstspritelump, PU_CACHE);
+    patch = R_CacheLumpNum (vis->patch+firstspritelump, PU_CACHE);
 
-    dc_colormap = vis->colormap;
+    rc->dc_colormap = vis->colormap;
     
-    if (!dc_colormap)
+    if (!rc->dc_colormap)
     {
 	// NULL colormap = shadow draw
-	colfunc = fuzzcolfunc;
+	rc->colfunc = fuzzcolfunc;
     }
     else if (vis->mobjflags & MF_TRANSLATION)
     {
-	colfunc = transcolfunc;
-	dc_translation = translationtables - 256 +
+	rc->colfunc = transcolfunc;
+	rc->dc_translation = translationtables - 256 +
 	    ( (vis->mobjflags & MF_TRANSLATION) >> (MF_TRANSSHIFT-8) );
     }
 	
-    dc_iscale = abs(vis->xiscale)>>detailshift;
-    dc_texturemid = vis->texturemid;
+    rc->dc_iscale = abs(vis->xiscale)>>detailshift;
+    rc->dc_texturemid = vis->texturemid;
     frac = vis->startfrac;
-    spryscale = vis->scale;
-    sprtopscreen = centeryfrac - FixedMul(dc_texturemid,spryscale);
+    rc->spryscale = vis->scale;
+    rc->sprtopscreen = centeryfrac - FixedMul(rc->dc_texturemid,rc->spryscale);
 	
-    for (dc_x=vis->x1 ; dc_x<=vis->x2 ; dc_x++, frac += vis->xiscale)
+    for (rc->dc_x=vis->x1 ;
+	 rc->dc_x<=vis->x2 ;
+	 rc->dc_x++, frac += vis->xiscale)
     {
 	texturecolumn = frac>>FRACBITS;
 #ifdef RANGECHECK
@@ -428,10 +420,10 @@ R_DrawVisSprite
 #endif
 	column = (column_t *) ((byte *)patch +
 			       LONG(patch->columnofs[texturecolumn]));
-	R_DrawMaskedColumn (column);
+	R_DrawMaskedColumn (rc, column);
     }
 
-    colfunc = basecolfunc;
+    rc->colfunc = basecolfunc;
 }
 
 
@@ -441,7 +433,7 @@ R_DrawVisSprite
 // Generates a vissprite for a thing
 //  if it might be visible.
 //
-void R_ProjectSprite (mobj_t* thing)
+void R_ProjectSprite (rcontext_t* rc, mobj_t* thing)
 {
     fixed_t		tr_x;
     fixed_t		tr_y;
@@ -472,11 +464,11 @@ void R_ProjectSprite (mobj_t* thing)
     fixed_t		iscale;
     
     // transform the origin point
-    tr_x = thing->x - viewx;
-    tr_y = thing->y - viewy;
+    tr_x = thing->x - rc->viewx;
+    tr_y = thing->y - rc->viewy;
 	
-    gxt = FixedMul(tr_x,viewcos); 
-    gyt = -FixedMul(tr_y,viewsin);
+    gxt = FixedMul(tr_x,rc->viewcos); 
+    gyt = -FixedMul(tr_y,rc->viewsin);
     
     tz = gxt-gyt; 
 
@@ -486,8 +478,8 @@ void R_ProjectSprite (mobj_t* thing)
     
     xscale = FixedDiv(projection, tz);
 	
-    gxt = -FixedMul(tr_x,viewsin); 
-    gyt = FixedMul(tr_y,viewcos); 
+    gxt = -FixedMul(tr_x,rc->viewsin); 
+    gyt = FixedMul(tr_y,rc->viewcos); 
     tx = -(gyt+gxt); 
 
     // too far off the side?
@@ -511,7 +503,7 @@ void R_ProjectSprite (mobj_t* thing)
     if (sprframe->rotate)
     {
 	// choose a different rotation based on player view
-	ang = R_PointToAngle (thing->x, thing->y);
+	ang = R_PointToAngle (rc, thing->x, thing->y);
 	rot = (ang-thing->angle+(unsigned)(ANG45/2)*9)>>29;
 	lump = sprframe->lump[rot];
 	flip = (boolean)sprframe->flip[rot];
@@ -539,14 +531,14 @@ void R_ProjectSprite (mobj_t* thing)
 	return;
     
     // store information in a vissprite
-    vis = R_NewVisSprite ();
+    vis = R_NewVisSprite (rc);
     vis->mobjflags = thing->flags;
     vis->scale = xscale<<detailshift;
     vis->gx = thing->x;
     vis->gy = thing->y;
     vis->gz = thing->z;
     vis->gzt = thing->z + spritetopoffset[lump];
-    vis->texturemid = vis->gzt - viewz;
+    vis->texturemid = vis->gzt - rc->viewz;
     vis->x1 = x1 < 0 ? 0 : x1;
     vis->x2 = x2 >= viewwidth ? viewwidth-1 : x2;	
     iscale = FixedDiv (FRACUNIT, xscale);
@@ -572,10 +564,10 @@ void R_ProjectSprite (mobj_t* thing)
 	// shadow draw
 	vis->colormap = NULL;
     }
-    else if (fixedcolormap)
+    else if (rc->fixedcolormap)
     {
 	// fixed map
-	vis->colormap = fixedcolormap;
+	vis->colormap = rc->fixedcolormap;
     }
     else if (thing->frame & FF_FULLBRIGHT)
     {
@@ -591,7 +583,7 @@ void R_ProjectSprite (mobj_t* thing)
 	if (index >= MAXLIGHTSCALE) 
 	    index = MAXLIGHTSCALE-1;
 
-	vis->colormap = spritelights[index];
+	vis->colormap = rc->spritelights[index];
     }	
 }
 
@@ -602,7 +594,7 @@ void R_ProjectSprite (mobj_t* thing)
 // R_AddSprites
 // During BSP traversal, this adds sprites by sector.
 //
-void R_AddSprites (sector_t* sec)
+void R_AddSprites (rcontext_t* rc, sector_t* sec)
 {
     mobj_t*		thing;
     int			lightnum;
@@ -611,31 +603,31 @@ void R_AddSprites (sector_t* sec)
     // A sector might have been split into several
     //  subsectors during BSP building.
     // Thus we check whether its already added.
-    if (sec->validcount == validcount)
+    if (rc->sectorvalid[sec - sectors] == rc->validcount)
 	return;		
 
     // Well, now it will be done.
-    sec->validcount = validcount;
+    rc->sectorvalid[sec - sectors] = rc->validcount;
 	
-    lightnum = (sec->lightlevel >> LIGHTSEGSHIFT)+extralight;
+    lightnum = (sec->lightlevel >> LIGHTSEGSHIFT)+rc->extralight;
 
     if (lightnum < 0)		
-	spritelights = scalelight[0];
+	rc->spritelights = scalelight[0];
     else if (lightnum >= LIGHTLEVELS)
-	spritelights = scalelight[LIGHTLEVELS-1];
+	rc->spritelights = scalelight[LIGHTLEVELS-1];
     else
-	spritelights = scalelight[lightnum];
+	rc->spritelights = scalelight[lightnum];
 
     // Handle all things in sector.
     for (thing = sec->thinglist ; thing ; thing = thing->snext)
-	R_ProjectSprite (thing);
+	R_ProjectSprite (rc, thing);
 }
 
 
 //
 // R_DrawPSprite
 //
-void R_DrawPSprite (pspdef_t* psp)
+void R_DrawPSprite (rcontext_t* rc, pspdef_t* psp)
 {
     fixed_t		tx;
     int			x1;
@@ -705,16 +697,16 @@ void R_DrawPSprite (pspdef_t* psp)
 
     vis->patch = lump;
 
-    if (viewplayer->powers[pw_invisibility] > 4*32
-	|| viewplayer->powers[pw_invisibility] & 8)
+    if (rc->viewplayer->powers[pw_invisibility] > 4*32
+	|| rc->viewplayer->powers[pw_invisibility] & 8)
     {
 	// shadow draw
 	vis->colormap = NULL;
     }
-    else if (fixedcolormap)
+    else if (rc->fixedcolormap)
     {
 	// fixed color
-	vis->colormap = fixedcolormap;
+	vis->colormap = rc->fixedcolormap;
     }
     else if (psp->state->frame & FF_FULLBRIGHT)
     {
@@ -724,10 +716,10 @@ void R_DrawPSprite (pspdef_t* psp)
     else
     {
 	// local light
-	vis->colormap = spritelights[MAXLIGHTSCALE-1];
+	vis->colormap = rc->spritelights[MAXLIGHTSCALE-1];
     }
 	
-    R_DrawVisSprite (vis, vis->x1, vis->x2);
+    R_DrawVisSprite (rc, vis, vis->x1, vis->x2);
 }
 
 
@@ -735,7 +727,7 @@ void R_DrawPSprite (pspdef_t* psp)
 //
 // R_DrawPlayerSprites
 //
-void R_DrawPlayerSprites (void)
+void R_DrawPlayerSprites (rcontext_t* rc)
 {
     int		i;
     int		lightnum;
@@ -743,88 +735,160 @@ void R_DrawPlayerSprites (void)
     
     // get light level
     lightnum =
-	(viewplayer->mo->subsector->sector->lightlevel >> LIGHTSEGSHIFT) 
-	+extralight;
+	(rc->viewplayer->mo->subsector->sector->lightlevel >> LIGHTSEGSHIFT) 
+	+rc->extralight;
 
     if (lightnum < 0)		
-	spritelights = scalelight[0];
+	rc->spritelights = scalelight[0];
     else if (lightnum >= LIGHTLEVELS)
-	spritelights = scalelight[LIGHTLEVELS-1];
+	rc->spritelights = scalelight[LIGHTLEVELS-1];
     else
-	spritelights = scalelight[lightnum];
+	rc->spritelights = scalelight[lightnum];
     
     // clip to screen bounds
-    mfloorclip = screenheightarray;
-    mceilingclip = negonearray;
+    rc->mfloorclip = screenheightarray;
+    rc->mceilingclip = negonearray;
     
     // add all active psprites
-    for (i=0, psp=viewplayer->psprites;
+    for (i=0, psp=rc->viewplayer->psprites;
 	 i<NUMPSPRITES;
 	 i++,psp++)
     {
 	if (psp->state)
-	    R_DrawPSprite (psp);
+	    R_DrawPSprite (rc, psp);
     }
 }
 
 
 
 
+// Sort time for -renderstats.
+static unsigned int	statsortframes;
+static unsigned int	statsortsprites;
+static unsigned int	statsortmax;
+static uint64_t		statsorttime;
+
+
 //
-// R_SortVisSprites
+// R_MergeVisSprites
+// Merges the sorted runs src[lo..mid-1] and src[mid..hi-1] into dest.
+// Ties are taken from the first run, to keep the sort stable.
 //
-vissprite_t	vsprsortedhead;
+static void
+R_MergeVisSprites
+( vissprite_t**	src,
+  vissprite_t**	dest,
+  int		lo,
+  int		mid,
+  int		hi )
+{
+    int		i;
+    int		j;
+    int		k;
+
+    i = lo;
+    j = mid;
+
+    for (k=lo ; k<hi ; k++)
+    {
+	if (i < mid && (j >= hi || src[i]->scale <= src[j]->scale))
+	    dest[k] = src[i++];
+	else
+	    dest[k] = src[j++];
+    }
+}
 
 
-void R_SortVisSprites (void)
+//
+// R_SortVisSprites
+// Sorts the vissprites by scale, smallest first.  Sprites of the same
+//  scale stay in the order they were found, as the selection sort this
+//  replaces left them, so the picture drawn does not change.
+//
+void R_SortVisSprites (rcontext_t* rc)
 {
-    int			i;
+    vissprite_t**	src;
+    vissprite_t**	dest;
+    vissprite_t**	swap;
+    vissprite_t*	prev;
     int			count;
-    vissprite_t*	ds;
-    vissprite_t*	best;
-    vissprite_t		unsorted;
-    fixed_t		bestscale;
+    int			width;
+    int			lo;
+    int			mid;
+    int			hi;
+    int			i;
+    uint64_t		starttime;
 
-    count = vissprite_p - vissprites;
-	
-    unsorted.next = unsorted.prev = &unsorted;
+    count = rc->vissprite_p - rc->vissprites;
+
+    rc->vsprsortedhead.next = rc->vsprsortedhead.prev = &rc->vsprsortedhead;
 
     if (!count)
 	return;
-		
-    for (ds=vissprites ; ds<vissprite_p ; ds++)
-    {
-	ds->next = ds+1;
-	ds->prev = ds-1;
-    }
-    
-    vissprites[0].prev = &unsorted;
-    unsorted.next = &vissprites[0];
-    (vissprite_p-1)->next = &unsorted;
-    unsorted.prev = vissprite_p-1;
-    
-    // pull the vissprites out by scale
 
-    vsprsortedhead.next = vsprsortedhead.prev = &vsprsortedhead;
+    starttime = renderstats ? I_GetTimeUS() : 0;
+
+    src = rc->sortbuf[0];
+    dest = rc->sortbuf[1];
+
     for (i=0 ; i<count ; i++)
+	src[i] = &rc->vissprites[i];
+
+    // merge runs of width, doubling each pass
+    for (width=1 ; width<count ; width*=2)
     {
-	bestscale = INT_MAX;
-        best = unsorted.next;
-	for (ds=unsorted.next ; ds!= &unsorted ; ds=ds->next)
+	for (lo=0 ; lo<count ; lo+=2*width)
 	{
-	    if (ds->scale < bestscale)
-	    {
-		bestscale = ds->scale;
-		best = ds;
-	    }
+	    mid = lo + width < count ? lo + width : count;
+	    hi = lo + 2*width < count ? lo + 2*width : count;
+	    R_MergeVisSprites (src, dest, lo, mid, hi);
 	}
-	best->next->prev = best->prev;
-	best->prev->next = best->next;
-	best->next = &vsprsortedhead;
-	best->prev = vsprsortedhead.prev;
-	vsprsortedhead.prev->next = best;
-	vsprsortedhead.prev = best;
+
+	swap = src;
+	src = dest;
+	dest = swap;
     }
+
+    // link them up in order
+    prev = &rc->vsprsortedhead;
+
+    for (i=0 ; i<count ; i++)
+    {
+	prev->next = src[i];
+	src[i]->prev = prev;
+	prev = src[i];
+    }
+
+    prev->next = &rc->vsprsortedhead;
+    rc->vsprsortedhead.prev = prev;
+
+    if (renderstats)
+    {
+	statsorttime += I_GetTimeUS() - starttime;
+	statsortsprites += count;
+	statsortframes++;
+
+	if (count > statsortmax)
+	    statsortmax = count;
+    }
+}
+
+
+//
+// R_PrintSpriteStats
+// Prints the -renderstats totals for sprites.
+//
+void R_PrintSpriteStats (void)
+{
+    if (!renderstats || statsortframes == 0)
+	return;
+
+    printf ("R_PrintSpriteStats: %u frames with sprites, "
+	    "%.1f sprites/frame (max %u), %.3f us/frame sorting\n",
+	    statsortframes,
+	    (double) statsortsprites / statsortframes,
+	    statsortmax,
+	    (double) statsorttime / statsortframes);
 }
 
 
@@ -832,7 +896,7 @@ void R_SortVisSprites (void)
 //
 // R_DrawSprite
 //
-void R_DrawSprite (vissprite_t* spr)
+void R_DrawSprite (rcontext_t* rc, vissprite_t* spr)
 {
     drawseg_t*		ds;
     short		clipbot[SCREENWIDTH];
@@ -850,7 +914,7 @@ void R_DrawSprite (vissprite_t* spr)
     // Scan drawsegs from end to start for obscuring segs.
     // The first drawseg that has a greater scale
     //  is the clip seg.
-    for (ds=ds_p-1 ; ds >= drawsegs ; ds--)
+    for (ds=rc->ds_p-1 ; ds >= rc->drawsegs ; ds--)
     {
 	// determine if the drawseg obscures the sprite
 	if (ds->x1 > spr->x2
@@ -882,7 +946,7 @@ void R_DrawSprite (vissprite_t* spr)
 	{
 	    // masked mid texture?
 	    if (ds->maskedtexturecol)	
-		R_RenderMaskedSegRange (ds, r1, r2);
+		R_RenderMaskedSegRange (rc, ds, r1, r2);
 	    // seg is behind sprite
 	    continue;			
 	}
@@ -937,9 +1001,9 @@ void R_DrawSprite (vissprite_t* spr)
 	    cliptop[x] = -1;
     }
 		
-    mfloorclip = clipbot;
-    mceilingclip = cliptop;
-    R_DrawVisSprite (spr, spr->x1, spr->x2);
+    rc->mfloorclip = clipbot;
+    rc->mceilingclip = cliptop;
+    R_DrawVisSprite (rc, spr, spr->x1, spr->x2);
 }
 
 
@@ -948,34 +1012,34 @@ void R_DrawSprite (vissprite_t* spr)
 //
 // R_DrawMasked
 //
-void R_DrawMasked (void)
+void R_DrawMasked (rcontext_t* rc)
 {
     vissprite_t*	spr;
     drawseg_t*		ds;
 	
-    R_SortVisSprites ();
+    R_SortVisSprites (rc);
 
-    if (vissprite_p > vissprites)
+    if (rc->vissprite_p > rc->vissprites)
     {
 	// draw all vissprites back to front
-	for (spr = vsprsortedhead.next ;
-	     spr != &vsprsortedhead ;
+	for (spr = rc->vsprsortedhead.next ;
+	     spr != &rc->vsprsortedhead ;
 	     spr=spr->next)
 	{
 	    
-	    R_DrawSprite (spr);
+	    R_DrawSprite (rc, spr);
 	}
     }
     
     // render any remaining masked mid textures
-    for (ds=ds_p-1 ; ds >= drawsegs ; ds--)
+    for (ds=rc->ds_p-1 ; ds >= rc->drawsegs ; ds--)
 	if (ds->maskedtexturecol)
-	    R_RenderMaskedSegRange (ds, ds->x1, ds->x2);
+	    R_RenderMaskedSegRange (rc, ds, ds->x1, ds->x2);
     
     // draw the psprites on top of everything
     //  but does not draw on side views
     if (!viewangleoffset)		
-	R_DrawPlayerSprites ();
+	R_DrawPlayerSprites (rc);
 }
 
 
@@ -22,38 +22,27 @@
 
 
 
-#define MAXVISSPRITES  	128
-
-extern vissprite_t	vissprites[MAXVISSPRITES];
-extern vissprite_t*	vissprite_p;
-extern vissprite_t	vsprsortedhead;
-
 // Constant arrays used for psprite clipping
 //  and initializing clipping.
 extern short		negonearray[SCREENWIDTH];
 extern short		screenheightarray[SCREENWIDTH];
 
-// vars for R_DrawMaskedColumn
-extern short*		mfloorclip;
-extern short*		mceilingclip;
-extern fixed_t		spryscale;
-extern fixed_t		sprtopscreen;
-
 extern fixed_t		pspritescale;
 extern fixed_t		pspriteiscale;
 
 
-void R_DrawMaskedColumn (column_t* column);
+void R_DrawMaskedColumn (rcontext_t* rc, column_t* column);
 
 
-void R_SortVisSprites (void);
+void R_SortVisSprites (rcontext_t* rc);
+void R_PrintSpriteStats (void);
 
-void R_AddSprites (sector_t* sec);
+void R_AddSprites (rcontext_t* rc, sector_t* sec);
 void R_AddPSprites (void);
 void R_DrawSprites (void);
 void R_InitSprites (char** namelist);
-void R_ClearSprites (void);
-void R_DrawMasked (void);
+void R_ClearSprites (rcontext_t* rc);
+void R_DrawMasked (rcontext_t* rc);
 
 void
 R_ClipVisSprite
@@ -196,27 +196,15 @@ static void S_StopChannel(int cnum)
 //  determines music if any, changes music.
 //
 
-void S_Start(void)
+// Get the music for the given level.
+
+static int S_LevelMusic(int episode, int map)
 {
-    int cnum;
     int mnum;
 
-    // kill all playing sounds at start of level
-    //  (trust me - a good idea)
-    for (cnum=0 ; cnum<snd_channels ; cnum++)
-    {
-        if (channels[cnum].sfxinfo)
-        {
-            S_StopChannel(cnum);
-        }
-    }
-
-    // start new music for the level
-    mus_paused = 0;
-
     if (gamemode == commercial)
     {
-        mnum = mus_runnin + gamemap - 1;
+        mnum = mus_runnin + map - 1;
     }
     else
     {
@@ -235,17 +223,81 @@ void S_Start(void)
             mus_e1m9,        // Tim          e4m9
         };
 
-        if (gameepisode < 4)
+        if (episode < 4)
         {
-            mnum = mus_e1m1 + (gameepisode-1)*9 + gamemap-1;
+            mnum = mus_e1m1 + (episode-1)*9 + map-1;
         }
         else
         {
-            mnum = spmus[gamemap-1];
+            mnum = spmus[map-1];
         }
     }
 
-    S_ChangeMusic(mnum, true);
+    return mnum;
+}
+
+void S_Start(void)
+{
+    int cnum;
+
+    // kill all playing sounds at start of level
+    //  (trust me - a good idea)
+    for (cnum=0 ; cnum<snd_channels ; cnum++)
+    {
+        if (channels[cnum].sfxinfo)
+        {
+            S_StopChannel(cnum);
+        }
+    }
+
+    // start new music for the level
+    mus_paused = 0;
+
+    S_ChangeMusic(S_LevelMusic(gameepisode, gamemap), true);
+}
+
+//
+// Prepare the music for the given level, so that it starts more
+// quickly when the level is loaded.  Called during the intermission.
+//
+
+void S_PrefetchLevelMusic(int episode, int map)
+{
+    musicinfo_t *music;
+    char namebuf[9];
+    int mnum;
+    int lumpnum;
+
+    mnum = S_LevelMusic(episode, map);
+
+    if (mnum <= mus_None || mnum >= NUMMUSIC)
+    {
+        return;
+    }
+
+    music = &S_music[mnum];
+
+    if (mus_playing == music)
+    {
+        return;
+    }
+
+    if (!music->lumpnum)
+    {
+        M_snprintf(namebuf, sizeof(namebuf), "d_%s", DEH_String(music->name));
+        lumpnum = W_CheckNumForName(namebuf);
+
+        if (lumpnum < 0)
+        {
+            return;
+        }
+
+        music->lumpnum = lumpnum;
+    }
+
+    I_PrefetchSong(W_CacheLumpNum(music->lumpnum, PU_STATIC),
+                   W_LumpLength(music->lumpnum));
+    W_ReleaseLumpNum(music->lumpnum);
 }
 
 void S_StopSound(mobj_t *origin)
@@ -64,6 +64,9 @@ void S_StartMusic(int music_id);
 //  and set whether looping
 void S_ChangeMusic(int music_id, int looping);
 
+// Prepare the music for the given level before it is loaded
+void S_PrefetchLevelMusic(int episode, int map);
+
 // query if music is playing
 boolean S_MusicPlaying(void);
 
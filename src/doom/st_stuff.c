@@ -1180,6 +1180,7 @@ static void ST_loadUnloadGraphics(load_callback_t callback)
 static void ST_loadCallback(char *lumpname, patch_t **variable)
 {
     *variable = W_CacheLumpName(lumpname, PU_STATIC);
+    V_CachePatch(*variable);
 }
 
 void ST_loadGraphics(void)
@@ -1195,6 +1196,7 @@ void ST_loadData(void)
 
 static void ST_unloadCallback(char *lumpname, patch_t **variable)
 {
+    V_UncachePatch(*variable);
     W_ReleaseLumpName(lumpname);
     *variable = NULL;
 }
@@ -1704,6 +1704,7 @@ static void WI_loadUnloadData(load_callback_t callback)
 static void WI_loadCallback(char *name, patch_t **variable)
 {
     *variable = W_CacheLumpName(name, PU_STATIC);
+    V_CachePatch(*variable);
 }
 
 void WI_loadData(void)
@@ -1734,6 +1735,7 @@ void WI_loadData(void)
 
 static void WI_unloadCallback(char *name, patch_t **variable)
 {
+    V_UncachePatch(*variable);
     W_ReleaseLumpName(name);
     *variable = NULL;
 }
@@ -1820,6 +1822,10 @@ void WI_Start(wbstartstruct_t* wbstartstruct)
     WI_initVariables(wbstartstruct);
     WI_loadData();
 
+    // Get the music for the next level ready while the intermission
+    // is shown.
+    S_PrefetchLevelMusic(wbs->epsd + 1, wbs->next + 1);
+
     if (deathmatch)
 	WI_initDeathmatchStats();
     else if (netgame)
@@ -0,0 +1,494 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Built-in sound effect mixer.
+//
+//     All channels are added to the music in a 32-bit buffer, which
+//     is clamped to 16 bits once at the end, rather than after every
+//     channel.  Each sample is scaled as (sample * gain) >> 15; the
+//     SSE2 and NEON versions give exactly the same output as the
+//     portable version.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__SSE2__) || defined(_M_X64) \
+ || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIXER_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MIXER_NEON
+#include <arm_neon.h>
+#endif
+
+#include "i_mixer.h"
+
+// Buffer that channels are added up in, two samples per frame.  It
+// is fixed, as memory cannot safely be allocated from the audio
+// callback; longer streams are mixed a slice at a time.
+
+#define MIX_BUFFER_FRAMES 1024
+
+static int32_t mix_buffer[MIX_BUFFER_FRAMES * 2];
+
+void I_Mixer_SetParams(mixer_channel_t *channel, int vol, int sep)
+{
+    int left, right;
+
+    // The same volume and separation curves as used with SDL_mixer's
+    // panning, where 255 is full volume.
+
+    left = ((254 - sep) * vol) / 127;
+    right = ((sep) * vol) / 127;
+
+    if (left < 0) left = 0;
+    else if ( left > 255) left = 255;
+    if (right < 0) right = 0;
+    else if (right > 255) right = 255;
+
+    channel->left_gain = (left * MIXER_UNITY_GAIN) / 255;
+    channel->right_gain = (right * MIXER_UNITY_GAIN) / 255;
+}
+
+boolean I_Mixer_ChannelPlaying(mixer_channel_t *channel)
+{
+    return channel->samples != NULL && channel->position < channel->length;
+}
+
+// Portable versions.
+
+static void LoadStream_C(int32_t *buf, const int16_t *stream,
+                         unsigned int nsamples)
+{
+    unsigned int i;
+
+    for (i = 0; i < nsamples; ++i)
+    {
+        buf[i] = stream[i];
+    }
+}
+
+static void AddChannel_C(int32_t *buf, const int16_t *samples,
+                         unsigned int nframes, int left_gain, int right_gain)
+{
+    unsigned int i;
+
+    for (i = 0; i < nframes; ++i)
+    {
+        buf[i * 2] += (samples[i * 2] * left_gain) >> 15;
+        buf[i * 2 + 1] += (samples[i * 2 + 1] * right_gain) >> 15;
+    }
+}
+
+static void StoreStream_C(int16_t *stream, const int32_t *buf,
+                          unsigned int nsamples)
+{
+    unsigned int i;
+    int32_t s;
+
+    for (i = 0; i < nsamples; ++i)
+    {
+        s = buf[i];
+
+        if (s < -32768)
+        {
+            s = -32768;
+        }
+        else if (s > 32767)
+        {
+            s = 32767;
+        }
+
+        stream[i] = s;
+    }
+}
+
+#if defined(MIXER_SSE2)
+
+static void LoadStream_SIMD(int32_t *buf, const int16_t *stream,
+                            unsigned int nsamples)
+{
+    __m128i v;
+    unsigned int i;
+
+    for (i = 0; i + 8 <= nsamples; i += 8)
+    {
+        v = _mm_loadu_si128((const __m128i *) (stream + i));
+
+        // Sign extend by putting each sample in the top half and
+        // shifting it down.
+
+        _mm_storeu_si128((__m128i *) (buf + i),
+                         _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+        _mm_storeu_si128((__m128i *) (buf + i + 4),
+                         _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+    }
+
+    LoadStream_C(buf + i, stream + i, nsamples - i);
+}
+
+static void AddChannel_SIMD(int32_t *buf, const int16_t *samples,
+                            unsigned int nframes, int left_gain,
+                            int right_gain)
+{
+    __m128i gains, v, lo, hi;
+    int32_t *p;
+    unsigned int i;
+
+    // Each sample is paired with itself and multiplied by two halves
+    // of the gain, which each fit in 16 bits even at unity gain.
+
+    gains = _mm_set_epi16(right_gain - right_gain / 2, right_gain / 2,
+                          left_gain - left_gain / 2, left_gain / 2,
+                          right_gain - right_gain / 2, right_gain / 2,
+                          left_gain - left_gain / 2, left_gain / 2);
+
+    for (i = 0; i + 4 <= nframes; i += 4)
+    {
+        v = _mm_loadu_si128((const __m128i *) (samples + i * 2));
+        lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(v, v), gains),
+                            15);
+        hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(v, v), gains),
+                            15);
+
+        p = buf + i * 2;
+        _mm_storeu_si128((__m128i *) p,
+                         _mm_add_epi32(_mm_loadu_si128((__m128i *) p), lo));
+        _mm_storeu_si128((__m128i *) (p + 4),
+                         _mm_add_epi32(_mm_loadu_si128((__m128i *) (p + 4)),
+                                       hi));
+    }
+
+    AddChannel_C(buf + i * 2, samples + i * 2, nframes - i,
+                 left_gain, right_gain);
+}
+
+static void StoreStream_SIMD(int16_t *stream, const int32_t *buf,
+                             unsigned int nsamples)
+{
+    __m128i lo, hi;
+    unsigned int i;
+
+    // Packing with signed saturation does the clamping.
+
+    for (i = 0; i + 8 <= nsamples; i += 8)
+    {
+        lo = _mm_loadu_si128((const __m128i *) (buf + i));
+        hi = _mm_loadu_si128((const __m128i *) (buf + i + 4));
+        _mm_storeu_si128((__m128i *) (stream + i), _mm_packs_epi32(lo, hi));
+    }
+
+    StoreStream_C(stream + i, buf + i, nsamples - i);
+}
+
+#elif defined(MIXER_NEON)
+
+static void LoadStream_SIMD(int32_t *buf, const int16_t *stream,
+                            unsigned int nsamples)
+{
+    int16x8_t v;
+    unsigned int i;
+
+    for (i = 0; i + 8 <= nsamples; i += 8)
+    {
+        v = vld1q_s16(stream + i);
+        vst1q_s32(buf + i, vmovl_s16(vget_low_s16(v)));
+        vst1q_s32(buf + i + 4, vmovl_s16(vget_high_s16(v)));
+    }
+
+    LoadStream_C(buf + i, stream + i, nsamples - i);
+}
+
+static void AddChannel_SIMD(int32_t *buf, const int16_t *samples,
+                            unsigned int nframes, int left_gain,
+                            int right_gain)
+{
+    int32_t gain_values[4];
+    int32x4_t gains, lo, hi;
+    int16x8_t v;
+    int32_t *p;
+    unsigned int i;
+
+    gain_values[0] = left_gain;
+    gain_values[1] = right_gain;
+    gain_values[2] = left_gain;
+    gain_values[3] = right_gain;
+    gains = vld1q_s32(gain_values);
+
+    for (i = 0; i + 4 <= nframes; i += 4)
+    {
+        v = vld1q_s16(samples + i * 2);
+        lo = vshrq_n_s32(vmulq_s32(vmovl_s16(vget_low_s16(v)), gains), 15);
+        hi = vshrq_n_s32(vmulq_s32(vmovl_s16(vget_high_s16(v)), gains), 15);
+
+        p = buf + i * 2;
+        vst1q_s32(p, vaddq_s32(vld1q_s32(p), lo));
+        vst1q_s32(p + 4, vaddq_s32(vld1q_s32(p + 4), hi));
+    }
+
+    AddChannel_C(buf + i * 2, samples + i * 2, nframes - i,
+                 left_gain, right_gain);
+}
+
+static void StoreStream_SIMD(int16_t *stream, const int32_t *buf,
+                             unsigned int nsamples)
+{
+    unsigned int i;
+
+    for (i = 0; i + 8 <= nsamples; i += 8)
+    {
+        vst1q_s16(stream + i, vcombine_s16(vqmovn_s32(vld1q_s32(buf + i)),
+                                           vqmovn_s32(vld1q_s32(buf + i + 4))));
+    }
+
+    StoreStream_C(stream + i, buf + i, nsamples - i);
+}
+
+#else
+
+#define LoadStream_SIMD  LoadStream_C
+#define AddChannel_SIMD  AddChannel_C
+#define StoreStream_SIMD StoreStream_C
+
+#endif
+
+// Mix up to MIX_BUFFER_FRAMES frames.
+
+static void MixSlice(int16_t *stream, unsigned int nframes,
+                     mixer_channel_t *channels, int num_channels,
+                     boolean use_simd)
+{
+    mixer_channel_t *channel;
+    unsigned int n;
+    int i;
+
+    // Start with the music that is already in the stream.
+
+    if (use_simd)
+    {
+        LoadStream_SIMD(mix_buffer, stream, nframes * 2);
+    }
+    else
+    {
+        LoadStream_C(mix_buffer, stream, nframes * 2);
+    }
+
+    for (i = 0; i < num_channels; ++i)
+    {
+        channel = &channels[i];
+
+        if (!I_Mixer_ChannelPlaying(channel))
+        {
+            continue;
+        }
+
+        n = channel->length - channel->position;
+
+        if (n > nframes)
+        {
+            n = nframes;
+        }
+
+        // A silent channel still has to move on.
+
+        if (channel->left_gain != 0 || channel->right_gain != 0)
+        {
+            if (use_simd)
+            {
+                AddChannel_SIMD(mix_buffer,
+                                channel->samples + channel->position * 2,
+                                n, channel->left_gain, channel->right_gain);
+            }
+            else
+            {
+                AddChannel_C(mix_buffer,
+                             channel->samples + channel->position * 2,
+                             n, channel->left_gain, channel->right_gain);
+            }
+        }
+
+        channel->position += n;
+    }
+
+    if (use_simd)
+    {
+        StoreStream_SIMD(stream, mix_buffer, nframes * 2);
+    }
+    else
+    {
+        StoreStream_C(stream, mix_buffer, nframes * 2);
+    }
+}
+
+static void MixChannels(int16_t *stream, unsigned int nframes,
+                        mixer_channel_t *channels, int num_channels,
+                        boolean use_simd)
+{
+    unsigned int n;
+
+    while (nframes > 0)
+    {
+        n = nframes;
+
+        if (n > MIX_BUFFER_FRAMES)
+        {
+            n = MIX_BUFFER_FRAMES;
+        }
+
+        MixSlice(stream, n, channels, num_channels, use_simd);
+
+        stream += n * 2;
+        nframes -= n;
+    }
+}
+
+void I_Mixer_Mix(int16_t *stream, unsigned int nframes,
+                 mixer_channel_t *channels, int num_channels)
+{
+    MixChannels(stream, nframes, channels, num_channels, true);
+}
+
+//
+// Benchmark
+//
+
+#define BENCH_SLICE 1024
+#define BENCH_SOUNDS 16
+
+static unsigned int rand_state = 1;
+
+static unsigned int Random(void)
+{
+    rand_state = rand_state * 1103515245 + 12345;
+    return (rand_state >> 16) & 0x7fff;
+}
+
+// Start a random sound at a random volume and separation, as the game
+// does for every sound effect.
+
+static void StartBenchSound(mixer_channel_t *channel, int16_t **sounds,
+                            unsigned int *lengths)
+{
+    int n = Random() % BENCH_SOUNDS;
+
+    channel->samples = sounds[n];
+    channel->length = lengths[n];
+    channel->position = 0;
+    I_Mixer_SetParams(channel, Random() % 128, Random() % 255);
+}
+
+// Mix the given number of seconds of audio, and return the CPU time
+// taken in microseconds per second of audio.  The output is hashed,
+// so that the two versions can be compared.
+
+static unsigned int BenchmarkMix(int samplerate, int num_channels,
+                                 int seconds, boolean use_simd,
+                                 int16_t **sounds, unsigned int *lengths,
+                                 unsigned int *hash)
+{
+    mixer_channel_t *channels;
+    int16_t stream[BENCH_SLICE * 2];
+    unsigned int nslices, slice;
+    clock_t start, total;
+    int i;
+
+    channels = calloc(num_channels, sizeof(mixer_channel_t));
+    rand_state = 1;
+    *hash = 0;
+
+    for (i = 0; i < num_channels; ++i)
+    {
+        StartBenchSound(&channels[i], sounds, lengths);
+    }
+
+    nslices = (seconds * samplerate) / BENCH_SLICE;
+    total = 0;
+
+    for (slice = 0; slice < nslices; ++slice)
+    {
+        // Some quiet "music" to mix with.
+
+        for (i = 0; i < BENCH_SLICE * 2; ++i)
+        {
+            stream[i] = (int16_t) (Random() - 0x4000) / 4;
+        }
+
+        for (i = 0; i < num_channels; ++i)
+        {
+            if (!I_Mixer_ChannelPlaying(&channels[i]))
+            {
+                StartBenchSound(&channels[i], sounds, lengths);
+            }
+        }
+
+        start = clock();
+        MixChannels(stream, BENCH_SLICE, channels, num_channels, use_simd);
+        total += clock() - start;
+
+        for (i = 0; i < BENCH_SLICE * 2; ++i)
+        {
+            *hash = *hash * 31 + (uint16_t) stream[i];
+        }
+    }
+
+    free(channels);
+
+    return (unsigned int) ((1000000.0 * total / CLOCKS_PER_SEC)
+                         / ((double) nslices * BENCH_SLICE / samplerate));
+}
+
+void I_Mixer_Benchmark(int samplerate)
+{
+    static const int channel_counts[] = { 8, 16, 32 };
+    int16_t *sounds[BENCH_SOUNDS];
+    unsigned int lengths[BENCH_SOUNDS];
+    unsigned int c_us, simd_us;
+    unsigned int c_hash, simd_hash;
+    unsigned int i, j;
+
+    // Loud random sounds of between a quarter of a second and one and
+    // a quarter seconds, so that the output clips.
+
+    for (i = 0; i < BENCH_SOUNDS; ++i)
+    {
+        lengths[i] = samplerate / 4 + Random() % samplerate;
+        sounds[i] = malloc(lengths[i] * 2 * sizeof(int16_t));
+
+        for (j = 0; j < lengths[i] * 2; ++j)
+        {
+            sounds[i][j] = (int16_t) (Random() * 2 - 0x8000);
+        }
+    }
+
+    for (i = 0; i < sizeof(channel_counts) / sizeof(*channel_counts); ++i)
+    {
+        c_us = BenchmarkMix(samplerate, channel_counts[i], 60, false,
+                            sounds, lengths, &c_hash);
+        simd_us = BenchmarkMix(samplerate, channel_counts[i], 60, true,
+                               sounds, lengths, &simd_hash);
+
+        printf("mixerbench: channels=%i cpu_us_per_audio_sec: portable=%u "
+               "simd=%u output=%s\n", channel_counts[i], c_us, simd_us,
+               c_hash == simd_hash ? "identical" : "MISMATCH");
+    }
+
+    for (i = 0; i < BENCH_SOUNDS; ++i)
+    {
+        free(sounds[i]);
+    }
+}
+
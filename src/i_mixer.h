@@ -0,0 +1,70 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Built-in sound effect mixer.
+//
+
+#ifndef __I_MIXER__
+#define __I_MIXER__
+
+#include "doomtype.h"
+
+// Gain that leaves samples unchanged.
+
+#define MIXER_UNITY_GAIN 32768
+
+typedef struct
+{
+    // Sound being played: signed 16-bit stereo frames at the output
+    // sample rate, and the number of frames.  NULL if the channel is
+    // not playing.
+
+    const int16_t *samples;
+    unsigned int length;
+
+    // Next frame to mix.  The sound has finished when this reaches
+    // the length.
+
+    unsigned int position;
+
+    // Gain applied to each side, where MIXER_UNITY_GAIN is full volume.
+
+    int left_gain;
+    int right_gain;
+} mixer_channel_t;
+
+// Set the gains of a channel from a volume (0-127) and separation
+// (0-254), as passed to the sound module.
+
+void I_Mixer_SetParams(mixer_channel_t *channel, int vol, int sep);
+
+// Is the channel still playing a sound?
+
+boolean I_Mixer_ChannelPlaying(mixer_channel_t *channel);
+
+// Mix the given channels into a buffer of signed 16-bit stereo
+// frames, which already holds the music, advancing the position of
+// each channel.
+
+void I_Mixer_Mix(int16_t *stream, unsigned int nframes,
+                 mixer_channel_t *channels, int num_channels);
+
+// Check that the accelerated mixer gives the same output as the
+// portable version, and print how long each takes to mix 8, 16 and 32
+// channels.
+
+void I_Mixer_Benchmark(int samplerate);
+
+#endif /* #ifndef __I_MIXER__ */
+
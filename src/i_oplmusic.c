@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
 #include "memio.h"
 #include "mus2mid.h"
@@ -27,7 +28,10 @@
 #include "deh_main.h"
 #include "i_sound.h"
 #include "i_swap.h"
+#include "i_timer.h"
+#include "m_argv.h"
 #include "m_misc.h"
+#include "sha1.h"
 #include "w_wad.h"
 #include "z_zone.h"
 
@@ -105,11 +109,45 @@ typedef struct
 
     opl_channel_data_t channels[MIDI_CHANNELS_PER_TRACK];
 
-    // Track iterator used to read new events.
-
-    midi_track_iter_t *iter;
 } opl_track_data_t;
 
+// An event in a compiled song.
+
+typedef struct
+{
+    // Time from the start of the song, in microseconds:
+
+    uint32_t time;
+
+    // Track the event is from, and the event itself:
+
+    unsigned int track;
+    midi_event_t *event;
+} opl_song_event_t;
+
+// A song compiled for playback: the events of all tracks are merged
+// into a single list in the order they are played, and the time of
+// each event is worked out in advance, taking tempo changes into
+// account.  Compiled songs are cached, so that playing the same song
+// again does not need the lump to be parsed again.
+
+typedef struct
+{
+    sha1_digest_t digest;
+    midi_file_t *file;
+    unsigned int num_tracks;
+
+    opl_song_event_t *events;
+    unsigned int num_events;
+
+    // Number of times the song is registered, whether it is in the
+    // cache, and when it was last registered, for eviction.
+
+    int use_count;
+    boolean cached;
+    unsigned int last_used;
+} opl_song_t;
+
 typedef struct opl_voice_s opl_voice_t;
 
 struct opl_voice_s
@@ -538,10 +576,17 @@ static unsigned int num_tracks = 0;
 static unsigned int running_tracks = 0;
 static boolean song_looping;
 
-// Tempo control variables
+// Song that is playing, and the next event to play from it:
+
+static opl_song_t *current_song;
+static unsigned int song_position;
 
-static unsigned int ticks_per_beat;
-static unsigned int us_per_beat;
+// Cache of compiled songs:
+
+#define SONG_CACHE_SIZE 16
+
+static opl_song_t *song_cache[SONG_CACHE_SIZE];
+static unsigned int song_cache_time = 0;
 
 // Mini-log of recently played percussion instruments:
 
@@ -1596,19 +1641,10 @@ static void PitchBendEvent(opl_track_data_t *track, midi_event_t *event)
     }
 }
 
-static void MetaSetTempo(unsigned int tempo)
-{
-    OPL_AdjustCallbacks((float) us_per_beat / tempo);
-    us_per_beat = tempo;
-}
-
 // Process a meta event.
 
 static void MetaEvent(opl_track_data_t *track, midi_event_t *event)
 {
-    byte *data = event->data.meta.data;
-    unsigned int data_len = event->data.meta.length;
-
     switch (event->data.meta.type)
     {
         // Things we can just ignore.
@@ -1624,11 +1660,10 @@ static void MetaEvent(opl_track_data_t *track, midi_event_t *event)
         case MIDI_META_SEQUENCER_SPECIFIC:
             break;
 
+        // Tempo changes are applied to event times when the song is
+        // compiled, see CompileSong.
+
         case MIDI_META_SET_TEMPO:
-            if (data_len == 3)
-            {
-                MetaSetTempo((data[0] << 16) | (data[1] << 8) | data[2]);
-            }
             break;
 
         // End of track - actually handled when we run out of events
@@ -1690,7 +1725,7 @@ static void ProcessEvent(opl_track_data_t *track, midi_event_t *event)
     }
 }
 
-static void ScheduleTrack(opl_track_data_t *track);
+static void ScheduleSong(void);
 static void InitChannel(opl_track_data_t *track, opl_channel_data_t *channel);
 
 // Restart a song from the beginning.
@@ -1705,47 +1740,52 @@ static void RestartSong(void *unused)
 
     for (i = 0; i < num_tracks; ++i)
     {
-        MIDI_RestartIterator(tracks[i].iter);
-        ScheduleTrack(&tracks[i]);
         for (j = 0; j < MIDI_CHANNELS_PER_TRACK; ++j)
         {
             InitChannel(&tracks[i], &tracks[i].channels[j]);
         }
     }
+
+    song_position = 0;
+    ScheduleSong();
 }
 
-// Callback function invoked when another event needs to be read from
-// a track.
+// Callback function invoked when the next events in the song are due.
 
-static void TrackTimerCallback(void *arg)
+static void SongTimerCallback(void *unused)
 {
-    opl_track_data_t *track = arg;
-    midi_event_t *event;
+    opl_song_event_t *event;
+    uint32_t now;
 
-    // Get the next event and process it.
+    // Process all the events that are due now.
 
-    if (!MIDI_GetNextEvent(track->iter, &event))
-    {
-        return;
-    }
+    now = current_song->events[song_position].time;
 
-    ProcessEvent(track, event);
+    do
+    {
+        event = &current_song->events[song_position];
+        ++song_position;
 
-    // End of track?
+        ProcessEvent(&tracks[event->track], event->event);
 
-    if (event->event_type == MIDI_EVENT_META
-     && event->data.meta.type == MIDI_META_END_OF_TRACK)
-    {
-        --running_tracks;
+        if (event->event->event_type == MIDI_EVENT_META
+         && event->event->data.meta.type == MIDI_META_END_OF_TRACK)
+        {
+            --running_tracks;
+        }
+    } while (song_position < current_song->num_events
+          && current_song->events[song_position].time == now);
 
-        // When all tracks have finished, restart the song.
-        // Don't restart the song immediately, but wait for 5ms
-        // before triggering a restart.  Otherwise it is possible
-        // to construct an empty MIDI file that causes the game
-        // to lock up in an infinite loop. (5ms should be short
-        // enough not to be noticeable by the listener).
+    // When all tracks have finished, restart the song.
+    // Don't restart the song immediately, but wait for 5ms
+    // before triggering a restart.  Otherwise it is possible
+    // to construct an empty MIDI file that causes the game
+    // to lock up in an infinite loop. (5ms should be short
+    // enough not to be noticeable by the listener).
 
-        if (running_tracks <= 0 && song_looping)
+    if (song_position >= current_song->num_events)
+    {
+        if (song_looping)
         {
             OPL_SetCallback(5000, RestartSong, NULL);
         }
@@ -1753,25 +1793,22 @@ static void TrackTimerCallback(void *arg)
         return;
     }
 
-    // Reschedule the callback for the next event in the track.
+    // Set a timer to be invoked when the next events are ready to
+    // play.
 
-    ScheduleTrack(track);
+    OPL_SetCallback(current_song->events[song_position].time - now,
+                    SongTimerCallback, NULL);
 }
 
-static void ScheduleTrack(opl_track_data_t *track)
-{
-    unsigned int nticks;
-    uint64_t us;
-
-    // Get the number of microseconds until the next event.
+// Schedule the first events of the song.
 
-    nticks = MIDI_GetDeltaTime(track->iter);
-    us = ((uint64_t) nticks * us_per_beat) / ticks_per_beat;
-
-    // Set a timer to be invoked when the next event is
-    // ready to play.
-
-    OPL_SetCallback(us, TrackTimerCallback, track);
+static void ScheduleSong(void)
+{
+    if (current_song->num_events > 0)
+    {
+        OPL_SetCallback(current_song->events[0].time,
+                        SongTimerCallback, NULL);
+    }
 }
 
 // Initialize a channel.
@@ -1795,26 +1832,6 @@ static void InitChannel(opl_track_data_t *track, opl_channel_data_t *channel)
     channel->bend = 0;
 }
 
-// Start a MIDI track playing:
-
-static void StartTrack(midi_file_t *file, unsigned int track_num)
-{
-    opl_track_data_t *track;
-    unsigned int i;
-
-    track = &tracks[track_num];
-    track->iter = MIDI_IterateTrack(file, track_num);
-
-    for (i = 0; i < MIDI_CHANNELS_PER_TRACK; ++i)
-    {
-        InitChannel(track, &track->channels[i]);
-    }
-
-    // Schedule the first event.
-
-    ScheduleTrack(track);
-}
-
 void FaderCallback(void *unused)
 {
     int i, j;
@@ -1851,31 +1868,24 @@ static void StartFader(void)
 
 static void I_OPL_PlaySong(void *handle, boolean looping)
 {
-    midi_file_t *file;
-    unsigned int i;
+    unsigned int i, j;
 
     if (!music_initialized || handle == NULL)
     {
         return;
     }
 
-    file = handle;
+    current_song = handle;
+    song_position = 0;
 
     // Allocate track data.
 
-    tracks = malloc(MIDI_NumTracks(file) * sizeof(opl_track_data_t));
+    tracks = malloc(current_song->num_tracks * sizeof(opl_track_data_t));
 
-    num_tracks = MIDI_NumTracks(file);
+    num_tracks = current_song->num_tracks;
     running_tracks = num_tracks;
     song_looping = looping;
 
-    ticks_per_beat = MIDI_GetFileTimeDivision(file);
-
-    // Default is 120 bpm.
-    // TODO: this is wrong
-
-    us_per_beat = 500 * 1000;
-
     start_music_volume = current_music_volume;
 
     if (opl_drv_ver == opl_doom_beta)
@@ -1888,8 +1898,15 @@ static void I_OPL_PlaySong(void *handle, boolean looping)
     }
     for (i = 0; i < num_tracks; ++i)
     {
-        StartTrack(file, i);
+        for (j = 0; j < MIDI_CHANNELS_PER_TRACK; ++j)
+        {
+            InitChannel(&tracks[i], &tracks[i].channels[j]);
+        }
     }
+
+    // Schedule the first events.
+
+    ScheduleSong();
 }
 
 static void I_OPL_PauseSong(void)
@@ -1956,29 +1973,41 @@ static void I_OPL_StopSong(void)
 
     // Free all track data.
 
-    for (i = 0; i < num_tracks; ++i)
-    {
-        MIDI_FreeIterator(tracks[i].iter);
-    }
-
     free(tracks);
 
     tracks = NULL;
     num_tracks = 0;
+    current_song = NULL;
 
     OPL_Unlock();
 }
 
+static void FreeSong(opl_song_t *song)
+{
+    MIDI_FreeFile(song->file);
+    free(song->events);
+    free(song);
+}
+
 static void I_OPL_UnRegisterSong(void *handle)
 {
+    opl_song_t *song = handle;
+
     if (!music_initialized)
     {
         return;
     }
 
-    if (handle != NULL)
+    if (song != NULL)
     {
-        MIDI_FreeFile(handle);
+        --song->use_count;
+
+        // Songs in the cache are kept for next time.
+
+        if (song->use_count <= 0 && !song->cached)
+        {
+            FreeSong(song);
+        }
     }
 }
 
@@ -1989,12 +2018,13 @@ static boolean IsMid(byte *mem, int len)
     return len > 4 && !memcmp(mem, "MThd", 4);
 }
 
-static boolean ConvertMus(byte *musdata, int len, char *filename)
+// Convert a MUS lump to MIDI in memory.  Returns a stream holding the
+// MIDI data, to be closed with mem_fclose, or NULL on failure.
+
+static MEMFILE *ConvertMus(byte *musdata, int len)
 {
     MEMFILE *instream;
     MEMFILE *outstream;
-    void *outbuf;
-    size_t outbuf_len;
     int result;
 
     instream = mem_fopen_read(musdata, len);
@@ -2002,58 +2032,307 @@ static boolean ConvertMus(byte *musdata, int len, char *filename)
 
     result = mus2mid(instream, outstream);
 
-    if (result == 0)
-    {
-        mem_get_buf(outstream, &outbuf, &outbuf_len);
+    mem_fclose(instream);
 
-        M_WriteFile(filename, outbuf, outbuf_len);
+    if (result != 0)
+    {
+        mem_fclose(outstream);
+        return NULL;
     }
 
-    mem_fclose(instream);
-    mem_fclose(outstream);
-
-    return result;
+    return outstream;
 }
 
-static void *I_OPL_RegisterSong(void *data, int len)
+// Load a MUS or MIDI lump.
+
+static midi_file_t *LoadSong(void *data, int len)
 {
     midi_file_t *result;
-    char *filename;
-
-    if (!music_initialized)
-    {
-        return NULL;
-    }
+    MEMFILE *midistream;
+    void *midibuf;
+    size_t midibuf_len;
 
     // MUS files begin with "MUS"
     // Reject anything which doesnt have this signature
 
-    filename = M_TempFile("doom.mid");
-
     if (IsMid(data, len) && len < MAXMIDLENGTH)
     {
-        M_WriteFile(filename, data, len);
+        result = MIDI_LoadBuffer(data, len);
     }
     else
     {
         // Assume a MUS file and try to convert
 
-        ConvertMus(data, len, filename);
-    }
+        midistream = ConvertMus(data, len);
 
-    result = MIDI_LoadFile(filename);
+        if (midistream != NULL)
+        {
+            mem_get_buf(midistream, &midibuf, &midibuf_len);
+            result = MIDI_LoadBuffer(midibuf, midibuf_len);
+            mem_fclose(midistream);
+        }
+        else
+        {
+            result = NULL;
+        }
+    }
 
     if (result == NULL)
     {
         fprintf(stderr, "I_OPL_RegisterSong: Failed to load MID.\n");
     }
 
-    // remove file now
+    return result;
+}
 
-    remove(filename);
-    free(filename);
+// Compile a loaded MIDI file: merge the events of all its tracks into
+// one list, and convert their times from MIDI ticks to microseconds.
 
-    return result;
+static opl_song_t *CompileSong(midi_file_t *file)
+{
+    opl_song_t *song;
+    midi_track_iter_t **iters;
+    uint64_t *next_tick;
+    boolean *finished;
+    midi_event_t *event;
+    opl_song_event_t *song_event;
+    unsigned int ticks_per_beat, us_per_beat;
+    uint64_t tick, tempo_tick, tempo_time, time;
+    unsigned int i, track;
+
+    song = malloc(sizeof(opl_song_t));
+    song->file = file;
+    song->num_tracks = MIDI_NumTracks(file);
+    song->use_count = 0;
+    song->cached = false;
+
+    iters = malloc(song->num_tracks * sizeof(midi_track_iter_t *));
+    next_tick = malloc(song->num_tracks * sizeof(uint64_t));
+    finished = malloc(song->num_tracks * sizeof(boolean));
+
+    // Count the events.
+
+    song->num_events = 0;
+
+    for (i = 0; i < song->num_tracks; ++i)
+    {
+        iters[i] = MIDI_IterateTrack(file, i);
+
+        while (MIDI_GetNextEvent(iters[i], &event))
+        {
+            ++song->num_events;
+        }
+
+        MIDI_RestartIterator(iters[i]);
+        next_tick[i] = MIDI_GetDeltaTime(iters[i]);
+        finished[i] = false;
+    }
+
+    song->events = malloc(song->num_events * sizeof(opl_song_event_t));
+
+    // Default is 120 bpm.
+    // TODO: this is wrong
+
+    ticks_per_beat = MIDI_GetFileTimeDivision(file);
+    us_per_beat = 500 * 1000;
+    tempo_tick = 0;
+    tempo_time = 0;
+
+    song_event = song->events;
+
+    while (song_event < song->events + song->num_events)
+    {
+        // Take the next event from the track that has the earliest
+        // one.  Events at the same time are taken in track order.
+
+        track = song->num_tracks;
+
+        for (i = 0; i < song->num_tracks; ++i)
+        {
+            if (!finished[i]
+             && (track == song->num_tracks || next_tick[i] < next_tick[track]))
+            {
+                track = i;
+            }
+        }
+
+        if (track == song->num_tracks)
+        {
+            break;
+        }
+
+        tick = next_tick[track];
+
+        // A track might not end with an end of track event.
+
+        if (!MIDI_GetNextEvent(iters[track], &event))
+        {
+            finished[track] = true;
+            continue;
+        }
+
+        if (event->event_type == MIDI_EVENT_META
+         && event->data.meta.type == MIDI_META_END_OF_TRACK)
+        {
+            finished[track] = true;
+        }
+        else
+        {
+            next_tick[track] = tick + MIDI_GetDeltaTime(iters[track]);
+        }
+
+        // Work out the time of the event from the last tempo change.
+
+        time = tempo_time
+             + ((tick - tempo_tick) * us_per_beat) / ticks_per_beat;
+
+        if (event->event_type == MIDI_EVENT_META
+         && event->data.meta.type == MIDI_META_SET_TEMPO
+         && event->data.meta.length == 3)
+        {
+            tempo_tick = tick;
+            tempo_time = time;
+            us_per_beat = (event->data.meta.data[0] << 16)
+                        | (event->data.meta.data[1] << 8)
+                        | event->data.meta.data[2];
+        }
+
+        song_event->time = time;
+        song_event->track = track;
+        song_event->event = event;
+        ++song_event;
+    }
+
+    song->num_events = song_event - song->events;
+
+    for (i = 0; i < song->num_tracks; ++i)
+    {
+        MIDI_FreeIterator(iters[i]);
+    }
+
+    free(iters);
+    free(next_tick);
+    free(finished);
+
+    return song;
+}
+
+// Look for a compiled song in the cache.
+
+static opl_song_t *FindCachedSong(sha1_digest_t digest)
+{
+    int i;
+
+    for (i = 0; i < SONG_CACHE_SIZE; ++i)
+    {
+        if (song_cache[i] != NULL
+         && !memcmp(song_cache[i]->digest, digest, sizeof(sha1_digest_t)))
+        {
+            return song_cache[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Add a song to the cache, replacing the least recently used song that
+// is not registered if the cache is full.  If every song in the cache
+// is registered, the new song is not cached.
+
+static void AddCachedSong(opl_song_t *song)
+{
+    int slot;
+    int i;
+
+    slot = -1;
+
+    for (i = 0; i < SONG_CACHE_SIZE; ++i)
+    {
+        if (song_cache[i] == NULL)
+        {
+            slot = i;
+            break;
+        }
+
+        if (song_cache[i]->use_count <= 0
+         && (slot < 0 || song_cache[i]->last_used < song_cache[slot]->last_used))
+        {
+            slot = i;
+        }
+    }
+
+    if (slot < 0)
+    {
+        return;
+    }
+
+    if (song_cache[slot] != NULL)
+    {
+        FreeSong(song_cache[slot]);
+    }
+
+    song_cache[slot] = song;
+    song->cached = true;
+}
+
+static void FreeSongCache(void)
+{
+    int i;
+
+    for (i = 0; i < SONG_CACHE_SIZE; ++i)
+    {
+        if (song_cache[i] != NULL)
+        {
+            if (song_cache[i]->use_count <= 0)
+            {
+                FreeSong(song_cache[i]);
+            }
+            else
+            {
+                song_cache[i]->cached = false;
+            }
+
+            song_cache[i] = NULL;
+        }
+    }
+}
+
+static void *I_OPL_RegisterSong(void *data, int len)
+{
+    sha1_context_t context;
+    sha1_digest_t digest;
+    midi_file_t *file;
+    opl_song_t *song;
+
+    if (!music_initialized)
+    {
+        return NULL;
+    }
+
+    SHA1_Init(&context);
+    SHA1_Update(&context, data, len);
+    SHA1_Final(digest, &context);
+
+    song = FindCachedSong(digest);
+
+    if (song == NULL)
+    {
+        file = LoadSong(data, len);
+
+        if (file == NULL)
+        {
+            return NULL;
+        }
+
+        song = CompileSong(file);
+        memcpy(song->digest, digest, sizeof(sha1_digest_t));
+        AddCachedSong(song);
+    }
+
+    ++song->use_count;
+    song->last_used = ++song_cache_time;
+
+    return song;
 }
 
 // Is the song playing?
@@ -2080,6 +2359,8 @@ static void I_OPL_ShutdownMusic(void)
 
         OPL_Shutdown();
 
+        FreeSongCache();
+
         // Release GENMIDI lump
 
         W_ReleaseLumpName("GENMIDI");
@@ -2159,6 +2440,21 @@ static boolean I_OPL_InitMusic(void)
     return true;
 }
 
+// Compile a song that is about to be played, so that it is already in
+// the song cache when it is registered.
+
+static void I_OPL_PrefetchSong(void *data, int len)
+{
+    void *handle;
+
+    handle = I_OPL_RegisterSong(data, len);
+
+    if (handle != NULL)
+    {
+        I_OPL_UnRegisterSong(handle);
+    }
+}
+
 static snddevice_t music_opl_devices[] =
 {
     SNDDEVICE_ADLIB,
@@ -2180,8 +2476,328 @@ music_module_t music_opl_module =
     I_OPL_StopSong,
     I_OPL_MusicIsPlaying,
     NULL,  // Poll
+    I_OPL_PrefetchSong,
 };
 
+//----------------------------------------------------------------------
+//
+// Offline rendering of music lumps to WAV files, as fast as the
+// emulator can run.
+//
+//----------------------------------------------------------------------
+
+// Silence rendered after the end of each song, so that the releases
+// of the final notes are not cut off.
+
+#define RENDER_TAIL_MS 1000
+
+// Songs that have not ended after this long are cut off.
+
+#define RENDER_MAX_SECONDS (20 * 60)
+
+// Number of samples generated per call to OPL_Render.
+
+#define RENDER_CHUNK 1024
+
+static void WriteLE16(byte *p, unsigned int value)
+{
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+}
+
+static void WriteLE32(byte *p, unsigned int value)
+{
+    WriteLE16(p, value & 0xffff);
+    WriteLE16(p + 2, (value >> 16) & 0xffff);
+}
+
+static boolean WriteWAVHeader(FILE *fstream, unsigned int nsamples)
+{
+    byte header[44];
+    unsigned int data_len;
+
+    data_len = nsamples * 4;
+
+    memcpy(header, "RIFF", 4);
+    WriteLE32(header + 4, 36 + data_len);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    WriteLE32(header + 16, 16);                   // Format chunk length
+    WriteLE16(header + 20, 1);                    // PCM
+    WriteLE16(header + 22, 2);                    // Channels
+    WriteLE32(header + 24, snd_samplerate);
+    WriteLE32(header + 28, snd_samplerate * 4);   // Bytes per second
+    WriteLE16(header + 32, 4);                    // Bytes per sample
+    WriteLE16(header + 34, 16);                   // Bits per channel
+    memcpy(header + 36, "data", 4);
+    WriteLE32(header + 40, data_len);
+
+    return fwrite(header, 1, sizeof(header), fstream) == sizeof(header);
+}
+
+// Determine whether a lump is a MUS or MIDI file, without loading it.
+
+static boolean IsMusicLump(lumpindex_t lump)
+{
+    char name[9];
+    byte header[4];
+
+    if (lumpinfo[lump]->size < 4)
+    {
+        return false;
+    }
+
+    // Only the last lump with a given name is ever played.
+
+    M_StringCopy(name, lumpinfo[lump]->name, sizeof(name));
+
+    if (W_CheckNumForName(name) != lump)
+    {
+        return false;
+    }
+
+    if (W_Read(lumpinfo[lump]->wad_file, lumpinfo[lump]->position,
+               header, sizeof(header)) != sizeof(header))
+    {
+        return false;
+    }
+
+    return !memcmp(header, "MUS\x1a", 4) || !memcmp(header, "MThd", 4);
+}
+
+// Render a single lump.  The music system is started from scratch for
+// each song, so that the output does not depend on which songs were
+// rendered before it.  Returns the number of samples rendered, the
+// time spent generating them, and the time taken to register the song
+// the first time and again when it is already in the cache.
+
+static unsigned int RenderLump(lumpindex_t lump, char *filename,
+                               uint64_t *render_us, uint64_t *load_us,
+                               uint64_t *cached_us)
+{
+    void *song;
+    void *data;
+    int len;
+    FILE *fstream;
+    int16_t buffer[RENDER_CHUNK * 2];
+    unsigned int nsamples, tail, max_samples, tail_samples;
+    uint64_t start_time;
+    int i;
+
+    *render_us = 0;
+    *load_us = 0;
+    *cached_us = 0;
+
+    fstream = fopen(filename, "wb");
+
+    if (fstream == NULL)
+    {
+        fprintf(stderr, "RenderLump: Failed to open '%s'.\n", filename);
+        return 0;
+    }
+
+    if (!I_OPL_InitMusic())
+    {
+        fclose(fstream);
+        return 0;
+    }
+
+    I_OPL_SetMusicVolume(127);
+
+    data = W_CacheLumpNum(lump, PU_STATIC);
+    len = W_LumpLength(lump);
+
+    start_time = I_GetTimeUS();
+    song = I_OPL_RegisterSong(data, len);
+    *load_us = I_GetTimeUS() - start_time;
+
+    // Register the song again, as happens when a level is restarted.
+
+    if (song != NULL)
+    {
+        I_OPL_UnRegisterSong(song);
+
+        start_time = I_GetTimeUS();
+        song = I_OPL_RegisterSong(data, len);
+        *cached_us = I_GetTimeUS() - start_time;
+    }
+
+    W_ReleaseLumpNum(lump);
+
+    if (song == NULL)
+    {
+        I_OPL_ShutdownMusic();
+        fclose(fstream);
+        remove(filename);
+        return 0;
+    }
+
+    WriteWAVHeader(fstream, 0);
+    I_OPL_PlaySong(song, false);
+
+    max_samples = RENDER_MAX_SECONDS * snd_samplerate;
+    tail_samples = (RENDER_TAIL_MS * snd_samplerate) / 1000;
+    nsamples = 0;
+    tail = 0;
+
+    while (tail < tail_samples && nsamples < max_samples)
+    {
+        start_time = I_GetTimeUS();
+        OPL_Render(buffer, RENDER_CHUNK);
+        *render_us += I_GetTimeUS() - start_time;
+
+        nsamples += RENDER_CHUNK;
+
+        if (running_tracks == 0)
+        {
+            tail += RENDER_CHUNK;
+        }
+
+        for (i = 0; i < RENDER_CHUNK * 2; ++i)
+        {
+            buffer[i] = SHORT(buffer[i]);
+        }
+
+        if (fwrite(buffer, 4, RENDER_CHUNK, fstream) != RENDER_CHUNK)
+        {
+            fprintf(stderr, "RenderLump: Error writing '%s'.\n", filename);
+            break;
+        }
+    }
+
+    I_OPL_StopSong();
+    I_OPL_UnRegisterSong(song);
+    I_OPL_ShutdownMusic();
+
+    // Now the length is known, fill in the header.
+
+    rewind(fstream);
+    WriteWAVHeader(fstream, nsamples);
+    fclose(fstream);
+
+    return nsamples;
+}
+
+// Render music lumps to WAV files, named after the lumps and written
+// to the current directory.  If no lumps are listed, every music lump
+// is rendered.  Prints the speed of the emulator for each song and
+// the total.
+
+void I_OPL_RenderMusic(void)
+{
+    lumpindex_t lump;
+    char name[9];
+    char *filename;
+    unsigned int nsamples, total_samples;
+    uint64_t render_us, total_us;
+    uint64_t load_us, total_load_us;
+    uint64_t cached_us, total_cached_us;
+    int job, num_jobs;
+    int count;
+    int p;
+    int i;
+
+    p = M_CheckParm("-oplrender");
+
+    //!
+    // @arg <n> <count>
+    //
+    // With -oplrender, only render every <count>th music lump,
+    // starting with number <n> (counting from zero), so that the
+    // rendering can be split between several processes.
+    //
+
+    i = M_CheckParmWithArgs("-oplrenderjob", 2);
+
+    if (i > 0)
+    {
+        job = atoi(myargv[i + 1]);
+        num_jobs = atoi(myargv[i + 2]);
+    }
+    else
+    {
+        job = 0;
+        num_jobs = 1;
+    }
+
+    OPL_SetOffline(1);
+
+    total_samples = 0;
+    total_us = 0;
+    total_load_us = 0;
+    total_cached_us = 0;
+    count = 0;
+
+    for (lump = 0; lump < numlumps; ++lump)
+    {
+        if (p + 1 < myargc && myargv[p + 1][0] != '-')
+        {
+            // Only render the listed lumps.
+
+            for (i = p + 1; i < myargc && myargv[i][0] != '-'; ++i)
+            {
+                if (W_CheckNumForName(myargv[i]) == lump)
+                {
+                    break;
+                }
+            }
+
+            if (i >= myargc || myargv[i][0] == '-')
+            {
+                continue;
+            }
+        }
+        else if (!IsMusicLump(lump))
+        {
+            continue;
+        }
+
+        ++count;
+
+        if ((count - 1) % num_jobs != job)
+        {
+            continue;
+        }
+
+        M_StringCopy(name, lumpinfo[lump]->name, sizeof(name));
+
+        for (i = 0; name[i] != '\0'; ++i)
+        {
+            name[i] = tolower(name[i]);
+        }
+
+        filename = M_StringJoin(name, ".wav", NULL);
+        nsamples = RenderLump(lump, filename, &render_us,
+                              &load_us, &cached_us);
+
+        if (nsamples > 0)
+        {
+            printf("oplrender: file=%s samples=%u render_ms=%u "
+                   "samples_per_sec=%u cpu_us_per_audio_sec=%u "
+                   "load_us=%u cached_load_us=%u\n",
+                   filename, nsamples, (unsigned int) (render_us / 1000),
+                   (unsigned int) ((nsamples * OPL_SECOND)
+                                 / (render_us > 0 ? render_us : 1)),
+                   (unsigned int) ((render_us * snd_samplerate) / nsamples),
+                   (unsigned int) load_us, (unsigned int) cached_us);
+        }
+
+        total_samples += nsamples;
+        total_us += render_us;
+        total_load_us += load_us;
+        total_cached_us += cached_us;
+        free(filename);
+    }
+
+    printf("oplrender: total samples=%u render_ms=%u samples_per_sec=%u "
+           "cpu_us_per_audio_sec=%u load_us=%u cached_load_us=%u\n",
+           total_samples, (unsigned int) (total_us / 1000),
+           (unsigned int) ((total_samples * OPL_SECOND)
+                         / (total_us > 0 ? total_us : 1)),
+           (unsigned int) ((total_us * snd_samplerate)
+                         / (total_samples > 0 ? total_samples : 1)),
+           (unsigned int) total_load_us, (unsigned int) total_cached_us);
+}
+
 //----------------------------------------------------------------------
 //
 // Development / debug message generation, to help developing GENMIDI
@@ -2222,6 +2838,7 @@ static int ChannelInUse(opl_channel_data_t *channel)
 void I_OPL_DevMessages(char *result, size_t result_len)
 {
     char tmp[80];
+    opl_stats_t stats;
     int instr_num;
     int lines;
     int i;
@@ -2232,8 +2849,12 @@ void I_OPL_DevMessages(char *result, size_t result_len)
         return;
     }
 
-    M_snprintf(result, result_len, "Tracks:\n");
-    lines = 1;
+    OPL_GetStats(&stats);
+
+    M_snprintf(result, result_len,
+               "Underruns: %u  deferred: %u  waits: %u\n\nTracks:\n",
+               stats.underruns, stats.deferred, stats.ring_waits);
+    lines = 3;
 
     for (i = 0; i < NumActiveChannels(); ++i)
     {
@@ -40,6 +40,17 @@ static byte *dest_buffer;
 
 static int dest_pitch;
 
+// In true color modes, the 32-bit pixel value for each palette index;
+// NULL when drawing to an 8-bit buffer.
+
+static uint32_t *palette_lut = NULL;
+
+// 8-bit buffer that the blending scale functions draw to in true color
+// modes, before it is converted through palette_lut.
+
+static byte *blend_buffer = NULL;
+static int blend_buffer_size = 0;
+
 // Lookup tables used for aspect ratio correction stretching code.
 // stretch_tables[0] : 20% / 80%
 // stretch_tables[1] : 40% / 60%
@@ -61,6 +72,118 @@ void I_InitScale(byte *_src_buffer, byte *_dest_buffer, int _dest_pitch)
     dest_pitch = _dest_pitch;
 }
 
+// Set the palette lookup table to use for true color modes, or NULL
+// for 8-bit modes.
+
+void I_SetScalePalette(uint32_t *_palette_lut)
+{
+    palette_lut = _palette_lut;
+}
+
+// Scale up by an integer factor into a 32-bit destination, looking up
+// each pixel in the palette and then copying each line down.
+
+static boolean ScaleTrueColor(int x1, int y1, int x2, int y2, int factor)
+{
+    byte *bufp, *screenp, *bp;
+    uint32_t *sp;
+    uint32_t c;
+    int x, y, i;
+    int line_bytes;
+
+    bufp = src_buffer + y1 * SCREENWIDTH + x1;
+    screenp = (byte *) dest_buffer + (y1 * dest_pitch + x1 * 4) * factor;
+    line_bytes = (x2 - x1) * factor * 4;
+
+    for (y=y1; y<y2; ++y)
+    {
+        sp = (uint32_t *) screenp;
+        bp = bufp;
+
+        for (x=x1; x<x2; ++x)
+        {
+            c = palette_lut[*bp];
+
+            for (i=0; i<factor; ++i)
+            {
+                *sp++ = c;
+            }
+
+            ++bp;
+        }
+
+        for (i=1; i<factor; ++i)
+        {
+            memcpy(screenp + i * dest_pitch, screenp, line_bytes);
+        }
+
+        screenp += dest_pitch * factor;
+        bufp += SCREENWIDTH;
+    }
+
+    return true;
+}
+
+// The aspect ratio correcting functions blend through 8-bit lookup
+// tables, so in true color modes they draw the whole screen to an
+// 8-bit buffer, which is then converted through palette_lut.
+
+static boolean DrawBlendedTrueColor(boolean (*draw)(int, int, int, int),
+                                    int width, int height)
+{
+    uint32_t *lut;
+    byte *real_dest;
+    int real_pitch;
+    byte *bp;
+    uint32_t *sp;
+    boolean result;
+    int x, y;
+
+    if (blend_buffer_size < width * height)
+    {
+        if (blend_buffer != NULL)
+        {
+            Z_Free(blend_buffer);
+        }
+
+        blend_buffer = Z_Malloc(width * height, PU_STATIC, NULL);
+        blend_buffer_size = width * height;
+    }
+
+    lut = palette_lut;
+    real_dest = dest_buffer;
+    real_pitch = dest_pitch;
+
+    palette_lut = NULL;
+    dest_buffer = blend_buffer;
+    dest_pitch = width;
+
+    result = draw(0, 0, SCREENWIDTH, SCREENHEIGHT);
+
+    palette_lut = lut;
+    dest_buffer = real_dest;
+    dest_pitch = real_pitch;
+
+    if (!result)
+    {
+        return false;
+    }
+
+    bp = blend_buffer;
+
+    for (y=0; y<height; ++y)
+    {
+        sp = (uint32_t *) (dest_buffer + y * dest_pitch);
+
+        for (x=0; x<width; ++x)
+        {
+            *sp++ = palette_lut[*bp++];
+        }
+    }
+
+    return true;
+}
+
 //
 // Pixel doubling scale-up functions.
 //
@@ -73,6 +196,11 @@ static boolean I_Scale1x(int x1, int y1, int x2, int y2)
     byte *bufp, *screenp;
     int y;
     int w = x2 - x1;
+
+    if (palette_lut != NULL)
+    {
+        return ScaleTrueColor(x1, y1, x2, y2, 1);
+    }
     
     // Need to byte-copy from buffer into the screen buffer
 
@@ -104,6 +232,11 @@ static boolean I_Scale2x(int x1, int y1, int x2, int y2)
     int x, y;
     int multi_pitch;
 
+    if (palette_lut != NULL)
+    {
+        return ScaleTrueColor(x1, y1, x2, y2, 2);
+    }
+
     multi_pitch = dest_pitch * 2;
     bufp = src_buffer + y1 * SCREENWIDTH + x1;
     screenp = (byte *) dest_buffer + (y1 * dest_pitch + x1) * 2;
@@ -145,6 +278,11 @@ static boolean I_Scale3x(int x1, int y1, int x2, int y2)
     int x, y;
     int multi_pitch;
 
+    if (palette_lut != NULL)
+    {
+        return ScaleTrueColor(x1, y1, x2, y2, 3);
+    }
+
     multi_pitch = dest_pitch * 3;
     bufp = src_buffer + y1 * SCREENWIDTH + x1;
     screenp = (byte *) dest_buffer + (y1 * dest_pitch + x1) * 3;
@@ -190,6 +328,11 @@ static boolean I_Scale4x(int x1, int y1, int x2, int y2)
     int x, y;
     int multi_pitch;
 
+    if (palette_lut != NULL)
+    {
+        return ScaleTrueColor(x1, y1, x2, y2, 4);
+    }
+
     multi_pitch = dest_pitch * 4;
     bufp = src_buffer + y1 * SCREENWIDTH + x1;
     screenp = (byte *) dest_buffer + (y1 * dest_pitch + x1) * 4;
@@ -239,6 +382,11 @@ static boolean I_Scale5x(int x1, int y1, int x2, int y2)
     int x, y;
     int multi_pitch;
 
+    if (palette_lut != NULL)
+    {
+        return ScaleTrueColor(x1, y1, x2, y2, 5);
+    }
+
     multi_pitch = dest_pitch * 5;
     bufp = src_buffer + y1 * SCREENWIDTH + x1;
     screenp = (byte *) dest_buffer + (y1 * dest_pitch + x1) * 5;
@@ -455,6 +603,11 @@ static boolean I_Stretch1x(int x1, int y1, int x2, int y2)
         return false;
     }    
 
+    if (palette_lut != NULL)
+    {
+        return DrawBlendedTrueColor(I_Stretch1x, SCREENWIDTH, SCREENHEIGHT_4_3);
+    }
+
     // Need to byte-copy from buffer into the screen buffer
 
     bufp = src_buffer + y1 * SCREENWIDTH + x1;
@@ -544,6 +697,11 @@ static boolean I_Stretch2x(int x1, int y1, int x2, int y2)
         return false;
     }    
 
+    if (palette_lut != NULL)
+    {
+        return DrawBlendedTrueColor(I_Stretch2x, SCREENWIDTH * 2, SCREENHEIGHT_4_3 * 2);
+    }
+
     // Need to byte-copy from buffer into the screen buffer
 
     bufp = src_buffer + y1 * SCREENWIDTH + x1;
@@ -659,6 +817,11 @@ static boolean I_Stretch3x(int x1, int y1, int x2, int y2)
         return false;
     }    
 
+    if (palette_lut != NULL)
+    {
+        return DrawBlendedTrueColor(I_Stretch3x, SCREENWIDTH * 3, SCREENHEIGHT_4_3 * 3);
+    }
+
     // Need to byte-copy from buffer into the screen buffer
 
     bufp = src_buffer + y1 * SCREENWIDTH + x1;
@@ -800,6 +963,11 @@ static boolean I_Stretch4x(int x1, int y1, int x2, int y2)
         return false;
     }    
 
+    if (palette_lut != NULL)
+    {
+        return DrawBlendedTrueColor(I_Stretch4x, SCREENWIDTH * 4, SCREENHEIGHT_4_3 * 4);
+    }
+
     // Need to byte-copy from buffer into the screen buffer
 
     bufp = src_buffer + y1 * SCREENWIDTH + x1;
@@ -947,6 +1115,11 @@ static boolean I_Stretch5x(int x1, int y1, int x2, int y2)
         return false;
     }    
 
+    if (palette_lut != NULL)
+    {
+        return DrawBlendedTrueColor(I_Stretch5x, SCREENWIDTH * 5, SCREENHEIGHT_4_3 * 5);
+    }
+
     // Need to byte-copy from buffer into the screen buffer
 
     bufp = src_buffer + y1 * SCREENWIDTH + x1;
@@ -1066,6 +1239,11 @@ static boolean I_Squash1x(int x1, int y1, int x2, int y2)
         return false;
     }    
 
+    if (palette_lut != NULL)
+    {
+        return DrawBlendedTrueColor(I_Squash1x, SCREENWIDTH_4_3, SCREENHEIGHT);
+    }
+
     bufp = src_buffer;
     screenp = (byte *) dest_buffer;
 
@@ -1165,6 +1343,11 @@ static boolean I_Squash2x(int x1, int y1, int x2, int y2)
         return false;
     }    
 
+    if (palette_lut != NULL)
+    {
+        return DrawBlendedTrueColor(I_Squash2x, SCREENWIDTH_4_3 * 2, SCREENHEIGHT * 2);
+    }
+
     bufp = src_buffer;
     screenp = (byte *) dest_buffer;
 
@@ -1248,6 +1431,11 @@ static boolean I_Squash3x(int x1, int y1, int x2, int y2)
         return false;
     }    
 
+    if (palette_lut != NULL)
+    {
+        return DrawBlendedTrueColor(I_Squash3x, 800, 600);
+    }
+
     bufp = src_buffer;
     screenp = (byte *) dest_buffer;
 
@@ -1359,6 +1547,11 @@ static boolean I_Squash4x(int x1, int y1, int x2, int y2)
         return false;
     }    
 
+    if (palette_lut != NULL)
+    {
+        return DrawBlendedTrueColor(I_Squash4x, SCREENWIDTH_4_3 * 4, SCREENHEIGHT * 4);
+    }
+
     bufp = src_buffer;
     screenp = (byte *) dest_buffer;
 
@@ -23,6 +23,7 @@
 #include "doomtype.h"
 
 void I_InitScale(byte *_src_buffer, byte *_dest_buffer, int _dest_pitch);
+void I_SetScalePalette(uint32_t *_palette_lut);
 void I_ResetScaleTables(byte *palette);
 
 // Scaled modes (direct multiples of 320x200)
@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <sys/stat.h>
 
 #include "SDL.h"
 #include "SDL_mixer.h"
@@ -120,6 +121,57 @@ static char *temp_timidity_cfg = NULL;
 static boolean playing_substitute = false;
 static file_metadata_t file_metadata;
 
+// Songs loaded by SDL_mixer from data in memory.  The data is kept
+// until the song is unregistered.
+
+typedef struct memory_song_s memory_song_t;
+
+struct memory_song_s
+{
+    Mix_Music *music;
+    SDL_RWops *rw;
+    void *data;
+    memory_song_t *next;
+};
+
+static memory_song_t *memory_songs = NULL;
+
+// Index of the music lumps in the loaded WADs, and the substitute music
+// file for each of them (if any).  This is built at startup so that
+// songs do not need to be hashed when they are registered.
+
+typedef struct
+{
+    lumpindex_t lumpnum;
+    sha1_digest_t hash;
+    char *filename;
+    long file_length;
+    long file_mtime;
+    file_metadata_t metadata;
+} music_index_t;
+
+static music_index_t *music_index = NULL;
+static unsigned int music_index_len = 0;
+
+// Loop points read from substitute music files are saved in this file
+// in the config directory, so that the files do not need to be parsed
+// every time the game starts.
+
+#define MUSIC_INDEX_FILENAME "music-index.cfg"
+
+// Substitute music files larger than this are not read ahead, but
+// streamed from disk as usual.
+
+#define MAX_PREFETCH_SIZE (32 * 1024 * 1024)
+
+// Substitute music file being read into memory in the background, so
+// that it is ready when the song is registered:
+
+static SDL_Thread *prefetch_thread = NULL;
+static char *prefetch_filename = NULL;
+static void *prefetch_data = NULL;
+static size_t prefetch_data_len;
+
 // Position (in samples) that we have reached in the current track.
 // This is updated by the TrackPositionCallback function.
 static unsigned int current_track_pos;
@@ -416,26 +468,14 @@ static void ReadLoopPoints(char *filename, file_metadata_t *metadata)
     }
 }
 
-// Given a MUS lump, look up a substitute MUS file to play instead
-// (or NULL to just use normal MIDI playback).
+// Given the hash of a MUS lump, look up a substitute music file to play
+// instead (or NULL to just use normal MIDI playback).
 
-static char *GetSubstituteMusicFile(void *data, size_t data_len)
+static char *FindSubstituteMusic(sha1_digest_t hash)
 {
-    sha1_context_t context;
-    sha1_digest_t hash;
     char *filename;
     unsigned int i;
 
-    // Don't bother doing a hash if we're never going to find anything.
-    if (subst_music_len == 0)
-    {
-        return NULL;
-    }
-
-    SHA1_Init(&context);
-    SHA1_Update(&context, data, data_len);
-    SHA1_Final(hash, &context);
-
     // Look for a hash that matches.
     // The substitute mapping list can (intentionally) contain multiple
     // filename mappings for the same hash. This allows us to try
@@ -445,7 +485,7 @@ static char *GetSubstituteMusicFile(void *data, size_t data_len)
 
     for (i = 0; i < subst_music_len; ++i)
     {
-        if (memcmp(hash, subst_music[i].hash, sizeof(hash)) == 0)
+        if (memcmp(hash, subst_music[i].hash, sizeof(sha1_digest_t)) == 0)
         {
             filename = subst_music[i].filename;
 
@@ -463,6 +503,27 @@ static char *GetSubstituteMusicFile(void *data, size_t data_len)
     return filename;
 }
 
+// Given a MUS lump, look up a substitute MUS file to play instead
+// (or NULL to just use normal MIDI playback).
+
+static char *GetSubstituteMusicFile(void *data, size_t data_len)
+{
+    sha1_context_t context;
+    sha1_digest_t hash;
+
+    // Don't bother doing a hash if we're never going to find anything.
+    if (subst_music_len == 0)
+    {
+        return NULL;
+    }
+
+    SHA1_Init(&context);
+    SHA1_Update(&context, data, data_len);
+    SHA1_Final(hash, &context);
+
+    return FindSubstituteMusic(hash);
+}
+
 // Add a substitute music file to the lookup list.
 
 static void AddSubstituteMusic(subst_music_t *subst)
@@ -708,24 +769,411 @@ static void LoadSubstituteConfigs(void)
 
 static boolean IsMusicLump(int lumpnum)
 {
-    byte *data;
-    boolean result;
+    byte header[4];
 
     if (W_LumpLength(lumpnum) < 4)
     {
         return false;
     }
 
-    data = W_CacheLumpNum(lumpnum, PU_STATIC);
+    // Only read the header, rather than loading the whole lump.
+
+    if (W_Read(lumpinfo[lumpnum]->wad_file, lumpinfo[lumpnum]->position,
+               header, sizeof(header)) != sizeof(header))
+    {
+        return false;
+    }
+
+    return memcmp(header, MUS_HEADER_MAGIC, 4) == 0
+        || memcmp(header, MID_HEADER_MAGIC, 4) == 0;
+}
+
+// Get the length and modification time of a file.  The length is -1
+// if it does not exist.
+
+static void GetFileInfo(char *filename, long *length, long *mtime)
+{
+    struct stat st;
+
+    if (stat(filename, &st) != 0)
+    {
+        *length = -1;
+        *mtime = 0;
+        return;
+    }
+
+    *length = (long) st.st_size;
+    *mtime = (long) st.st_mtime;
+}
+
+static boolean ParseHash(char *str, sha1_digest_t hash)
+{
+    int hi, lo;
+    size_t i;
+
+    for (i = 0; i < sizeof(sha1_digest_t); ++i)
+    {
+        hi = ParseHexDigit(str[i * 2]);
+        lo = hi < 0 ? -1 : ParseHexDigit(str[i * 2 + 1]);
+
+        if (lo < 0)
+        {
+            return false;
+        }
+
+        hash[i] = (hi << 4) | lo;
+    }
+
+    return true;
+}
+
+// Read the loop points saved by WriteMusicIndex().  Each line holds the
+// hash of a lump, the length and modification time of its substitute
+// file, the loop points and the filename.
+
+static music_index_t *ReadSavedMusicIndex(char *filename,
+                                          unsigned int *num_entries)
+{
+    music_index_t *result;
+    music_index_t entry;
+    char hash[41];
+    char line[512];
+    char *p;
+    int valid;
+    unsigned int samplerate;
+    FILE *fs;
+
+    result = NULL;
+    *num_entries = 0;
+
+    fs = fopen(filename, "r");
+
+    if (fs == NULL)
+    {
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), fs) != NULL)
+    {
+        // Strip the newline and find the filename, which comes last.
+
+        p = strchr(line, '\n');
+
+        if (p != NULL)
+        {
+            *p = '\0';
+        }
+
+        if (sscanf(line, "%40s %ld %ld %i %u %i %i",
+                   hash, &entry.file_length, &entry.file_mtime, &valid,
+                   &samplerate, &entry.metadata.start_time,
+                   &entry.metadata.end_time) != 7
+         || strlen(hash) != 40 || !ParseHash(hash, entry.hash))
+        {
+            continue;
+        }
+
+        p = strchr(line, '\t');
+
+        if (p == NULL)
+        {
+            continue;
+        }
+
+        entry.lumpnum = -1;
+        entry.filename = M_StringDuplicate(p + 1);
+        entry.metadata.valid = valid != 0;
+        entry.metadata.samplerate_hz = samplerate;
 
-    result = memcmp(data, MUS_HEADER_MAGIC, 4) == 0
-          || memcmp(data, MID_HEADER_MAGIC, 4) == 0;
+        result = realloc(result, sizeof(music_index_t) * (*num_entries + 1));
+        result[*num_entries] = entry;
+        ++*num_entries;
+    }
 
-    W_ReleaseLumpNum(lumpnum);
+    fclose(fs);
 
     return result;
 }
 
+static void WriteIndexEntry(FILE *fs, music_index_t *entry)
+{
+    size_t h;
+
+    for (h = 0; h < sizeof(sha1_digest_t); ++h)
+    {
+        fprintf(fs, "%02x", entry->hash[h]);
+    }
+
+    fprintf(fs, " %ld %ld %i %u %i %i\t%s\n", entry->file_length,
+            entry->file_mtime, entry->metadata.valid ? 1 : 0, entry->metadata.samplerate_hz,
+            entry->metadata.start_time, entry->metadata.end_time,
+            entry->filename);
+}
+
+// Save the loop points of the substitute music files in the index,
+// along with those saved before for music that is not in the loaded
+// WADs, so that playing a different game does not lose them.
+
+static void WriteMusicIndex(char *filename, music_index_t *saved,
+                            unsigned int num_saved)
+{
+    char *tempname;
+    FILE *fs;
+    unsigned int i, j;
+
+    tempname = M_StringJoin(filename, ".tmp", NULL);
+    fs = fopen(tempname, "w");
+
+    if (fs == NULL)
+    {
+        free(tempname);
+        return;
+    }
+
+    for (i = 0; i < music_index_len; ++i)
+    {
+        if (music_index[i].filename != NULL
+         && music_index[i].file_length >= 0)
+        {
+            WriteIndexEntry(fs, &music_index[i]);
+        }
+    }
+
+    for (i = 0; i < num_saved; ++i)
+    {
+        for (j = 0; j < music_index_len; ++j)
+        {
+            if (!memcmp(saved[i].hash, music_index[j].hash,
+                        sizeof(sha1_digest_t)))
+            {
+                break;
+            }
+        }
+
+        if (j >= music_index_len)
+        {
+            WriteIndexEntry(fs, &saved[i]);
+        }
+    }
+
+    fclose(fs);
+
+    remove(filename);
+    rename(tempname, filename);
+    free(tempname);
+}
+
+// Find the substitute music for every music lump in the loaded WADs.
+
+static void BuildMusicIndex(void)
+{
+    sha1_context_t context;
+    music_index_t *entry;
+    music_index_t *saved;
+    unsigned int num_saved;
+    boolean changed;
+    char *path;
+    byte *data;
+    lumpindex_t lumpnum;
+    unsigned int i;
+
+    if (subst_music_len == 0)
+    {
+        return;
+    }
+
+    path = M_StringJoin(configdir, MUSIC_INDEX_FILENAME, NULL);
+    saved = ReadSavedMusicIndex(path, &num_saved);
+    changed = false;
+
+    for (lumpnum = 0; lumpnum < numlumps; ++lumpnum)
+    {
+        if (!IsMusicLump(lumpnum))
+        {
+            continue;
+        }
+
+        music_index = realloc(music_index,
+                              sizeof(music_index_t) * (music_index_len + 1));
+        entry = &music_index[music_index_len];
+        ++music_index_len;
+
+        data = W_CacheLumpNum(lumpnum, PU_STATIC);
+        SHA1_Init(&context);
+        SHA1_Update(&context, data, W_LumpLength(lumpnum));
+        SHA1_Final(entry->hash, &context);
+        W_ReleaseLumpNum(lumpnum);
+
+        entry->lumpnum = lumpnum;
+        entry->filename = FindSubstituteMusic(entry->hash);
+        entry->file_length = -1;
+        entry->file_mtime = 0;
+        entry->metadata.valid = false;
+
+        if (entry->filename == NULL)
+        {
+            continue;
+        }
+
+        GetFileInfo(entry->filename, &entry->file_length,
+                    &entry->file_mtime);
+
+        if (entry->file_length < 0)
+        {
+            continue;
+        }
+
+        // Use the saved loop points if the file has not changed.  A
+        // loop tag can be edited without changing the file's length,
+        // so its modification time must match too.
+
+        for (i = 0; i < num_saved; ++i)
+        {
+            if (!memcmp(saved[i].hash, entry->hash, sizeof(sha1_digest_t))
+             && saved[i].file_length == entry->file_length
+             && saved[i].file_mtime == entry->file_mtime
+             && !strcmp(saved[i].filename, entry->filename))
+            {
+                entry->metadata = saved[i].metadata;
+                break;
+            }
+        }
+
+        if (i >= num_saved)
+        {
+            ReadLoopPoints(entry->filename, &entry->metadata);
+            changed = true;
+        }
+    }
+
+    if (changed)
+    {
+        WriteMusicIndex(path, saved, num_saved);
+    }
+
+    for (i = 0; i < num_saved; ++i)
+    {
+        free(saved[i].filename);
+    }
+
+    free(saved);
+    free(path);
+}
+
+// Find the index entry for the lump that the given data was loaded
+// from, or NULL if it is not a music lump in the index.
+
+static music_index_t *FindMusicIndex(void *data)
+{
+    lumpinfo_t *lump;
+    unsigned int i;
+
+    for (i = 0; i < music_index_len; ++i)
+    {
+        lump = lumpinfo[music_index[i].lumpnum];
+
+        if (data == lump->cache
+         || (lump->wad_file->mapped != NULL
+          && data == lump->wad_file->mapped + lump->position))
+        {
+            return &music_index[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Read a substitute music file into memory.  This runs in a separate
+// thread.
+
+static int PrefetchThread(void *unused)
+{
+    FILE *fs;
+    long length;
+    void *buf;
+
+    fs = fopen(prefetch_filename, "rb");
+
+    if (fs == NULL)
+    {
+        return 0;
+    }
+
+    length = M_FileLength(fs);
+
+    if (length > 0 && length <= MAX_PREFETCH_SIZE)
+    {
+        buf = malloc(length);
+
+        if (fread(buf, 1, length, fs) == (size_t) length)
+        {
+            prefetch_data = buf;
+            prefetch_data_len = length;
+        }
+        else
+        {
+            free(buf);
+        }
+    }
+
+    fclose(fs);
+
+    return 0;
+}
+
+// Wait for the prefetch thread to finish.  If it was reading the given
+// file, return the data that was read and true; otherwise the data is
+// discarded.
+
+static boolean FinishPrefetch(char *filename, void **data, size_t *data_len)
+{
+    boolean result;
+
+    if (prefetch_thread != NULL)
+    {
+        SDL_WaitThread(prefetch_thread, NULL);
+        prefetch_thread = NULL;
+    }
+
+    result = filename != NULL && prefetch_filename != NULL
+          && prefetch_data != NULL && !strcmp(filename, prefetch_filename);
+
+    if (result)
+    {
+        *data = prefetch_data;
+        *data_len = prefetch_data_len;
+    }
+    else
+    {
+        free(prefetch_data);
+    }
+
+    prefetch_data = NULL;
+    prefetch_filename = NULL;
+
+    return result;
+}
+
+static void StartPrefetch(char *filename)
+{
+    // Already reading this file?
+
+    if (prefetch_filename != NULL && !strcmp(prefetch_filename, filename))
+    {
+        return;
+    }
+
+    FinishPrefetch(NULL, NULL, NULL);
+
+    prefetch_filename = filename;
+    prefetch_thread = SDL_CreateThread(PrefetchThread, NULL);
+
+    if (prefetch_thread == NULL)
+    {
+        prefetch_filename = NULL;
+    }
+}
+
 // Dump an example config file containing checksums for all MIDI music
 // found in the WAD directory.
 
@@ -871,6 +1319,11 @@ static void I_SDL_ShutdownMusic(void)
         Mix_HaltMusic();
         music_initialized = false;
 
+        FinishPrefetch(NULL, NULL, NULL);
+        free(music_index);
+        music_index = NULL;
+        music_index_len = 0;
+
         if (sdl_was_initialized)
         {
             Mix_CloseAudio();
@@ -983,6 +1436,18 @@ static boolean I_SDL_InitMusic(void)
     if (snd_musicdevice == SNDDEVICE_GENMIDI)
     {
         LoadSubstituteConfigs();
+
+        //!
+        // Don't build an index of the substitute music for the music
+        // lumps at startup, or read substitute music ahead of time;
+        // hash each song and load its substitute file when it is
+        // registered instead.
+        //
+
+        if (!M_ParmExists("-nomusicindex"))
+        {
+            BuildMusicIndex();
+        }
     }
 
     return music_initialized;
@@ -1096,9 +1561,25 @@ static void I_SDL_StopSong(void)
     current_track_music = NULL;
 }
 
+// Add a song loaded from memory to the list, so that the data is freed
+// when the song is unregistered.
+
+static void AddMemorySong(Mix_Music *music, SDL_RWops *rw, void *data)
+{
+    memory_song_t *memsong;
+
+    memsong = malloc(sizeof(memory_song_t));
+    memsong->music = music;
+    memsong->rw = rw;
+    memsong->data = data;
+    memsong->next = memory_songs;
+    memory_songs = memsong;
+}
+
 static void I_SDL_UnRegisterSong(void *handle)
 {
     Mix_Music *music = (Mix_Music *) handle;
+    memory_song_t **song, *memsong;
 
     if (!music_initialized)
     {
@@ -1111,6 +1592,22 @@ static void I_SDL_UnRegisterSong(void *handle)
     }
 
     Mix_FreeMusic(music);
+
+    // Free the MIDI data if the song was loaded from memory.
+
+    for (song = &memory_songs; *song != NULL; song = &(*song)->next)
+    {
+        if ((*song)->music == music)
+        {
+            memsong = *song;
+            *song = memsong->next;
+
+            SDL_FreeRW(memsong->rw);
+            free(memsong->data);
+            free(memsong);
+            break;
+        }
+    }
 }
 
 // Determine whether memory block is a .mid file 
@@ -1120,7 +1617,11 @@ static boolean IsMid(byte *mem, int len)
     return len > 4 && !memcmp(mem, "MThd", 4);
 }
 
-static boolean ConvertMus(byte *musdata, int len, char *filename)
+// Convert a MUS lump to MIDI in memory.  Returns true if successful, and
+// sets *midibuf to a newly allocated buffer holding the MIDI data.
+
+static boolean ConvertMus(byte *musdata, int len,
+                          void **midibuf, size_t *midibuf_len)
 {
     MEMFILE *instream;
     MEMFILE *outstream;
@@ -1137,19 +1638,86 @@ static boolean ConvertMus(byte *musdata, int len, char *filename)
     {
         mem_get_buf(outstream, &outbuf, &outbuf_len);
 
-        M_WriteFile(filename, outbuf, outbuf_len);
+        *midibuf = malloc(outbuf_len);
+        memcpy(*midibuf, outbuf, outbuf_len);
+        *midibuf_len = outbuf_len;
     }
 
     mem_fclose(instream);
     mem_fclose(outstream);
 
-    return result;
+    return result == 0;
+}
+
+// Load MIDI data through a temporary file.  This is needed when an
+// external program plays the music, or if SDL_mixer cannot load MIDI
+// data from memory.
+
+static Mix_Music *LoadMidiFile(void *midibuf, size_t midibuf_len)
+{
+    char *filename;
+    Mix_Music *music;
+
+    filename = M_TempFile("doom.mid");
+
+    M_WriteFile(filename, midibuf, midibuf_len);
+
+    music = Mix_LoadMUS(filename);
+
+    // Remove the temporary MIDI file; however, when using an external
+    // MIDI program we can't delete the file. Otherwise, the program
+    // won't find the file to play. This means we leave a mess on
+    // disk :(
+
+    if (strlen(snd_musiccmd) == 0)
+    {
+        remove(filename);
+    }
+
+    free(filename);
+
+    return music;
+}
+
+// Load a substitute music file, from the data read ahead of time if
+// there is any.
+
+static Mix_Music *LoadSubstituteMusic(char *filename)
+{
+    Mix_Music *music;
+    SDL_RWops *rw;
+    void *buf;
+    size_t buf_len;
+
+    // Only wait for the prefetch thread if it is reading this file.
+
+    if (prefetch_filename != NULL && !strcmp(prefetch_filename, filename)
+     && FinishPrefetch(filename, &buf, &buf_len))
+    {
+        rw = SDL_RWFromMem(buf, buf_len);
+        music = Mix_LoadMUS_RW(rw);
+
+        if (music != NULL)
+        {
+            AddMemorySong(music, rw, buf);
+            return music;
+        }
+
+        SDL_FreeRW(rw);
+        free(buf);
+    }
+
+    return Mix_LoadMUS(filename);
 }
 
 static void *I_SDL_RegisterSong(void *data, int len)
 {
     char *filename;
+    music_index_t *index;
     Mix_Music *music;
+    SDL_RWops *rw;
+    void *midibuf;
+    size_t midibuf_len;
 
     if (!music_initialized)
     {
@@ -1159,11 +1727,21 @@ static void *I_SDL_RegisterSong(void *data, int len)
     playing_substitute = false;
 
     // See if we're substituting this MUS for a high-quality replacement.
-    filename = GetSubstituteMusicFile(data, len);
+    // Music lumps are looked up in the index, so they need not be hashed.
+    index = FindMusicIndex(data);
+
+    if (index != NULL)
+    {
+        filename = index->filename;
+    }
+    else
+    {
+        filename = GetSubstituteMusicFile(data, len);
+    }
 
     if (filename != NULL)
     {
-        music = Mix_LoadMUS(filename);
+        music = LoadSubstituteMusic(filename);
 
         if (music == NULL)
         {
@@ -1177,7 +1755,16 @@ static void *I_SDL_RegisterSong(void *data, int len)
             // Read loop point metadata from the file so that we know where
             // to loop the music.
             playing_substitute = true;
-            ReadLoopPoints(filename, &file_metadata);
+
+            if (index != NULL)
+            {
+                file_metadata = index->metadata;
+            }
+            else
+            {
+                ReadLoopPoints(filename, &file_metadata);
+            }
+
             return music;
         }
     }
@@ -1185,24 +1772,45 @@ static void *I_SDL_RegisterSong(void *data, int len)
     // MUS files begin with "MUS"
     // Reject anything which doesnt have this signature
 
-    filename = M_TempFile("doom.mid");
-
     if (IsMid(data, len) && len < MAXMIDLENGTH)
     {
-        M_WriteFile(filename, data, len);
+        midibuf = malloc(len);
+        memcpy(midibuf, data, len);
+        midibuf_len = len;
     }
     else
     {
 	// Assume a MUS file and try to convert
 
-        ConvertMus(data, len, filename);
+        if (!ConvertMus(data, len, &midibuf, &midibuf_len))
+        {
+            fprintf(stderr, "Error loading midi: Failed to convert MUS\n");
+            return NULL;
+        }
     }
 
-    // Load the MIDI. In an ideal world we'd be using Mix_LoadMUS_RW()
-    // by now, but Mix_SetMusicCMD() only works with Mix_LoadMUS(), so
-    // we have to generate a temporary file.
+    // Load the MIDI from memory if we can.  Mix_SetMusicCMD() only works
+    // with Mix_LoadMUS(), so an external music program still needs a
+    // temporary file.
 
-    music = Mix_LoadMUS(filename);
+    music = NULL;
+
+    if (strlen(snd_musiccmd) == 0)
+    {
+        rw = SDL_RWFromMem(midibuf, midibuf_len);
+        music = Mix_LoadMUS_RW(rw);
+
+        if (music != NULL)
+        {
+            AddMemorySong(music, rw, midibuf);
+            return music;
+        }
+
+        SDL_FreeRW(rw);
+    }
+
+    music = LoadMidiFile(midibuf, midibuf_len);
+    free(midibuf);
 
     if (music == NULL)
     {
@@ -1211,19 +1819,27 @@ static void *I_SDL_RegisterSong(void *data, int len)
         fprintf(stderr, "Error loading midi: %s\n", Mix_GetError());
     }
 
-    // Remove the temporary MIDI file; however, when using an external
-    // MIDI program we can't delete the file. Otherwise, the program
-    // won't find the file to play. This means we leave a mess on
-    // disk :(
+    return music;
+}
 
-    if (strlen(snd_musiccmd) == 0)
+// Start reading the substitute music file for a song that is about to
+// be played, so that registering it does not need to wait for the disk.
+
+static void I_SDL_PrefetchSong(void *data, int len)
+{
+    music_index_t *index;
+
+    if (!music_initialized)
     {
-        remove(filename);
+        return;
     }
 
-    free(filename);
+    index = FindMusicIndex(data);
 
-    return music;
+    if (index != NULL && index->filename != NULL && index->file_length >= 0)
+    {
+        StartPrefetch(index->filename);
+    }
 }
 
 // Is the song playing?
@@ -1320,5 +1936,6 @@ music_module_t music_sdl_module =
     I_SDL_StopSong,
     I_SDL_MusicIsPlaying,
     I_SDL_PollMusic,
+    I_SDL_PrefetchSong,
 };
 
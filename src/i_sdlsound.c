@@ -31,11 +31,16 @@
 #endif
 
 #include "deh_str.h"
+#include "i_mixer.h"
 #include "i_sound.h"
 #include "i_system.h"
 #include "i_swap.h"
+#include "i_timer.h"
 #include "m_argv.h"
+#include "m_config.h"
 #include "m_misc.h"
+#include "sha1.h"
+#include "w_file.h"
 #include "w_wad.h"
 #include "z_zone.h"
 
@@ -54,6 +59,11 @@ struct allocated_sound_s
     int use_count;
     int pitch;
     allocated_sound_t *prev, *next;
+
+    // Next sound allocated for the same sfxinfo at a different pitch.
+    // The first is pointed to by the sfxinfo's driver_data.
+
+    allocated_sound_t *variant_next;
 };
 
 static boolean setpanning_workaround = false;
@@ -62,10 +72,29 @@ static boolean sound_initialized = false;
 
 static allocated_sound_t *channels_playing[NUM_CHANNELS];
 
+// If true, sound effects are mixed by the built-in mixer, rather than
+// by SDL_mixer, and these are the channels being played.  The channels
+// are also used from the audio thread, so must only be changed with
+// the audio locked.
+
+static boolean builtin_mixer = false;
+static mixer_channel_t mixer_channels_playing[NUM_CHANNELS];
+
 static int mixer_freq;
 static Uint16 mixer_format;
 static int mixer_channels;
 static boolean use_sfx_prefix;
+
+// If true, report how long sounds take to load when first played.
+
+static boolean sfx_stats = false;
+static unsigned int sfx_stats_loads = 0;
+static uint64_t sfx_stats_total_us = 0;
+static uint64_t sfx_stats_max_us = 0;
+static unsigned int sfx_stats_allocs = 0;
+static unsigned int sfx_stats_pitch_hits = 0;
+static unsigned int sfx_stats_pitch_misses = 0;
+static unsigned int sfx_stats_pitch_evictions = 0;
 static boolean (*ExpandSoundData)(sfxinfo_t *sfxinfo,
                                   byte *data,
                                   int samplerate,
@@ -79,8 +108,21 @@ static allocated_sound_t *allocated_sounds_head = NULL;
 static allocated_sound_t *allocated_sounds_tail = NULL;
 static int allocated_sounds_size = 0;
 
+// Pitch-shifted sounds are kept after they finish playing, as the same
+// few pitches are used over and over, but they may only use this
+// fraction of snd_cachesize, so that they cannot push out the sounds
+// they are made from.
+
+#define PITCH_CACHE_FRACTION 2
+
+static int pitched_sounds_size = 0;
+
 int use_libsamplerate = 0;
 
+// If non-zero, use the built-in mixer to mix sound effects.
+
+int use_builtin_mixer = 0;
+
 // Scale factor used when converting libsamplerate floating point numbers
 // to integers. Too high means the sounds can clip; too low means they
 // will be too quiet. This is an amount that should avoid clipping most
@@ -133,14 +175,32 @@ static void AllocatedSoundUnlink(allocated_sound_t *snd)
 
 static void FreeAllocatedSound(allocated_sound_t *snd)
 {
+    allocated_sound_t **variant;
+
     // Unlink from linked list.
 
     AllocatedSoundUnlink(snd);
 
+    // Unlink from the list of sounds for this sfxinfo.
+
+    variant = (allocated_sound_t **) &snd->sfxinfo->driver_data;
+
+    while (*variant != snd)
+    {
+        variant = &(*variant)->variant_next;
+    }
+
+    *variant = snd->variant_next;
+
     // Keep track of the amount of allocated sound data:
 
     allocated_sounds_size -= snd->chunk.alen;
 
+    if (snd->pitch != NORM_PITCH)
+    {
+        pitched_sounds_size -= snd->chunk.alen;
+    }
+
     free(snd);
 }
 
@@ -195,9 +255,40 @@ static void ReserveCacheSpace(size_t len)
     }
 }
 
+// Free pitch-shifted sounds that are not in use, least recently used
+// first, until there is room for a new one of "len" bytes.
+
+static void ReservePitchCacheSpace(size_t len)
+{
+    allocated_sound_t *snd, *prev;
+    int limit;
+
+    if (snd_cachesize <= 0)
+    {
+        return;
+    }
+
+    limit = snd_cachesize / PITCH_CACHE_FRACTION;
+    snd = allocated_sounds_tail;
+
+    while (snd != NULL && pitched_sounds_size + len > limit)
+    {
+        prev = snd->prev;
+
+        if (snd->pitch != NORM_PITCH && snd->use_count == 0)
+        {
+            FreeAllocatedSound(snd);
+            ++sfx_stats_pitch_evictions;
+        }
+
+        snd = prev;
+    }
+}
+
 // Allocate a block for a new sound effect.
 
-static allocated_sound_t *AllocateSound(sfxinfo_t *sfxinfo, size_t len)
+static allocated_sound_t *AllocateSound(sfxinfo_t *sfxinfo, int pitch,
+                                        size_t len)
 {
     allocated_sound_t *snd;
 
@@ -228,15 +319,25 @@ static allocated_sound_t *AllocateSound(sfxinfo_t *sfxinfo, size_t len)
     snd->chunk.alen = len;
     snd->chunk.allocated = 1;
     snd->chunk.volume = MIX_MAX_VOLUME;
-    snd->pitch = NORM_PITCH;
+    snd->pitch = pitch;
 
     snd->sfxinfo = sfxinfo;
     snd->use_count = 0;
 
+    snd->variant_next = sfxinfo->driver_data;
+    sfxinfo->driver_data = snd;
+
     // Keep track of how much memory all these cached sounds are using...
 
     allocated_sounds_size += len;
 
+    if (pitch != NORM_PITCH)
+    {
+        pitched_sounds_size += len;
+    }
+
+    ++sfx_stats_allocs;
+
     AllocatedSoundLink(snd);
 
     return snd;
@@ -273,20 +374,20 @@ static void UnlockAllocatedSound(allocated_sound_t *snd)
     //printf("-- %s: Use count=%i\n", snd->sfxinfo->name, snd->use_count);
 }
 
-// Search through the list of allocated sounds and return the one that matches
-// the supplied sfxinfo entry and pitch level.
+// Search through the sounds allocated for the supplied sfxinfo entry and
+// return the one at the given pitch level.
 
 static allocated_sound_t * GetAllocatedSoundBySfxInfoAndPitch(sfxinfo_t *sfxinfo, int pitch)
 {
-    allocated_sound_t * p = allocated_sounds_head;
+    allocated_sound_t * p = sfxinfo->driver_data;
 
     while (p != NULL)
     {
-        if (p->sfxinfo == sfxinfo && p->pitch == pitch)
+        if (p->pitch == pitch)
         {
             return p;
         }
-        p = p->next;
+        p = p->variant_next;
     }
 
     return NULL;
@@ -301,6 +402,7 @@ static allocated_sound_t * PitchShift(allocated_sound_t *insnd, int pitch)
     Sint16 *inp, *outp;
     Sint16 *srcbuf, *dstbuf;
     Uint32 srclen, dstlen;
+    Uint32 step, frac_step, frac;
 
     srcbuf = (Sint16 *)insnd->chunk.abuf;
     srclen = insnd->chunk.alen;
@@ -315,21 +417,37 @@ static allocated_sound_t * PitchShift(allocated_sound_t *insnd, int pitch)
         dstlen++;
     }
 
-    outsnd = AllocateSound(insnd->sfxinfo, dstlen);
+    ReservePitchCacheSpace(dstlen);
+
+    outsnd = AllocateSound(insnd->sfxinfo, pitch, dstlen);
 
     if (!outsnd)
     {
         return NULL;
     }
 
-    outsnd->pitch = pitch;
     dstbuf = (Sint16 *)outsnd->chunk.abuf;
 
-    // loop over output buffer. find corresponding input cell, copy over
+    // loop over output buffer. find corresponding input cell, copy over.
+    // The input cell is (outp - dstbuf) * srclen / dstlen, stepped along
+    // with an integer part and a remainder instead of divided out.
+    step = srclen / dstlen;
+    frac_step = srclen % dstlen;
+    frac = 0;
+    inp = srcbuf;
+
     for (outp = dstbuf; outp < dstbuf + dstlen/2; ++outp)
     {
-        inp = srcbuf + (int)((float)(outp - dstbuf) / dstlen * srclen);
         *outp = *inp;
+
+        inp += step;
+        frac += frac_step;
+
+        if (frac >= dstlen)
+        {
+            frac -= dstlen;
+            ++inp;
+        }
     }
 
     return outsnd;
@@ -343,6 +461,16 @@ static void ReleaseSoundOnChannel(int channel)
 {
     allocated_sound_t *snd = channels_playing[channel];
 
+    // Stop the built-in mixer reading the sound first: once unlocked,
+    // it can be freed to make room for another.
+
+    if (builtin_mixer)
+    {
+        SDL_LockAudio();
+        mixer_channels_playing[channel].samples = NULL;
+        SDL_UnlockAudio();
+    }
+
     if (snd == NULL)
     {
         return;
@@ -351,13 +479,6 @@ static void ReleaseSoundOnChannel(int channel)
     channels_playing[channel] = NULL;
 
     UnlockAllocatedSound(snd);
-
-    // if the sound is a pitch-shift and it's not in use, immediately
-    // free it
-    if (snd->pitch != NORM_PITCH && snd->use_count <= 0)
-    {
-        FreeAllocatedSound(snd);
-    }
 }
 
 #ifdef HAVE_LIBSAMPLERATE
@@ -393,21 +514,18 @@ static int SRC_ConversionMode(void)
 //   unsigned 8 bits --> signed 16 bits
 //   mono --> stereo
 //   samplerate --> mixer_freq
-// Returns number of clipped samples.
+// Returns a newly allocated buffer, and sets *alen to its length in bytes
+// and *clipped to the number of clipped samples.  This is run by the
+// precache worker threads, so it must not change any global state.
 // DWF 2008-02-10 with cleanups by Simon Howard.
 
-static boolean ExpandSoundData_SRC(sfxinfo_t *sfxinfo,
-                                   byte *data,
-                                   int samplerate,
-                                   int length)
+static int16_t *ConvertSound_SRC(byte *data, int samplerate, int length,
+                                 uint32_t *alen, uint32_t *clipped)
 {
     SRC_DATA src_data;
-    uint32_t i, abuf_index=0, clipped=0;
-//    uint32_t alen;
+    uint32_t i, abuf_index=0;
     int retn;
     int16_t *expanded;
-    allocated_sound_t *snd;
-    Mix_Chunk *chunk;
 
     src_data.input_frames = length;
     src_data.data_in = malloc(length * sizeof(float));
@@ -434,19 +552,13 @@ static boolean ExpandSoundData_SRC(sfxinfo_t *sfxinfo,
     retn = src_simple(&src_data, SRC_ConversionMode(), 1);
     assert(retn == 0);
 
-    // Allocate the new chunk.
+    // Allocate the output buffer.
 
-//    alen = src_data.output_frames_gen * 4;
+    *alen = src_data.output_frames_gen * 4;
+    *clipped = 0;
 
-    snd = AllocateSound(sfxinfo, src_data.output_frames_gen * 4);
-
-    if (snd == NULL)
-    {
-        return false;
-    }
-
-    chunk = &snd->chunk;
-    expanded = (int16_t *) chunk->abuf;
+    expanded = malloc(*alen);
+    assert(expanded != NULL);
 
     // Convert the result back into 16-bit integers.
 
@@ -481,12 +593,12 @@ static boolean ExpandSoundData_SRC(sfxinfo_t *sfxinfo,
         if (cvtval_i < -INT16_MAX)
         {
             cvtval_i = -INT16_MAX;
-            ++clipped;
+            ++*clipped;
         }
         else if (cvtval_i > INT16_MAX)
         {
             cvtval_i = INT16_MAX;
-            ++clipped;
+            ++*clipped;
         }
 
         // Left and right channels
@@ -498,16 +610,223 @@ static boolean ExpandSoundData_SRC(sfxinfo_t *sfxinfo,
     free(src_data.data_in);
     free(src_data.data_out);
 
+    return expanded;
+}
+
+// Allocate a sound and copy already converted sample data into it.
+
+static boolean StoreConvertedSound(sfxinfo_t *sfxinfo, void *data,
+                                   uint32_t alen, uint32_t clipped)
+{
+    allocated_sound_t *snd;
+
+    snd = AllocateSound(sfxinfo, NORM_PITCH, alen);
+
+    if (snd == NULL)
+    {
+        return false;
+    }
+
+    memcpy(snd->chunk.abuf, data, alen);
+
     if (clipped > 0)
     {
         fprintf(stderr, "Sound '%s': clipped %u samples (%0.2f %%)\n", 
                         sfxinfo->name, clipped,
-                        400.0 * clipped / chunk->alen);
+                        400.0 * clipped / alen);
     }
 
     return true;
 }
 
+static boolean ExpandSoundData_SRC(sfxinfo_t *sfxinfo,
+                                   byte *data,
+                                   int samplerate,
+                                   int length)
+{
+    int16_t *expanded;
+    uint32_t alen, clipped;
+    boolean result;
+
+    expanded = ConvertSound_SRC(data, samplerate, length, &alen, &clipped);
+    result = StoreConvertedSound(sfxinfo, expanded, alen, clipped);
+    free(expanded);
+
+    return result;
+}
+
+// Converting all the sound effects with libsamplerate takes several
+// seconds with the higher quality modes, so converted sounds are saved
+// to a cache file in the config directory, one for each mixer rate and
+// conversion mode.  Sounds are looked up by the SHA-1 digest of their
+// lump, so the same file serves every IWAD and PWAD.  The file is in
+// native byte order and is mapped into memory where possible.
+
+#define SFX_CACHE_MAGIC "CHOCSFX1"
+#define SFX_CACHE_BYTE_ORDER 0x01020304
+
+typedef struct
+{
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t freq;
+    uint32_t mode;
+    float scale;
+    uint32_t num_entries;
+} sfx_cache_header_t;
+
+typedef struct
+{
+    sha1_digest_t digest;
+    uint32_t offset;
+    uint32_t length;
+} sfx_cache_entry_t;
+
+static char *sfx_cache_path = NULL;
+static wad_file_t *sfx_cache_file = NULL;
+static byte *sfx_cache_data = NULL;
+static sfx_cache_entry_t *sfx_cache_entries = NULL;
+static unsigned int sfx_cache_num_entries = 0;
+
+static void CloseSfxCache(void)
+{
+    if (sfx_cache_file != NULL)
+    {
+        if (sfx_cache_file->mapped == NULL)
+        {
+            Z_Free(sfx_cache_data);
+        }
+
+        W_CloseFile(sfx_cache_file);
+        sfx_cache_file = NULL;
+    }
+
+    sfx_cache_data = NULL;
+    sfx_cache_entries = NULL;
+    sfx_cache_num_entries = 0;
+}
+
+static void OpenSfxCache(void)
+{
+    sfx_cache_header_t *header;
+    sfx_cache_entry_t *entry;
+    unsigned int length;
+    unsigned int i;
+
+    CloseSfxCache();
+
+    if (sfx_cache_path == NULL)
+    {
+        return;
+    }
+
+    sfx_cache_file = W_OpenMappedFile(sfx_cache_path);
+
+    if (sfx_cache_file == NULL)
+    {
+        return;
+    }
+
+    length = sfx_cache_file->length;
+
+    if (sfx_cache_file->mapped != NULL)
+    {
+        sfx_cache_data = sfx_cache_file->mapped;
+    }
+    else
+    {
+        sfx_cache_data = Z_Malloc(length, PU_STATIC, NULL);
+
+        if (W_Read(sfx_cache_file, 0, sfx_cache_data, length) != length)
+        {
+            CloseSfxCache();
+            return;
+        }
+    }
+
+    // Ignore the file if it was written with different settings or is
+    // damaged.  It will be replaced when the sounds are converted again.
+
+    header = (sfx_cache_header_t *) sfx_cache_data;
+
+    if (length < sizeof(sfx_cache_header_t)
+     || memcmp(header->magic, SFX_CACHE_MAGIC, sizeof(header->magic)) != 0
+     || header->byte_order != SFX_CACHE_BYTE_ORDER
+     || header->freq != mixer_freq
+     || header->mode != use_libsamplerate
+     || header->scale != libsamplerate_scale
+     || header->num_entries > (length - sizeof(sfx_cache_header_t))
+                            / sizeof(sfx_cache_entry_t))
+    {
+        CloseSfxCache();
+        return;
+    }
+
+    sfx_cache_entries =
+        (sfx_cache_entry_t *) (sfx_cache_data + sizeof(sfx_cache_header_t));
+
+    for (i=0; i<header->num_entries; ++i)
+    {
+        entry = &sfx_cache_entries[i];
+
+        if (entry->offset > length || entry->length > length - entry->offset)
+        {
+            CloseSfxCache();
+            return;
+        }
+    }
+
+    sfx_cache_num_entries = header->num_entries;
+}
+
+static void GetLumpDigest(byte *lump, unsigned int lumplen,
+                          sha1_digest_t digest)
+{
+    sha1_context_t context;
+
+    SHA1_Init(&context);
+    SHA1_Update(&context, lump, lumplen);
+    SHA1_Final(digest, &context);
+}
+
+// Find a converted sound in the cache file.  Returns a pointer to the
+// sample data and sets *alen, or returns NULL if it is not there.
+
+static byte *FindCachedSound(sha1_digest_t digest, uint32_t *alen)
+{
+    unsigned int i;
+
+    for (i=0; i<sfx_cache_num_entries; ++i)
+    {
+        if (!memcmp(sfx_cache_entries[i].digest, digest,
+                    sizeof(sha1_digest_t)))
+        {
+            *alen = sfx_cache_entries[i].length;
+            return sfx_cache_data + sfx_cache_entries[i].offset;
+        }
+    }
+
+    return NULL;
+}
+
+static void InitSfxCache(void)
+{
+    char filename[32];
+
+    M_snprintf(filename, sizeof(filename), "sfx-%i-%i.cache",
+               mixer_freq, use_libsamplerate);
+    sfx_cache_path = M_StringJoin(configdir, filename, NULL);
+
+    OpenSfxCache();
+}
+
+static void ShutdownSfxCache(void)
+{
+    CloseSfxCache();
+    free(sfx_cache_path);
+    sfx_cache_path = NULL;
+}
+
 #endif
 
 static boolean ConvertibleRatio(int freq1, int freq2)
@@ -612,7 +931,7 @@ static boolean ExpandSoundData_SDL(sfxinfo_t *sfxinfo,
 
     // Allocate a chunk in which to expand the sound
 
-    snd = AllocateSound(sfxinfo, expanded_length);
+    snd = AllocateSound(sfxinfo, NORM_PITCH, expanded_length);
 
     if (snd == NULL)
     {
@@ -702,23 +1021,13 @@ static boolean ExpandSoundData_SDL(sfxinfo_t *sfxinfo,
     return true;
 }
 
-// Load and convert a sound effect
-// Returns true if successful
+// Check the header of a sound lump, and find the sample data within it.
+// Returns true if this is a valid sound.
 
-static boolean CacheSFX(sfxinfo_t *sfxinfo)
+static boolean GetSoundSamples(byte *data, unsigned int lumplen,
+                               int *samplerate, byte **samples,
+                               unsigned int *length)
 {
-    int lumpnum;
-    unsigned int lumplen;
-    int samplerate;
-    unsigned int length;
-    byte *data;
-
-    // need to load the sound
-
-    lumpnum = sfxinfo->lumpnum;
-    data = W_CacheLumpNum(lumpnum, PU_STATIC);
-    lumplen = W_LumpLength(lumpnum);
-
     // Check the header, and ensure this is a valid sound
 
     if (lumplen < 8
@@ -731,8 +1040,8 @@ static boolean CacheSFX(sfxinfo_t *sfxinfo)
 
     // 16 bit sample rate field, 32 bit length field
 
-    samplerate = (data[3] << 8) | data[2];
-    length = (data[7] << 24) | (data[6] << 16) | (data[5] << 8) | data[4];
+    *samplerate = (data[3] << 8) | data[2];
+    *length = (data[7] << 24) | (data[6] << 16) | (data[5] << 8) | data[4];
 
     // If the header specifies that the length of the sound is greater than
     // the length of the lump itself, this is an invalid sound lump
@@ -743,7 +1052,7 @@ static boolean CacheSFX(sfxinfo_t *sfxinfo)
     // further investigation to better understand the correct
     // behavior.
 
-    if (length > lumplen - 8 || length <= 48)
+    if (*length > lumplen - 8 || *length <= 48)
     {
         return false;
     }
@@ -751,12 +1060,58 @@ static boolean CacheSFX(sfxinfo_t *sfxinfo)
     // The DMX sound library seems to skip the first 16 and last 16
     // bytes of the lump - reason unknown.
 
-    data += 16;
-    length -= 32;
+    *samples = data + 16 + 8;
+    *length -= 32;
+
+    return true;
+}
+
+// Load and convert a sound effect
+// Returns true if successful
+
+static boolean CacheSFX(sfxinfo_t *sfxinfo)
+{
+    int lumpnum;
+    unsigned int lumplen;
+    int samplerate;
+    unsigned int length;
+    byte *data;
+    byte *samples;
+
+    // need to load the sound
+
+    lumpnum = sfxinfo->lumpnum;
+    data = W_CacheLumpNum(lumpnum, PU_STATIC);
+    lumplen = W_LumpLength(lumpnum);
+
+    if (!GetSoundSamples(data, lumplen, &samplerate, &samples, &length))
+    {
+        return false;
+    }
+
+#ifdef HAVE_LIBSAMPLERATE
+    // It may already have been converted on a previous run.
+
+    if (sfx_cache_num_entries > 0 && ExpandSoundData == ExpandSoundData_SRC)
+    {
+        sha1_digest_t digest;
+        byte *cached;
+        uint32_t alen;
+
+        GetLumpDigest(data, lumplen, digest);
+        cached = FindCachedSound(digest, &alen);
+
+        if (cached != NULL)
+        {
+            W_ReleaseLumpNum(lumpnum);
+            return StoreConvertedSound(sfxinfo, cached, alen, 0);
+        }
+    }
+#endif
 
     // Sample rate conversion
 
-    if (!ExpandSoundData(sfxinfo, data + 8, samplerate, length))
+    if (!ExpandSoundData(sfxinfo, samples, samplerate, length))
     {
         return false;
     }
@@ -804,11 +1159,199 @@ static void GetSfxLumpName(sfxinfo_t *sfx, char *buf, size_t buf_len)
 
 #ifdef HAVE_LIBSAMPLERATE
 
+#define DEFAULT_PRECACHE_THREADS 4
+#define MAX_PRECACHE_THREADS 32
+
+// A sound effect to be converted when precaching.
+
+typedef struct
+{
+    sfxinfo_t *sfxinfo;
+    byte *lump;
+    sha1_digest_t digest;
+
+    int samplerate;
+    byte *samples;
+    unsigned int length;
+
+    // Converted data: either in the cache file, or newly converted by a
+    // worker thread into the output buffer.
+
+    byte *cached;
+    int16_t *output;
+    uint32_t alen;
+    uint32_t clipped;
+} precache_job_t;
+
+static precache_job_t *precache_jobs;
+static int precache_num_jobs;
+static int precache_next_job;
+static SDL_mutex *precache_mutex;
+
+// Worker thread function: take jobs from the list until there are none
+// left.  The main thread runs this as well.
+
+static int PrecacheThread(void *unused)
+{
+    precache_job_t *job;
+    int i;
+
+    for (;;)
+    {
+        SDL_LockMutex(precache_mutex);
+        i = precache_next_job++;
+        SDL_UnlockMutex(precache_mutex);
+
+        if (i >= precache_num_jobs)
+        {
+            break;
+        }
+
+        job = &precache_jobs[i];
+
+        if (job->cached == NULL)
+        {
+            job->output = ConvertSound_SRC(job->samples, job->samplerate,
+                                           job->length, &job->alen,
+                                           &job->clipped);
+        }
+    }
+
+    return 0;
+}
+
+// Rewrite the cache file with its existing contents plus any sounds that
+// were newly converted.
+
+static void WriteSfxCache(precache_job_t *jobs, int num_jobs)
+{
+    sfx_cache_header_t header;
+    sfx_cache_entry_t *entries;
+    byte **entry_data;
+    char *temp_path;
+    FILE *fstream;
+    boolean success;
+    uint32_t offset;
+    unsigned int num_entries;
+    unsigned int i;
+    int j;
+
+    temp_path = M_StringJoin(sfx_cache_path, ".tmp", NULL);
+    fstream = fopen(temp_path, "wb");
+
+    if (fstream == NULL)
+    {
+        free(temp_path);
+        return;
+    }
+
+    entries = malloc((sfx_cache_num_entries + num_jobs)
+                     * sizeof(sfx_cache_entry_t));
+    entry_data = malloc((sfx_cache_num_entries + num_jobs) * sizeof(byte *));
+    num_entries = 0;
+
+    for (i=0; i<sfx_cache_num_entries; ++i)
+    {
+        entries[num_entries] = sfx_cache_entries[i];
+        entry_data[num_entries] = sfx_cache_data + sfx_cache_entries[i].offset;
+        ++num_entries;
+    }
+
+    for (j=0; j<num_jobs; ++j)
+    {
+        if (jobs[j].output == NULL)
+        {
+            continue;
+        }
+
+        // Linked sounds share a lump, and are only stored once.
+
+        for (i=sfx_cache_num_entries; i<num_entries; ++i)
+        {
+            if (!memcmp(entries[i].digest, jobs[j].digest,
+                        sizeof(sha1_digest_t)))
+            {
+                break;
+            }
+        }
+
+        if (i < num_entries)
+        {
+            continue;
+        }
+
+        memcpy(entries[num_entries].digest, jobs[j].digest,
+               sizeof(sha1_digest_t));
+        entries[num_entries].length = jobs[j].alen;
+        entry_data[num_entries] = (byte *) jobs[j].output;
+        ++num_entries;
+    }
+
+    // Sample data follows the header and the entries.
+
+    offset = sizeof(sfx_cache_header_t)
+           + num_entries * sizeof(sfx_cache_entry_t);
+
+    for (i=0; i<num_entries; ++i)
+    {
+        entries[i].offset = offset;
+        offset += entries[i].length;
+    }
+
+    memcpy(header.magic, SFX_CACHE_MAGIC, sizeof(header.magic));
+    header.byte_order = SFX_CACHE_BYTE_ORDER;
+    header.freq = mixer_freq;
+    header.mode = use_libsamplerate;
+    header.scale = libsamplerate_scale;
+    header.num_entries = num_entries;
+
+    success = fwrite(&header, sizeof(header), 1, fstream) == 1
+           && fwrite(entries, sizeof(sfx_cache_entry_t),
+                     num_entries, fstream) == num_entries;
+
+    for (i=0; success && i<num_entries; ++i)
+    {
+        success = fwrite(entry_data[i], 1, entries[i].length, fstream)
+               == entries[i].length;
+    }
+
+    success = fclose(fstream) == 0 && success;
+
+    free(entries);
+    free(entry_data);
+
+    // The old file must be closed before it can be replaced.
+
+    CloseSfxCache();
+
+    if (success)
+    {
+        remove(sfx_cache_path);
+        success = rename(temp_path, sfx_cache_path) == 0;
+    }
+
+    if (!success)
+    {
+        fprintf(stderr, "WriteSfxCache: Failed to write %s\n",
+                        sfx_cache_path);
+        remove(temp_path);
+    }
+
+    free(temp_path);
+
+    OpenSfxCache();
+}
+
 // Preload all the sound effects - stops nasty ingame freezes
 
 static void I_SDL_PrecacheSounds(sfxinfo_t *sounds, int num_sounds)
 {
+    SDL_Thread *threads[MAX_PRECACHE_THREADS];
+    precache_job_t *job;
     char namebuf[9];
+    uint64_t start_time;
+    unsigned int lumplen;
+    int num_threads, num_cached, num_converted;
     int i;
 
     // Don't need to precache the sounds unless we are using libsamplerate.
@@ -818,27 +1361,151 @@ static void I_SDL_PrecacheSounds(sfxinfo_t *sounds, int num_sounds)
 	return;
     }
 
-    printf("I_SDL_PrecacheSounds: Precaching all sound effects..");
+    printf("I_SDL_PrecacheSounds: Precaching all sound effects...");
+    fflush(stdout);
+
+    start_time = I_GetTimeUS();
+
+    // Load the lumps and look for them in the cache file.  The lumps
+    // stay locked in memory while the worker threads convert them.
+
+    precache_jobs = malloc(num_sounds * sizeof(precache_job_t));
+    precache_num_jobs = 0;
+    num_cached = 0;
 
     for (i=0; i<num_sounds; ++i)
     {
-        if ((i % 6) == 0)
+        GetSfxLumpName(&sounds[i], namebuf, sizeof(namebuf));
+
+        sounds[i].lumpnum = W_CheckNumForName(namebuf);
+
+        if (sounds[i].lumpnum == -1)
         {
-            printf(".");
-            fflush(stdout);
+            continue;
         }
 
-        GetSfxLumpName(&sounds[i], namebuf, sizeof(namebuf));
+        job = &precache_jobs[precache_num_jobs];
+        job->sfxinfo = &sounds[i];
+        job->lump = W_CacheLumpNum(sounds[i].lumpnum, PU_STATIC);
+        lumplen = W_LumpLength(sounds[i].lumpnum);
 
-        sounds[i].lumpnum = W_CheckNumForName(namebuf);
+        if (!GetSoundSamples(job->lump, lumplen, &job->samplerate,
+                             &job->samples, &job->length))
+        {
+            W_ReleaseLumpNum(sounds[i].lumpnum);
+            continue;
+        }
 
-        if (sounds[i].lumpnum != -1)
+        GetLumpDigest(job->lump, lumplen, job->digest);
+        job->cached = FindCachedSound(job->digest, &job->alen);
+        job->output = NULL;
+        job->clipped = 0;
+
+        if (job->cached != NULL)
         {
-            CacheSFX(&sounds[i]);
+            ++num_cached;
         }
+
+        ++precache_num_jobs;
     }
 
-    printf("\n");
+    num_converted = precache_num_jobs - num_cached;
+
+    //!
+    // @arg <n>
+    //
+    // Use n threads to convert sound effects with libsamplerate when
+    // precaching them at startup.  The default is 4.
+    //
+
+    i = M_CheckParmWithArgs("-sfxthreads", 1);
+
+    if (i > 0)
+    {
+        num_threads = atoi(myargv[i + 1]);
+    }
+    else
+    {
+        num_threads = DEFAULT_PRECACHE_THREADS;
+    }
+
+    if (num_threads > num_converted)
+    {
+        num_threads = num_converted;
+    }
+
+    if (num_threads > MAX_PRECACHE_THREADS)
+    {
+        num_threads = MAX_PRECACHE_THREADS;
+    }
+    else if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+
+    // The main thread is one of the workers.
+
+    precache_next_job = 0;
+    precache_mutex = SDL_CreateMutex();
+
+    for (i=1; i<num_threads; ++i)
+    {
+        threads[i] = SDL_CreateThread(PrecacheThread, NULL);
+
+        if (threads[i] == NULL)
+        {
+            break;
+        }
+    }
+
+    num_threads = i;
+
+    PrecacheThread(NULL);
+
+    for (i=1; i<num_threads; ++i)
+    {
+        SDL_WaitThread(threads[i], NULL);
+    }
+
+    SDL_DestroyMutex(precache_mutex);
+
+    // Store the converted sounds.
+
+    for (i=0; i<precache_num_jobs; ++i)
+    {
+        job = &precache_jobs[i];
+
+        if (job->cached != NULL)
+        {
+            StoreConvertedSound(job->sfxinfo, job->cached, job->alen, 0);
+        }
+        else
+        {
+            StoreConvertedSound(job->sfxinfo, job->output, job->alen,
+                                job->clipped);
+        }
+
+        W_ReleaseLumpNum(job->sfxinfo->lumpnum);
+    }
+
+    if (num_converted > 0 && sfx_cache_path != NULL)
+    {
+        WriteSfxCache(precache_jobs, precache_num_jobs);
+    }
+
+    for (i=0; i<precache_num_jobs; ++i)
+    {
+        free(precache_jobs[i].output);
+    }
+
+    free(precache_jobs);
+    precache_jobs = NULL;
+
+    printf(" done in %i ms\n",
+           (int) ((I_GetTimeUS() - start_time) / 1000));
+    printf("I_SDL_PrecacheSounds: %i from disk cache, "
+           "%i converted using %i threads\n",
+           num_cached, num_converted, num_threads);
 }
 
 #else
@@ -854,13 +1521,33 @@ static void I_SDL_PrecacheSounds(sfxinfo_t *sounds, int num_sounds)
 
 static boolean LockSound(sfxinfo_t *sfxinfo)
 {
+    uint64_t start_time, load_time;
+
     // If the sound isn't loaded, load it now
     if (GetAllocatedSoundBySfxInfoAndPitch(sfxinfo, NORM_PITCH) == NULL)
     {
+        start_time = I_GetTimeUS();
+
         if (!CacheSFX(sfxinfo))
         {
             return false;
         }
+
+        if (sfx_stats)
+        {
+            load_time = I_GetTimeUS() - start_time;
+
+            ++sfx_stats_loads;
+            sfx_stats_total_us += load_time;
+
+            if (load_time > sfx_stats_max_us)
+            {
+                sfx_stats_max_us = load_time;
+            }
+
+            printf("LockSound: '%s' loaded in %u us\n",
+                   DEH_String(sfxinfo->name), (unsigned int) load_time);
+        }
     }
 
     LockAllocatedSound(GetAllocatedSoundBySfxInfoAndPitch(sfxinfo, NORM_PITCH));
@@ -891,6 +1578,14 @@ static void I_SDL_UpdateSoundParams(int handle, int vol, int sep)
         return;
     }
 
+    if (builtin_mixer)
+    {
+        SDL_LockAudio();
+        I_Mixer_SetParams(&mixer_channels_playing[handle], vol, sep);
+        SDL_UnlockAudio();
+        return;
+    }
+
     left = ((254 - sep) * vol) / 127;
     right = ((sep) * vol) / 127;
 
@@ -939,46 +1634,56 @@ static int I_SDL_StartSound(sfxinfo_t *sfxinfo, int channel, int vol, int sep, i
 
     ReleaseSoundOnChannel(channel);
 
-    // Get the sound data
+    // Get the sound data, un-pitch-shifted
 
     if (!LockSound(sfxinfo))
     {
         return -1;
     }
 
-    snd = GetAllocatedSoundBySfxInfoAndPitch(sfxinfo, pitch);
+    snd = GetAllocatedSoundBySfxInfoAndPitch(sfxinfo, NORM_PITCH);
 
-    if (snd == NULL)
+    // Use a pitch-shifted copy instead, making one if there isn't one
+    // already.  The base sound stays locked while it is being shifted.
+
+    if (snd_pitchshift && pitch != NORM_PITCH)
     {
         allocated_sound_t *newsnd;
-        // fetch the base sound effect, un-pitch-shifted
-        snd = GetAllocatedSoundBySfxInfoAndPitch(sfxinfo, NORM_PITCH);
 
-        if (snd == NULL)
+        newsnd = GetAllocatedSoundBySfxInfoAndPitch(sfxinfo, pitch);
+
+        if (newsnd != NULL)
         {
-            return -1;
+            ++sfx_stats_pitch_hits;
         }
-
-        if (snd_pitchshift)
+        else
         {
+            ++sfx_stats_pitch_misses;
             newsnd = PitchShift(snd, pitch);
+        }
 
-            if (newsnd)
-            {
-                LockAllocatedSound(newsnd);
-                UnlockAllocatedSound(snd);
-                snd = newsnd;
-            }
+        if (newsnd)
+        {
+            LockAllocatedSound(newsnd);
+            UnlockAllocatedSound(snd);
+            snd = newsnd;
         }
     }
-    else
-    {
-        LockAllocatedSound(snd);
-    }
 
     // play sound
 
-    Mix_PlayChannel(channel, &snd->chunk, 0);
+    if (builtin_mixer)
+    {
+        SDL_LockAudio();
+        mixer_channels_playing[channel].samples = (int16_t *) snd->chunk.abuf;
+        mixer_channels_playing[channel].length = snd->chunk.alen / 4;
+        mixer_channels_playing[channel].position = 0;
+        SDL_UnlockAudio();
+    }
+    else
+    {
+        Mix_PlayChannel(channel, &snd->chunk, 0);
+    }
 
     channels_playing[channel] = snd;
 
@@ -996,7 +1701,10 @@ static void I_SDL_StopSound(int handle)
         return;
     }
 
-    Mix_HaltChannel(handle);
+    if (!builtin_mixer)
+    {
+        Mix_HaltChannel(handle);
+    }
 
     // Sound data is no longer needed; release the
     // sound data being used for this channel
@@ -1007,11 +1715,22 @@ static void I_SDL_StopSound(int handle)
 
 static boolean I_SDL_SoundIsPlaying(int handle)
 {
+    boolean result;
+
     if (!sound_initialized || handle < 0 || handle >= NUM_CHANNELS)
     {
         return false;
     }
 
+    if (builtin_mixer)
+    {
+        SDL_LockAudio();
+        result = I_Mixer_ChannelPlaying(&mixer_channels_playing[handle]);
+        SDL_UnlockAudio();
+
+        return result;
+    }
+
     return Mix_Playing(handle);
 }
 
@@ -1044,12 +1763,48 @@ static void I_SDL_ShutdownSound(void)
         return;
     }
 
+    if (sfx_stats)
+    {
+        if (sfx_stats_loads > 0)
+        {
+            printf("I_SDL_ShutdownSound: %u sounds loaded on first play, "
+                   "average %u us, worst %u us\n", sfx_stats_loads,
+                   (unsigned int) (sfx_stats_total_us / sfx_stats_loads),
+                   (unsigned int) sfx_stats_max_us);
+        }
+
+        printf("I_SDL_ShutdownSound: %u allocations, pitch-shifted sounds: "
+               "%u hits, %u misses, %u evictions, %i bytes cached\n",
+               sfx_stats_allocs, sfx_stats_pitch_hits,
+               sfx_stats_pitch_misses, sfx_stats_pitch_evictions,
+               pitched_sounds_size);
+    }
+
+#ifdef HAVE_LIBSAMPLERATE
+    ShutdownSfxCache();
+#endif
+
+    if (builtin_mixer)
+    {
+        Mix_SetPostMix(NULL, NULL);
+        builtin_mixer = false;
+    }
+
     Mix_CloseAudio();
     SDL_QuitSubSystem(SDL_INIT_AUDIO);
 
     sound_initialized = false;
 }
 
+// Called by SDL_mixer from the audio thread, after it has mixed the
+// music, to mix in the sound effects.
+
+static void BuiltinMixCallback(void *udata, Uint8 *stream, int len)
+{
+    I_Mixer_Mix((int16_t *) stream, len / 4,
+                mixer_channels_playing, NUM_CHANNELS);
+}
+
 // Calculate slice size, based on snd_maxslicetime_ms.
 // The result must be a power of two.
 
@@ -1083,6 +1838,14 @@ static boolean I_SDL_InitSound(boolean _use_sfx_prefix)
 
     use_sfx_prefix = _use_sfx_prefix;
 
+    //!
+    // Print how long each sound effect takes to load and convert when
+    // it is first played.  On exit, print a summary, along with how
+    // well pitch-shifted sounds were cached.
+    //
+
+    sfx_stats = M_ParmExists("-sfxstats");
+
     // No sounds yet
 
     for (i=0; i<NUM_CHANNELS; ++i)
@@ -1116,6 +1879,16 @@ static boolean I_SDL_InitSound(boolean _use_sfx_prefix)
         }
 
         ExpandSoundData = ExpandSoundData_SRC;
+
+        //!
+        // Don't save sound effects converted with libsamplerate to a
+        // cache file in the config directory, or load them from it.
+        //
+
+        if (!M_ParmExists("-nosfxcache"))
+        {
+            InitSfxCache();
+        }
     }
 #else
     if (use_libsamplerate != 0)
@@ -1154,6 +1927,28 @@ static boolean I_SDL_InitSound(boolean _use_sfx_prefix)
 
     Mix_AllocateChannels(NUM_CHANNELS);
 
+    // The built-in mixer adds the sound effects to the output after
+    // SDL_mixer has mixed in the music.
+
+    if (use_builtin_mixer)
+    {
+        if (mixer_format == AUDIO_S16SYS && mixer_channels == 2)
+        {
+            for (i = 0; i < NUM_CHANNELS; ++i)
+            {
+                mixer_channels_playing[i].samples = NULL;
+            }
+
+            builtin_mixer = true;
+            Mix_SetPostMix(BuiltinMixCallback, NULL);
+        }
+        else
+        {
+            fprintf(stderr, "I_SDL_InitSound: Output format not supported "
+                            "by the built-in mixer; using SDL_mixer.\n");
+        }
+    }
+
     SDL_PauseAudio(0);
 
     sound_initialized = true;
@@ -25,7 +25,9 @@
 #include "doomtype.h"
 
 #include "gusconf.h"
+#include "i_mixer.h"
 #include "i_sound.h"
+#include "i_timer.h"
 #include "i_video.h"
 #include "m_argv.h"
 #include "m_config.h"
@@ -58,6 +60,10 @@ int snd_pitchshift = -1;
 static sound_module_t *sound_module;
 static music_module_t *music_module;
 
+// If true, print how long each song takes to load.
+
+static boolean music_stats = false;
+
 int snd_musicdevice = SNDDEVICE_SB;
 int snd_sfxdevice = SNDDEVICE_SB;
 
@@ -73,6 +79,7 @@ extern music_module_t music_opl_module;
 
 extern opl_driver_ver_t opl_drv_ver;
 extern int opl_io_port;
+extern void I_OPL_RenderMusic(void);
 
 // For native music module:
 
@@ -218,6 +225,42 @@ void I_InitSound(boolean use_sfx_prefix)
 
     nomusic = M_CheckParm("-nomusic") > 0;
 
+    //!
+    // Print how long each music lump takes to load and convert when
+    // it starts playing.
+    //
+
+    music_stats = M_ParmExists("-musicstats");
+
+#ifdef FEATURE_SOUND
+
+    //!
+    // @arg [<lumps>]
+    //
+    // Render the specified music lumps (or, if none are listed, all
+    // music in the loaded WADs) to WAV files in the current directory
+    // using OPL emulation, as fast as possible, and exit.
+    //
+
+    if (M_CheckParm("-oplrender") > 0)
+    {
+        I_OPL_RenderMusic();
+        exit(0);
+    }
+
+    //!
+    // Check the built-in sound effect mixer and measure how long it
+    // takes to mix 8, 16 and 32 channels, then exit.
+    //
+
+    if (M_CheckParm("-mixerbench") > 0)
+    {
+        I_Mixer_Benchmark(snd_samplerate);
+        exit(0);
+    }
+
+#endif
+
     // Initialize the sound and music subsystems.
 
     if (!nosound && !screensaver_mode)
@@ -389,9 +432,21 @@ void I_ResumeSong(void)
 
 void *I_RegisterSong(void *data, int len)
 {
+    uint64_t start_time;
+    void *handle;
+
     if (music_module != NULL)
     {
-        return music_module->RegisterSong(data, len);
+        start_time = I_GetTimeUS();
+        handle = music_module->RegisterSong(data, len);
+
+        if (music_stats)
+        {
+            printf("I_RegisterSong: %i byte lump loaded in %u us\n", len,
+                   (unsigned int) (I_GetTimeUS() - start_time));
+        }
+
+        return handle;
     }
     else
     {
@@ -435,10 +490,19 @@ boolean I_MusicIsPlaying(void)
     }
 }
 
+void I_PrefetchSong(void *data, int len)
+{
+    if (music_module != NULL && music_module->PrefetchSong != NULL)
+    {
+        music_module->PrefetchSong(data, len);
+    }
+}
+
 void I_BindSoundVariables(void)
 {
     extern char *snd_dmxoption;
     extern int use_libsamplerate;
+    extern int use_builtin_mixer;
     extern float libsamplerate_scale;
 
     M_BindIntVariable("snd_musicdevice",         &snd_musicdevice);
@@ -462,6 +526,7 @@ void I_BindSoundVariables(void)
 #ifdef FEATURE_SOUND
     M_BindIntVariable("use_libsamplerate",       &use_libsamplerate);
     M_BindFloatVariable("libsamplerate_scale",   &libsamplerate_scale);
+    M_BindIntVariable("use_builtin_mixer",       &use_builtin_mixer);
 #endif
 
     // Before SDL_mixer version 1.2.11, MIDI music caused the game
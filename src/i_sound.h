@@ -214,6 +214,11 @@ typedef struct
     // Invoked periodically to poll.
 
     void (*Poll)(void);
+
+    // Prepare a song that is about to be registered, so that it can
+    // be started more quickly.  May be NULL.
+
+    void (*PrefetchSong)(void *data, int len);
 } music_module_t;
 
 void I_InitMusic(void);
@@ -226,6 +231,7 @@ void I_UnRegisterSong(void *handle);
 void I_PlaySong(void *handle, boolean looping);
 void I_StopSong(void);
 boolean I_MusicIsPlaying(void);
+void I_PrefetchSong(void *data, int len);
 
 extern int snd_sfxdevice;
 extern int snd_musicdevice;
@@ -0,0 +1,136 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Pool of worker threads for splitting up work.
+//
+
+#include "SDL.h"
+
+#include "i_thread.h"
+#include "doomtype.h"
+
+typedef struct
+{
+    SDL_Thread *thread;
+    SDL_sem *start;
+    int index;
+} worker_t;
+
+static worker_t workers[MAX_PARALLEL_JOBS];
+static int num_workers = 0;
+
+// Posted by each worker when it has finished its job.
+
+static SDL_sem *workers_done = NULL;
+
+// The job being run.
+
+static parallel_func_t job_func;
+static void *job_data;
+
+static int WorkerThread(void *arg)
+{
+    worker_t *worker = arg;
+
+    for (;;)
+    {
+        SDL_SemWait(worker->start);
+        job_func(worker->index, job_data);
+        SDL_SemPost(workers_done);
+    }
+
+    return 0;
+}
+
+// Start more worker threads, so that there are enough to run the given
+// number of jobs.  Returns false if a thread could not be started.
+
+static boolean StartWorkers(int count)
+{
+    worker_t *worker;
+
+    if (workers_done == NULL)
+    {
+        workers_done = SDL_CreateSemaphore(0);
+
+        if (workers_done == NULL)
+        {
+            return false;
+        }
+    }
+
+    // Worker 0 is the calling thread.
+
+    while (num_workers < count - 1)
+    {
+        worker = &workers[num_workers];
+        worker->index = num_workers + 1;
+        worker->start = SDL_CreateSemaphore(0);
+
+        if (worker->start == NULL)
+        {
+            return false;
+        }
+
+        worker->thread = SDL_CreateThread(WorkerThread, worker);
+
+        if (worker->thread == NULL)
+        {
+            SDL_DestroySemaphore(worker->start);
+            return false;
+        }
+
+        ++num_workers;
+    }
+
+    return true;
+}
+
+void I_RunParallel(int count, parallel_func_t func, void *data)
+{
+    int threaded;
+    int i;
+
+    // Jobs that there are no threads for are run here after our own.
+
+    StartWorkers(count < MAX_PARALLEL_JOBS ? count : MAX_PARALLEL_JOBS);
+
+    threaded = count - 1;
+
+    if (threaded > num_workers)
+    {
+        threaded = num_workers;
+    }
+
+    job_func = func;
+    job_data = data;
+
+    for (i=0; i<threaded; ++i)
+    {
+        SDL_SemPost(workers[i].start);
+    }
+
+    func(0, data);
+
+    for (i=threaded + 1; i<count; ++i)
+    {
+        func(i, data);
+    }
+
+    for (i=0; i<threaded; ++i)
+    {
+        SDL_SemWait(workers_done);
+    }
+}
+
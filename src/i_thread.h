@@ -0,0 +1,37 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Pool of worker threads for splitting up work.
+//
+
+
+#ifndef __I_THREAD__
+#define __I_THREAD__
+
+// Maximum number of jobs that are run at once.
+
+#define MAX_PARALLEL_JOBS 16
+
+typedef void (*parallel_func_t)(int index, void *data);
+
+// Call func(index, data) for each index from 0 to count - 1, each on
+// its own thread, and return once they have all finished.  Index 0,
+// and any jobs beyond MAX_PARALLEL_JOBS, are run on the calling
+// thread.  The worker threads are started on first use and then kept
+// for later calls.
+
+void I_RunParallel(int count, parallel_func_t func, void *data);
+
+#endif
+
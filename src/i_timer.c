@@ -16,30 +16,83 @@
 //      Timer functions.
 //
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <time.h>
+#endif
+
 #include "SDL.h"
 
 #include "i_timer.h"
 #include "doomtype.h"
 
+// Sleeping finishes this long before a deadline, and the rest of the
+// wait is spent spinning, as SDL_Delay may oversleep by a millisecond
+// or more.
+
+#define SPIN_NS 2000000
+
 //
-// I_GetTime
-// returns time in 1/35th second tics
+// Returns time in nanoseconds, from a clock that never goes backwards.
 //
 
-static Uint32 basetime = 0;
-
-int  I_GetTime (void)
+uint64_t I_GetTimeNS(void)
 {
-    Uint32 ticks;
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
 
-    ticks = SDL_GetTicks();
+    if (freq.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&freq);
+    }
 
+    QueryPerformanceCounter(&count);
+
+    return (uint64_t) (count.QuadPart / freq.QuadPart) * 1000000000
+         + (uint64_t) (count.QuadPart % freq.QuadPart) * 1000000000
+         / freq.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return (uint64_t) tv.tv_sec * 1000000000
+         + (uint64_t) tv.tv_usec * 1000;
+#endif
+}
+
+// The time that the game clock counts from.
+
+static uint64_t basetime = 0;
+
+static uint64_t GetBaseTime(void)
+{
     if (basetime == 0)
-        basetime = ticks;
+    {
+        basetime = I_GetTimeNS();
+    }
+
+    return basetime;
+}
 
-    ticks -= basetime;
+//
+// I_GetTime
+// returns time in 1/35th second tics
+//
 
-    return (ticks * TICRATE) / 1000;    
+int  I_GetTime (void)
+{
+    return (int) (((uint64_t) I_GetTimeMS() * TICRATE) / 1000);
 }
 
 //
@@ -48,14 +101,34 @@ int  I_GetTime (void)
 
 int I_GetTimeMS(void)
 {
-    Uint32 ticks;
+    uint64_t base;
 
-    ticks = SDL_GetTicks();
+    base = GetBaseTime();
 
-    if (basetime == 0)
-        basetime = ticks;
+    return (int) ((I_GetTimeNS() - base) / 1000000);
+}
+
+//
+// Returns time in microseconds, for timing short pieces of code.
+//
+
+uint64_t I_GetTimeUS(void)
+{
+    return I_GetTimeNS() / 1000;
+}
+
+// Returns the time, in nanoseconds as returned by I_GetTimeNS, at
+// which I_GetTime reaches the given tic.
+
+uint64_t I_GetTicTimeNS(int tic)
+{
+    uint64_t ms;
+
+    // The first millisecond at which I_GetTime returns tic.
+
+    ms = ((uint64_t) tic * 1000 + TICRATE - 1) / TICRATE;
 
-    return ticks - basetime;
+    return GetBaseTime() + ms * 1000000;
 }
 
 // Sleep for a specified number of ms
@@ -65,6 +138,38 @@ void I_Sleep(int ms)
     SDL_Delay(ms);
 }
 
+// Sleep until I_GetTimeNS reaches the given time, sleeping for most of
+// the wait and spinning for the end of it.
+
+void I_SleepUntilNS(uint64_t deadline)
+{
+    uint64_t now;
+
+    for (;;)
+    {
+        now = I_GetTimeNS();
+
+        if (now + SPIN_NS >= deadline)
+        {
+            break;
+        }
+
+        I_Sleep((int) ((deadline - now - SPIN_NS) / 1000000) + 1);
+    }
+
+    while (I_GetTimeNS() < deadline)
+    {
+        // spin
+    }
+}
+
+// Sleep until I_GetTime reaches the given tic.
+
+void I_SleepUntilTic(int tic)
+{
+    I_SleepUntilNS(I_GetTicTimeNS(tic));
+}
+
 void I_WaitVBL(int count)
 {
     I_Sleep((count * 1000) / 70);
@@ -20,6 +20,8 @@
 #ifndef __I_TIMER__
 #define __I_TIMER__
 
+#include "doomtype.h"
+
 #define TICRATE 35
 
 // Called by D_DoomLoop,
@@ -29,9 +31,24 @@ int I_GetTime (void);
 // returns current time in ms
 int I_GetTimeMS (void);
 
+// returns current time in microseconds, for timing short intervals
+uint64_t I_GetTimeUS(void);
+
+// returns current time in nanoseconds, from a monotonic clock
+uint64_t I_GetTimeNS(void);
+
+// returns the time in nanoseconds at which I_GetTime reaches a tic
+uint64_t I_GetTicTimeNS(int tic);
+
 // Pause for a specified number of ms
 void I_Sleep(int ms);
 
+// Sleep until I_GetTimeNS reaches the given time
+void I_SleepUntilNS(uint64_t deadline);
+
+// Sleep until the given tic
+void I_SleepUntilTic(int tic);
+
 // Initialize timer
 void I_InitTimer(void);
 
@@ -41,6 +41,7 @@
 #include "i_video.h"
 #include "i_scale.h"
 #include "m_argv.h"
+#include "m_bbox.h"
 #include "m_config.h"
 #include "m_misc.h"
 #include "tables.h"
@@ -138,8 +139,11 @@ static SDL_Surface *screen;
 static char *window_title = "";
 
 // Intermediate 8-bit buffer that we draw to instead of 'screen'.
-// This is used when we are rendering in 32-bit screen mode.
-// When in a real 8-bit screen mode, screenbuffer == screen.
+// This is used when we are rendering in a 15, 16 or 24-bit screen
+// mode, or in 32-bit mode with -sdlconvert.
+// When in a real 8-bit screen mode, screenbuffer == screen.  In a
+// 32-bit mode, the scale functions write straight to the screen, so
+// screenbuffer == screen there too.
 
 static SDL_Surface *screenbuffer = NULL;
 
@@ -148,6 +152,19 @@ static SDL_Surface *screenbuffer = NULL;
 static SDL_Color palette[256];
 static boolean palette_to_set;
 
+// If true, the screen is a 32-bit surface that the scale functions
+// write to through palette_lut.
+
+static boolean truecolor = false;
+
+// If true, 32-bit modes use an 8-bit screenbuffer converted by SDL.
+
+static boolean sdl_convert = false;
+
+// The screen pixel value of each palette entry, in true color modes.
+
+static uint32_t palette_lut[256];
+
 // display has been set up?
 
 static boolean initialized = false;
@@ -254,6 +271,45 @@ static SDL_Cursor *cursors[2];
 
 static screen_mode_t *screen_mode;
 
+// If true, only the rows of the screen that have changed since the
+// last update are scaled and copied to the screen.
+
+static boolean dirty_rects = false;
+
+// If true, the game marks everything it draws with V_MarkRect, so
+// only the dirty box need be searched for changes.
+
+static boolean use_dirty_box = false;
+
+// If true, the next update must copy the whole screen.
+
+static boolean full_update = true;
+
+// Copy of the screen as it was at the last update, to compare against.
+
+static byte *last_frame = NULL;
+
+// Areas of the screen buffer to update this time, in screen buffer
+// coordinates as passed to BlitArea.
+
+#define MAX_DIRTY_RECTS 16
+
+typedef struct
+{
+    int x1, y1, x2, y2;
+} dirtyrect_t;
+
+static dirtyrect_t dirty_list[MAX_DIRTY_RECTS];
+static int num_dirty_rects;
+
+// Statistics for -blitstats.
+
+static boolean blit_stats = false;
+static unsigned int stat_frames;
+static uint64_t stat_bytes;
+static uint64_t stat_time;
+static uint64_t stat_start_time;
+
 // Window resize state.
 
 static boolean need_resize = false;
@@ -341,6 +397,11 @@ void I_DisplayFPSDots(boolean dots_on)
     display_fps_dots = dots_on;
 }
 
+void I_UseDirtyBox(void)
+{
+    use_dirty_box = true;
+}
+
 // Update the value of window_focused when we get a focus event
 //
 // We try to make ourselves be well-behaved: the grab on the mouse
@@ -906,7 +967,7 @@ static boolean BlitArea(int x1, int y1, int x2, int y2)
         I_InitScale(I_VideoBuffer,
                     (byte *) screenbuffer->pixels
                                 + (y_offset * screenbuffer->pitch)
-                                + x_offset,
+                                + x_offset * screenbuffer->format->BytesPerPixel,
                     screenbuffer->pitch);
         result = screen_mode->DrawScreen(x1, y1, x2, y2);
       	SDL_UnlockSurface(screenbuffer);
@@ -919,6 +980,158 @@ static boolean BlitArea(int x1, int y1, int x2, int y2)
     return result;
 }
 
+// Add an area to the list of areas to update, merging it into the
+// last one if the list is full.
+
+static void AddDirtyRect(int x1, int y1, int x2, int y2)
+{
+    dirtyrect_t *rect;
+
+    if (num_dirty_rects == MAX_DIRTY_RECTS)
+    {
+        rect = &dirty_list[num_dirty_rects - 1];
+        rect->y2 = y2;
+        return;
+    }
+
+    rect = &dirty_list[num_dirty_rects];
+    rect->x1 = x1;
+    rect->y1 = y1;
+    rect->x2 = x2;
+    rect->y2 = y2;
+    ++num_dirty_rects;
+}
+
+// Work out which areas of the screen have changed since the last
+// update: the rows inside the dirty box (or the whole screen, if the
+// game does not mark what it draws) that differ from the last frame.
+
+static void FindDirtyRects(void)
+{
+    int x1, y1, x2, y2;
+    int run_start;
+    int y;
+    byte *row;
+    byte *last_row;
+
+    num_dirty_rects = 0;
+
+    if (full_update)
+    {
+        AddDirtyRect(0, 0, SCREENWIDTH, SCREENHEIGHT);
+        memcpy(last_frame, I_VideoBuffer, SCREENWIDTH * SCREENHEIGHT);
+        return;
+    }
+
+    x1 = 0;
+    x2 = SCREENWIDTH;
+    y1 = 0;
+    y2 = SCREENHEIGHT;
+
+    if (use_dirty_box)
+    {
+        if (dirtybox[BOXLEFT] > x1)
+            x1 = dirtybox[BOXLEFT];
+        if (dirtybox[BOXRIGHT] + 1 < x2)
+            x2 = dirtybox[BOXRIGHT] + 1;
+        if (dirtybox[BOXBOTTOM] > y1)
+            y1 = dirtybox[BOXBOTTOM];
+        if (dirtybox[BOXTOP] + 1 < y2)
+            y2 = dirtybox[BOXTOP] + 1;
+
+        if (x1 >= x2 || y1 >= y2)
+        {
+            return;
+        }
+    }
+
+    run_start = -1;
+
+    for (y=y1; y<y2; ++y)
+    {
+        row = I_VideoBuffer + y * SCREENWIDTH + x1;
+        last_row = last_frame + y * SCREENWIDTH + x1;
+
+        if (memcmp(row, last_row, x2 - x1) != 0)
+        {
+            memcpy(last_row, row, x2 - x1);
+
+            if (run_start < 0)
+            {
+                run_start = y;
+            }
+        }
+        else if (run_start >= 0)
+        {
+            AddDirtyRect(x1, run_start, x2, y);
+            run_start = -1;
+        }
+    }
+
+    if (run_start >= 0)
+    {
+        AddDirtyRect(x1, run_start, x2, y2);
+    }
+}
+
+// Convert an area of the screen buffer to the area of the screen it
+// is drawn to.  Only used with the plain scale modes, which are the
+// only ones that can draw part of the screen.
+
+static void DirtyRectToScreen(dirtyrect_t *rect, SDL_Rect *result)
+{
+    int scale;
+    int x_offset, y_offset;
+
+    scale = screen_mode->width / SCREENWIDTH;
+
+    x_offset = (screenbuffer->w - screen_mode->width) / 2
+             + (screen->w - screenbuffer->w) / 2;
+    y_offset = (screenbuffer->h - screen_mode->height) / 2
+             + (screen->h - screenbuffer->h) / 2;
+
+    result->x = x_offset + rect->x1 * scale;
+    result->y = y_offset + rect->y1 * scale;
+    result->w = (rect->x2 - rect->x1) * scale;
+    result->h = (rect->y2 - rect->y1) * scale;
+}
+
+// Print the -blitstats figures every few seconds.
+
+static void UpdateBlitStats(uint64_t start_time)
+{
+    uint64_t now;
+    uint64_t elapsed;
+
+    now = I_GetTimeUS();
+    stat_time += now - start_time;
+    ++stat_frames;
+
+    if (stat_start_time == 0)
+    {
+        stat_start_time = start_time;
+    }
+
+    elapsed = now - stat_start_time;
+
+    if (elapsed < 5000000)
+    {
+        return;
+    }
+
+    printf("I_FinishUpdate: %u frames, %.1f KiB/frame copied, "
+           "%.3f ms/frame updating the screen (%.1f%% of the time)\n",
+           stat_frames,
+           stat_bytes / 1024.0 / stat_frames,
+           stat_time / 1000.0 / stat_frames,
+           100.0 * stat_time / elapsed);
+
+    stat_frames = 0;
+    stat_bytes = 0;
+    stat_time = 0;
+    stat_start_time = now;
+}
+
 //
 // I_FinishUpdate
 //
@@ -927,6 +1140,10 @@ void I_FinishUpdate (void)
     static int	lasttic;
     int		tics;
     int		i;
+    uint64_t	start_time;
+    SDL_Rect	screen_rects[MAX_DIRTY_RECTS];
+    dirtyrect_t	*rect;
+    int		bytes_per_pixel;
 
     if (!initialized)
         return;
@@ -950,6 +1167,8 @@ void I_FinishUpdate (void)
     if (!(SDL_GetAppState() & SDL_APPACTIVE))
         return;
 
+    start_time = blit_stats ? I_GetTimeUS() : 0;
+
     // draws little dots on the bottom of the screen
 
     if (display_fps_dots)
@@ -963,6 +1182,8 @@ void I_FinishUpdate (void)
 	    I_VideoBuffer[ (SCREENHEIGHT-1)*SCREENWIDTH + i] = 0xff;
 	for ( ; i<20*4 ; i+=4)
 	    I_VideoBuffer[ (SCREENHEIGHT-1)*SCREENWIDTH + i] = 0x0;
+
+	V_MarkRect(0, SCREENHEIGHT-1, 20*4, 1);
     }
 
     if (show_diskicon && disk_indicator == disk_on)
@@ -978,9 +1199,60 @@ void I_FinishUpdate (void)
     }
     diskicon_readbytes = 0;
 
+    // Only some of the screen need be drawn if nothing but the
+    // changed rows are being updated.  A new palette changes every
+    // pixel, and a double-buffered screen must be flipped whole.
+
+    if (!dirty_rects || palette_to_set || (screen->flags & SDL_DOUBLEBUF))
+    {
+        full_update = true;
+    }
+
+    // In true color modes, a new palette only means a new lookup
+    // table; the screen is then redrawn through it.
+
+    if (palette_to_set && truecolor)
+    {
+        for (i=0; i<256; ++i)
+        {
+            palette_lut[i] = SDL_MapRGB(screen->format, palette[i].r,
+                                        palette[i].g, palette[i].b);
+        }
+
+        palette_to_set = false;
+    }
+
+    if (dirty_rects)
+    {
+        FindDirtyRects();
+    }
+    else
+    {
+        num_dirty_rects = 0;
+        AddDirtyRect(0, 0, SCREENWIDTH, SCREENHEIGHT);
+    }
+
+    M_ClearBox(dirtybox);
+
     // draw to screen
 
-    BlitArea(0, 0, SCREENWIDTH, SCREENHEIGHT);
+    for (i=0; i<num_dirty_rects; ++i)
+    {
+        rect = &dirty_list[i];
+
+        // The stretched and squashed modes can only draw the whole
+        // screen at once.
+
+        if (!BlitArea(rect->x1, rect->y1, rect->x2, rect->y2)
+         && !full_update)
+        {
+            full_update = true;
+            num_dirty_rects = 0;
+            AddDirtyRect(0, 0, SCREENWIDTH, SCREENHEIGHT);
+            BlitArea(0, 0, SCREENWIDTH, SCREENHEIGHT);
+            break;
+        }
+    }
 
     if (palette_to_set)
     {
@@ -992,26 +1264,78 @@ void I_FinishUpdate (void)
 
         if (screenbuffer == screen)
         {
+            full_update = false;
             return;
         }
     }
 
-    // In 8in32 mode, we must blit from the fake 8-bit screen buffer
-    // to the real screen before doing a screen flip.
+    if (blit_stats)
+    {
+        bytes_per_pixel = screenbuffer->format->BytesPerPixel;
 
-    if (screenbuffer != screen)
+        if (full_update)
+        {
+            stat_bytes += screenbuffer->w * screenbuffer->h
+                        * bytes_per_pixel;
+        }
+        else
+        {
+            for (i=0; i<num_dirty_rects; ++i)
+            {
+                rect = &dirty_list[i];
+                DirtyRectToScreen(rect, &screen_rects[i]);
+                stat_bytes += screen_rects[i].w * screen_rects[i].h
+                            * bytes_per_pixel;
+            }
+        }
+    }
+
+    if (full_update)
     {
-        SDL_Rect dst_rect;
+        // In 8in32 mode, we must blit from the fake 8-bit screen buffer
+        // to the real screen before doing a screen flip.
+
+        if (screenbuffer != screen)
+        {
+            SDL_Rect dst_rect;
 
-        // Center the buffer within the full screen space.
+            // Center the buffer within the full screen space.
 
-        dst_rect.x = (screen->w - screenbuffer->w) / 2;
-        dst_rect.y = (screen->h - screenbuffer->h) / 2;
+            dst_rect.x = (screen->w - screenbuffer->w) / 2;
+            dst_rect.y = (screen->h - screenbuffer->h) / 2;
 
-        SDL_BlitSurface(screenbuffer, NULL, screen, &dst_rect);
+            SDL_BlitSurface(screenbuffer, NULL, screen, &dst_rect);
+        }
+
+        SDL_Flip(screen);
+        full_update = false;
     }
+    else if (num_dirty_rects > 0)
+    {
+        for (i=0; i<num_dirty_rects; ++i)
+        {
+            DirtyRectToScreen(&dirty_list[i], &screen_rects[i]);
+
+            if (screenbuffer != screen)
+            {
+                SDL_Rect src_rect;
 
-    SDL_Flip(screen);
+                src_rect = screen_rects[i];
+                src_rect.x -= (screen->w - screenbuffer->w) / 2;
+                src_rect.y -= (screen->h - screenbuffer->h) / 2;
+
+                SDL_BlitSurface(screenbuffer, &src_rect,
+                                screen, &screen_rects[i]);
+            }
+        }
+
+        SDL_UpdateRects(screen, num_dirty_rects, screen_rects);
+    }
+
+    if (blit_stats)
+    {
+        UpdateBlitStats(start_time);
+    }
 }
 
 
@@ -1454,6 +1778,34 @@ void I_GraphicsCheckCommandLine(void)
 
     noblit = M_CheckParm ("-noblit"); 
 
+    //!
+    // @category video
+    //
+    // Only scale and copy to the screen the rows that have changed
+    // since the last frame.
+    //
+
+    dirty_rects = M_CheckParm("-dirtyrects") > 0;
+
+    //!
+    // @category video
+    //
+    // Every few seconds, print how much was copied to the screen
+    // each frame and how long it took.
+    //
+
+    blit_stats = M_CheckParm("-blitstats") > 0;
+
+    //!
+    // @category video
+    //
+    // In 32-bit video modes, draw to an 8-bit buffer and have SDL
+    // convert it to the screen format, rather than writing 32-bit
+    // pixels directly.
+    //
+
+    sdl_convert = M_CheckParm("-sdlconvert") > 0;
+
     //!
     // @category video 
     //
@@ -1818,9 +2170,14 @@ static void SetVideoMode(screen_mode_t *mode, int w, int h)
     }
 
     // Create the screenbuffer surface; if we have a real 8-bit palettized
-    // screen, then we can use the screen as the screenbuffer.
+    // screen, then we can use the screen as the screenbuffer.  So we can
+    // in a 32-bit mode, as the scale functions can write 32-bit pixels.
+
+    truecolor = screen->format->BitsPerPixel == 32 && !sdl_convert;
 
-    if (screen->format->BitsPerPixel == 8)
+    I_SetScalePalette(truecolor ? palette_lut : NULL);
+
+    if (screen->format->BitsPerPixel == 8 || truecolor)
     {
         screenbuffer = screen;
     }
@@ -2009,6 +2366,14 @@ void I_InitGraphics(void)
 
     memset(I_VideoBuffer, 0, SCREENWIDTH * SCREENHEIGHT);
 
+    if (dirty_rects)
+    {
+        last_frame = Z_Malloc(SCREENWIDTH * SCREENHEIGHT, PU_STATIC, NULL);
+    }
+
+    M_ClearBox(dirtybox);
+    full_update = true;
+
     // We need SDL to give us translated versions of keys as well
 
     SDL_EnableUNICODE(1);
@@ -117,6 +117,12 @@ void I_CheckIsScreensaver(void);
 void I_SetGrabMouseCallback(grabmouse_callback_t func);
 
 void I_DisplayFPSDots(boolean dots_on);
+
+// Called by games that mark everything they draw to the screen buffer
+// with V_MarkRect, so that -dirtyrects need only look inside the
+// marked area for changes.
+void I_UseDirtyBox(void);
+
 void I_BindVideoVariables(void);
 
 void I_InitWindowTitle(void);
@@ -1134,6 +1134,14 @@ static default_t extra_defaults_list[] =
 
     CONFIG_VARIABLE_FLOAT(libsamplerate_scale),
 
+    //!
+    // If non-zero, sound effects are mixed by Chocolate Doom's own
+    // mixer rather than by SDL_mixer.  This is faster when many sound
+    // channels are used.
+    //
+
+    CONFIG_VARIABLE_INT(use_builtin_mixer),
+
     //!
     // Full path to a Timidity configuration file to use for MIDI
     // playback. The file will be evaluated from the directory where
@@ -22,6 +22,7 @@
 
 #include "doomtype.h"
 #include "i_swap.h"
+#include "memio.h"
 #include "midifile.h"
 
 #define HEADER_CHUNK_ID "MThd"
@@ -106,28 +107,22 @@ static boolean CheckChunkHeader(chunk_header_t *chunk,
 
 // Read a single byte.  Returns false on error.
 
-static boolean ReadByte(byte *result, FILE *stream)
+static boolean ReadByte(byte *result, MEMFILE *stream)
 {
-    int c;
-
-    c = fgetc(stream);
-
-    if (c == EOF)
+    if (mem_fread(result, 1, 1, stream) < 1)
     {
         fprintf(stderr, "ReadByte: Unexpected end of file\n");
         return false;
     }
     else
     {
-        *result = (byte) c;
-
         return true;
     }
 }
 
 // Read a variable-length value.
 
-static boolean ReadVariableLength(unsigned int *result, FILE *stream)
+static boolean ReadVariableLength(unsigned int *result, MEMFILE *stream)
 {
     int i;
     byte b = 0;
@@ -163,9 +158,8 @@ static boolean ReadVariableLength(unsigned int *result, FILE *stream)
 
 // Read a byte sequence into the data buffer.
 
-static void *ReadByteSequence(unsigned int num_bytes, FILE *stream)
+static void *ReadByteSequence(unsigned int num_bytes, MEMFILE *stream)
 {
-    unsigned int i;
     byte *result;
 
     // Allocate a buffer. Allocate one extra byte, as malloc(0) is
@@ -181,15 +175,11 @@ static void *ReadByteSequence(unsigned int num_bytes, FILE *stream)
 
     // Read the data:
 
-    for (i=0; i<num_bytes; ++i)
+    if (mem_fread(result, 1, num_bytes, stream) < num_bytes)
     {
-        if (!ReadByte(&result[i], stream))
-        {
-            fprintf(stderr, "ReadByteSequence: Error while reading byte %u\n",
-                            i);
-            free(result);
-            return NULL;
-        }
+        fprintf(stderr, "ReadByteSequence: Unexpected end of file\n");
+        free(result);
+        return NULL;
     }
 
     return result;
@@ -201,7 +191,7 @@ static void *ReadByteSequence(unsigned int num_bytes, FILE *stream)
 
 static boolean ReadChannelEvent(midi_event_t *event,
                                 byte event_type, boolean two_param,
-                                FILE *stream)
+                                MEMFILE *stream)
 {
     byte b = 0;
 
@@ -241,7 +231,7 @@ static boolean ReadChannelEvent(midi_event_t *event,
 // Read sysex event:
 
 static boolean ReadSysExEvent(midi_event_t *event, int event_type,
-                              FILE *stream)
+                              MEMFILE *stream)
 {
     event->event_type = event_type;
 
@@ -267,7 +257,7 @@ static boolean ReadSysExEvent(midi_event_t *event, int event_type,
 
 // Read meta event:
 
-static boolean ReadMetaEvent(midi_event_t *event, FILE *stream)
+static boolean ReadMetaEvent(midi_event_t *event, MEMFILE *stream)
 {
     byte b = 0;
 
@@ -306,7 +296,7 @@ static boolean ReadMetaEvent(midi_event_t *event, FILE *stream)
 }
 
 static boolean ReadEvent(midi_event_t *event, unsigned int *last_event_type,
-                         FILE *stream)
+                         MEMFILE *stream)
 {
     byte event_type = 0;
 
@@ -331,7 +321,7 @@ static boolean ReadEvent(midi_event_t *event, unsigned int *last_event_type,
     {
         event_type = *last_event_type;
 
-        if (fseek(stream, -1, SEEK_CUR) < 0)
+        if (mem_fseek(stream, -1, MEM_SEEK_CUR) < 0)
         {
             fprintf(stderr, "ReadEvent: Unable to seek in stream\n");
             return false;
@@ -410,12 +400,13 @@ static void FreeEvent(midi_event_t *event)
 
 // Read and check the track chunk header
 
-static boolean ReadTrackHeader(midi_track_t *track, FILE *stream)
+static boolean ReadTrackHeader(midi_track_t *track, MEMFILE *stream)
 {
     size_t records_read;
     chunk_header_t chunk_header;
 
-    records_read = fread(&chunk_header, sizeof(chunk_header_t), 1, stream);
+    records_read = mem_fread(&chunk_header, sizeof(chunk_header_t), 1,
+                             stream);
 
     if (records_read < 1)
     {
@@ -432,14 +423,16 @@ static boolean ReadTrackHeader(midi_track_t *track, FILE *stream)
     return true;
 }
 
-static boolean ReadTrack(midi_track_t *track, FILE *stream)
+static boolean ReadTrack(midi_track_t *track, MEMFILE *stream)
 {
     midi_event_t *new_events;
     midi_event_t *event;
     unsigned int last_event_type;
+    int events_size;
 
     track->num_events = 0;
     track->events = NULL;
+    events_size = 0;
 
     // Read the header:
 
@@ -454,17 +447,23 @@ static boolean ReadTrack(midi_track_t *track, FILE *stream)
 
     for (;;)
     {
-        // Resize the track slightly larger to hold another event:
+        // Resize the track to hold another event, doubling the size
+        // each time so that long tracks are not copied over and over:
 
-        new_events = realloc(track->events, 
-                             sizeof(midi_event_t) * (track->num_events + 1));
-
-        if (new_events == NULL)
+        if (track->num_events >= events_size)
         {
-            return false;
-        }
+            events_size = events_size > 0 ? events_size * 2 : 64;
 
-        track->events = new_events;
+            new_events = realloc(track->events,
+                                 sizeof(midi_event_t) * events_size);
+
+            if (new_events == NULL)
+            {
+                return false;
+            }
+
+            track->events = new_events;
+        }
 
         // Read the next event:
 
@@ -502,7 +501,7 @@ static void FreeTrack(midi_track_t *track)
     free(track->events);
 }
 
-static boolean ReadAllTracks(midi_file_t *file, FILE *stream)
+static boolean ReadAllTracks(midi_file_t *file, MEMFILE *stream)
 {
     unsigned int i;
 
@@ -532,12 +531,13 @@ static boolean ReadAllTracks(midi_file_t *file, FILE *stream)
 
 // Read and check the header chunk.
 
-static boolean ReadFileHeader(midi_file_t *file, FILE *stream)
+static boolean ReadFileHeader(midi_file_t *file, MEMFILE *stream)
 {
     size_t records_read;
     unsigned int format_type;
 
-    records_read = fread(&file->header, sizeof(midi_header_t), 1, stream);
+    records_read = mem_fread(&file->header, sizeof(midi_header_t), 1,
+                             stream);
 
     if (records_read < 1)
     {
@@ -584,10 +584,10 @@ void MIDI_FreeFile(midi_file_t *file)
     free(file);
 }
 
-midi_file_t *MIDI_LoadFile(char *filename)
+midi_file_t *MIDI_LoadBuffer(void *buf, size_t buflen)
 {
     midi_file_t *file;
-    FILE *stream;
+    MEMFILE *stream;
 
     file = malloc(sizeof(midi_file_t));
 
@@ -601,37 +601,70 @@ midi_file_t *MIDI_LoadFile(char *filename)
     file->buffer = NULL;
     file->buffer_size = 0;
 
-    // Open file
+    stream = mem_fopen_read(buf, buflen);
 
-    stream = fopen(filename, "rb");
+    // Read MIDI file header
 
-    if (stream == NULL)
+    if (!ReadFileHeader(file, stream))
     {
-        fprintf(stderr, "MIDI_LoadFile: Failed to open '%s'\n", filename);
+        mem_fclose(stream);
         MIDI_FreeFile(file);
         return NULL;
     }
 
-    // Read MIDI file header
+    // Read all tracks:
 
-    if (!ReadFileHeader(file, stream))
+    if (!ReadAllTracks(file, stream))
     {
-        fclose(stream);
+        mem_fclose(stream);
         MIDI_FreeFile(file);
         return NULL;
     }
 
-    // Read all tracks:
+    mem_fclose(stream);
 
-    if (!ReadAllTracks(file, stream))
+    return file;
+}
+
+midi_file_t *MIDI_LoadFile(char *filename)
+{
+    midi_file_t *file;
+    FILE *stream;
+    byte *buf;
+    long buflen;
+
+    // Open file
+
+    stream = fopen(filename, "rb");
+
+    if (stream == NULL)
     {
+        fprintf(stderr, "MIDI_LoadFile: Failed to open '%s'\n", filename);
+        return NULL;
+    }
+
+    // Read the whole file into memory and parse it from there.
+
+    fseek(stream, 0, SEEK_END);
+    buflen = ftell(stream);
+    fseek(stream, 0, SEEK_SET);
+
+    buf = malloc(buflen);
+
+    if (buf == NULL || fread(buf, 1, buflen, stream) < buflen)
+    {
+        fprintf(stderr, "MIDI_LoadFile: Failed to read '%s'\n", filename);
+        free(buf);
         fclose(stream);
-        MIDI_FreeFile(file);
         return NULL;
     }
 
     fclose(stream);
 
+    file = MIDI_LoadBuffer(buf, buflen);
+
+    free(buf);
+
     return file;
 }
 
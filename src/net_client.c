@@ -33,6 +33,7 @@
 #include "net_common.h"
 #include "net_defs.h"
 #include "net_gui.h"
+#include "net_impair.h"
 #include "net_io.h"
 #include "net_packet.h"
 #include "net_server.h"
@@ -41,6 +42,7 @@
 #include "w_wad.h"
 
 extern void D_ReceiveTic(ticcmd_t *ticcmds, boolean *playeringame);
+extern boolean D_TicBufferFull(void);
 
 typedef enum
 {
@@ -70,6 +72,11 @@ typedef struct
 
     unsigned int resend_time;
 
+    // Time we sent the first resend request for this tic, used to
+    // measure the time taken to recover from a dropped packet.
+
+    unsigned int first_resend_time;
+
     // Tic data from server
 
     net_full_ticcmd_t cmd;
@@ -150,6 +157,10 @@ static net_server_recv_t recvwindow[BACKUPTICS];
 static boolean need_to_acknowledge;
 static unsigned int gamedata_recv_time;
 
+// Receive point when we last sent an acknowledgement as a drone.
+
+static int drone_ack_seq;
+
 // Hash checksums of our wad directory and dehacked data.
 
 sha1_digest_t net_local_wad_sha1sum;
@@ -163,6 +174,19 @@ unsigned int net_local_is_freedoom;
 
 static fixed_t average_latency;
 
+// With -netadapt, a smoothed estimate of the latency and its
+// variation, used to choose the lead and redundancy.
+
+static boolean cl_adaptive = false;
+static net_rtt_t latency_rtt;
+
+// Statistics on recovering from dropped packets, for -netstats.
+
+static unsigned int stats_resend_requests;
+static unsigned int stats_recovered_tics;
+static unsigned int stats_recover_time;
+static unsigned int stats_max_recover_time;
+
 #define NET_CL_ExpandTicNum(b) NET_ExpandTicNum(recvwindow_start, (b))
 
 // Called when we become disconnected from the server
@@ -204,6 +228,8 @@ static void NET_CL_ExpandFullTiccmd(net_full_ticcmd_t *cmd, unsigned int seq,
 
     if (latency >= 0)
     {
+        NET_RTT_Update(&latency_rtt, latency);
+
         if (seq <= 20)
         {
             average_latency = latency * FRACUNIT;
@@ -269,7 +295,10 @@ static void NET_CL_AdvanceWindow(void)
 {
     ticcmd_t ticcmds[NET_MAXPLAYERS];
 
-    while (recvwindow[0].active)
+    // The game loop may not have run the tics it already has yet; this
+    // can happen when we are fast-forwarding through a game in progress.
+
+    while (recvwindow[0].active && !D_TicBufferFull())
     {
         // Expand tic diff data into d_net.c structures
 
@@ -338,6 +367,7 @@ static void NET_CL_SendGameDataACK(void)
     NET_FreePacket(packet);
 
     need_to_acknowledge = false;
+    drone_ack_seq = recvwindow_start;
 }
 
 static void NET_CL_SendTics(int start, int end)
@@ -417,7 +447,16 @@ void NET_CL_SendTiccmd(ticcmd_t *ticcmd, int maketic)
 
     // Send to server.
 
-    starttic = maketic - settings.extratics;
+    if (cl_adaptive)
+    {
+        starttic = maketic - NET_RTT_ExtraTics(&latency_rtt, settings.ticdup,
+                                               settings.extratics);
+    }
+    else
+    {
+        starttic = maketic - settings.extratics;
+    }
+
     endtic = maketic;
 
     if (starttic < 0)
@@ -517,6 +556,8 @@ static void NET_CL_ParseGameStart(net_packet_t *packet)
     memset(recvwindow, 0, sizeof(recvwindow));
     recvwindow_start = 0;
     memset(&recvwindow_cmd_base, 0, sizeof(recvwindow_cmd_base));
+    drone_ack_seq = 0;
+    memset(&latency_rtt, 0, sizeof(latency_rtt));
 
     // Clear the send queue
 
@@ -538,6 +579,8 @@ static void NET_CL_SendResendRequest(int start, int end)
     NET_Conn_SendPacket(&client_connection, packet);
     NET_FreePacket(packet);
 
+    ++stats_resend_requests;
+
     nowtime = I_GetTimeMS();
 
     // Save the time we sent the resend request
@@ -552,6 +595,11 @@ static void NET_CL_SendResendRequest(int start, int end)
             continue;
 
         recvwindow[index].resend_time = nowtime;
+
+        if (recvwindow[index].first_resend_time == 0)
+        {
+            recvwindow[index].first_resend_time = nowtime;
+        }
     }
 }
 
@@ -617,15 +665,31 @@ static void NET_CL_CheckResends(void)
 
     // We have received some data from the server and not acknowledged
     // it yet.  Normally this gets acknowledged when we send our game
-    // data, but if the client is a drone we need to do this.
+    // data, but if the client is a drone we need to do this.  When
+    // catching up with a game in progress, the server waits for our
+    // acknowledgements, so send them as soon as we have made progress.
 
-    if (need_to_acknowledge && nowtime - gamedata_recv_time > 200)
+    if ((need_to_acknowledge && nowtime - gamedata_recv_time > 200)
+     || (drone && recvwindow_start - drone_ack_seq >= BACKUPTICS / 8))
     {
         NET_CL_SendGameDataACK();
     }
 }
 
 
+// Record a tic that was received after we sent a resend request for it.
+
+static void NET_CL_RecoveredTic(unsigned int recover_time)
+{
+    ++stats_recovered_tics;
+    stats_recover_time += recover_time;
+
+    if (recover_time > stats_max_recover_time)
+    {
+        stats_max_recover_time = recover_time;
+    }
+}
+
 // Parsing of NET_PACKET_TYPE_GAMEDATA packets
 // (packets containing the actual ticcmd data)
 
@@ -683,6 +747,11 @@ static void NET_CL_ParseGameData(net_packet_t *packet)
         
         recvobj = &recvwindow[index];
 
+        if (!recvobj->active && recvobj->first_resend_time != 0)
+        {
+            NET_CL_RecoveredTic(nowtime - recvobj->first_resend_time);
+        }
+
         recvobj->active = true;
         recvobj->cmd = cmd;
     }
@@ -940,11 +1009,20 @@ boolean NET_CL_Connect(net_addr_t *addr, net_connect_data_t *data)
     memcpy(net_local_deh_sha1sum, data->deh_sha1sum, sizeof(sha1_digest_t));
     net_local_is_freedoom = data->is_freedoom;
 
+    // -netadapt is documented in net_server.c.
+
+    cl_adaptive = M_CheckParm("-netadapt") > 0;
+
     // create a new network I/O context and add just the
     // necessary module
 
     client_context = NET_NewContext();
 
+    // Pass packets through the network impairment simulator, if it
+    // has been enabled on the command line.
+
+    addr->module = NET_Impair_WrapModule(addr->module);
+
     // initialize module for client mode
 
     if (!addr->module->InitClient())
@@ -1071,6 +1149,58 @@ void NET_CL_Disconnect(void)
     NET_CL_Shutdown();
 }
 
+// Returns the number of tics that ticcmds can be built ahead of the
+// game.  With -netadapt this is extended to cover the latency that
+// we have measured, so that a slow connection does not cause a stall
+// every tic.
+
+#define MAX_ADAPTIVE_LEAD (BACKUPTICS / 4)
+
+int NET_CL_MaxLead(int lead)
+{
+    int result;
+
+    if (!cl_adaptive)
+    {
+        return lead;
+    }
+
+    result = NET_RTT_Tics(&latency_rtt, settings.ticdup) + 2;
+
+    if (result < lead)
+    {
+        result = lead;
+    }
+
+    if (result > MAX_ADAPTIVE_LEAD)
+    {
+        result = MAX_ADAPTIVE_LEAD;
+    }
+
+    return result;
+}
+
+// Print statistics for -netstats.
+
+void NET_CL_PrintStats(void)
+{
+    unsigned int average;
+
+    average = 0;
+
+    if (stats_recovered_tics > 0)
+    {
+        average = stats_recover_time / stats_recovered_tics;
+    }
+
+    printf("netstats: client resend_requests=%u recovered_tics=%u "
+           "recover_avg_ms=%u recover_max_ms=%u latency_ms=%i "
+           "jitter_ms=%i\n",
+           stats_resend_requests, stats_recovered_tics,
+           average, stats_max_recover_time, average_latency / FRACUNIT,
+           latency_rtt.rttvar);
+}
+
 void NET_CL_Init(void)
 {
     // Try to set from the USER and USERNAME environment variables
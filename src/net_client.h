@@ -30,6 +30,8 @@ void NET_CL_LaunchGame(void);
 void NET_CL_StartGame(net_gamesettings_t *settings);
 void NET_CL_SendTiccmd(ticcmd_t *ticcmd, int maketic);
 boolean NET_CL_GetSettings(net_gamesettings_t *_settings);
+int NET_CL_MaxLead(int lead);
+void NET_CL_PrintStats(void);
 void NET_Init(void);
 
 void NET_BindVariables(void);
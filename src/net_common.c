@@ -52,6 +52,10 @@ static void NET_Conn_Init(net_connection_t *conn, net_addr_t *addr)
     conn->reliable_packets = NULL;
     conn->reliable_send_seq = 0;
     conn->reliable_recv_seq = 0;
+    conn->packets_sent = 0;
+    conn->bytes_sent = 0;
+    conn->packets_received = 0;
+    conn->bytes_received = 0;
 }
 
 // Initialize as a client connection
@@ -77,6 +81,8 @@ void NET_Conn_InitServer(net_connection_t *conn, net_addr_t *addr)
 void NET_Conn_SendPacket(net_connection_t *conn, net_packet_t *packet)
 {
     conn->keepalive_send_time = I_GetTimeMS();
+    ++conn->packets_sent;
+    conn->bytes_sent += packet->len;
     NET_SendPacket(conn->addr, packet);
 }
 
@@ -263,6 +269,8 @@ boolean NET_Conn_Packet(net_connection_t *conn, net_packet_t *packet,
                         unsigned int *packet_type)
 {
     conn->keepalive_recv_time = I_GetTimeMS();
+    ++conn->packets_received;
+    conn->bytes_received += packet->len;
 
     // Is this a reliable packet?
 
@@ -532,3 +540,73 @@ boolean NET_ValidGameSettings(GameMode_t mode, GameMission_t mission,
     return true;
 }
 
+// Add a new sample to a round trip time estimate.  This uses the same
+// filter as TCP's retransmission timer: the average is weighted 1/8
+// towards each new sample, and the mean deviation 1/4.
+
+void NET_RTT_Update(net_rtt_t *rtt, int sample)
+{
+    int delta;
+
+    if (sample < 0)
+    {
+        return;
+    }
+
+    if (!rtt->valid)
+    {
+        rtt->srtt = sample;
+        rtt->rttvar = sample / 2;
+        rtt->valid = true;
+        return;
+    }
+
+    delta = sample - rtt->srtt;
+
+    rtt->srtt += delta / 8;
+    rtt->rttvar += (abs(delta) - rtt->rttvar) / 4;
+}
+
+// Convert a round trip time estimate to a number of tics, allowing for
+// the variation in round trip time.  The result is rounded up.
+
+int NET_RTT_Tics(net_rtt_t *rtt, int ticdup)
+{
+    int ms_per_tic;
+
+    if (!rtt->valid)
+    {
+        return 0;
+    }
+
+    ms_per_tic = (1000 * ticdup) / TICRATE;
+
+    return (rtt->srtt + 4 * rtt->rttvar + ms_per_tic - 1) / ms_per_tic;
+}
+
+// Choose how many previous tics to resend in each game data packet.
+// A lost packet costs a resend request and another round trip to
+// recover from, so the longer the round trip, the more redundancy is
+// worthwhile: one extra tic for every four tics of round trip time,
+// never less than the value chosen when the game was started.
+
+#define MAX_ADAPTIVE_EXTRATICS 8
+
+int NET_RTT_ExtraTics(net_rtt_t *rtt, int ticdup, int extratics)
+{
+    int result;
+
+    result = 1 + NET_RTT_Tics(rtt, ticdup) / 4;
+
+    if (result > MAX_ADAPTIVE_EXTRATICS)
+    {
+        result = MAX_ADAPTIVE_EXTRATICS;
+    }
+
+    if (result < extratics)
+    {
+        result = extratics;
+    }
+
+    return result;
+}
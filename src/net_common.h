@@ -75,6 +75,16 @@ typedef enum
 
 #define MAX_RETRIES 5
 
+// Smoothed estimate of a round trip time and its variation, in
+// milliseconds.  Used by the adaptive mode (-netadapt).
+
+typedef struct
+{
+    boolean valid;
+    int srtt;
+    int rttvar;
+} net_rtt_t;
+
 typedef struct net_reliable_packet_s net_reliable_packet_t;
 
 typedef struct 
@@ -89,6 +99,13 @@ typedef struct
     net_reliable_packet_t *reliable_packets;
     int reliable_send_seq;
     int reliable_recv_seq;
+
+    // Traffic statistics.
+
+    unsigned int packets_sent;
+    unsigned int bytes_sent;
+    unsigned int packets_received;
+    unsigned int bytes_received;
 } net_connection_t;
 
 
@@ -107,5 +124,9 @@ unsigned int NET_ExpandTicNum(unsigned int relative, unsigned int b);
 boolean NET_ValidGameSettings(GameMode_t mode, GameMission_t mission, 
                               net_gamesettings_t *settings);
 
+void NET_RTT_Update(net_rtt_t *rtt, int sample);
+int NET_RTT_Tics(net_rtt_t *rtt, int ticdup);
+int NET_RTT_ExtraTics(net_rtt_t *rtt, int ticdup, int extratics);
+
 #endif /* #ifndef NET_COMMON_H */
 
@@ -26,6 +26,7 @@
 #include "m_argv.h"
 
 #include "net_defs.h"
+#include "net_query.h"
 #include "net_sdl.h"
 #include "net_server.h"
 
@@ -63,6 +64,26 @@ static void CheckForClientOptions(void)
 
 void NET_DedicatedServer(void)
 {
+    int p;
+
+    //!
+    // @arg <address>
+    // @category net
+    //
+    // Print the metrics of the server running on this machine at the
+    // given address, which must have been started with -metrics, and
+    // exit.  Each line of output describes either the server or one
+    // connected client, as a list of name=value pairs.
+    //
+
+    p = M_CheckParmWithArgs("-querymetrics", 1);
+
+    if (p > 0)
+    {
+        NET_QueryMetrics(myargv[p + 1]);
+        exit(0);
+    }
+
     CheckForClientOptions();
 
     NET_SV_Init();
@@ -126,6 +126,8 @@ typedef enum
     NET_PACKET_TYPE_QUERY,
     NET_PACKET_TYPE_QUERY_RESPONSE,
     NET_PACKET_TYPE_LAUNCH,
+    NET_PACKET_TYPE_METRICS,
+    NET_PACKET_TYPE_METRICS_RESPONSE,
 } net_packet_type_t;
 
 typedef enum
@@ -0,0 +1,305 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Simulated master server and game servers, for benchmarking
+//     server queries.
+//
+//     This is a network module, like the loopback module, whose
+//     addresses are a master server and a number of game servers that
+//     exist only in this process.  Each server has its own round trip
+//     time; some never respond, and some packets are lost, so that the
+//     query code sees something like the real Internet.  The same
+//     servers are generated every time, so that runs can be compared.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "doomtype.h"
+#include "d_mode.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_misc.h"
+#include "net_defs.h"
+#include "net_fake.h"
+#include "net_packet.h"
+#include "net_structrw.h"
+
+// Percentage of servers that never respond, and of packets lost.
+
+#define DEAD_SERVER_PERCENT 5
+#define PACKET_LOSS_PERCENT 2
+
+// Range of round trip times of the simulated servers, in ms.
+
+#define MIN_RTT 10
+#define MAX_RTT 300
+
+// A reply waiting for its simulated round trip time to pass.
+
+typedef struct
+{
+    unsigned int release_time;
+    net_addr_t *addr;
+    net_packet_t *packet;
+} fake_reply_t;
+
+typedef struct
+{
+    net_addr_t addr;
+    unsigned int rtt;
+    boolean dead;
+} fake_server_t;
+
+// Index 0 is the master server.
+
+static fake_server_t *servers = NULL;
+static int num_fake_servers = 0;
+
+static fake_reply_t *replies = NULL;
+static int num_replies = 0;
+static int replies_alloced = 0;
+
+static unsigned int rand_state;
+
+static unsigned int FakeRandom(void)
+{
+    rand_state = rand_state * 1103515245 + 12345;
+
+    return (rand_state >> 16) & 0x7fff;
+}
+
+// Create the simulated master server and game servers.
+
+void NET_Fake_Init(int num_servers)
+{
+    int i;
+
+    num_fake_servers = num_servers + 1;
+    servers = calloc(num_fake_servers, sizeof(fake_server_t));
+
+    if (servers == NULL)
+    {
+        I_Error("NET_Fake_Init: Failed to allocate %i servers", num_servers);
+    }
+
+    rand_state = 1;
+
+    for (i = 0; i < num_fake_servers; ++i)
+    {
+        servers[i].addr.module = &net_fake_module;
+        servers[i].addr.handle = &servers[i];
+        servers[i].rtt = MIN_RTT + FakeRandom() % (MAX_RTT - MIN_RTT);
+        servers[i].dead = i > 0 && FakeRandom() % 100 < DEAD_SERVER_PERCENT;
+    }
+
+    // The master server is always reachable, and not far away.
+
+    servers[0].rtt = MIN_RTT;
+}
+
+static void QueueReply(fake_server_t *server, net_packet_t *packet)
+{
+    if (FakeRandom() % 100 < PACKET_LOSS_PERCENT)
+    {
+        NET_FreePacket(packet);
+        return;
+    }
+
+    if (num_replies >= replies_alloced)
+    {
+        replies_alloced = replies_alloced * 2 + 16;
+        replies = realloc(replies, replies_alloced * sizeof(fake_reply_t));
+
+        if (replies == NULL)
+        {
+            I_Error("QueueReply: Failed to grow reply queue");
+        }
+    }
+
+    replies[num_replies].release_time = I_GetTimeMS() + server->rtt;
+    replies[num_replies].addr = &server->addr;
+    replies[num_replies].packet = packet;
+    ++num_replies;
+}
+
+static void MasterReply(fake_server_t *master)
+{
+    net_packet_t *reply;
+    char addr_str[32];
+    int i;
+
+    reply = NET_NewPacket(num_fake_servers * 12);
+    NET_WriteInt16(reply, NET_MASTER_PACKET_TYPE_QUERY_RESPONSE);
+
+    for (i = 1; i < num_fake_servers; ++i)
+    {
+        M_snprintf(addr_str, sizeof(addr_str), "fake-%i", i);
+        NET_WriteString(reply, addr_str);
+    }
+
+    QueueReply(master, reply);
+}
+
+static void ServerReply(fake_server_t *server)
+{
+    net_packet_t *reply;
+    net_querydata_t querydata;
+    char description[32];
+
+    M_snprintf(description, sizeof(description), "Fake server %i",
+               (int) (server - servers));
+
+    querydata.version = "Fake server";
+    querydata.server_state = 0;
+    querydata.num_players = server->rtt % 4;
+    querydata.max_players = 4;
+    querydata.gamemode = registered;
+    querydata.gamemission = doom;
+    querydata.description = description;
+
+    reply = NET_NewPacket(64);
+    NET_WriteInt16(reply, NET_PACKET_TYPE_QUERY_RESPONSE);
+    NET_WriteQueryData(reply, &querydata);
+
+    QueueReply(server, reply);
+}
+
+static boolean NET_Fake_InitClient(void)
+{
+    return servers != NULL;
+}
+
+static boolean NET_Fake_InitServer(void)
+{
+    return false;
+}
+
+static void NET_Fake_SendPacket(net_addr_t *addr, net_packet_t *packet)
+{
+    fake_server_t *server;
+    unsigned int packet_type;
+    size_t pos;
+
+    server = addr->handle;
+
+    if (server->dead || FakeRandom() % 100 < PACKET_LOSS_PERCENT)
+    {
+        return;
+    }
+
+    pos = packet->pos;
+    packet->pos = 0;
+
+    if (NET_ReadInt16(packet, &packet_type))
+    {
+        if (server == &servers[0]
+         && packet_type == NET_MASTER_PACKET_TYPE_QUERY)
+        {
+            MasterReply(server);
+        }
+        else if (server != &servers[0]
+              && packet_type == NET_PACKET_TYPE_QUERY)
+        {
+            ServerReply(server);
+        }
+    }
+
+    packet->pos = pos;
+}
+
+static boolean NET_Fake_RecvPacket(net_addr_t **addr, net_packet_t **packet)
+{
+    unsigned int now;
+    int i;
+
+    now = I_GetTimeMS();
+
+    for (i = 0; i < num_replies; ++i)
+    {
+        if ((int) (now - replies[i].release_time) >= 0)
+        {
+            *addr = replies[i].addr;
+            *packet = replies[i].packet;
+
+            replies[i] = replies[num_replies - 1];
+            --num_replies;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void NET_Fake_AddrToString(net_addr_t *addr, char *buffer,
+                                  int buffer_len)
+{
+    fake_server_t *server;
+
+    server = addr->handle;
+
+    if (server == &servers[0])
+    {
+        M_StringCopy(buffer, NET_FAKE_MASTER_ADDRESS, buffer_len);
+    }
+    else
+    {
+        M_snprintf(buffer, buffer_len, "fake-%i", (int) (server - servers));
+    }
+}
+
+static void NET_Fake_FreeAddress(net_addr_t *addr)
+{
+}
+
+static net_addr_t *NET_Fake_ResolveAddress(char *address)
+{
+    int i;
+
+    if (address == NULL || servers == NULL)
+    {
+        return NULL;
+    }
+
+    if (!strcmp(address, NET_FAKE_MASTER_ADDRESS))
+    {
+        return &servers[0].addr;
+    }
+
+    if (strncmp(address, "fake-", 5) == 0)
+    {
+        i = atoi(address + 5);
+
+        if (i > 0 && i < num_fake_servers)
+        {
+            return &servers[i].addr;
+        }
+    }
+
+    return NULL;
+}
+
+net_module_t net_fake_module =
+{
+    NET_Fake_InitClient,
+    NET_Fake_InitServer,
+    NET_Fake_SendPacket,
+    NET_Fake_RecvPacket,
+    NET_Fake_AddrToString,
+    NET_Fake_FreeAddress,
+    NET_Fake_ResolveAddress,
+};
+
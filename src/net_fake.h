@@ -0,0 +1,31 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Simulated master server and game servers, for benchmarking
+//     server queries.
+//
+
+#ifndef NET_FAKE_H
+#define NET_FAKE_H
+
+#include "net_defs.h"
+
+#define NET_FAKE_MASTER_ADDRESS "fake-master"
+
+extern net_module_t net_fake_module;
+
+void NET_Fake_Init(int num_servers);
+
+#endif /* #ifndef NET_FAKE_H */
+
@@ -0,0 +1,576 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Network impairment simulator.  Wraps another network module,
+//     dropping, delaying, reordering and duplicating packets.
+//
+//     Impairments are applied to outgoing packets only; to impair
+//     both directions of a connection, both ends must be run with
+//     the same options.  All random decisions are taken from a
+//     private, seedable generator so that runs can be reproduced.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "doomtype.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "net_defs.h"
+#include "net_impair.h"
+#include "net_io.h"
+#include "net_packet.h"
+
+// Maximum number of modules that can be wrapped at once.  A loopback
+// server needs three (loop client, loop server and SDL server).
+
+#define MAX_WRAPPED_MODULES 4
+
+// Maximum number of packets held back by delay simulation per module.
+// Packets sent when the queue is full are dropped, as a congested
+// router would do.
+
+#define MAX_DELAYED_PACKETS 512
+
+// Maximum extra delay applied to a packet that is selected to be
+// reordered.
+
+#define REORDER_MAX_DELAY_MS 100
+
+typedef struct
+{
+    net_addr_t *addr;
+    net_packet_t *packet;
+    unsigned int release_time;
+} delayed_packet_t;
+
+typedef struct
+{
+    net_module_t module;
+    net_module_t *inner;
+
+    delayed_packet_t delayed[MAX_DELAYED_PACKETS];
+    int num_delayed;
+
+    // Gilbert-Elliott "bad" state: currently inside a burst of losses.
+
+    boolean in_burst;
+
+    // Statistics:
+
+    unsigned int sent;
+    unsigned int dropped;
+    unsigned int duplicated;
+    unsigned int reordered;
+    unsigned int delayed_count;
+} impair_slot_t;
+
+static boolean impair_initted = false;
+static boolean impair_enabled = false;
+
+static int loss_percent = 0;
+static int burst_length = 0;
+static int delay_ms = 0;
+static int jitter_ms = 0;
+static int reorder_percent = 0;
+static int dup_percent = 0;
+
+static unsigned int rand_state;
+
+static impair_slot_t slots[MAX_WRAPPED_MODULES];
+static int num_slots = 0;
+
+// Simple xorshift generator.  We do not use rand() so that the
+// sequence is not disturbed by anything else in the program.
+
+static unsigned int ImpairRandom(void)
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+
+    return rand_state;
+}
+
+// Returns true with the given percentage probability.
+
+static boolean RandomChance(int percent)
+{
+    return percent > 0 && (int) (ImpairRandom() % 100) < percent;
+}
+
+static int IntParm(char *name, int default_value)
+{
+    int p;
+
+    p = M_CheckParmWithArgs(name, 1);
+
+    if (p > 0)
+    {
+        return atoi(myargv[p + 1]);
+    }
+
+    return default_value;
+}
+
+static void InitImpairment(void)
+{
+    unsigned int seed;
+    int p;
+
+    impair_initted = true;
+
+    //!
+    // @category net
+    // @arg <percent>
+    //
+    // Simulate a lossy network: drop the given percentage of
+    // outgoing network packets.
+    //
+
+    loss_percent = IntParm("-netloss", 0);
+
+    //!
+    // @category net
+    // @arg <n>
+    //
+    // When simulating packet loss with -netloss, drop packets in
+    // bursts with an average length of n packets.
+    //
+
+    burst_length = IntParm("-netburst", 0);
+
+    //!
+    // @category net
+    // @arg <ms>
+    //
+    // Simulate network latency: delay all outgoing packets by the
+    // given number of milliseconds.
+    //
+
+    delay_ms = IntParm("-netdelay", 0);
+
+    //!
+    // @category net
+    // @arg <ms>
+    //
+    // Simulate network jitter: delay each outgoing packet by a
+    // random extra time of up to the given number of milliseconds.
+    //
+
+    jitter_ms = IntParm("-netjitter", 0);
+
+    //!
+    // @category net
+    // @arg <percent>
+    //
+    // Simulate packet reordering: hold back the given percentage of
+    // outgoing packets so that they arrive out of order.
+    //
+
+    reorder_percent = IntParm("-netreorder", 0);
+
+    //!
+    // @category net
+    // @arg <percent>
+    //
+    // Simulate packet duplication: send the given percentage of
+    // outgoing packets twice.
+    //
+
+    dup_percent = IntParm("-netdup", 0);
+
+    impair_enabled = loss_percent > 0 || delay_ms > 0 || jitter_ms > 0
+                  || reorder_percent > 0 || dup_percent > 0;
+
+    if (!impair_enabled)
+    {
+        return;
+    }
+
+    //!
+    // @category net
+    // @arg <n>
+    //
+    // Seed the random number generator used by the network impairment
+    // options (-netloss, -netdelay, etc.) so that runs can be
+    // reproduced.
+    //
+
+    p = M_CheckParmWithArgs("-netseed", 1);
+
+    if (p > 0)
+    {
+        seed = strtoul(myargv[p + 1], NULL, 0);
+    }
+    else
+    {
+        seed = (unsigned int) time(NULL);
+    }
+
+    // Zero is a fixed point of xorshift.
+
+    rand_state = seed != 0 ? seed : 1;
+
+    printf("NET_Impair: loss %i%% (burst %i), delay %ims (+%ims jitter), "
+           "reorder %i%%, duplicate %i%%, seed %u\n",
+           loss_percent, burst_length, delay_ms, jitter_ms,
+           reorder_percent, dup_percent, seed);
+}
+
+// Find the slot that wraps the module that owns the given address.
+
+static impair_slot_t *SlotForAddr(net_addr_t *addr)
+{
+    int i;
+
+    for (i = 0; i < num_slots; ++i)
+    {
+        if (addr->module == &slots[i].module)
+        {
+            return &slots[i];
+        }
+    }
+
+    I_Error("NET_Impair: Address does not belong to a wrapped module");
+
+    return NULL;
+}
+
+// Addresses returned by the inner module are claimed by the wrapper, so
+// that packets sent to them pass back through us.
+
+static void ClaimAddr(impair_slot_t *slot, net_addr_t *addr)
+{
+    if (addr != NULL && addr != &net_broadcast_addr)
+    {
+        addr->module = &slot->module;
+    }
+}
+
+static void QueueDelayed(impair_slot_t *slot, net_addr_t *addr,
+                         net_packet_t *packet, unsigned int release_time)
+{
+    int i;
+
+    if (slot->num_delayed >= MAX_DELAYED_PACKETS)
+    {
+        ++slot->dropped;
+        return;
+    }
+
+    // Keep the queue sorted by release time.  Packets released at the
+    // same time stay in the order they were sent.
+
+    i = slot->num_delayed;
+
+    while (i > 0 && slot->delayed[i - 1].release_time > release_time)
+    {
+        --i;
+    }
+
+    memmove(&slot->delayed[i + 1], &slot->delayed[i],
+            sizeof(delayed_packet_t) * (slot->num_delayed - i));
+
+    slot->delayed[i].addr = addr;
+    slot->delayed[i].packet = NET_PacketDup(packet);
+    slot->delayed[i].release_time = release_time;
+    ++slot->num_delayed;
+    ++slot->delayed_count;
+}
+
+// Transmit any delayed packets whose time has come.
+
+static void ReleaseDelayed(impair_slot_t *slot)
+{
+    unsigned int nowtime;
+    int released;
+    int i;
+
+    nowtime = I_GetTimeMS();
+    released = 0;
+
+    while (released < slot->num_delayed
+        && (int) (nowtime - slot->delayed[released].release_time) >= 0)
+    {
+        ++released;
+    }
+
+    for (i = 0; i < released; ++i)
+    {
+        slot->inner->SendPacket(slot->delayed[i].addr,
+                                slot->delayed[i].packet);
+        NET_FreePacket(slot->delayed[i].packet);
+    }
+
+    memmove(&slot->delayed[0], &slot->delayed[released],
+            sizeof(delayed_packet_t) * (slot->num_delayed - released));
+    slot->num_delayed -= released;
+}
+
+// Discard any delayed packets for an address that is being freed.
+
+static void DiscardDelayed(impair_slot_t *slot, net_addr_t *addr)
+{
+    int i, j;
+
+    j = 0;
+
+    for (i = 0; i < slot->num_delayed; ++i)
+    {
+        if (slot->delayed[i].addr == addr)
+        {
+            NET_FreePacket(slot->delayed[i].packet);
+        }
+        else
+        {
+            slot->delayed[j] = slot->delayed[i];
+            ++j;
+        }
+    }
+
+    slot->num_delayed = j;
+}
+
+// Decide whether the next packet is lost.  With -netburst, losses
+// follow a two-state (Gilbert-Elliott) model: after a loss, following
+// packets are lost with probability 1 - 1/burst_length.
+
+static boolean PacketLost(impair_slot_t *slot)
+{
+    if (slot->in_burst)
+    {
+        slot->in_burst = (int) (ImpairRandom() % burst_length) != 0;
+    }
+    else if (RandomChance(loss_percent))
+    {
+        slot->in_burst = burst_length > 1;
+        return true;
+    }
+
+    return slot->in_burst;
+}
+
+static void SendOne(impair_slot_t *slot, net_addr_t *addr,
+                    net_packet_t *packet)
+{
+    unsigned int delay;
+
+    delay = delay_ms;
+
+    if (jitter_ms > 0)
+    {
+        delay += ImpairRandom() % (jitter_ms + 1);
+    }
+
+    if (RandomChance(reorder_percent))
+    {
+        delay += 1 + ImpairRandom() % REORDER_MAX_DELAY_MS;
+        ++slot->reordered;
+    }
+
+    if (delay == 0 && slot->num_delayed == 0)
+    {
+        slot->inner->SendPacket(addr, packet);
+    }
+    else
+    {
+        QueueDelayed(slot, addr, packet, I_GetTimeMS() + delay);
+    }
+}
+
+static boolean ImpairInitClient(impair_slot_t *slot)
+{
+    return slot->inner->InitClient();
+}
+
+static boolean ImpairInitServer(impair_slot_t *slot)
+{
+    return slot->inner->InitServer();
+}
+
+static void ImpairSendPacket(impair_slot_t *slot, net_addr_t *addr,
+                             net_packet_t *packet)
+{
+    ReleaseDelayed(slot);
+
+    ++slot->sent;
+
+    if (PacketLost(slot))
+    {
+        ++slot->dropped;
+        return;
+    }
+
+    SendOne(slot, addr, packet);
+
+    if (RandomChance(dup_percent))
+    {
+        ++slot->duplicated;
+        SendOne(slot, addr, packet);
+    }
+}
+
+static boolean ImpairRecvPacket(impair_slot_t *slot, net_addr_t **addr,
+                                net_packet_t **packet)
+{
+    ReleaseDelayed(slot);
+
+    if (!slot->inner->RecvPacket(addr, packet))
+    {
+        return false;
+    }
+
+    ClaimAddr(slot, *addr);
+
+    return true;
+}
+
+static net_addr_t *ImpairResolveAddress(impair_slot_t *slot, char *addr)
+{
+    net_addr_t *result;
+
+    result = slot->inner->ResolveAddress(addr);
+    ClaimAddr(slot, result);
+
+    return result;
+}
+
+static void NET_Impair_AddrToString(net_addr_t *addr, char *buffer,
+                                    int buffer_len)
+{
+    SlotForAddr(addr)->inner->AddrToString(addr, buffer, buffer_len);
+}
+
+static void NET_Impair_FreeAddress(net_addr_t *addr)
+{
+    impair_slot_t *slot;
+
+    slot = SlotForAddr(addr);
+    DiscardDelayed(slot, addr);
+    slot->inner->FreeAddress(addr);
+}
+
+// The module interface does not pass the module itself to the functions
+// that do not take an address, so each slot needs its own set of entry
+// points.
+
+#define IMPAIR_SLOT_FUNCS(n)                                               \
+    static boolean NET_Impair_InitClient##n(void)                          \
+    {                                                                      \
+        return ImpairInitClient(&slots[n]);                                \
+    }                                                                      \
+    static boolean NET_Impair_InitServer##n(void)                          \
+    {                                                                      \
+        return ImpairInitServer(&slots[n]);                                \
+    }                                                                      \
+    static void NET_Impair_SendPacket##n(net_addr_t *addr,                 \
+                                         net_packet_t *packet)             \
+    {                                                                      \
+        ImpairSendPacket(&slots[n], addr, packet);                         \
+    }                                                                      \
+    static boolean NET_Impair_RecvPacket##n(net_addr_t **addr,             \
+                                            net_packet_t **packet)         \
+    {                                                                      \
+        return ImpairRecvPacket(&slots[n], addr, packet);                  \
+    }                                                                      \
+    static net_addr_t *NET_Impair_ResolveAddress##n(char *addr)            \
+    {                                                                      \
+        return ImpairResolveAddress(&slots[n], addr);                      \
+    }
+
+#define IMPAIR_SLOT_MODULE(n)                                              \
+    {                                                                      \
+        NET_Impair_InitClient##n,                                          \
+        NET_Impair_InitServer##n,                                          \
+        NET_Impair_SendPacket##n,                                          \
+        NET_Impair_RecvPacket##n,                                          \
+        NET_Impair_AddrToString,                                           \
+        NET_Impair_FreeAddress,                                            \
+        NET_Impair_ResolveAddress##n,                                      \
+    }
+
+IMPAIR_SLOT_FUNCS(0)
+IMPAIR_SLOT_FUNCS(1)
+IMPAIR_SLOT_FUNCS(2)
+IMPAIR_SLOT_FUNCS(3)
+
+static const net_module_t slot_modules[MAX_WRAPPED_MODULES] =
+{
+    IMPAIR_SLOT_MODULE(0),
+    IMPAIR_SLOT_MODULE(1),
+    IMPAIR_SLOT_MODULE(2),
+    IMPAIR_SLOT_MODULE(3),
+};
+
+//
+// Wrap the given module with the impairment simulator.  If no network
+// impairment options were given on the command line, the module is
+// returned unchanged.  Wrapping the same module twice returns the same
+// wrapper.
+//
+
+net_module_t *NET_Impair_WrapModule(net_module_t *module)
+{
+    impair_slot_t *slot;
+    int i;
+
+    if (!impair_initted)
+    {
+        InitImpairment();
+    }
+
+    if (!impair_enabled)
+    {
+        return module;
+    }
+
+    for (i = 0; i < num_slots; ++i)
+    {
+        if (slots[i].inner == module || &slots[i].module == module)
+        {
+            return &slots[i].module;
+        }
+    }
+
+    if (num_slots >= MAX_WRAPPED_MODULES)
+    {
+        I_Error("NET_Impair_WrapModule: Too many wrapped modules");
+    }
+
+    slot = &slots[num_slots];
+    memset(slot, 0, sizeof(impair_slot_t));
+    slot->module = slot_modules[num_slots];
+    slot->inner = module;
+    ++num_slots;
+
+    return &slot->module;
+}
+
+void NET_Impair_PrintStats(void)
+{
+    int i;
+
+    for (i = 0; i < num_slots; ++i)
+    {
+        printf("netstats: impair%i sent=%u dropped=%u duplicated=%u "
+               "reordered=%u delayed=%u\n",
+               i, slots[i].sent, slots[i].dropped, slots[i].duplicated,
+               slots[i].reordered, slots[i].delayed_count);
+    }
+}
+
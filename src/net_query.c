@@ -22,6 +22,7 @@
 
 #include "i_system.h"
 #include "i_timer.h"
+#include "m_argv.h"
 #include "m_misc.h"
 
 #include "net_common.h"
@@ -48,6 +49,17 @@
 
 #define QUERY_MAX_ATTEMPTS 3
 
+// Default number of queries to have in flight at once.
+
+#define QUERY_WINDOW 32
+
+// Once we have seen some responses, the time to wait for a server is
+// based on their round trip times, doubling with each attempt, but
+// within these limits.
+
+#define QUERY_MIN_TIMEOUT_MS 250
+#define QUERY_MAX_TIMEOUT_MS (QUERY_TIMEOUT_SECS * 1000)
+
 typedef enum
 {
     QUERY_TARGET_SERVER,       // Normal server target.
@@ -72,6 +84,7 @@ typedef struct
     unsigned int ping_time;
     unsigned int query_time;
     unsigned int query_attempts;
+    unsigned int timeout;
     boolean printed;
 } query_target_t;
 
@@ -84,7 +97,12 @@ static int num_targets;
 
 static boolean query_loop_running = false;
 static boolean printed_header = false;
-static int last_query_time = 0;
+
+// Number of queries that can be in flight at once, and round trip time
+// of the server responses received so far.
+
+static int query_window = QUERY_WINDOW;
+static net_rtt_t query_rtt;
 
 static char *securedemo_start_message = NULL;
 
@@ -209,6 +227,7 @@ static query_target_t *GetTargetForAddr(net_addr_t *addr, boolean create)
     target->state = QUERY_TARGET_QUEUED;
     target->printed = false;
     target->query_attempts = 0;
+    target->timeout = QUERY_TIMEOUT_SECS * 1000;
     target->addr = addr;
     ++num_targets;
 
@@ -294,10 +313,18 @@ static void NET_Query_ParseResponse(net_addr_t *addr, net_packet_t *packet,
         target->state = QUERY_TARGET_RESPONDED;
         memcpy(&target->data, &querydata, sizeof(net_querydata_t));
 
-        // Calculate RTT.
+        // Calculate RTT.  If we sent more than one query, we do not
+        // know which one this is a response to, so it cannot be used
+        // for the timeout estimate.
 
         target->ping_time = I_GetTimeMS() - target->query_time;
 
+        if (target->type == QUERY_TARGET_SERVER
+         && target->query_attempts == 1)
+        {
+            NET_RTT_Update(&query_rtt, target->ping_time);
+        }
+
         // Invoke callback to signal that we have a new address.
 
         callback(addr, &target->data, target->ping_time, user_data);
@@ -377,71 +404,106 @@ static void NET_Query_GetResponse(net_query_callback_t callback,
     net_addr_t *addr;
     net_packet_t *packet;
 
-    if (NET_RecvPacket(query_context, &addr, &packet))
+    while (NET_RecvPacket(query_context, &addr, &packet))
     {
         NET_Query_ParsePacket(addr, packet, callback, user_data);
         NET_FreePacket(packet);
     }
 }
 
-// Find a target we have not yet queried and send a query.
+// Work out how long to wait for a response to the query just sent to
+// the given target.
 
-static void SendOneQuery(void)
+static unsigned int QueryTimeout(query_target_t *target)
+{
+    unsigned int timeout;
+
+    // Until we have seen some responses, use the fixed timeout.  The
+    // master server and LAN broadcasts always use it.
+
+    if (target->type != QUERY_TARGET_SERVER || !query_rtt.valid)
+    {
+        return QUERY_TIMEOUT_SECS * 1000;
+    }
+
+    timeout = query_rtt.srtt + 4 * query_rtt.rttvar;
+
+    if (timeout < QUERY_MIN_TIMEOUT_MS)
+    {
+        timeout = QUERY_MIN_TIMEOUT_MS;
+    }
+
+    timeout <<= target->query_attempts - 1;
+
+    if (timeout > QUERY_MAX_TIMEOUT_MS)
+    {
+        timeout = QUERY_MAX_TIMEOUT_MS;
+    }
+
+    return timeout;
+}
+
+// Send queries to targets that we have not yet queried, or whose last
+// query timed out, keeping up to query_window queries in flight.
+
+static void SendQueries(void)
 {
     unsigned int now;
     unsigned int i;
+    int in_flight;
 
     now = I_GetTimeMS();
 
-    // Rate limit - only send one query every 50ms.
+    in_flight = 0;
 
-    if (now - last_query_time < 50)
+    for (i = 0; i < num_targets; ++i)
     {
-        return;
+        if (targets[i].state == QUERY_TARGET_QUERIED
+         && now - targets[i].query_time <= targets[i].timeout)
+        {
+            ++in_flight;
+        }
     }
 
-    for (i = 0; i < num_targets; ++i)
+    for (i = 0; i < num_targets && in_flight < query_window; ++i)
     {
         // Not queried yet?
         // Or last query timed out without a response?
 
-        if (targets[i].state == QUERY_TARGET_QUEUED
-         || (targets[i].state == QUERY_TARGET_QUERIED
-             && now - targets[i].query_time > QUERY_TIMEOUT_SECS * 1000))
+        if (targets[i].state != QUERY_TARGET_QUEUED
+         && (targets[i].state != QUERY_TARGET_QUERIED
+          || now - targets[i].query_time <= targets[i].timeout
+          || targets[i].query_attempts >= QUERY_MAX_ATTEMPTS))
         {
-            break;
+            continue;
         }
-    }
 
-    if (i >= num_targets)
-    {
-        return;
-    }
+        // Found a target to query.  Send a query; how to do this
+        // depends on the target type.
 
-    // Found a target to query.  Send a query; how to do this depends on
-    // the target type.
-
-    switch (targets[i].type)
-    {
-        case QUERY_TARGET_SERVER:
-            NET_Query_SendQuery(targets[i].addr);
-            break;
+        switch (targets[i].type)
+        {
+            case QUERY_TARGET_SERVER:
+                NET_Query_SendQuery(targets[i].addr);
+                break;
 
-        case QUERY_TARGET_BROADCAST:
-            NET_Query_SendQuery(NULL);
-            break;
+            case QUERY_TARGET_BROADCAST:
+                NET_Query_SendQuery(NULL);
+                break;
 
-        case QUERY_TARGET_MASTER:
-            NET_Query_SendMasterQuery(targets[i].addr);
-            break;
-    }
+            case QUERY_TARGET_MASTER:
+                NET_Query_SendMasterQuery(targets[i].addr);
+                break;
+        }
 
-    //printf("Queried %s\n", NET_AddrToString(targets[i].addr));
-    targets[i].state = QUERY_TARGET_QUERIED;
-    targets[i].query_time = now;
-    ++targets[i].query_attempts;
+        //printf("Queried %s\n", NET_AddrToString(targets[i].addr));
+        targets[i].state = QUERY_TARGET_QUERIED;
+        targets[i].query_time = now;
+        ++targets[i].query_attempts;
+        targets[i].timeout = QueryTimeout(&targets[i]);
 
-    last_query_time = now;
+        ++in_flight;
+    }
 }
 
 // Time out servers that have been queried and not responded.
@@ -467,7 +529,7 @@ static void CheckTargetTimeouts(void)
 
         if (targets[i].state == QUERY_TARGET_QUERIED
          && targets[i].query_attempts >= QUERY_MAX_ATTEMPTS
-         && now - targets[i].query_time > QUERY_TIMEOUT_SECS * 1000)
+         && now - targets[i].query_time > targets[i].timeout)
         {
             targets[i].state = QUERY_TARGET_NO_RESPONSE;
 
@@ -507,11 +569,11 @@ int NET_Query_Poll(net_query_callback_t callback, void *user_data)
 {
     CheckTargetTimeouts();
 
-    // Send a query.  This will only send a single query at once.
+    // Send queries, up to the number allowed in flight at once.
 
-    SendOneQuery();
+    SendQueries();
 
-    // Check for a response
+    // Check for responses
 
     NET_Query_GetResponse(callback, user_data);
 
@@ -542,6 +604,8 @@ static void NET_Query_QueryLoop(net_query_callback_t callback, void *user_data)
 
 void NET_Query_Init(void)
 {
+    int i;
+
     if (query_context == NULL)
     {
         query_context = NET_NewContext();
@@ -554,6 +618,28 @@ void NET_Query_Init(void)
     num_targets = 0;
 
     printed_header = false;
+
+    memset(&query_rtt, 0, sizeof(query_rtt));
+
+    //!
+    // @arg <n>
+    // @category net
+    //
+    // When searching for servers, query up to this many servers at
+    // once (the default is 32).
+    //
+
+    i = M_CheckParmWithArgs("-querywindow", 1);
+
+    if (i > 0)
+    {
+        query_window = atoi(myargv[i + 1]);
+
+        if (query_window < 1)
+        {
+            query_window = 1;
+        }
+    }
 }
 
 // Callback that exits the query loop when the first server is found.
@@ -801,6 +887,68 @@ void NET_QueryAddress(char *addr_str)
     }
 }
 
+// Search benchmark: query a master server and all of the servers it
+// lists, and report how long it took to get the first response and
+// to finish.
+
+static unsigned int bench_first_time;
+static int bench_responses;
+
+static void NET_QueryBenchmarkCallback(net_addr_t *addr,
+                                       net_querydata_t *data,
+                                       unsigned int ping_time,
+                                       void *user_data)
+{
+    if (bench_responses == 0)
+    {
+        bench_first_time = I_GetTimeMS();
+    }
+
+    ++bench_responses;
+}
+
+void NET_SearchBenchmark(net_module_t *module, char *master_str)
+{
+    net_addr_t *master;
+    query_target_t *target;
+    unsigned int start_time, end_time;
+
+    // Use the given network module rather than the real network.
+
+    if (query_context == NULL)
+    {
+        query_context = NET_NewContext();
+    }
+
+    NET_AddModule(query_context, module);
+    module->InitClient();
+
+    NET_Query_Init();
+
+    master = NET_ResolveAddress(query_context, master_str);
+
+    if (master == NULL)
+    {
+        I_Error("NET_SearchBenchmark: Failed to resolve '%s'", master_str);
+    }
+
+    target = GetTargetForAddr(master, true);
+    target->type = QUERY_TARGET_MASTER;
+
+    bench_responses = 0;
+    start_time = I_GetTimeMS();
+    bench_first_time = start_time;
+
+    NET_Query_QueryLoop(NET_QueryBenchmarkCallback, NULL);
+
+    end_time = I_GetTimeMS();
+
+    printf("searchbench: servers=%i window=%i responses=%i "
+           "first_ms=%u complete_ms=%u\n",
+           num_targets - 1, query_window, bench_responses,
+           bench_first_time - start_time, end_time - start_time);
+}
+
 net_addr_t *NET_FindLANServer(void)
 {
     query_target_t *target;
@@ -950,3 +1098,94 @@ char *NET_EndSecureDemo(sha1_digest_t demo_hash)
     return signature;
 }
 
+// Request metrics from a server (which must have been started with
+// -metrics) and print them to stdout.
+
+void NET_QueryMetrics(char *addr_str)
+{
+    net_packet_t *request, *response;
+    net_addr_t *addr;
+    char *parts[256];
+    unsigned int part, num_parts, received;
+    unsigned int attempt;
+    char *text;
+    unsigned int i;
+
+    NET_Query_Init();
+
+    addr = NET_ResolveAddress(query_context, addr_str);
+
+    if (addr == NULL)
+    {
+        I_Error("NET_QueryMetrics: Host '%s' not found!", addr_str);
+    }
+
+    memset(parts, 0, sizeof(parts));
+    num_parts = 0;
+    received = 0;
+
+    for (attempt = 0; attempt < QUERY_MAX_ATTEMPTS; ++attempt)
+    {
+        request = NET_NewPacket(10);
+        NET_WriteInt16(request, NET_PACKET_TYPE_METRICS);
+        NET_SendPacket(addr, request);
+        NET_FreePacket(request);
+
+        // A fresh request produces a fresh set of metrics; discard any
+        // parts of an earlier response.
+
+        for (i = 0; i < 256; ++i)
+        {
+            free(parts[i]);
+            parts[i] = NULL;
+        }
+
+        num_parts = 0;
+        received = 0;
+
+        while (num_parts == 0 || received < num_parts)
+        {
+            response = BlockForPacket(addr, NET_PACKET_TYPE_METRICS_RESPONSE,
+                                      QUERY_TIMEOUT_SECS * 1000);
+
+            if (response == NULL)
+            {
+                break;
+            }
+
+            if (NET_ReadInt8(response, &part)
+             && NET_ReadInt8(response, &num_parts)
+             && part < num_parts
+             && parts[part] == NULL)
+            {
+                text = NET_ReadString(response);
+
+                if (text != NULL)
+                {
+                    parts[part] = M_StringDuplicate(text);
+                    ++received;
+                }
+            }
+
+            NET_FreePacket(response);
+        }
+
+        if (num_parts > 0 && received == num_parts)
+        {
+            break;
+        }
+    }
+
+    if (num_parts == 0 || received < num_parts)
+    {
+        I_Error("No metrics response from '%s'", addr_str);
+    }
+
+    for (i = 0; i < num_parts; ++i)
+    {
+        fputs(parts[i], stdout);
+        free(parts[i]);
+    }
+
+    fflush(stdout);
+}
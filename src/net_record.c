@@ -0,0 +1,378 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Server-side recording of the tics of a netgame.
+//
+//     Every complete tic that the server advances past is kept in
+//     memory, so that spectators joining a game in progress can be
+//     sent the game from the start and fast-forward to the present.
+//
+//     With -netrecord, the tics are also written to a file as the
+//     game is played.  The file is a sequence of records, each of
+//     which is:
+//
+//       type      (1 byte)
+//       length    (4 bytes, big endian)
+//       payload   (length bytes)
+//       checksum  (4 bytes, Adler-32 of the payload)
+//
+//     The file is flushed after every record, so if the server
+//     crashes, everything up to the last complete record can be
+//     recovered; a truncated final record is detected by its length
+//     or checksum.  Index records are written periodically, holding
+//     the complete ticcmd of every player at that point, so that
+//     playback can start from an index without decoding all of the
+//     tics before it.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "doomtype.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "net_defs.h"
+#include "net_packet.h"
+#include "net_record.h"
+#include "net_structrw.h"
+
+#define RECORD_MAGIC "CHOCNREC"
+
+// Record types:
+
+#define RECORD_SETTINGS 1
+#define RECORD_INDEX    2
+#define RECORD_TICS     3
+
+// Number of tics in each tics record, and number of tics between
+// index records.
+
+#define RECORD_CHUNK_TICS  TICRATE
+#define RECORD_INDEX_TICS  (10 * TICRATE)
+
+// Serialized tics of the current game, and the offset of each tic
+// within the buffer.
+
+static net_packet_t *history = NULL;
+static unsigned int *history_offsets = NULL;
+static unsigned int history_len;
+static unsigned int history_alloced;
+
+static boolean lowres_turn;
+
+// Recording file, if -netrecord was given.
+
+static FILE *record_file = NULL;
+static unsigned int record_games = 0;
+
+// First tic not yet written to the recording file.
+
+static unsigned int record_written;
+
+// Complete ticcmd of each player as of the latest tic recorded;
+// written in index records.
+
+static ticcmd_t record_base[NET_MAXPLAYERS];
+
+static unsigned int Adler32(byte *data, unsigned int len)
+{
+    unsigned int a = 1, b = 0;
+    unsigned int i;
+
+    for (i = 0; i < len; ++i)
+    {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+
+    return (b << 16) | a;
+}
+
+static void WriteRecord(unsigned int type, net_packet_t *payload)
+{
+    byte header[5];
+    byte trailer[4];
+    unsigned int checksum;
+
+    header[0] = type;
+    header[1] = (payload->len >> 24) & 0xff;
+    header[2] = (payload->len >> 16) & 0xff;
+    header[3] = (payload->len >> 8) & 0xff;
+    header[4] = payload->len & 0xff;
+
+    checksum = Adler32(payload->data, payload->len);
+
+    trailer[0] = (checksum >> 24) & 0xff;
+    trailer[1] = (checksum >> 16) & 0xff;
+    trailer[2] = (checksum >> 8) & 0xff;
+    trailer[3] = checksum & 0xff;
+
+    if (fwrite(header, 1, sizeof(header), record_file) != sizeof(header)
+     || fwrite(payload->data, 1, payload->len, record_file) != payload->len
+     || fwrite(trailer, 1, sizeof(trailer), record_file) != sizeof(trailer)
+     || fflush(record_file) != 0)
+    {
+        fprintf(stderr, "NET_Record: Error writing recording; "
+                        "recording stopped.\n");
+        fclose(record_file);
+        record_file = NULL;
+    }
+}
+
+static void WriteIndexRecord(void)
+{
+    net_packet_t *payload;
+    net_ticdiff_t diff;
+    ticcmd_t zero;
+    int i;
+
+    memset(&zero, 0, sizeof(zero));
+
+    payload = NET_NewPacket(64);
+    NET_WriteInt32(payload, record_written);
+
+    for (i = 0; i < NET_MAXPLAYERS; ++i)
+    {
+        NET_TiccmdDiff(&zero, &record_base[i], &diff);
+        NET_WriteTiccmdDiff(payload, &diff, false);
+    }
+
+    WriteRecord(RECORD_INDEX, payload);
+    NET_FreePacket(payload);
+}
+
+// Write out the tics that have been recorded since the last tics
+// record.
+
+static void WriteTicsRecord(void)
+{
+    net_packet_t *payload;
+    unsigned int start, end;
+
+    start = history_offsets[record_written];
+    end = history_offsets[history_len];
+
+    payload = NET_NewPacket(end - start + 8);
+    NET_WriteInt32(payload, record_written);
+    NET_WriteInt8(payload, history_len - record_written);
+
+    memcpy(payload->data + payload->len, history->data + start, end - start);
+    payload->len += end - start;
+
+    WriteRecord(RECORD_TICS, payload);
+    NET_FreePacket(payload);
+
+    record_written = history_len;
+}
+
+static void OpenRecordFile(net_gamesettings_t *settings,
+                           unsigned int gamemode, unsigned int gamemission)
+{
+    net_packet_t *payload;
+    char *filename;
+    int p;
+
+    //!
+    // @arg <file>
+    // @category net
+    //
+    // Record the tics of each game played on the server to the
+    // specified file.  If more than one game is played, the number
+    // of the game is appended to the filename for the second and
+    // later games.
+    //
+
+    p = M_CheckParmWithArgs("-netrecord", 1);
+
+    if (p == 0)
+    {
+        return;
+    }
+
+    if (record_games == 0)
+    {
+        filename = M_StringDuplicate(myargv[p + 1]);
+    }
+    else
+    {
+        size_t len = strlen(myargv[p + 1]) + 16;
+
+        filename = malloc(len);
+        M_snprintf(filename, len, "%s.%u", myargv[p + 1], record_games);
+    }
+
+    ++record_games;
+
+    record_file = fopen(filename, "wb");
+
+    if (record_file == NULL)
+    {
+        fprintf(stderr, "NET_Record: Failed to open '%s' for writing.\n",
+                filename);
+        free(filename);
+        return;
+    }
+
+    printf("NET_Record: Recording game to '%s'.\n", filename);
+    free(filename);
+
+    if (fwrite(RECORD_MAGIC, 1, strlen(RECORD_MAGIC), record_file)
+        != strlen(RECORD_MAGIC))
+    {
+        fclose(record_file);
+        record_file = NULL;
+        return;
+    }
+
+    payload = NET_NewPacket(64);
+    NET_WriteInt8(payload, gamemode);
+    NET_WriteInt8(payload, gamemission);
+    NET_WriteSettings(payload, settings);
+    WriteRecord(RECORD_SETTINGS, payload);
+    NET_FreePacket(payload);
+}
+
+// Start recording a new game.
+
+void NET_Record_Start(net_gamesettings_t *settings,
+                      unsigned int gamemode, unsigned int gamemission)
+{
+    NET_Record_Stop();
+
+    history = NET_NewPacket(1024);
+    history_alloced = 1024;
+    history_offsets = malloc(history_alloced * sizeof(*history_offsets));
+    history_offsets[0] = 0;
+    history_len = 0;
+    record_written = 0;
+
+    lowres_turn = settings->lowres_turn;
+    memset(record_base, 0, sizeof(record_base));
+
+    OpenRecordFile(settings, gamemode, gamemission);
+}
+
+// Add the next tic of the game.
+
+void NET_Record_AddTic(net_full_ticcmd_t *cmd)
+{
+    int i;
+
+    if (history == NULL)
+    {
+        return;
+    }
+
+    if (history_len + 1 >= history_alloced)
+    {
+        history_alloced *= 2;
+        history_offsets = realloc(history_offsets,
+                                  history_alloced * sizeof(*history_offsets));
+
+        if (history_offsets == NULL)
+        {
+            I_Error("NET_Record_AddTic: Failed to grow tic history");
+        }
+    }
+
+    NET_WriteFullTiccmd(history, cmd, lowres_turn);
+    ++history_len;
+    history_offsets[history_len] = history->len;
+
+    if (record_file == NULL)
+    {
+        return;
+    }
+
+    // Index records describe the state before the first tic of the
+    // tics record that follows them.
+
+    if (record_written % RECORD_INDEX_TICS == 0
+     && history_len == record_written + 1)
+    {
+        WriteIndexRecord();
+    }
+
+    for (i = 0; i < NET_MAXPLAYERS; ++i)
+    {
+        if (cmd->playeringame[i])
+        {
+            NET_TiccmdPatch(&record_base[i], &cmd->cmds[i], &record_base[i]);
+        }
+    }
+
+    if (history_len - record_written >= RECORD_CHUNK_TICS)
+    {
+        WriteTicsRecord();
+    }
+}
+
+unsigned int NET_Record_NumTics(void)
+{
+    return history_len;
+}
+
+// Read back a recorded tic.  The sequence number is set to the tic
+// number, so that it can be placed directly into a send queue.
+
+void NET_Record_GetTic(unsigned int tic, net_full_ticcmd_t *cmd)
+{
+    if (tic >= history_len)
+    {
+        I_Error("NET_Record_GetTic: Tic %u not recorded (%u tics)",
+                tic, history_len);
+    }
+
+    history->pos = history_offsets[tic];
+
+    if (!NET_ReadFullTiccmd(history, cmd, lowres_turn))
+    {
+        I_Error("NET_Record_GetTic: Failed to read tic %u", tic);
+    }
+
+    cmd->seq = tic;
+}
+
+// Finish recording the current game.
+
+void NET_Record_Stop(void)
+{
+    if (record_file != NULL)
+    {
+        if (history_len > record_written)
+        {
+            WriteTicsRecord();
+        }
+
+        if (record_file != NULL)
+        {
+            fclose(record_file);
+            record_file = NULL;
+        }
+    }
+
+    if (history != NULL)
+    {
+        NET_FreePacket(history);
+        history = NULL;
+        free(history_offsets);
+        history_offsets = NULL;
+    }
+
+    history_len = 0;
+}
+
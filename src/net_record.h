@@ -0,0 +1,31 @@
+//
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//     Server-side recording of the tics of a netgame.
+//
+
+#ifndef NET_RECORD_H
+#define NET_RECORD_H
+
+#include "net_defs.h"
+
+void NET_Record_Start(net_gamesettings_t *settings,
+                      unsigned int gamemode, unsigned int gamemission);
+void NET_Record_AddTic(net_full_ticcmd_t *cmd);
+unsigned int NET_Record_NumTics(void);
+void NET_Record_GetTic(unsigned int tic, net_full_ticcmd_t *cmd);
+void NET_Record_Stop(void);
+
+#endif /* #ifndef NET_RECORD_H */
+
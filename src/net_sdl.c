@@ -182,10 +182,6 @@ static boolean NET_SDL_InitClient(void)
     
     recvpacket = SDLNet_AllocPacket(1500);
 
-#ifdef DROP_PACKETS
-    srand(time(NULL));
-#endif
-
     initted = true;
 
     return true;
@@ -212,9 +208,6 @@ static boolean NET_SDL_InitServer(void)
     }
 
     recvpacket = SDLNet_AllocPacket(1500);
-#ifdef DROP_PACKETS
-    srand(time(NULL));
-#endif
 
     initted = true;
 
@@ -252,11 +245,6 @@ static void NET_SDL_SendPacket(net_addr_t *addr, net_packet_t *packet)
     }
 #endif
 
-#ifdef DROP_PACKETS
-    if ((rand() % 4) == 0)
-        return;
-#endif
-
     sdl_packet.channel = 0;
     sdl_packet.data = packet->data;
     sdl_packet.len = packet->len;
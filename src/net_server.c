@@ -31,10 +31,12 @@
 #include "net_client.h"
 #include "net_common.h"
 #include "net_defs.h"
+#include "net_impair.h"
 #include "net_io.h"
 #include "net_loop.h"
 #include "net_packet.h"
 #include "net_query.h"
+#include "net_record.h"
 #include "net_server.h"
 #include "net_sdl.h"
 #include "net_structrw.h"
@@ -47,6 +49,24 @@
 
 #define MASTER_RESOLVE_PERIOD 8 * 60 * 60 /* 8 hours */
 
+// Maximum number of recorded tics to send in one packet to a spectator
+// that is catching up with a game in progress, and how far ahead of
+// the spectator's acknowledgement point we can send.
+
+#define CATCHUP_TICS_PER_PACKET 8
+#define CATCHUP_WINDOW (BACKUPTICS / 2)
+
+// Number of unacknowledged tics we allow the slowest client to fall
+// behind before we stop sending to everyone.  With -netadapt, this is
+// raised for clients with a long round trip time, up to the maximum.
+
+#define SEND_LEAD 40
+#define MAX_ADAPTIVE_SEND_LEAD (BACKUPTICS / 2)
+
+// Maximum amount of text in each metrics response packet.
+
+#define METRICS_PART_SIZE 1024
+
 typedef enum
 {
     // waiting for the game to be "launched" (key player to press the start
@@ -97,6 +117,22 @@ typedef struct
     int sendseq;
     net_full_ticcmd_t sendqueue[BACKUPTICS];
 
+    // Time that each entry in the send queue was first sent, used to
+    // measure the round trip time from the acknowledgements.
+
+    unsigned int sendtime[BACKUPTICS];
+    net_rtt_t rtt;
+
+    // Number of previous tics to resend with each new tic (-netadapt).
+
+    int extratics;
+
+    // Number of resend requests we have sent to this client, and the
+    // number of tics we have resent at its request (-metrics).
+
+    unsigned int resend_requests;
+    unsigned int resent_tics;
+
     // Latest acknowledged by the client
 
     unsigned int acknowledged;
@@ -109,6 +145,13 @@ typedef struct
 
     boolean drone;
 
+    // Observer that joined a game in progress and is being sent the
+    // recorded tics of the game so far.  It does not hold back the
+    // recv window until it has caught up.
+
+    boolean catchup;
+    unsigned int catchup_start_time;
+
     // SHA1 hash sums of the client's WAD directory and dehacked data
 
     sha1_digest_t wad_sha1sum;
@@ -140,6 +183,11 @@ typedef struct
 
     unsigned int resend_time;
 
+    // Time we sent the first resend request for this tic, used to
+    // measure the time taken to recover from a dropped packet.
+
+    unsigned int first_resend_time;
+
     // Tic data itself
 
     net_ticdiff_t diff;
@@ -165,6 +213,34 @@ static unsigned int master_resolve_time;
 static unsigned int recvwindow_start;
 static net_client_recv_t recvwindow[BACKUPTICS][NET_MAXPLAYERS];
 
+// Statistics on recovering from dropped packets, for -netstats.
+
+static unsigned int stats_resend_requests;
+static unsigned int stats_recovered_tics;
+static unsigned int stats_recover_time;
+static unsigned int stats_max_recover_time;
+
+// If true, adapt the send lead and redundancy to each client's round
+// trip time.
+
+static boolean sv_adaptive = false;
+
+// If true, answer metrics requests from this machine.  Time spent in
+// each iteration of the server loop is measured for the metrics, and
+// the maximum is reset each time the metrics are read.
+
+static boolean sv_metrics = false;
+static unsigned int start_time;
+static unsigned int loop_iterations;
+static uint64_t loop_time_total;
+static uint64_t loop_time_max;
+
+// Text of a metrics response as it is built.
+
+static char *metrics_buf = NULL;
+static size_t metrics_len;
+static size_t metrics_alloced;
+
 #define NET_SV_ExpandTicNum(b) NET_ExpandTicNum(recvwindow_start, (b))
 
 static void NET_SV_DisconnectClient(net_client_t *client)
@@ -450,7 +526,7 @@ static unsigned int NET_SV_LatestAcknowledged(void)
 
     for (i=0; i<MAXNETNODES; ++i) 
     {
-        if (ClientConnected(&clients[i]))
+        if (ClientConnected(&clients[i]) && !clients[i].catchup)
         {
             if (clients[i].acknowledged < lowtic)
             {
@@ -463,6 +539,31 @@ static unsigned int NET_SV_LatestAcknowledged(void)
 }
 
 
+// Save the complete tic at the start of the recv window, before it
+// is advanced past.
+
+static void NET_SV_RecordTic(void)
+{
+    net_full_ticcmd_t cmd;
+    int i;
+
+    cmd.latency = 0;
+    cmd.seq = recvwindow_start;
+
+    for (i=0; i<NET_MAXPLAYERS; ++i)
+    {
+        cmd.playeringame[i] = sv_players[i] != NULL
+                           && recvwindow[0][i].active;
+
+        if (cmd.playeringame[i])
+        {
+            cmd.cmds[i] = recvwindow[0][i].diff;
+        }
+    }
+
+    NET_Record_AddTic(&cmd);
+}
+
 // Possibly advance the recv window if all connected clients have
 // used the data in the window
 
@@ -512,6 +613,8 @@ static void NET_SV_AdvanceWindow(void)
             break;
         }
         
+        NET_SV_RecordTic();
+
         // Advance the window
 
         memmove(recvwindow, recvwindow + 1,
@@ -570,7 +673,12 @@ static void NET_SV_InitNewClient(net_client_t *client,
 
     client->sendseq = 0;
     client->acknowledged = 0;
+    memset(&client->rtt, 0, sizeof(client->rtt));
+    client->extratics = 0;
+    client->resend_requests = 0;
+    client->resent_tics = 0;
     client->drone = false;
+    client->catchup = false;
     client->ready = false;
 
     client->last_gamedata_time = 0;
@@ -663,9 +771,11 @@ static void NET_SV_ParseSYN(net_packet_t *packet,
 
     // received a valid SYN
 
-    // not accepting new connections?
+    // not accepting new connections?  Drones can join a game that is
+    // already in progress.
 
-    if (server_state != SERVER_WAITING_LAUNCH)
+    if (server_state != SERVER_WAITING_LAUNCH
+     && !(server_state == SERVER_IN_GAME && data.drone))
     {
         NET_SV_SendReject(addr, "Server is not currently accepting connections");
         return;
@@ -709,9 +819,13 @@ static void NET_SV_ParseSYN(net_packet_t *packet,
         int num_players;
 
         // Before accepting a new client, check that there is a slot
-        // free
+        // free.  Player numbers must not change once in game.
+
+        if (server_state == SERVER_WAITING_LAUNCH)
+        {
+            NET_SV_AssignPlayers();
+        }
 
-        NET_SV_AssignPlayers();
         num_players = NET_SV_NumPlayers();
 
         if ((!data.drone && num_players >= NET_SV_MaxPlayers())
@@ -756,6 +870,12 @@ static void NET_SV_ParseSYN(net_packet_t *packet,
         client->recording_lowres = data.lowres_turn;
         client->drone = data.drone;
         client->player_class = data.player_class;
+
+        if (server_state == SERVER_IN_GAME)
+        {
+            client->player_number = -1;
+            client->catchup = true;
+        }
     }
 
     if (client->connection.state == NET_CONN_STATE_WAITING_ACK)
@@ -875,6 +995,31 @@ static void StartGame(void)
 
     memset(recvwindow, 0, sizeof(recvwindow));
     recvwindow_start = 0;
+
+    NET_Record_Start(&sv_settings, sv_gamemode, sv_gamemission);
+}
+
+// Start the game for a drone that has connected to a game that is
+// already in progress.
+
+static void NET_SV_StartLateClient(net_client_t *client)
+{
+    net_packet_t *packet;
+    net_gamesettings_t settings;
+
+    packet = NET_Conn_NewReliable(&client->connection,
+                                  NET_PACKET_TYPE_LAUNCH);
+    NET_WriteInt8(packet, sv_settings.num_players);
+
+    packet = NET_Conn_NewReliable(&client->connection,
+                                  NET_PACKET_TYPE_GAMESTART);
+    settings = sv_settings;
+    settings.consoleplayer = client->player_number;
+    NET_WriteSettings(packet, &settings);
+
+    client->ready = true;
+    client->last_gamedata_time = I_GetTimeMS();
+    client->catchup_start_time = client->last_gamedata_time;
 }
 
 // Returns true when all nodes have indicated readiness to start the game.
@@ -984,6 +1129,9 @@ static void NET_SV_SendResendRequest(net_client_t *client, int start, int end)
     NET_Conn_SendPacket(&client->connection, packet);
     NET_FreePacket(packet);
 
+    ++stats_resend_requests;
+    ++client->resend_requests;
+
     // Store the time we send the resend request
 
     nowtime = I_GetTimeMS();
@@ -1002,6 +1150,11 @@ static void NET_SV_SendResendRequest(net_client_t *client, int start, int end)
         recvobj = &recvwindow[index][client->player_number];
 
         recvobj->resend_time = nowtime;
+
+        if (recvobj->first_resend_time == 0)
+        {
+            recvobj->first_resend_time = nowtime;
+        }
     }
 }
 
@@ -1069,6 +1222,49 @@ static void NET_SV_CheckResends(net_client_t *client)
     }
 }
 
+// Record a tic that was received after we sent a resend request for it.
+
+static void NET_SV_RecoveredTic(unsigned int recover_time)
+{
+    ++stats_recovered_tics;
+    stats_recover_time += recover_time;
+
+    if (recover_time > stats_max_recover_time)
+    {
+        stats_max_recover_time = recover_time;
+    }
+}
+
+// Update the acknowledgement point of a client, measuring the round
+// trip time from when the newly acknowledged tic was sent.
+
+static void NET_SV_Acknowledge(net_client_t *client, unsigned int ackseq)
+{
+    unsigned int seq;
+
+    if (ackseq <= client->acknowledged)
+    {
+        return;
+    }
+
+    seq = ackseq - 1;
+
+    if (client->sendqueue[seq % BACKUPTICS].seq == seq)
+    {
+        NET_RTT_Update(&client->rtt,
+                       I_GetTimeMS() - client->sendtime[seq % BACKUPTICS]);
+    }
+
+    client->acknowledged = ackseq;
+
+    if (sv_adaptive)
+    {
+        client->extratics = NET_RTT_ExtraTics(&client->rtt,
+                                              sv_settings.ticdup,
+                                              sv_settings.extratics);
+    }
+}
+
 // Process game data from a client
 
 static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
@@ -1137,6 +1333,12 @@ static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
         }
 
         recvobj = &recvwindow[index][player];
+
+        if (!recvobj->active && recvobj->first_resend_time != 0)
+        {
+            NET_SV_RecoveredTic(nowtime - recvobj->first_resend_time);
+        }
+
         recvobj->active = true;
         recvobj->diff = diff;
         recvobj->latency = latency;
@@ -1146,10 +1348,7 @@ static void NET_SV_ParseGameData(net_packet_t *packet, net_client_t *client)
 
     // Higher acknowledgement point?
 
-    if (ackseq > client->acknowledged)
-    {
-        client->acknowledged = ackseq;
-    }
+    NET_SV_Acknowledge(client, ackseq);
 
     // Has this been received out of sequence, ie. have we not received
     // all tics before the first tic in this packet?  If so, send a 
@@ -1222,15 +1421,33 @@ static void NET_SV_ParseGameDataACK(net_packet_t *packet, net_client_t *client)
         return;
     }
 
-    // Expand 8-bit values to the full sequence number
+    // Expand 8-bit values to the full sequence number.  A drone that is
+    // catching up may be far behind the recv window.
 
-    ackseq = NET_SV_ExpandTicNum(ackseq);
+    if (client->catchup)
+    {
+        ackseq = NET_ExpandTicNum(client->acknowledged, ackseq);
+    }
+    else
+    {
+        ackseq = NET_SV_ExpandTicNum(ackseq);
+    }
 
     // Higher acknowledgement point than we already have?
 
-    if (ackseq > client->acknowledged)
+    NET_SV_Acknowledge(client, ackseq);
+
+    // A late-joining drone has caught up once it has received every
+    // tic up to the recv window; from now on it is treated the same as
+    // any other client.
+
+    if (client->catchup && client->acknowledged >= recvwindow_start)
     {
-        client->acknowledged = ackseq;
+        client->catchup = false;
+
+        printf("SV: '%s' caught up with the game in progress: "
+               "%u tics in %u ms\n", client->name, client->acknowledged,
+               I_GetTimeMS() - client->catchup_start_time);
     }
 }
 
@@ -1316,6 +1533,231 @@ static void NET_SV_ParseResendRequest(net_packet_t *packet, net_client_t *client
     // Resend those tics
 
     NET_SV_SendTics(client, start, last);
+    client->resent_tics += num_tics;
+}
+
+// Add a line of text to the metrics response being built.  The line
+// is formatted straight into the buffer, which is grown until the
+// whole line fits: a line cut short would be missing its last fields.
+
+static void MetricsLine(char *s, ...)
+{
+    size_t space;
+    size_t line_len;
+    va_list args;
+
+    for (;;)
+    {
+        space = metrics_alloced - metrics_len;
+
+        if (metrics_buf != NULL)
+        {
+            va_start(args, s);
+            line_len = M_vsnprintf(metrics_buf + metrics_len, space, s, args);
+            va_end(args);
+
+            // Leave room for the newline and terminator, and one byte
+            // more, as M_vsnprintf returns the same length whether the
+            // line only just fitted or was cut short.
+
+            if (line_len + 3 <= space)
+            {
+                break;
+            }
+        }
+
+        metrics_alloced = metrics_alloced * 2 + 256;
+        metrics_buf = realloc(metrics_buf, metrics_alloced);
+
+        if (metrics_buf == NULL)
+        {
+            I_Error("MetricsLine: Failed to allocate %i bytes",
+                    (int) metrics_alloced);
+        }
+    }
+
+    metrics_len += line_len;
+    metrics_buf[metrics_len] = '\n';
+    ++metrics_len;
+    metrics_buf[metrics_len] = '\0';
+}
+
+// Copy a player name so that it can be used as a metrics value:
+// whitespace and other characters that would confuse a parser are
+// replaced.
+
+static void MetricsName(char *dest, char *src, size_t dest_len)
+{
+    size_t i;
+
+    M_StringCopy(dest, src, dest_len);
+
+    for (i = 0; dest[i] != '\0'; ++i)
+    {
+        if (dest[i] <= ' ' || dest[i] == '=' || dest[i] == '"'
+         || dest[i] > '~')
+        {
+            dest[i] = '_';
+        }
+    }
+}
+
+static void MetricsClient(int node, net_client_t *client)
+{
+    char name[MAXPLAYERNAME];
+    int recvwindow_used;
+    int i;
+
+    MetricsName(name, client->name, sizeof(name));
+
+    recvwindow_used = 0;
+
+    if (!client->drone && client->player_number >= 0)
+    {
+        for (i = 0; i < BACKUPTICS; ++i)
+        {
+            if (recvwindow[i][client->player_number].active)
+            {
+                ++recvwindow_used;
+            }
+        }
+    }
+
+    MetricsLine("client node=%i name=%s addr=%s player=%i drone=%i "
+                "rtt_ms=%i rttvar_ms=%i resend_requests=%u "
+                "resent_tics=%u packets_in=%u bytes_in=%u "
+                "packets_out=%u bytes_out=%u sendseq=%i acknowledged=%u "
+                "unacked=%i recvwindow_used=%i recvwindow_size=%i",
+                node, name, NET_AddrToString(client->addr),
+                client->player_number, client->drone,
+                client->rtt.srtt, client->rtt.rttvar,
+                client->resend_requests, client->resent_tics,
+                client->connection.packets_received,
+                client->connection.bytes_received,
+                client->connection.packets_sent,
+                client->connection.bytes_sent,
+                client->sendseq, client->acknowledged,
+                client->sendseq - (int) client->acknowledged,
+                recvwindow_used, BACKUPTICS);
+}
+
+static void NET_SV_BuildMetrics(void)
+{
+    static const char *state_names[] =
+    {
+        "waiting_launch", "waiting_start", "in_game",
+    };
+    unsigned int loop_avg;
+    int i;
+
+    metrics_len = 0;
+
+    loop_avg = 0;
+
+    if (loop_iterations > 0)
+    {
+        loop_avg = (unsigned int) (loop_time_total / loop_iterations);
+    }
+
+    MetricsLine("server uptime_ms=%u state=%s clients=%i players=%i "
+                "drones=%i recvwindow_start=%u loop_iterations=%u "
+                "loop_us_avg=%u loop_us_max=%u",
+                I_GetTimeMS() - start_time, state_names[server_state],
+                NET_SV_NumClients(), NET_SV_NumPlayers(),
+                NET_SV_NumDrones(), recvwindow_start, loop_iterations,
+                loop_avg, (unsigned int) loop_time_max);
+
+    for (i = 0; i < MAXNETNODES; ++i)
+    {
+        if (ClientConnected(&clients[i]))
+        {
+            MetricsClient(i, &clients[i]);
+        }
+    }
+
+    loop_iterations = 0;
+    loop_time_total = 0;
+    loop_time_max = 0;
+}
+
+// Find where the metrics response part starting at the given offset
+// ends: as many whole lines as will fit in one packet.
+
+static size_t MetricsPartEnd(size_t start)
+{
+    size_t end, i;
+
+    end = start;
+
+    for (i = start; i < metrics_len; ++i)
+    {
+        // A single line longer than a part still goes out whole.
+
+        if (i - start >= METRICS_PART_SIZE && end > start)
+        {
+            break;
+        }
+
+        if (metrics_buf[i] == '\n')
+        {
+            end = i + 1;
+        }
+    }
+
+    return end;
+}
+
+// Respond to a metrics request.  The response is one or more packets,
+// each containing a number of lines of text.
+
+static void NET_SV_SendMetrics(net_addr_t *addr)
+{
+    net_packet_t *reply;
+    size_t start, end;
+    unsigned int num_parts, part;
+    char *addr_str;
+    char saved;
+
+    // Only respond to requests from this machine.
+
+    addr_str = NET_AddrToString(addr);
+
+    if (!sv_metrics
+     || (strncmp(addr_str, "127.", 4) != 0
+      && addr->module != &net_loop_server_module))
+    {
+        return;
+    }
+
+    NET_SV_BuildMetrics();
+
+    num_parts = 0;
+
+    for (start = 0; start < metrics_len; start = MetricsPartEnd(start))
+    {
+        ++num_parts;
+    }
+
+    part = 0;
+
+    for (start = 0; start < metrics_len; start = end)
+    {
+        end = MetricsPartEnd(start);
+
+        saved = metrics_buf[end];
+        metrics_buf[end] = '\0';
+
+        reply = NET_NewPacket(end - start + 16);
+        NET_WriteInt16(reply, NET_PACKET_TYPE_METRICS_RESPONSE);
+        NET_WriteInt8(reply, part);
+        NET_WriteInt8(reply, num_parts);
+        NET_WriteString(reply, metrics_buf + start);
+        NET_SendPacket(addr, reply);
+        NET_FreePacket(reply);
+
+        metrics_buf[end] = saved;
+        ++part;
+    }
 }
 
 // Send a response back to the client
@@ -1406,6 +1848,10 @@ static void NET_SV_Packet(net_packet_t *packet, net_addr_t *addr)
     {
         NET_SV_SendQueryResponse(addr);
     }
+    else if (packet_type == NET_PACKET_TYPE_METRICS)
+    {
+        NET_SV_SendMetrics(addr);
+    }
     else if (client == NULL)
     {
         // Must come from a valid client; ignore otherwise
@@ -1452,6 +1898,74 @@ static void NET_SV_Packet(net_packet_t *packet, net_addr_t *addr)
 }
 
 
+// Send recorded tics to a drone that is catching up with a game in
+// progress.
+
+static void NET_SV_PumpCatchup(net_client_t *client)
+{
+    unsigned int num_tics;
+    unsigned int start;
+
+    num_tics = NET_Record_NumTics();
+
+    while (client->sendseq < num_tics
+        && client->sendseq < client->acknowledged + CATCHUP_WINDOW)
+    {
+        start = client->sendseq;
+
+        while (client->sendseq < num_tics
+            && client->sendseq < client->acknowledged + CATCHUP_WINDOW
+            && client->sendseq - start < CATCHUP_TICS_PER_PACKET)
+        {
+            NET_Record_GetTic(client->sendseq,
+                      &client->sendqueue[client->sendseq % BACKUPTICS]);
+            client->sendtime[client->sendseq % BACKUPTICS] = I_GetTimeMS();
+            ++client->sendseq;
+        }
+
+        NET_SV_SendTics(client, start, client->sendseq - 1);
+    }
+}
+
+// Number of tics that we can send ahead of the slowest client's
+// acknowledgement point.
+
+static unsigned int NET_SV_SendLead(void)
+{
+    unsigned int result;
+    unsigned int lead;
+    int i;
+
+    result = SEND_LEAD;
+
+    if (!sv_adaptive)
+    {
+        return result;
+    }
+
+    // Allow for two round trips of the slowest client.
+
+    for (i=0; i<MAXNETNODES; ++i)
+    {
+        if (ClientConnected(&clients[i]) && !clients[i].catchup)
+        {
+            lead = 2 * NET_RTT_Tics(&clients[i].rtt, sv_settings.ticdup);
+
+            if (lead > result)
+            {
+                result = lead;
+            }
+        }
+    }
+
+    if (result > MAX_ADAPTIVE_SEND_LEAD)
+    {
+        result = MAX_ADAPTIVE_SEND_LEAD;
+    }
+
+    return result;
+}
+
 static void NET_SV_PumpSendQueue(net_client_t *client)
 {
     net_full_ticcmd_t cmd;
@@ -1460,10 +1974,19 @@ static void NET_SV_PumpSendQueue(net_client_t *client)
     int i;
     int starttic, endtic;
 
+    // Tics before the recv window are only available from the
+    // recording.
+
+    if (client->catchup && client->sendseq < NET_Record_NumTics())
+    {
+        NET_SV_PumpCatchup(client);
+        return;
+    }
+
     // If a client has not sent any acknowledgments for a while,
     // wait until they catch up.
 
-    if (client->sendseq - NET_SV_LatestAcknowledged() > 40)
+    if (client->sendseq - NET_SV_LatestAcknowledged() > NET_SV_SendLead())
     {
         return;
     }
@@ -1561,10 +2084,19 @@ static void NET_SV_PumpSendQueue(net_client_t *client)
     // Add into the queue
 
     client->sendqueue[client->sendseq % BACKUPTICS] = cmd;
+    client->sendtime[client->sendseq % BACKUPTICS] = I_GetTimeMS();
 
     // Transmit the new tic to the client
 
-    starttic = client->sendseq - sv_settings.extratics;
+    if (sv_adaptive)
+    {
+        starttic = client->sendseq - client->extratics;
+    }
+    else
+    {
+        starttic = client->sendseq - sv_settings.extratics;
+    }
+
     endtic = client->sendseq;
 
     if (starttic < 0)
@@ -1622,6 +2154,27 @@ void NET_SV_CheckDeadlock(net_client_t *client)
     }
 }
 
+// Print statistics for -netstats.
+
+static void NET_SV_PrintStats(void)
+{
+    unsigned int average;
+
+    average = 0;
+
+    if (stats_recovered_tics > 0)
+    {
+        average = stats_recover_time / stats_recovered_tics;
+    }
+
+    printf("netstats: server resend_requests=%u recovered_tics=%u "
+           "recover_avg_ms=%u recover_max_ms=%u\n",
+           stats_resend_requests, stats_recovered_tics,
+           average, stats_max_recover_time);
+    NET_Impair_PrintStats();
+    fflush(stdout);
+}
+
 // Called when all players have disconnected.  Return to listening for 
 // players to start a new game, and disconnect any drones still connected.
 
@@ -1629,9 +2182,24 @@ static void NET_SV_GameEnded(void)
 {
     int i;
 
+    //!
+    // @category net
+    //
+    // Print statistics about the network protocol (resend requests,
+    // time taken to recover from dropped packets, and so on) when
+    // the game ends.
+    //
+
+    if (server_state == SERVER_IN_GAME && M_CheckParm("-netstats") > 0)
+    {
+        NET_SV_PrintStats();
+    }
+
     server_state = SERVER_WAITING_LAUNCH;
     sv_gamemode = indetermined;
 
+    NET_Record_Stop();
+
     for (i=0; i<MAXNETNODES; ++i)
     {
         if (clients[i].active)
@@ -1710,6 +2278,11 @@ static void NET_SV_RunClient(net_client_t *client)
 
     if (server_state == SERVER_IN_GAME)
     {
+        if (!client->ready)
+        {
+            NET_SV_StartLateClient(client);
+        }
+
         NET_SV_PumpSendQueue(client);
         NET_SV_CheckDeadlock(client);
     }
@@ -1719,6 +2292,7 @@ static void NET_SV_RunClient(net_client_t *client)
 
 void NET_SV_AddModule(net_module_t *module)
 {
+    module = NET_Impair_WrapModule(module);
     module->InitServer();
     NET_AddModule(server_context, module);
 }
@@ -1742,6 +2316,29 @@ void NET_SV_Init(void)
 
     NET_SV_AssignPlayers();
 
+    //!
+    // @category net
+    //
+    // Adapt the network protocol to the measured round trip time of
+    // each connection: resend more previous tics in each packet, and
+    // allow a longer lead before waiting, for players with a slow
+    // connection.  This does not affect the game itself, and can be
+    // given to the server and clients independently.
+    //
+
+    sv_adaptive = M_CheckParm("-netadapt") > 0;
+
+    //!
+    // @category net
+    //
+    // Answer requests for server metrics (per-client round trip time,
+    // resends, traffic and window state, and time spent in the server
+    // loop) from this machine.  See -querymetrics.
+    //
+
+    sv_metrics = M_CheckParm("-metrics") > 0;
+    start_time = I_GetTimeMS();
+
     server_state = SERVER_WAITING_LAUNCH;
     sv_gamemode = indetermined;
     server_initialized = true;
@@ -1817,6 +2414,7 @@ void NET_SV_Run(void)
 {
     net_addr_t *addr;
     net_packet_t *packet;
+    uint64_t loop_start, loop_time;
     int i;
 
     if (!server_initialized)
@@ -1824,6 +2422,8 @@ void NET_SV_Run(void)
         return;
     }
 
+    loop_start = I_GetTimeUS();
+
     while (NET_RecvPacket(server_context, &addr, &packet))
     {
         NET_SV_Packet(packet, addr);
@@ -1867,6 +2467,18 @@ void NET_SV_Run(void)
             }
             break;
     }
+
+    if (sv_metrics)
+    {
+        loop_time = I_GetTimeUS() - loop_start;
+        loop_time_total += loop_time;
+        ++loop_iterations;
+
+        if (loop_time > loop_time_max)
+        {
+            loop_time_max = loop_time;
+        }
+    }
 }
 
 void NET_SV_Shutdown(void)
@@ -0,0 +1,131 @@
+#!/bin/sh
+#
+# Copyright(C) 2005-2014 Simon Howard
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# Network protocol benchmark.  Runs a dedicated server and a number of
+# headless clients on this machine, plays a game for a fixed number of
+# tics and prints the statistics gathered by -netstats, so that the
+# behaviour of the protocol can be compared between builds.
+#
+# Any extra options are passed to the server and all clients; these are
+# normally network impairment options, eg:
+#
+#   ./netbench.sh -i doom2.wad -n 4 -- -netloss 5 -netdelay 75
+#
+# With -r, the benchmark is repeated for each of a list of round trip
+# times, simulated by delaying packets by half the round trip time in
+# each direction.  To compare stall frequency with and without the
+# adaptive protocol mode:
+#
+#   ./netbench.sh -i doom2.wad -r "50 150 300"
+#   ./netbench.sh -i doom2.wad -r "50 150 300" -- -netadapt
+#
+
+usage() {
+    cat <<EOF
+Usage: $0 -i <iwad> [-n clients] [-t tics] [-p port] [-s seed]
+          [-b bindir] [-r "rtt..."] [-- options...]
+EOF
+    exit 1
+}
+
+iwad=
+clients=2
+tics=2100
+port=2400
+seed=1
+bindir=$(dirname "$0")
+rtts=
+
+while getopts "i:n:t:p:s:b:r:" opt; do
+    case "$opt" in
+        i) iwad="$OPTARG" ;;
+        n) clients="$OPTARG" ;;
+        t) tics="$OPTARG" ;;
+        p) port="$OPTARG" ;;
+        s) seed="$OPTARG" ;;
+        b) bindir="$OPTARG" ;;
+        r) rtts="$OPTARG" ;;
+        *) usage ;;
+    esac
+done
+
+shift $((OPTIND - 1))
+
+if [ -z "$iwad" ]; then
+    usage
+fi
+
+workdir=$(mktemp -d)
+trap 'kill $server_pid 2>/dev/null; rm -rf "$workdir"' EXIT
+
+# Headless operation: no video or audio output.
+
+SDL_VIDEODRIVER=dummy
+SDL_AUDIODRIVER=dummy
+export SDL_VIDEODRIVER SDL_AUDIODRIVER
+
+# Run the benchmark once; arguments are passed to the server and all
+# clients.
+
+run_bench() {
+    "$bindir/chocolate-server" -privateserver -port "$port" -netstats \
+        -netseed "$seed" "$@" > "$workdir/server.log" 2>&1 &
+    server_pid=$!
+
+    sleep 1
+
+    pids=
+    i=1
+    while [ "$i" -le "$clients" ]; do
+        "$bindir/chocolate-doom" -iwad "$iwad" -connect "localhost:$port" \
+            -nodes "$clients" -netbench "$tics" -nosound -nograbmouse \
+            -config "$workdir/client$i.cfg" \
+            -extraconfig "$workdir/client$i-extra.cfg" \
+            -netseed $((seed + i)) "$@" > "$workdir/client$i.log" 2>&1 &
+        pids="$pids $!"
+        i=$((i + 1))
+    done
+
+    start=$(date +%s)
+
+    for pid in $pids; do
+        wait "$pid"
+    done
+
+    end=$(date +%s)
+
+    # The server prints its statistics when the last client disconnects.
+
+    sleep 1
+    kill "$server_pid" 2>/dev/null
+    wait "$server_pid" 2>/dev/null
+
+    echo "clients=$clients tics=$tics elapsed_s=$((end - start)) options: $*"
+
+    for log in "$workdir"/client*.log "$workdir/server.log"; do
+        name=$(basename "$log" .log)
+        grep '^netstats:' "$log" | sed "s/^netstats:/$name:/"
+    done
+}
+
+if [ -z "$rtts" ]; then
+    run_bench "$@"
+else
+    for rtt in $rtts; do
+        echo "rtt_ms=$rtt"
+        run_bench -netdelay $((rtt / 2)) "$@"
+        echo
+    done
+fi
+
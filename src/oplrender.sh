@@ -0,0 +1,130 @@
+#!/bin/sh
+#
+# Copyright(C) 2005-2014 Simon Howard
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# Batch OPL music renderer.  Renders the music of a WAD to WAV files
+# with the OPL emulator, running one renderer process per CPU core,
+# and prints the speed of the emulator.  Any extra options are passed
+# to the game, eg. to add a PWAD or select particular lumps:
+#
+#   ./oplrender.sh -i doom2.wad -o music -- -file mymusic.wad
+#   ./oplrender.sh -i doom.wad -o music -- -oplrender D_E1M1 D_E1M2
+#
+# The emulator state is reset before each song, so the output does not
+# depend on how the songs are divided between processes.
+#
+# Each song line gives the CPU time spent per second of audio.  To
+# compare with the emulator's skipping of silent slots turned off:
+#
+#   OPL_NOSKIP=1 ./oplrender.sh -i doom2.wad -o music
+#
+
+usage() {
+    cat <<EOF
+Usage: $0 -i <iwad> [-o outdir] [-j jobs] [-g game] [-b bindir]
+          [-- options...]
+EOF
+    exit 1
+}
+
+iwad=
+outdir=.
+jobs=$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)
+game=doom
+bindir=$(cd "$(dirname "$0")" && pwd)
+
+while getopts "i:o:j:g:b:" opt; do
+    case "$opt" in
+        i) iwad="$OPTARG" ;;
+        o) outdir="$OPTARG" ;;
+        j) jobs="$OPTARG" ;;
+        g) game="$OPTARG" ;;
+        b) bindir="$OPTARG" ;;
+        *) usage ;;
+    esac
+done
+
+shift $((OPTIND - 1))
+
+if [ -z "$iwad" ]; then
+    usage
+fi
+
+mkdir -p "$outdir" || exit 1
+
+# The renderers run in the output directory; let WAD files named
+# relative to the current directory still be found.
+
+case "$iwad" in
+    /*) ;;
+    *) iwad="$PWD/$iwad" ;;
+esac
+
+DOOMWADPATH="$PWD${DOOMWADPATH:+:$DOOMWADPATH}"
+export DOOMWADPATH
+
+workdir=$(mktemp -d)
+trap 'rm -rf "$workdir"' EXIT
+
+SDL_VIDEODRIVER=dummy
+SDL_AUDIODRIVER=dummy
+export SDL_VIDEODRIVER SDL_AUDIODRIVER
+
+# -oplrender is added after any options, so that lumps listed by a
+# -oplrender in the options are still used.
+
+case " $* " in
+    *" -oplrender "*) ;;
+    *) set -- "$@" -oplrender ;;
+esac
+
+start=$(date +%s)
+
+pids=
+job=0
+while [ "$job" -lt "$jobs" ]; do
+    (cd "$outdir" && "$bindir/chocolate-$game" -iwad "$iwad" \
+        -config "$workdir/job$job.cfg" \
+        -extraconfig "$workdir/job$job-extra.cfg" \
+        -oplrenderjob "$job" "$jobs" "$@") > "$workdir/job$job.log" 2>&1 &
+    pids="$pids $!"
+    job=$((job + 1))
+done
+
+for pid in $pids; do
+    wait "$pid"
+done
+
+end=$(date +%s)
+
+# Per-song lines, then the combined speed of all processes.
+
+grep -h '^oplrender: file=' "$workdir"/job*.log
+
+grep -h '^oplrender: total' "$workdir"/job*.log | awk -v jobs="$jobs" \
+    -v elapsed=$((end - start)) '
+    {
+        for (i = 2; i <= NF; ++i) {
+            split($i, kv, "=")
+            v[kv[1]] += kv[2]
+        }
+    }
+    END {
+        rate = 0
+        if (v["render_ms"] > 0) {
+            rate = v["samples"] * 1000 / v["render_ms"]
+        }
+        printf "oplrender: jobs=%d samples=%d elapsed_s=%d ", \
+               jobs, v["samples"], elapsed
+        printf "samples_per_sec_per_job=%d\n", rate
+    }'
@@ -95,6 +95,7 @@ static int voiceVolume = 15;
 static int show_talk = 0;
 static int use_libsamplerate = 0;
 static float libsamplerate_scale = 0.65;
+static int use_builtin_mixer = 0;
 
 static char *timidity_cfg_path = NULL;
 static char *gus_patch_path = NULL;
@@ -369,6 +370,7 @@ void BindSoundVariables(void)
 
     M_BindIntVariable("use_libsamplerate",        &use_libsamplerate);
     M_BindFloatVariable("libsamplerate_scale",    &libsamplerate_scale);
+    M_BindIntVariable("use_builtin_mixer",        &use_builtin_mixer);
 
     M_BindIntVariable("gus_ram_kb",               &gus_ram_kb);
     M_BindStringVariable("gus_patch_path",        &gus_patch_path);
@@ -70,6 +70,7 @@
 #include "am_map.h"
 #include "net_client.h"
 #include "net_dedicated.h"
+#include "net_fake.h"
 #include "net_query.h"
 
 #include "p_setup.h"
@@ -1369,6 +1370,24 @@ void D_DoomMain (void)
         exit(0);
     }
 
+    //!
+    // @arg <n>
+    // @category net
+    //
+    // Benchmark searching for servers: query a simulated master server
+    // listing n simulated servers, and print the time taken to receive
+    // the first response and to complete the search.
+    //
+
+    p = M_CheckParmWithArgs("-searchbench", 1);
+
+    if (p)
+    {
+        NET_Fake_Init(atoi(myargv[p+1]));
+        NET_SearchBenchmark(&net_fake_module, NET_FAKE_MASTER_ADDRESS);
+        exit(0);
+    }
+
     //!
     // @arg <address>
     // @category net
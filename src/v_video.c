@@ -30,6 +30,7 @@
 #include "deh_str.h"
 #include "i_swap.h"
 #include "i_video.h"
+#include "m_argv.h"
 #include "m_bbox.h"
 #include "m_misc.h"
 #include "v_video.h"
@@ -63,6 +64,47 @@ int dirtybox[4];
 // This is needed for Chocolate Strife, which clips patches to the screen.
 static vpatchclipfunc_t patchclip_callback = NULL;
 
+// Patches that are drawn often (status bar, HUD font, intermission)
+// can be registered with V_CachePatch.  They are then decoded once
+// from columns and posts into the opaque runs of each row, so that
+// V_DrawPatch can copy them a row at a time.
+
+#define PATCHCACHE_HASH 128
+
+typedef struct
+{
+    short x;
+    short length;
+} patchspan_t;
+
+typedef struct cachedpatch_s
+{
+    patch_t *patch;
+    int refcount;
+
+    // Rows top to top + height - 1 of the patch are the only ones
+    // with anything in them.
+
+    int top;
+    int height;
+
+    // The spans of row n are spans[rowspans[n]] to
+    // spans[rowspans[n + 1] - 1].  Their pixels are packed together
+    // in the same order.
+
+    int *rowspans;
+    patchspan_t *spans;
+    byte *pixels;
+
+    struct cachedpatch_s *next;
+} cachedpatch_t;
+
+static cachedpatch_t *patchcache[PATCHCACHE_HASH];
+
+// Set to false by -nopatchcache.
+
+static boolean use_patch_cache = true;
+
 //
 // V_MarkRect 
 // 
@@ -131,6 +173,280 @@ void V_SetPatchClipCallback(vpatchclipfunc_t func)
     patchclip_callback = func;
 }
 
+static unsigned int PatchCacheHash(patch_t *patch)
+{
+    return (unsigned int) (((uintptr_t) patch) >> 4) % PATCHCACHE_HASH;
+}
+
+static cachedpatch_t *FindCachedPatch(patch_t *patch)
+{
+    cachedpatch_t *cached;
+
+    for (cached = patchcache[PatchCacheHash(patch)]; cached != NULL;
+         cached = cached->next)
+    {
+        if (cached->patch == patch)
+        {
+            return cached;
+        }
+    }
+
+    return NULL;
+}
+
+//
+// DecodePatch
+//
+// Convert a patch into the runs of opaque pixels along each row.
+// Where posts overlap, the later one wins, as when drawing them.
+//
+
+static cachedpatch_t *DecodePatch(patch_t *patch)
+{
+    cachedpatch_t *cached;
+    column_t *column;
+    byte *source;
+    byte *block;
+    byte *rows;
+    byte *mask;
+    byte *pixels;
+    int w, h;
+    int top, bottom;
+    int numspans, numpixels;
+    int col, row, x, n;
+
+    w = SHORT(patch->width);
+
+    // Find the rows that the posts cover.
+
+    top = INT_MAX;
+    bottom = 0;
+
+    for (col = 0; col < w; ++col)
+    {
+        column = (column_t *)((byte *)patch + LONG(patch->columnofs[col]));
+
+        while (column->topdelta != 0xff)
+        {
+            if (column->length > 0)
+            {
+                if (column->topdelta < top)
+                {
+                    top = column->topdelta;
+                }
+                if (column->topdelta + column->length > bottom)
+                {
+                    bottom = column->topdelta + column->length;
+                }
+            }
+            column = (column_t *)((byte *)column + column->length + 4);
+        }
+    }
+
+    if (top >= bottom)
+    {
+        top = bottom = 0;
+    }
+
+    h = bottom - top;
+
+    // Draw the posts into a row-major copy, with a mask of the
+    // pixels that were set.
+
+    rows = Z_Malloc(w * h * 2 + 1, PU_STATIC, NULL);
+    mask = rows + w * h;
+    memset(mask, 0, w * h);
+
+    for (col = 0; col < w; ++col)
+    {
+        column = (column_t *)((byte *)patch + LONG(patch->columnofs[col]));
+
+        while (column->topdelta != 0xff)
+        {
+            source = (byte *)column + 3;
+            row = column->topdelta - top;
+
+            for (n = 0; n < column->length; ++n, ++row)
+            {
+                rows[row * w + col] = source[n];
+                mask[row * w + col] = 1;
+            }
+            column = (column_t *)((byte *)column + column->length + 4);
+        }
+    }
+
+    // Count the runs along each row.
+
+    numspans = 0;
+    numpixels = 0;
+
+    for (n = 0; n < w * h; ++n)
+    {
+        if (mask[n])
+        {
+            ++numpixels;
+
+            if (n % w == 0 || !mask[n - 1])
+            {
+                ++numspans;
+            }
+        }
+    }
+
+    block = Z_Malloc(sizeof(cachedpatch_t)
+                   + (h + 1) * sizeof(int)
+                   + numspans * sizeof(patchspan_t)
+                   + numpixels, PU_STATIC, NULL);
+
+    cached = (cachedpatch_t *) block;
+    cached->patch = patch;
+    cached->refcount = 0;
+    cached->top = top;
+    cached->height = h;
+    cached->rowspans = (int *) (block + sizeof(cachedpatch_t));
+    cached->spans = (patchspan_t *) (cached->rowspans + h + 1);
+    cached->pixels = (byte *) (cached->spans + numspans);
+
+    numspans = 0;
+    pixels = cached->pixels;
+
+    for (row = 0; row < h; ++row)
+    {
+        cached->rowspans[row] = numspans;
+
+        for (x = 0; x < w; ++x)
+        {
+            n = row * w + x;
+
+            if (!mask[n])
+            {
+                continue;
+            }
+
+            if (x == 0 || !mask[n - 1])
+            {
+                cached->spans[numspans].x = x;
+                cached->spans[numspans].length = 0;
+                ++numspans;
+            }
+
+            ++cached->spans[numspans - 1].length;
+            *pixels++ = rows[n];
+        }
+    }
+
+    cached->rowspans[h] = numspans;
+
+    Z_Free(rows);
+
+    return cached;
+}
+
+//
+// V_CachePatch
+//
+// Register a patch that will be drawn often.  It must be released
+// with V_UncachePatch before its lump is released.
+//
+
+void V_CachePatch(patch_t *patch)
+{
+    cachedpatch_t *cached;
+    unsigned int hash;
+
+    if (!use_patch_cache)
+    {
+        return;
+    }
+
+    cached = FindCachedPatch(patch);
+
+    if (cached == NULL)
+    {
+        cached = DecodePatch(patch);
+        hash = PatchCacheHash(patch);
+        cached->next = patchcache[hash];
+        patchcache[hash] = cached;
+    }
+
+    ++cached->refcount;
+}
+
+//
+// V_UncachePatch
+//
+
+void V_UncachePatch(patch_t *patch)
+{
+    cachedpatch_t **prev;
+    cachedpatch_t *cached;
+
+    for (prev = &patchcache[PatchCacheHash(patch)]; *prev != NULL;
+         prev = &(*prev)->next)
+    {
+        cached = *prev;
+
+        if (cached->patch == patch)
+        {
+            if (--cached->refcount == 0)
+            {
+                *prev = cached->next;
+                Z_Free(cached);
+            }
+            return;
+        }
+    }
+}
+
+//
+// DrawCachedPatch
+// Copies the rows of a decoded patch to the screen.
+//
+
+static void DrawCachedPatch(int x, int y, cachedpatch_t *cached)
+{
+    byte *desttop;
+    byte *dest;
+    byte *source;
+    patchspan_t *span;
+    patchspan_t *rowend;
+    int count;
+    int row;
+
+    desttop = dest_screen + (y + cached->top) * SCREENWIDTH + x;
+    source = cached->pixels;
+    span = cached->spans;
+
+    for (row = 0; row < cached->height; ++row)
+    {
+        rowend = cached->spans + cached->rowspans[row + 1];
+
+        for ( ; span < rowend; ++span)
+        {
+            // Most runs are a few pixels long, too short for memcpy
+            // to pay for its call.
+
+            if (span->length > 16)
+            {
+                memcpy(desttop + span->x, source, span->length);
+                source += span->length;
+            }
+            else
+            {
+                dest = desttop + span->x;
+                count = span->length;
+
+                while (count--)
+                {
+                    *dest++ = *source++;
+                }
+            }
+        }
+
+        desttop += SCREENWIDTH;
+    }
+}
+
 //
 // V_DrawPatch
 // Masks a column based masked pic to the screen. 
@@ -138,6 +454,7 @@ void V_SetPatchClipCallback(vpatchclipfunc_t func)
 
 void V_DrawPatch(int x, int y, patch_t *patch)
 { 
+    cachedpatch_t *cached;
     int count;
     int col;
     column_t *column;
@@ -168,6 +485,14 @@ void V_DrawPatch(int x, int y, patch_t *patch)
 
     V_MarkRect(x, y, SHORT(patch->width), SHORT(patch->height));
 
+    cached = FindCachedPatch(patch);
+
+    if (cached != NULL)
+    {
+        DrawCachedPatch(x, y, cached);
+        return;
+    }
+
     col = 0;
     desttop = dest_screen + y * SCREENWIDTH + x;
 
@@ -531,6 +856,8 @@ void V_DrawFilledBox(int x, int y, int w, int h, int c)
     uint8_t *buf, *buf1;
     int x1, y1;
 
+    V_MarkRect(x, y, w, h);
+
     buf = I_VideoBuffer + SCREENWIDTH * y + x;
 
     for (y1 = 0; y1 < h; ++y1)
@@ -551,6 +878,8 @@ void V_DrawHorizLine(int x, int y, int w, int c)
     uint8_t *buf;
     int x1;
 
+    V_MarkRect(x, y, w, 1);
+
     buf = I_VideoBuffer + SCREENWIDTH * y + x;
 
     for (x1 = 0; x1 < w; ++x1)
@@ -564,6 +893,8 @@ void V_DrawVertLine(int x, int y, int h, int c)
     uint8_t *buf;
     int y1;
 
+    V_MarkRect(x, y, 1, h);
+
     buf = I_VideoBuffer + SCREENWIDTH * y + x;
 
     for (y1 = 0; y1 < h; ++y1)
@@ -588,6 +919,7 @@ void V_DrawBox(int x, int y, int w, int h, int c)
  
 void V_DrawRawScreen(byte *raw)
 {
+    V_MarkRect(0, 0, SCREENWIDTH, SCREENHEIGHT);
     memcpy(dest_screen, raw, SCREENWIDTH * SCREENHEIGHT);
 }
 
@@ -596,9 +928,18 @@ void V_DrawRawScreen(byte *raw)
 // 
 void V_Init (void) 
 { 
-    // no-op!
     // There used to be separate screens that could be drawn to; these are
     // now handled in the upper layers.
+
+    //!
+    // @category video
+    //
+    // Draw status bar, heads-up and intermission graphics straight
+    // from their columns every time, rather than from copies decoded
+    // into rows.
+    //
+
+    use_patch_cache = !M_ParmExists("-nopatchcache");
 }
 
 // Set the buffer that the code draws to.
@@ -62,6 +62,12 @@ void V_DrawShadowedPatch(int x, int y, patch_t *patch);
 void V_DrawXlaPatch(int x, int y, patch_t * patch);     // villsa [STRIFE]
 void V_DrawPatchDirect(int x, int y, patch_t *patch);
 
+// Decode a patch that is drawn often, so that V_DrawPatch can draw it
+// faster, and release it again before its lump is released.
+
+void V_CachePatch(patch_t *patch);
+void V_UncachePatch(patch_t *patch);
+
 // Draw a linear block of pixels into the view buffer.
 
 void V_DrawBlock(int x, int y, int width, int height, byte *src);
@@ -46,21 +46,11 @@ static wad_file_class_t *wad_file_classes[] =
     &stdc_wad_file,
 };
 
-wad_file_t *W_OpenFile(char *path)
+wad_file_t *W_OpenMappedFile(char *path)
 {
     wad_file_t *result;
     int i;
 
-    //!
-    // Use the OS's virtual memory subsystem to map WAD files
-    // directly into memory.
-    //
-
-    if (!M_CheckParm("-mmap"))
-    {
-        return stdc_wad_file.OpenFile(path);
-    }
-
     // Try all classes in order until we find one that works
 
     result = NULL;
@@ -78,6 +68,21 @@ wad_file_t *W_OpenFile(char *path)
     return result;
 }
 
+wad_file_t *W_OpenFile(char *path)
+{
+    //!
+    // Use the OS's virtual memory subsystem to map WAD files
+    // directly into memory.
+    //
+
+    if (!M_CheckParm("-mmap"))
+    {
+        return stdc_wad_file.OpenFile(path);
+    }
+
+    return W_OpenMappedFile(path);
+}
+
 void W_CloseFile(wad_file_t *wad)
 {
     wad->file_class->CloseFile(wad);
@@ -64,6 +64,11 @@ struct _wad_file_s
 
 wad_file_t *W_OpenFile(char *path);
 
+// Open the specified file, mapping it into memory if the OS supports
+// it, whether or not -mmap was given.
+
+wad_file_t *W_OpenMappedFile(char *path);
+
 // Close the specified WAD file.
 
 void W_CloseFile(wad_file_t *wad);